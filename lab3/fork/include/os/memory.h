@@ -25,7 +25,15 @@ int MemoryPageFaultHandler(PCB *pcb);
 //int mfree(void *ptr);
 //uint32 mPTE(uint32);
 int MemoryAllocPage(void);
+int MemoryAllocContiguousPages(int npages);
+int MemoryFreePageCount(void);
+void MemoryBenchmark(int rounds);
 uint32 MemorySetupPTE(uint32 page);
+uint32 MemoryZeroPagePTE(void);
+uint32 *MemoryGetPTE(PCB *pcb, uint32 vpage, int create);
+void MemoryForkTables(PCB *parent, PCB *child);
+void MemoryFreePageTables(PCB *pcb);
+void MemorySharePage(uint32 pte);
 void MemoryFreePTE(uint32);
 void MemoryFreePage(uint32 page);
 void MemoryROPAccessHandler(PCB * pcb);
@@ -39,8 +39,9 @@ typedef struct PCB {
   uint32	sysStackArea;	// System stack area for this process
   unsigned int	flags;
   char		name[80];	// Process name
-  uint32	pagetable[((MEM_MAX_VIRTUAL_ADDRESS)>>MEM_L1FIELD_FIRST_BITNUM)+1];
+  uint32	pagetable[MEM_L1TABLE_SIZE]; // L1 table: L2 table addresses, 0 if none
   int		npages;		// Number of pages allocated to this process
+  int		image;		// Program image in the image cache, -1 if none
   Link		*l;		// Used for keeping PCB in queues
 } PCB;
 
@@ -82,6 +83,20 @@ extern PCB	*currentPCB;
 #define PROCESS_NUMPAGES_SYSTEM_STACK 1
 #define PROCESS_NUMPAGES_USER_STACK 1
 #define PROCESS_PAGETABLESIZE (uint32)((MEM_MAX_VIRTUAL_ADDRESS+1)/MEM_PAGESIZE)
+
+// Program images, cached by file name so each executable is only read
+// and parsed once.  The code and data pages of a process start out
+// invalid and are filled from its image when first touched.  One slot
+// per process means a running program always finds one.
+#define PROCESS_MAX_IMAGES PROCESS_MAX_PROCS
+typedef struct ProcessImage {
+  char		name[80];	// Executable file name, "" if the slot is free
+  int		users;		// Processes running the image
+  int		lastuse;	// Load/use stamp, the oldest unused image goes first
+  uint32	start;		// Entry point
+  int		pages[PROCESS_NUMPAGES_USERCODE_GLOBALDATA]; // Frame per page, MEM_FAIL if no bytes
+  char		readonly[PROCESS_NUMPAGES_USERCODE_GLOBALDATA]; // Page holds code only, shared by all users
+} ProcessImage;
 #define PROCESS_FORK_SUCCESS 1
 #define PROCESS_FORK_FAILURE -1
 
@@ -103,6 +118,7 @@ void ProcessDestroy(PCB *pcb);
 extern unsigned GetCurrentPid();
 int GetPidFromAddress(PCB *pcb);
 void ProcessKill();
+int ProcessImageFault(PCB *pcb, int vpage);
 
 //-------------------------------------------------------
 // Put any functions prototypes that you define here.
@@ -9,16 +9,30 @@
 #include "process.h"
 #include "memory.h"
 #include "queue.h"
-
-// Freemap is an array of 32-bit integers
-//  Each bit represents a page, so we create the free
-//  map to be composed of MEM_MAX_PAGES/32 ints.
-static uint32 freemap[MEM_MAX_PAGES >> 5];
-static char pagereferencecounter[MEM_MAX_SIZE >> MEM_L1FIELD_FIRST_BITNUM];
+#include "clock.h"
+
+// Page frame allocator.  Every physical page has a descriptor in
+// frames[], and the free ones are chained into a doubly linked free
+// list, so MemoryAllocPage and MemoryFreePage are O(1) however much
+// memory there is.  freemap[] keeps one bit per page (set = in use)
+// and freesummary one bit per freemap word (set = all 32 pages in
+// use), which lets MemoryAllocContiguousPages skip full words.
+//
+// A fork shares the parent's L2 tables with the child, so an L2 table's
+// refcount is the number of processes using it, and a page's refcount
+// is the number of L2 tables mapping it.  A shared table is copied the
+// first time either process changes one of its PTEs.  zeropage is a
+// single page of zeroes that pages with nothing in them yet map read
+// only; it isn't refcounted and is never freed.
+static MemoryFrame frames[MEM_MAX_PAGES];
+static uint32 freemap[MEM_FREEMAP_WORDS];
+static uint32 freesummary;
+static int freehead;
 static uint32 pagestart;
 static int nfreepages;
-static int freemapmax;
-static int physicalpgmax; 
+static int physicalpgmax;
+static int zeropage;
+
 //----------------------------------------------------------------------
 //	This silliness is required because the compiler believes that
 //	it can invert a number by subtracting it from zero and subtracting
@@ -47,52 +61,209 @@ int MemoryGetSize()
 }
 
 //---------------------------------------------------------------------
-//  MemoryAllocPage 
+//  Free list and bitmap helpers
+//---------------------------------------------------------------------      
+static inline void MemoryMarkInUse(uint32 page)
+{
+    freemap[page>>5] |= (uint32)(0x1 << (31-(page & MEM_FREEMAP_PAGEOFFSET_MASK)));
+    if(freemap[page>>5] == MEM_FREEMAP_INUSE) freesummary |= (uint32)(0x1 << (31-(page>>5)));
+}
+
+static inline void MemoryMarkFree(uint32 page)
+{
+    freemap[page>>5] &= invert(0x1 << (31-(page & MEM_FREEMAP_PAGEOFFSET_MASK)));
+    freesummary &= invert(0x1 << (31-(page>>5)));
+}
+
+static inline void MemoryFreeListRemove(int page)
+{
+    if(frames[page].prev == MEM_FRAME_NONE) freehead = frames[page].next;
+    else frames[frames[page].prev].next = frames[page].next;
+    if(frames[page].next != MEM_FRAME_NONE) frames[frames[page].next].prev = frames[page].prev;
+}
+
+static inline void MemoryFreeListPush(int page)
+{
+    frames[page].prev = MEM_FRAME_NONE;
+    frames[page].next = freehead;
+    if(freehead != MEM_FRAME_NONE) frames[freehead].prev = page;
+    freehead = page;
+}
+
+//---------------------------------------------------------------------
+//  MemoryAllocPage ~ take the page at the head of the free list
 //---------------------------------------------------------------------      
 int MemoryAllocPage(void) 
 {
-    uint32 physical_page = (lastosaddress>>MEM_L1FIELD_FIRST_BITNUM);
-    uint32 idx = physical_page >> 5;
-    uint32 page_number = 0;
-    
+    int page = freehead;
+
     // Debug print statement
     dbprintf('m', "MemoryAllocPage: (PID:%d) function started\n",GetCurrentPid());
-    
-    // First cycle through the integer freemap vales, break at first !inuse
-    while(idx<(MEM_MAX_PAGES>>5) && (freemap[idx] == MEM_FREEMAP_INUSE)) idx++;
-
-    // Check if we over indexed
-    if(idx == MEM_MAX_PAGES >> 5) return MEM_FAIL;
-
-    // Scroll through bits in integer to find free page
-    while(freemap[idx] << page_number++);
 
-    // The physical page is the index in the freemap * 32 + page_number - 1
-    physical_page = (idx<<5) + page_number - 1;
-    pagereferencecounter[physical_page] = 1;
+    if(page == MEM_FRAME_NONE) return MEM_FAIL;
+    MemoryFreeListRemove(page);
+    MemoryMarkInUse(page);
+    frames[page].refcount = 1;
     nfreepages -= 1;
+    return page;
+}
 
-    // Mark in freemap that page now in use
-    freemap[idx] |= (uint32)(0x1 << (32-page_number));
-
-    // Check that physical page does not exceed memory size
-    if(physical_page > ((MemoryGetSize()-1) >> MEM_L1FIELD_FIRST_BITNUM)) return MEM_FAIL;
+//---------------------------------------------------------------------
+//  MemoryAllocContiguousPages ~ allocate npages physically contiguous
+//      pages, first fit, and return the first one.  Each page is
+//      freed on its own with MemoryFreePage.
+//---------------------------------------------------------------------      
+int MemoryAllocContiguousPages(int npages)
+{
+    int idx, bit, page, run = 0, first = 0;
 
-    // Else, return the physical page number
-    return physical_page;
+    if(npages <= 0 || npages > nfreepages) return MEM_FAIL;
+    for(idx=0; idx<MEM_FREEMAP_WORDS; idx++)
+    {
+        // A full word ends any run, an empty one extends it by 32
+        if(freesummary & (uint32)(0x1 << (31-idx))) {  run = 0; continue;  }
+        if(freemap[idx] == MEM_FREEMAP_NOTINUSE && run + 32 < npages)
+        {
+            if(run == 0) first = idx<<5;
+            run += 32;
+            continue;
+        }
+        for(bit=0; bit<32; bit++)
+        {
+            if(freemap[idx] & (uint32)(0x1 << (31-bit))) {  run = 0; continue;  }
+            if(run++ == 0) first = (idx<<5) + bit;
+            if(run < npages) continue;
+            for(page=first; page<first+npages; page++)
+            {
+                MemoryFreeListRemove(page);
+                MemoryMarkInUse(page);
+                frames[page].refcount = 1;
+            }
+            nfreepages -= npages;
+            return first;
+        }
+    }
+    return MEM_FAIL;
 }
 
+//---------------------------------------------------------------------
+//  MemoryFreePageCount ~ number of pages on the free list
+//---------------------------------------------------------------------      
+int MemoryFreePageCount(void)
+{  return nfreepages;  }
+
 //---------------------------------------------------------------------
 //  MemorySetupPTE ~ setup a page table entry given phys page number
 //---------------------------------------------------------------------      
 uint32 MemorySetupPTE (uint32 page)
-{  return ((page<<MEM_L1FIELD_FIRST_BITNUM) | MEM_PTE_VALID);  }
+{  return ((page<<MEM_L2FIELD_FIRST_BITNUM) | MEM_PTE_VALID);  }
 
 //---------------------------------------------------------------------
 //  MemoryFreePTE ~ free a page given a PTE
 //---------------------------------------------------------------------      
 void MemoryFreePTE (uint32 pte)
-{  MemoryFreePage(pte & MEM_PTE_TO_PAGEADDRESS_MASK);  }
+{  MemoryFreePage((pte & MEM_PTE_TO_PAGEADDRESS_MASK) >> MEM_L2FIELD_FIRST_BITNUM);  }
+
+//---------------------------------------------------------------------
+//  MemoryZeroPagePTE ~ PTE mapping the shared zero page read only
+//---------------------------------------------------------------------      
+uint32 MemoryZeroPagePTE(void)
+{  return (MemorySetupPTE(zeropage) | MEM_PTE_READONLY);  }
+
+//---------------------------------------------------------------------
+//  MemoryUnshareTable ~ give pcb its own copy of an L2 table it shares
+//      with another process.  Every page the table maps gains a
+//      reference for the copy.
+//---------------------------------------------------------------------
+static int MemoryUnshareTable(PCB *pcb, uint32 l1index)
+{
+    uint32 *oldtable = (uint32 *)(pcb->pagetable[l1index]);
+    uint32 *newtable;
+    int page, j;
+
+    if((page = MemoryAllocPage()) == MEM_FAIL) return MEM_FAIL;
+    newtable = (uint32 *)(page * MEM_PAGESIZE);
+    for(j=0; j<MEM_L2TABLE_SIZE; j++)
+    {
+        newtable[j] = oldtable[j];
+        if(newtable[j] & MEM_PTE_VALID) MemorySharePage(newtable[j]);
+    }
+    MemoryFreePage((uint32)oldtable / MEM_PAGESIZE);
+    pcb->pagetable[l1index] = (uint32)newtable;
+    dbprintf('m', "MemoryUnshareTable: (PID:%d) copied L2 table %d\n", GetCurrentPid(), l1index);
+    return MEM_SUCCESS;
+}
+
+//---------------------------------------------------------------------
+//  MemoryGetPTE ~ find the PTE for a virtual page through the L1 table
+//      in the PCB.  If create is set the caller may change the PTE, so
+//      a missing L2 table is allocated (zeroed, so all of its PTEs are
+//      invalid) and a shared one is copied.  Otherwise a missing table
+//      gives NULL, as do pages past the end of the address space.
+//---------------------------------------------------------------------
+uint32 *MemoryGetPTE(PCB *pcb, uint32 vpage, int create)
+{
+    uint32 l1index = vpage >> MEM_L2TABLE_BITS;
+    int page;
+
+    if(vpage >= MEM_PAGETABLE_SIZE) return NULL;
+    if(pcb->pagetable[l1index] == 0)
+    {
+        if(!create) return NULL;
+        if((page = MemoryAllocPage()) == MEM_FAIL) return NULL;
+        bzero((char *)(page * MEM_PAGESIZE), MEM_PAGESIZE);
+        pcb->pagetable[l1index] = page * MEM_PAGESIZE;
+    }
+    else if(create && frames[pcb->pagetable[l1index] / MEM_PAGESIZE].refcount > 1)
+    {  if(MemoryUnshareTable(pcb, l1index) != MEM_SUCCESS) return NULL;  }
+    return ((uint32 *)(pcb->pagetable[l1index])) + (vpage & (MEM_L2TABLE_SIZE-1));
+}
+
+//---------------------------------------------------------------------
+//  MemoryForkTables ~ share every L2 table of parent with child.  Each
+//      valid PTE is made READONLY, so the first write to a page from
+//      either process faults and copies it.  No page is copied here,
+//      and the pages' refcounts don't change.
+//---------------------------------------------------------------------
+void MemoryForkTables(PCB *parent, PCB *child)
+{
+    int i, j;
+    uint32 *l2table;
+
+    for(i=0; i<MEM_L1TABLE_SIZE; i++)
+    {
+        child->pagetable[i] = parent->pagetable[i];
+        if(parent->pagetable[i] == 0) continue;
+        l2table = (uint32 *)(parent->pagetable[i]);
+        for(j=0; j<MEM_L2TABLE_SIZE; j++)
+        {  if(l2table[j] & MEM_PTE_VALID) l2table[j] |= MEM_PTE_READONLY;  }
+        frames[parent->pagetable[i] / MEM_PAGESIZE].refcount += 1;
+    }
+}
+
+//---------------------------------------------------------------------
+//  MemoryFreePageTables ~ drop a process's L2 tables.  The pages a
+//      table maps are freed with it, unless another process still
+//      shares the table.
+//---------------------------------------------------------------------
+void MemoryFreePageTables(PCB *pcb)
+{
+    int i, j;
+    uint32 *l2table;
+
+    for(i=0; i<MEM_L1TABLE_SIZE; i++)
+    {
+        if(pcb->pagetable[i] == 0) continue;
+        l2table = (uint32 *)(pcb->pagetable[i]);
+        if(frames[pcb->pagetable[i] / MEM_PAGESIZE].refcount == 1)
+        {
+            for(j=0; j<MEM_L2TABLE_SIZE; j++)
+            {  if(l2table[j] & MEM_PTE_VALID) MemoryFreePTE(l2table[j]);  }
+        }
+        MemoryFreePage(pcb->pagetable[i] / MEM_PAGESIZE);
+        pcb->pagetable[i] = 0;
+    }
+}
     
 //---------------------------------------------------------------------
 //  MemorySharePage ~ share a page given its PTE
@@ -100,28 +271,29 @@ void MemoryFreePTE (uint32 pte)
 void MemorySharePage (uint32 pte)
 {
     int p = ((pte & MEM_PTE_MASK) / MEM_PAGESIZE);
-    pagereferencecounter[p] += 1;
+    if(p == zeropage) return;
+    frames[p].refcount += 1;
     return;
 }
 
 //---------------------------------------------------------------------
-//  MemoryFreePage ~ free a page given its PTE
+//  MemoryFreePage ~ drop a reference to a page, and put it back on
+//      the free list when the last one goes
 //---------------------------------------------------------------------      
 void MemoryFreePage(uint32 page)
 {
-    // Find the offset of the physical page from 32-bit intervals
-    // Use the offset to change the value of corresponding page
-    // in the freemap
-    uint32 offset = (uint32)(page & MEM_FREEMAP_PAGEOFFSET_MASK);
-    
-    pagereferencecounter[page] -= 1;
-    if(pagereferencecounter[page] > 0) return;
-
     // Debug print statement
     dbprintf('m', "MemoryFreePage: (PID:%d) function started\n",GetCurrentPid());
-    
-    // Use the page to find index in freemap of target int
-    freemap[page>>5] &= invert(0x1 << (31-offset));
+
+    // Ignore pages that aren't allocated (OS pages, or a PTE that
+    // was never set up) rather than corrupting the free list
+    if(page < pagestart || page >= physicalpgmax || page == zeropage || frames[page].refcount == 0)
+    {  dbprintf('m', "MemoryFreePage: page %d is not allocated\n", page); return;  }
+    frames[page].refcount -= 1;
+    if(frames[page].refcount > 0) return;
+
+    MemoryMarkFree(page);
+    MemoryFreeListPush(page);
     nfreepages += 1;
 }
 
@@ -138,77 +310,168 @@ void MemoryFreePage(uint32 page)
 void MemoryModuleInit() 
 {
     //-----------------------------------------------------
-    // Freemap: 
-    //          An array of bits in memory representing
-    //          which pages are in use and which are not
-    // 
-    // Implementation:  
-    //          Array of integers, each integer represents
-    //          32 pages. To find an availible physical
-    //          page, loop through the freemap ints until
-    //          you find one entry that is not zero. Then
-    //          start looking at each bit one-at-a-time
-    //          until you find a bit that is a one.
+    // Frames: 
+    //          One descriptor per physical page, holding
+    //          its reference count and its links on the
+    //          free list while it's free.
     // Init:
-    //          Mark the pages in use by OS as "INUSE" and
-    //          the rest as "NOTINUSE"... But how can I 
-    //          know which pages those are??? Well, the OS
-    //          is loaded at the top of physical memory.
-    //          So, it must be starting at address 0x0,
-    //          what about ending? DLXOS defines a global
-    //          var in /os/osend.s at compile time called:
-    //          lastosaddress.  
+    //          The OS is loaded at the bottom of physical
+    //          memory, from address 0x0 up to lastosaddress
+    //          (a global set in /os/osend.s at compile time).
+    //          Those pages and any past the end of memory
+    //          stay "INUSE" forever; every other page goes
+    //          on the free list in ascending order.
     //-----------------------------------------------------
     int idx=0;
-    uint32 lastosaddr_page = (lastosaddress>>MEM_L1FIELD_FIRST_BITNUM);
-    uint32 page_freemapoffset = (lastosaddr_page & MEM_FREEMAP_PAGEOFFSET_MASK);
+    uint32 lastosaddr_page = (lastosaddress>>MEM_L2FIELD_FIRST_BITNUM);
 
     physicalpgmax = MemoryGetSize() / MEM_PAGESIZE;
-    pagestart = (lastosaddress + MEM_PAGESIZE - 4) / MEM_PAGESIZE;
-    freemapmax = (physicalpgmax + 31) / 32;
+    if(physicalpgmax > MEM_MAX_PAGES) physicalpgmax = MEM_MAX_PAGES;
+    pagestart = lastosaddr_page + 1;
 
     // Debug print statement
     dbprintf('m', "MemoryModuleInit: (PID:%d) function started\n",GetCurrentPid());
 
     // Set all pages to be in use initially
-    for(idx=0; idx<freemapmax; idx++) freemap[idx] = MEM_FREEMAP_INUSE;
+    for(idx=0; idx<MEM_FREEMAP_WORDS; idx++) freemap[idx] = MEM_FREEMAP_INUSE;
+    freesummary = MEM_FREEMAP_INUSE;
+    for(idx=0; idx<MEM_MAX_PAGES; idx++)
+    {  frames[idx].refcount = 1; frames[idx].next = frames[idx].prev = MEM_FRAME_NONE;  }
+
+    // Free the rest, pushing from the top so the list starts low
+    freehead = MEM_FRAME_NONE;
+    nfreepages = 0;
+    for(idx=physicalpgmax-1; idx>=(int)pagestart; idx--)
+    {
+        frames[idx].refcount = 0;
+        MemoryMarkFree(idx);
+        MemoryFreeListPush(idx);
+        nfreepages++;
+    }
 
-    // Set references to zero for all pages
-    for(idx=0; idx<physicalpgmax; idx++) pagereferencecounter[idx] = 0;
+    // Take the zero page for good
+    zeropage = MemoryAllocPage();
+    bzero((char *)(zeropage * MEM_PAGESIZE), MEM_PAGESIZE);
+}
 
-    nfreepages=0;
-    // Mark all OS pages as INUSE
-    for(idx=0; idx<(lastosaddr_page>>5); idx++) 
-    {  pagereferencecounter[idx] = 1;  }
+//---------------------------------------------------------------------
+//  MemoryBenchmark ~ stress test for the page allocator, run as a
+//      system process when the OS is started with "-m rounds".  Each
+//      round takes every free page, gives them back in interleaved
+//      order so the free list ends up scrambled, then carves memory
+//      into MEM_BENCH_RUN page contiguous runs and frees those.
+//---------------------------------------------------------------------
+void MemoryBenchmark(int rounds)
+{
+    static int pages[MEM_MAX_PAGES];
+    int r, i, j, n, ops = 0;
+    int free_before = nfreepages;
+    int start = ClkGetCurJiffies();
 
-    // Handle the last 32 pages used by OS (may not be using all 32)
-    freemap[lastosaddr_page>>5] = (uint32)(MEM_FREEMAP_INUSE<<(31-page_freemapoffset));
-    
-    // Mark the rest of the pages as NOTINUSE
-    for(idx=(lastosaddr_page>>5)+1; idx<MEM_MAX_PAGES>>5; idx++)
-    {  freemap[idx]=MEM_FREEMAP_NOTINUSE; nfreepages++;  }
+    for(r=0; r<rounds; r++)
+    {
+        for(n=0; (pages[n] = MemoryAllocPage()) != MEM_FAIL; n++);
+        for(i=0; i<n; i+=2) MemoryFreePage(pages[i]);
+        for(i=1; i<n; i+=2) MemoryFreePage(pages[i]);
+        ops += 2*n + 1;
+        for(n=0; (pages[n] = MemoryAllocContiguousPages(MEM_BENCH_RUN)) != MEM_FAIL; n++);
+        for(i=0; i<n; i++) for(j=0; j<MEM_BENCH_RUN; j++) MemoryFreePage(pages[i] + j);
+        ops += n*(MEM_BENCH_RUN + 1) + 1;
+    }
+    printf("MemoryBenchmark: %d rounds over %d free pages, %d allocator calls in %d jiffies\n",
+           rounds, free_before, ops, ClkGetCurJiffies() - start);
+    if(nfreepages != free_before)
+        printf("MemoryBenchmark: %d free pages before, %d after!\n", free_before, nfreepages);
+}
+
+//---------------------------------------------------------------------
+//  MemoryFaultIn ~ make the page holding user address addr valid, if
+//      it's part of the program image or the user stack.  Returns
+//      MEM_FAIL for an address the process has no business touching.
+//---------------------------------------------------------------------
+static int MemoryFaultIn(PCB *pcb, uint32 addr)
+{
+    uint32 virtual_page_num = addr>>MEM_L2FIELD_FIRST_BITNUM;
+    uint32 physical_page_num;
+    uint32 stack_page_num = pcb->currentSavedFrame[PROCESS_STACK_USER_STACKPOINTER]>>MEM_L2FIELD_FIRST_BITNUM;
+    uint32 *pte;
+
+    // Code and global data pages come from the program's image
+    if(virtual_page_num < PROCESS_NUMPAGES_USERCODE_GLOBALDATA)
+    {  return ProcessImageFault(pcb, virtual_page_num);  }
+
+    // If user stack triggered Page fault, allocate page (and the L2
+    // table holding its PTE, if that's missing too) => return MEM_SUCCESS
+    if(virtual_page_num >= stack_page_num)
+    {
+        pte = MemoryGetPTE(pcb, virtual_page_num, 1);
+        if(pte != NULL)
+        {
+            physical_page_num = MemoryAllocPage();
+            if(physical_page_num != MEM_FAIL)
+            {
+                *pte = MemorySetupPTE(physical_page_num);
+                return MEM_SUCCESS;
+            }
+        }
+    }
+    return MEM_FAIL;
+}
+
+//---------------------------------------------------------------------
+//  MemoryMakeWritable ~ let pcb write to a mapped virtual page.  A
+//      READONLY page is copied unless pcb is its only user, and the
+//      zero page is replaced by a newly zeroed page rather than copied.
+//      Returns MEM_FAIL if the page isn't mapped or memory runs out.
+//---------------------------------------------------------------------
+static int MemoryMakeWritable(PCB *pcb, uint32 vpage)
+{
+    uint32 *pte = MemoryGetPTE(pcb, vpage, 0);
+    uint32 page;
+    int newPage;
+
+    if((pte == NULL) || ((*pte & MEM_PTE_VALID) == 0)) return MEM_FAIL;
+    if((*pte & MEM_PTE_READONLY) == 0) return MEM_SUCCESS;
+    // Changing the PTE, so the L2 table has to be this process's own
+    if((pte = MemoryGetPTE(pcb, vpage, 1)) == NULL) return MEM_FAIL;
+    page = (*pte & MEM_PTE_MASK) >> MEM_L2FIELD_FIRST_BITNUM;
+
+    if(page == zeropage || frames[page].refcount > 1)
+    {
+        if((newPage = MemoryAllocPage()) == MEM_FAIL) return MEM_FAIL;
+        if(page == zeropage) bzero((char *)(newPage * MEM_PAGESIZE), MEM_PAGESIZE);
+        else bcopy((char *)(page * MEM_PAGESIZE), (char *)(newPage * MEM_PAGESIZE), MEM_PAGESIZE);
+        *pte = MemorySetupPTE(newPage);
+        MemoryFreePage(page);
+    }
+    else *pte &= invert(MEM_PTE_READONLY);
+    return MEM_SUCCESS;
 }
 
 //----------------------------------------------------------------------
 //  MemoryTranslateUserToSystem
 //	  Translate a user address (in the process referenced by pcb)
-//	  into an OS (physical) address.  Return the physical address.
+//	  into an OS (physical) address.  Return the physical address,
+//	  or 0 if the address isn't mapped and can't be faulted in.
 //----------------------------------------------------------------------
 uint32 MemoryTranslateUserToSystem(PCB *pcb, uint32 addr)
 {
     uint32 physical_addr=0;
     int page_offset = addr & MEM_PAGE_OFFSET_MASK;
-    int page_virtual = addr >> MEM_L1FIELD_FIRST_BITNUM;
-    int pte = pcb->pagetable[page_virtual];
+    uint32 *pte = MemoryGetPTE(pcb, addr >> MEM_L2FIELD_FIRST_BITNUM, 0);
 
     // Debug print statement
     //dbprintf('m', "MemoryTranslateUserToSystem: (PID:%d) function started\n",GetCurrentPid());
 
-    // If PTE invalid, page fault
-    if((pte & MEM_PTE_VALID) == 0) return MemoryPageFaultHandler(pcb);
+    // If PTE invalid, fault the page in just as the user would have
+    if((pte == NULL) || ((*pte & MEM_PTE_VALID) == 0))
+    {
+        if(MemoryFaultIn(pcb, addr) != MEM_SUCCESS) return 0;
+        pte = MemoryGetPTE(pcb, addr >> MEM_L2FIELD_FIRST_BITNUM, 0);
+    }
 
     // Else calculate physical address and return it
-    physical_addr = (uint32)((pte&(~MEM_PAGE_OFFSET_MASK))+page_offset);
+    physical_addr = (uint32)((*pte&(~MEM_PAGE_OFFSET_MASK))+page_offset);
     return physical_addr;
 }
 
@@ -246,6 +509,14 @@ int MemoryMoveBetweenSpaces (PCB *pcb, unsigned char *system, unsigned char *use
         // If we could not translate address, exit now
         if (curUser == (unsigned char *)0) break;
 
+        // Writes from the kernel don't trap on READONLY pages, so break
+        // copy-on-write sharing here, as a write by the process would
+        if (dir >= 0)
+        {
+            if (MemoryMakeWritable(pcb, (uint32)user >> MEM_L2FIELD_FIRST_BITNUM) != MEM_SUCCESS) break;
+            curUser = (unsigned char *)MemoryTranslateUserToSystem(pcb, (uint32)user);
+        }
+
         // Calculate the number of bytes to copy this time. If we have more bytes
         // to copy than there are left in the current page, we'll have to just copy to the
         // end of the page and then go through the loop again with the next page.
@@ -294,8 +565,9 @@ int MemoryCopyUserToSystem (PCB *pcb, unsigned char *from,unsigned char *to, int
 //      Called in traps.c whenever a page fault, or sementation fault
 //      (better known as a "seg fault") occurs.  If the address that was
 //      being accessed is on the stack, we need to allocate a new page 
-//      for the stack.  If it is not on the stack, then this is a legitimate
-//      seg fault and we should kill the process.  Returns MEM_SUCCESS
+//      for the stack.  Code and data pages are filled from the program
+//      image.  Anything else is a legitimate seg fault and we should
+//      kill the process.  Returns MEM_SUCCESS
 //      on success, and kills the current process on failure.  Note that
 //      fault_address is the beginning of the page of the virtual address that 
 //      caused the page fault, i.e. it is the vaddr with the offset zero-ed
@@ -303,44 +575,27 @@ int MemoryCopyUserToSystem (PCB *pcb, unsigned char *from,unsigned char *to, int
 //---------------------------------------------------------------------
 int MemoryPageFaultHandler(PCB *pcb) 
 {
-    // Calculate the address and virt+stack page numbers
     uint32 addr = pcb->currentSavedFrame[PROCESS_STACK_FAULT];
-    uint32 virtual_page_num = addr>>MEM_L1FIELD_FIRST_BITNUM;
-    uint32 physical_page_num;
-    uint32 stack_page_num = pcb->currentSavedFrame[PROCESS_STACK_USER_STACKPOINTER]>>MEM_L1FIELD_FIRST_BITNUM;
 
     // Debug print statement
     dbprintf('m', "MemoryPageFaultHandler: (PID:%d) function started\n",GetCurrentPid());
 
-    // If user stack triggered Page fault, allocate page
-    //  => return MEM_SUCCESS
-    if(virtual_page_num >= stack_page_num)
-    {
-        physical_page_num = MemoryAllocPage();
-        pcb->pagetable[virtual_page_num] = MemorySetupPTE(physical_page_num);
-        return MEM_SUCCESS;
-    }
-    else
-    {
-        // Else, ProcessKill => return MEM_FAIL
-        ProcessKill();
-        return MEM_FAIL;
-    }
+    if(MemoryFaultIn(pcb, addr) == MEM_SUCCESS) return MEM_SUCCESS;
+
+    // Else, ProcessKill => return MEM_FAIL
+    ProcessKill();
+    return MEM_FAIL;
 }
 
+//---------------------------------------------------------------------
+//  MemoryROPAccessHandler
+//      Called in traps.c when a process writes to a READONLY page,
+//      which after a fork is a page it shares copy-on-write.  The
+//      process gets a page of its own, and is killed if it can't.
+//---------------------------------------------------------------------
 void MemoryROPAccessHandler(PCB * pcb)
 {
     uint32 faultAddress = pcb->currentSavedFrame[PROCESS_STACK_FAULT];
-    uint32 virtual_page_num = faultAddress >> MEM_L1FIELD_FIRST_BITNUM;
-    uint32 physical_page_num = ((pcb->pagetable[virtual_page_num]&MEM_PTE_MASK)>>MEM_L1FIELD_FIRST_BITNUM);
-    uint32 newPage;
 
-    if(pagereferencecounter[physical_page_num] > 1)
-    {
-        newPage = MemoryAllocPage();
-        pcb->pagetable[virtual_page_num] = MemorySetupPTE(newPage);
-        bcopy((char *)(faultAddress), (char *)(newPage * MEM_PAGESIZE), MEM_PAGESIZE);
-        pagereferencecounter[physical_page_num] -= 1;
-    }
-    else pcb->pagetable[virtual_page_num] &= invert(MEM_PTE_READONLY);
+    if(MemoryMakeWritable(pcb, faultAddress >> MEM_L2FIELD_FIRST_BITNUM) != MEM_SUCCESS) ProcessKill();
 }
@@ -0,0 +1,91 @@
+#include "usertraps.h"
+#include "misc.h"
+#include "umalloc.h"
+
+#define SLABBENCH_NUM_OBJS 64
+#define SLABBENCH_NUM_PASSES 4
+#define SLABBENCH_NUM_SIZES 8
+
+// Request sizes, none of them a power of two
+static const int reqsizes[SLABBENCH_NUM_SIZES] = { 12, 20, 40, 72, 100, 200, 300, 500 };
+void *objs[SLABBENCH_NUM_OBJS];
+
+/*~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+ * FUNCTION:        slabbench.c - compares the umalloc library to the heap traps
+ *
+ * DESCRIPTION:     Each pass allocates SLABBENCH_NUM_OBJS blocks of the sizes
+ *                  above and then frees them all, first with the malloc and
+ *                  mfree traps (the kernel buddy allocator), then with umalloc
+ *                  and ufree. For each it prints the traps taken per
+ *                  operation, and the bytes held for the blocks against the
+ *                  bytes asked for. Run it on its own with
+ *                  "make runslab" from apps/example.
+ * ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~*/
+void main (int argc, char *argv[])
+{
+    int i, pass, freed, failed = 0;
+    int requested = 0, held = 0, traps = 0, ops = 0;
+    umalloc_stats before, peak, after;
+
+    for(i=0; i<SLABBENCH_NUM_OBJS; i++) requested += reqsizes[i % SLABBENCH_NUM_SIZES];
+
+    Printf("================================================================================\n");
+    Printf(" slabbench (%d): %d blocks, %d bytes requested, %d passes\n", getpid(), SLABBENCH_NUM_OBJS, requested, SLABBENCH_NUM_PASSES);
+    Printf("================================================================================\n");
+
+    // KERNEL BUDDY PATH ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+    // Every call is a trap; mfree returns the size of the buddy block
+    for(pass=0; pass<SLABBENCH_NUM_PASSES; pass++)
+    {
+        for(i=0; i<SLABBENCH_NUM_OBJS; i++)
+        {
+            objs[i] = malloc(reqsizes[i % SLABBENCH_NUM_SIZES]);
+            traps++; ops++;
+            if(objs[i] == NULL) failed++;
+        }
+        for(i=0; i<SLABBENCH_NUM_OBJS; i++)
+        {
+            if(objs[i] == NULL) continue;
+            freed = mfree(objs[i]);
+            traps++; ops++;
+            if(pass == 0 && freed > 0) held += freed;
+        }
+    }
+    Printf(" slabbench (%d): malloc/mfree traps\n", getpid());
+    Printf("   %d traps for %d ops       = %d traps per 100 ops\n", traps, ops, traps*100/ops);
+    Printf("   %d bytes held for %d      = %d%% wasted\n", held, requested, (held-requested)*100/requested);
+    if(failed) Printf("   %d allocations failed\n", failed);
+
+    // USER SLAB PATH ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+    // Only getting or giving back a pool of pages traps
+    failed = 0; ops = 0; held = 0;
+    umalloc_getstats(&before);
+    for(pass=0; pass<SLABBENCH_NUM_PASSES; pass++)
+    {
+        for(i=0; i<SLABBENCH_NUM_OBJS; i++)
+        {
+            objs[i] = umalloc(reqsizes[i % SLABBENCH_NUM_SIZES]);
+            ops++;
+            if(objs[i] == NULL) failed++;
+        }
+        if(pass == 0) umalloc_getstats(&peak);
+        for(i=0; i<SLABBENCH_NUM_OBJS; i++)
+        {
+            if(objs[i] == NULL) continue;
+            ufree(objs[i]);
+            ops++;
+        }
+    }
+    umalloc_getstats(&after);
+    held = peak.objbytes - before.objbytes;
+    traps = after.traps - before.traps;
+    Printf(" slabbench (%d): umalloc/ufree\n", getpid());
+    Printf("   %d traps for %d ops       = %d traps per 100 ops\n", traps, ops, traps*100/ops);
+    Printf("   %d bytes held for %d      = %d%% wasted\n", held, requested, (held-requested)*100/requested);
+    Printf("   %d slab pages of %d pool pages at the peak\n", peak.slabpages, peak.poolpages);
+    if(failed) Printf("   %d allocations failed\n", failed);
+
+    Printf("================================================================================\n");
+    Printf(" slabbench (%d): benchmark complete, process ending...\n", getpid());
+    Printf("================================================================================\n");
+}
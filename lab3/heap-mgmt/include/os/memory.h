@@ -23,9 +23,18 @@ int MemoryPageFaultHandler(PCB *pcb);
 // All function prototypes including the malloc and mfree functions go here
 void *malloc(int memsize, PCB * pcb);
 int mfree(void *ptr, PCB * pcb);
+void MemoryHeapInit(PCB *pcb);
 int MemoryAllocPage(void);
+int MemoryAllocZeroedPage(void);
+int MemoryAllocContiguousPages(int npages);
+int MemoryFreePageCount(void);
+void MemoryBenchmark(int rounds);
+void MemoryZeroer(void);
 uint32 MemorySetupPTE(uint32 page);
+uint32 *MemoryGetPTE(PCB *pcb, uint32 vpage, int create);
+void MemoryFreePageTables(PCB *pcb);
 void MemoryFreePTE(uint32);
+void MemorySharePage(uint32 pte);
 void MemoryFreePage(uint32 page);
 
 #endif	// _memory_h_
@@ -14,42 +14,93 @@
 
 //---------------------------------------------------------
 
-#define MEM_L1FIELD_FIRST_BITNUM 12
-// Use a virtual memory size of 1024KB
-#define MEM_MAX_VIRTUAL_ADDRESS (1<<20)-1
+// Two-level page tables: each L1 entry maps 4MB through an L2 table
+// that fills exactly one 4KB page (1024 PTEs).
+#define MEM_L1FIELD_FIRST_BITNUM 22
+#define MEM_L2FIELD_FIRST_BITNUM 12
+// Use a virtual memory size of 64MB
+#define MEM_MAX_VIRTUAL_ADDRESS ((1<<26)-1)
 // Use a max physical memory size of 2MB
 #define MEM_MAX_SIZE (1<<21)
-#define MEM_MAX_PAGES (MEM_MAX_SIZE>>MEM_L1FIELD_FIRST_BITNUM)
+#define MEM_MAX_PAGES (MEM_MAX_SIZE>>MEM_L2FIELD_FIRST_BITNUM)
 
 #define MEM_PTE_READONLY 0x4
 #define MEM_PTE_DIRTY 0x2
 #define MEM_PTE_VALID 0x1
 
-#define MEM_PAGESIZE (0x1<<MEM_L1FIELD_FIRST_BITNUM)
+#define MEM_PAGESIZE (0x1<<MEM_L2FIELD_FIRST_BITNUM)
 #define MEM_MAX_PAGE_OFFSET (MEM_PAGESIZE-1)
 #define MEM_PAGE_OFFSET_MASK (MEM_PAGESIZE-1)
 
-#define MEM_PAGETABLE_SIZE ((MEM_MAX_VIRTUAL_ADDRESS + 1)>>MEM_L1FIELD_FIRST_BITNUM)
+// Number of virtual pages, and how they split between the two levels
+#define MEM_PAGETABLE_SIZE ((MEM_MAX_VIRTUAL_ADDRESS + 1)>>MEM_L2FIELD_FIRST_BITNUM)
 #define MEM_MAX_PAGETABLE_INDEX (MEM_PAGETABLE_SIZE-1)
+#define MEM_L2TABLE_BITS (MEM_L1FIELD_FIRST_BITNUM-MEM_L2FIELD_FIRST_BITNUM)
+#define MEM_L2TABLE_SIZE (0x1<<MEM_L2TABLE_BITS)
+#define MEM_L1TABLE_SIZE ((MEM_MAX_VIRTUAL_ADDRESS + 1)>>MEM_L1FIELD_FIRST_BITNUM)
 
 #define MEM_PTE_TO_PAGEADDRESS_MASK ~(MEM_PTE_READONLY | MEM_PTE_DIRTY | MEM_PTE_VALID)
 
 #define MEM_FREEMAP_PAGEOFFSET_MASK (uint32)0x1F
 #define MEM_FREEMAP_INUSE 0xFFFFFFFF
 #define MEM_FREEMAP_NOTINUSE 0x00000000
+#define MEM_FREEMAP_WORDS (MEM_MAX_PAGES>>5) // at most 32, one freesummary bit each
 
-#define MEM_MAX_HEAP_NODES 128
-
-typedef struct BuddyNode {
-    struct BuddyNode * parent;
-    struct BuddyNode * left_child;
-    struct BuddyNode * right_child;
-    int size;
-    int addr;
-    int used;
-    int order;
-    int idx;
-} BuddyNode;
+// Per-page descriptor of the page frame allocator
+#define MEM_FRAME_NONE -1
+typedef struct MemoryFrame {
+    int next;       // Free list links while the page is free
+    int prev;
+    char refcount;  // References to the page, 0 when free
+} MemoryFrame;
+
+// Contiguous run length used by MemoryBenchmark
+#define MEM_BENCH_RUN 8
+
+// Pool of pages zeroed ahead of time by the low priority "zeroer"
+// process.  It fills the pool up to MEM_ZERO_POOL_MAX pages, and is
+// woken to refill it when a zeroed allocation leaves fewer than
+// MEM_ZERO_POOL_LOW.
+#define MEM_ZERO_POOL_MAX 32
+#define MEM_ZERO_POOL_LOW 8
+
+// User heap: up to MEM_HEAP_MAX_PAGES virtual pages from page
+// MEM_HEAP_VPAGE, mapped as it grows.  Requests of more than half a
+// page get pages of their own; smaller ones come from up to
+// MEM_HEAP_ARENAS pages, each managed by a buddy allocator.
+// Order-0 blocks are 32 bytes and the largest block is the whole
+// page.  Blocks are numbered by the order-0 block they start at.
+#define MEM_HEAP_VPAGE 4
+#define MEM_HEAP_MAX_PAGES 64
+#define MEM_HEAP_ARENAS 4
+#define MEM_HEAP_MIN_BLOCK_BITS 5
+#define MEM_HEAP_MAX_ORDER (MEM_L2FIELD_FIRST_BITNUM-MEM_HEAP_MIN_BLOCK_BITS)
+#define MEM_HEAP_NBLOCKS (0x1<<MEM_HEAP_MAX_ORDER)
+#define MEM_HEAP_MAP_WORDS ((MEM_HEAP_NBLOCKS+31)>>5)
+#define MEM_HEAP_NONE -1
+
+// What a mapped heap page holds
+#define MEM_HEAP_PAGE_FREE 0    // nothing
+#define MEM_HEAP_PAGE_ARENA 1   // small blocks, pageinfo is the arena
+#define MEM_HEAP_PAGE_RUN 2     // start of a big block, pageinfo is its pages
+#define MEM_HEAP_PAGE_TAIL 3    // rest of a big block
+
+typedef struct MemoryHeapArena {
+    int hpage;                      // Heap page, MEM_HEAP_NONE if unused
+    short freelist[MEM_HEAP_MAX_ORDER+1]; // First free block of each order
+    short next[MEM_HEAP_NBLOCKS];   // Free list links, for free blocks
+    short prev[MEM_HEAP_NBLOCKS];
+    char order[MEM_HEAP_NBLOCKS];   // Order of the block starting here
+    uint32 freemap[MEM_HEAP_MAP_WORDS]; // Set where a free block starts
+    uint32 usedmap[MEM_HEAP_MAP_WORDS]; // Set where an allocated block starts
+} MemoryHeapArena;
+
+typedef struct MemoryHeap {
+    int npages;                     // Pages mapped, the top of the heap
+    char pagekind[MEM_HEAP_MAX_PAGES];
+    short pageinfo[MEM_HEAP_MAX_PAGES];
+    MemoryHeapArena arenas[MEM_HEAP_ARENAS];
+} MemoryHeap;
 
 //---------------------------------------------------------
 #endif	// _memory_constants_h_
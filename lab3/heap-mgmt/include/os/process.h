@@ -16,8 +16,6 @@
 #define PROCESS_FAIL 0
 #define PROCESS_SUCCESS 1
 
-#define	PROCESS_MAX_PROCS	32	// Maximum number of active processes
-
 #define	PROCESS_INIT_ISR_SYS	0x140	// Initial status reg value for system processes
 #define	PROCESS_INIT_ISR_USER	0x100	// Initial status reg value for user processes
 
@@ -29,6 +27,7 @@
 #define	PROCESS_STATUS_MASK	0x3f
 #define	PROCESS_TYPE_SYSTEM	0x100
 #define	PROCESS_TYPE_USER	0x200
+#define	PROCESS_TYPE_LOWPRI	0x400	// Passed over while others are runnable
 
 typedef	void (*VoidFunc)();
 
@@ -39,9 +38,10 @@ typedef struct PCB {
   uint32	sysStackArea;	// System stack area for this process
   unsigned int	flags;
   char		name[80];	// Process name
-  uint32	pagetable[((MEM_MAX_VIRTUAL_ADDRESS)>>MEM_L1FIELD_FIRST_BITNUM)+1];
-  BuddyNode heap_trees[MEM_MAX_HEAP_NODES+1];
+  uint32	pagetable[MEM_L1TABLE_SIZE]; // L1 table: L2 table addresses, 0 if none
+  MemoryHeap	heap;		// Heap pages and their allocators
   int		npages;		// Number of pages allocated to this process
+  int		image;		// Program image in the image cache, -1 if none
   Link		*l;		// Used for keeping PCB in queues
 } PCB;
 
@@ -84,6 +84,26 @@ extern PCB	*currentPCB;
 #define PROCESS_NUMPAGES_USER_STACK 1
 #define PROCESS_PAGETABLESIZE (uint32)((MEM_MAX_VIRTUAL_ADDRESS+1)/MEM_PAGESIZE)
 
+// The simulator exits instead of idling, so a low priority process
+// can't wait for an idle CPU.  It gets one quantum in this many, and
+// doesn't keep the OS running once only low priority processes are
+// left.
+#define PROCESS_LOWPRI_PERIOD 8
+
+// Program images, cached by file name so each executable is only read
+// and parsed once.  The code and data pages of a process start out
+// invalid and are filled from its image when first touched.  A fork
+// fails if every slot is held by a different running program.
+#define PROCESS_MAX_IMAGES 32
+typedef struct ProcessImage {
+  char		name[80];	// Executable file name, "" if the slot is free
+  int		users;		// Processes running the image
+  int		lastuse;	// Load/use stamp, the oldest unused image goes first
+  uint32	start;		// Entry point
+  int		pages[PROCESS_NUMPAGES_USERCODE_GLOBALDATA]; // Frame per page, MEM_FAIL if no bytes
+  char		readonly[PROCESS_NUMPAGES_USERCODE_GLOBALDATA]; // Page holds code only, shared by all users
+} ProcessImage;
+
 
 //---------------------------------------------------------
 // Existing function Prototypes
@@ -101,10 +121,12 @@ void ProcessDestroy(PCB *pcb);
 extern unsigned GetCurrentPid();
 int GetPidFromAddress(PCB *pcb);
 void ProcessKill();
+int ProcessImageFault(PCB *pcb, int vpage);
 
 //-------------------------------------------------------
 // Put any functions prototypes that you define here.
 //-------------------------------------------------------
+void ProcessSetLowPriority (int pid);
 
 
 
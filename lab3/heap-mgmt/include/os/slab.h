@@ -0,0 +1,58 @@
+//
+//	slab.h
+//
+//	Kernel object caches.  Each cache hands out objects of one size
+//	from pages taken with MemoryAllocPage, so a subsystem's capacity
+//	grows with load instead of being fixed by a static array.  Objects
+//	also have small integer handles, for things user programs name by
+//	number (semaphores, locks, process ids).
+//
+
+#ifndef	_slab_h_
+#define	_slab_h_
+
+#include "dlxos.h"
+
+#define SLAB_FAIL -1
+#define SLAB_SUCCESS 1
+
+#define SLAB_MIN_OBJECT	16	// Objects are at least this big, word aligned
+#define SLAB_MAP_WORDS	8	// Allocated bitmap, enough for 16-byte objects
+#define SLAB_MAX_PAGES	128	// Pages one cache can hold at once
+
+// Header at the start of every page a cache holds
+typedef struct SlabPage {
+  struct SlabCache *cache;
+  struct SlabPage *next;	// Pages of the cache with a free object
+  struct SlabPage *prev;
+  int		index;		// Slot in cache->pages
+  int		nfree;
+  void		*freelist;	// Free objects, linked through their first word
+  uint32	usedmap[SLAB_MAP_WORDS]; // Bit set = object allocated
+} SlabPage;
+
+typedef struct SlabCache {
+  char		*name;
+  int		size;		// Object size
+  int		perpage;	// Objects in each page
+  SlabPage	*partial;	// Pages with a free object
+  SlabPage	*pages[SLAB_MAX_PAGES]; // Every page held, by index, NULL if none
+  struct SlabCache *nextcache;	// All caches, for SlabPrintStats
+
+  // Usage statistics
+  int		npages;		// Pages held now
+  int		inuse;		// Objects allocated now
+  int		peak;		// Most objects allocated at once
+  int		allocs;
+  int		frees;
+  int		fails;		// Allocations that found no memory
+} SlabCache;
+
+void SlabCacheInit (SlabCache *cache, char *name, int size);
+void *SlabAlloc (SlabCache *cache);
+int SlabFree (SlabCache *cache, void *obj);
+int SlabIndex (SlabCache *cache, void *obj);
+void *SlabLookup (SlabCache *cache, int handle);
+void SlabPrintStats ();
+
+#endif	// _slab_h_
@@ -20,12 +20,6 @@
 #define SYNC_SUCCESS 1  // Note that many functions return a handle, hence the -1 value
                         // for failure.
 
-#define MAX_SEMS	32	//Maximum 32 semaphores allowed in the system
-#define MAX_LOCKS	64	//Maximum 64 locks allowed in the system
-				//This is because condition vars also use
-				//locks from the same pool
-#define MAX_CONDS	32	//Maximum 32 conds allowed in the system
-
 typedef int sem_t;
 typedef int lock_t;
 typedef int cond_t;
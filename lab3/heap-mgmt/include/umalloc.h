@@ -0,0 +1,40 @@
+//
+//	User-level allocator linked with every application.  Small requests
+//	come from per-size-class slabs kept in pages taken from the kernel
+//	heap, so they are served and freed without a trap.  Anything bigger
+//	than the largest class goes straight to the malloc/mfree traps.
+//
+
+#ifndef	_umalloc_h_
+#define	_umalloc_h_
+
+#define UMALLOC_PAGE_SIZE	4096	// Must match the kernel's page size
+#define UMALLOC_NUM_CLASSES	12	// Object sizes 8 .. 512 bytes
+#define UMALLOC_MAX_SMALL	512	// Largest request served from a slab
+#define UMALLOC_POOL_PAGES	8	// Pages asked for in a single malloc trap
+#define UMALLOC_MAX_POOLS	6	// Pools held at once
+#define UMALLOC_MAP_WORDS	16	// Free bitmap words, enough for 8-byte objects
+
+// Header at the start of every slab page
+typedef struct umalloc_slab {
+  struct umalloc_slab *next;	// Slabs of the class with free objects
+  struct umalloc_slab *prev;
+  short size;			// Object size
+  short nobjs;			// Objects in the page
+  short nfree;			// Objects still free
+  short onlist;			// Whether the slab is on its class list
+  unsigned int freemap[UMALLOC_MAP_WORDS];	// Bit set = object free
+} umalloc_slab;
+
+typedef struct umalloc_stats {
+  int traps;		// malloc/mfree traps made by the library
+  int objbytes;		// Bytes in live slab objects
+  int slabpages;	// Pages holding slabs
+  int poolpages;	// Pages taken from the kernel heap for slabs
+} umalloc_stats;
+
+extern void *umalloc(int memsize);
+extern int ufree(void *ptr);
+extern void umalloc_getstats(umalloc_stats *stats);
+
+#endif	// !_umalloc_h_
@@ -9,14 +9,32 @@
 #include "process.h"
 #include "memory.h"
 #include "queue.h"
-
-// Freemap is an array of 32-bit integers
-//  Each bit represents a page, so we create the free
-//  map to be composed of MEM_MAX_PAGES/32 ints.
-static uint32 freemap[MEM_MAX_PAGES >> 5];
-//static uint32 pagestart;
-//static int nfreepages;
-//static int freemapmax;
+#include "clock.h"
+
+// Page frame allocator.  Every physical page has a descriptor in
+// frames[], and the free ones are chained into a doubly linked free
+// list, so MemoryAllocPage and MemoryFreePage are O(1) however much
+// memory there is.  freemap[] keeps one bit per page (set = in use)
+// and freesummary one bit per freemap word (set = all 32 pages in
+// use), which lets MemoryAllocContiguousPages skip full words.
+//
+// The "zeroer" system process zeroes free pages while it has the CPU
+// and chains them, through frames[].next, into a pool that
+// MemoryAllocZeroedPage takes from, so a caller that needs a clean
+// page doesn't have to zero it itself.  Pool pages are marked in use
+// in freemap but have a refcount of 0.  The zeroer is preempted like
+// any other process, so every change to the free list, the pool or a
+// refcount is made with interrupts off.
+static MemoryFrame frames[MEM_MAX_PAGES];
+static uint32 freemap[MEM_FREEMAP_WORDS];
+static uint32 freesummary;
+static int freehead;
+static uint32 pagestart;
+static int nfreepages;
+static int physicalpgmax;
+static int zerohead;
+static int nzeropages;
+static PCB *zeroer;
 
 //----------------------------------------------------------------------
 //	This silliness is required because the compiler believes that
@@ -46,66 +64,271 @@ int MemoryGetSize()
 }
 
 //---------------------------------------------------------------------
-//  MemoryAllocPage 
+//  Free list and bitmap helpers
+//---------------------------------------------------------------------      
+static inline void MemoryMarkInUse(uint32 page)
+{
+    freemap[page>>5] |= (uint32)(0x1 << (31-(page & MEM_FREEMAP_PAGEOFFSET_MASK)));
+    if(freemap[page>>5] == MEM_FREEMAP_INUSE) freesummary |= (uint32)(0x1 << (31-(page>>5)));
+}
+
+static inline void MemoryMarkFree(uint32 page)
+{
+    freemap[page>>5] &= invert(0x1 << (31-(page & MEM_FREEMAP_PAGEOFFSET_MASK)));
+    freesummary &= invert(0x1 << (31-(page>>5)));
+}
+
+static inline void MemoryFreeListRemove(int page)
+{
+    if(frames[page].prev == MEM_FRAME_NONE) freehead = frames[page].next;
+    else frames[frames[page].prev].next = frames[page].next;
+    if(frames[page].next != MEM_FRAME_NONE) frames[frames[page].next].prev = frames[page].prev;
+}
+
+static inline void MemoryFreeListPush(int page)
+{
+    frames[page].prev = MEM_FRAME_NONE;
+    frames[page].next = freehead;
+    if(freehead != MEM_FRAME_NONE) frames[freehead].prev = page;
+    freehead = page;
+}
+
+//---------------------------------------------------------------------
+//  Zeroed pool helpers
+//---------------------------------------------------------------------
+static void MemoryZeroPage(int page)
+{
+    uint32 *w = (uint32 *)(page * MEM_PAGESIZE);
+    int i;
+
+    // A word at a time, rather than bzero's byte at a time
+    for(i=0; i<MEM_PAGESIZE/4; i+=4) {  w[i] = 0; w[i+1] = 0; w[i+2] = 0; w[i+3] = 0;  }
+}
+
+static int MemoryZeroPoolTake(void)
+{
+    int intrs = DisableIntrs();
+    int page = zerohead;
+
+    if(page == MEM_FRAME_NONE) {  RestoreIntrs(intrs); return MEM_FAIL;  }
+    zerohead = frames[page].next;
+    frames[page].refcount = 1;
+    nzeropages -= 1;
+    RestoreIntrs(intrs);
+    return page;
+}
+
+static void MemoryZeroPoolDrain(void)
+{
+    int page;
+
+    while((page = zerohead) != MEM_FRAME_NONE)
+    {
+        zerohead = frames[page].next;
+        MemoryMarkFree(page);
+        MemoryFreeListPush(page);
+        nfreepages += 1;
+    }
+    nzeropages = 0;
+}
+
+//---------------------------------------------------------------------
+//  MemoryAllocPage ~ take the page at the head of the free list, or
+//      a zeroed one when the free list is empty
 //---------------------------------------------------------------------      
 int MemoryAllocPage(void) 
 {
-    uint32 physical_page = (lastosaddress>>MEM_L1FIELD_FIRST_BITNUM);
-    uint32 idx = physical_page >> 5;
-    uint32 page_number = 0;
-    
+    int intrs, page;
+
     // Debug print statement
     dbprintf('m', "MemoryAllocPage: (PID:%d) function started\n",GetCurrentPid());
-    
-    // First cycle through the integer freemap vales, break at first !inuse
-    while(idx<(MEM_MAX_PAGES>>5) && (freemap[idx] == MEM_FREEMAP_INUSE)) idx++;
 
-    // Check if we over indexed
-    if(idx == MEM_MAX_PAGES >> 5) return MEM_FAIL;
+    intrs = DisableIntrs();
+    if((page = freehead) == MEM_FRAME_NONE) page = MemoryZeroPoolTake();
+    else
+    {
+        MemoryFreeListRemove(page);
+        MemoryMarkInUse(page);
+        frames[page].refcount = 1;
+        nfreepages -= 1;
+    }
+    RestoreIntrs(intrs);
+    return page;
+}
 
-    // Scroll through bits in integer to find free page
-    while(freemap[idx] << page_number++);
+//---------------------------------------------------------------------
+//  MemoryAllocZeroedPage ~ allocate a page that reads as all zeroes.
+//      It comes from the zeroed pool if there's one there, otherwise
+//      it's zeroed now.  The zeroer is woken when the pool runs low.
+//---------------------------------------------------------------------
+int MemoryAllocZeroedPage(void)
+{
+    int intrs = DisableIntrs();
+    int page = MemoryZeroPoolTake();
+
+    if(nzeropages < MEM_ZERO_POOL_LOW && zeroer != NULL && (zeroer->flags & PROCESS_STATUS_WAITING))
+    {  ProcessWakeup(zeroer);  }
+    RestoreIntrs(intrs);
+    if(page != MEM_FAIL) return page;
+
+    if((page = MemoryAllocPage()) == MEM_FAIL) return MEM_FAIL;
+    dbprintf('m', "MemoryAllocZeroedPage: pool empty, zeroing page %d\n", page);
+    MemoryZeroPage(page);
+    return page;
+}
+
+//---------------------------------------------------------------------
+//  MemoryAllocContiguousPages ~ allocate npages physically contiguous
+//      pages, first fit, and return the first one.  Each page is
+//      freed on its own with MemoryFreePage.
+//---------------------------------------------------------------------      
+static int MemoryTakeContiguousPages(int npages);
 
-    // The physical page is the index in the freemap * 32 + page_number - 1
-    physical_page = (idx<<5) + page_number - 1;
+int MemoryAllocContiguousPages(int npages)
+{
+    int intrs = DisableIntrs();
+    int first = MemoryTakeContiguousPages(npages);
 
-    // Mark in freemap that page now in use
-    freemap[idx] |= (uint32)(0x1 << (32-page_number));
+    RestoreIntrs(intrs);
+    return first;
+}
 
-    // Check that physical page does not exceed memory size
-    if(physical_page > ((MemoryGetSize()-1) >> MEM_L1FIELD_FIRST_BITNUM)) return MEM_FAIL;
+static int MemoryTakeContiguousPages(int npages)
+{
+    int idx, bit, page, run = 0, first = 0;
 
-    // Else, return the physical page number
-    return physical_page;
+    if(npages <= 0 || npages > nfreepages + nzeropages) return MEM_FAIL;
+    for(idx=0; idx<MEM_FREEMAP_WORDS; idx++)
+    {
+        // A full word ends any run, an empty one extends it by 32
+        if(freesummary & (uint32)(0x1 << (31-idx))) {  run = 0; continue;  }
+        if(freemap[idx] == MEM_FREEMAP_NOTINUSE && run + 32 < npages)
+        {
+            if(run == 0) first = idx<<5;
+            run += 32;
+            continue;
+        }
+        for(bit=0; bit<32; bit++)
+        {
+            if(freemap[idx] & (uint32)(0x1 << (31-bit))) {  run = 0; continue;  }
+            if(run++ == 0) first = (idx<<5) + bit;
+            if(run < npages) continue;
+            for(page=first; page<first+npages; page++)
+            {
+                MemoryFreeListRemove(page);
+                MemoryMarkInUse(page);
+                frames[page].refcount = 1;
+            }
+            nfreepages -= npages;
+            return first;
+        }
+    }
+    // Zeroed pages look in use to the free map, so put them back on
+    // the free list and look again before giving up
+    if(nzeropages > 0) {  MemoryZeroPoolDrain(); return MemoryTakeContiguousPages(npages);  }
+    return MEM_FAIL;
 }
 
+//---------------------------------------------------------------------
+//  MemoryFreePageCount ~ number of pages on the free list or in the
+//      zeroed pool
+//---------------------------------------------------------------------      
+int MemoryFreePageCount(void)
+{  return nfreepages + nzeropages;  }
+
 //---------------------------------------------------------------------
 //  MemorySetupPTE ~ setup a page table entry given phys page number
 //---------------------------------------------------------------------      
 uint32 MemorySetupPTE (uint32 page)
-{  return ((page<<MEM_L1FIELD_FIRST_BITNUM) | MEM_PTE_VALID);  }
+{  return ((page<<MEM_L2FIELD_FIRST_BITNUM) | MEM_PTE_VALID);  }
 
 //---------------------------------------------------------------------
 //  MemoryFreePTE ~ free a page given a PTE
 //---------------------------------------------------------------------      
 void MemoryFreePTE (uint32 pte)
-{  MemoryFreePage(pte & MEM_PTE_TO_PAGEADDRESS_MASK);  }
+{  MemoryFreePage((pte & MEM_PTE_TO_PAGEADDRESS_MASK) >> MEM_L2FIELD_FIRST_BITNUM);  }
+
+//---------------------------------------------------------------------
+//  MemoryGetPTE ~ find the PTE for a virtual page through the L1 table
+//      in the PCB.  A missing L2 table is allocated (zeroed, so all of
+//      its PTEs are invalid) if create is set, otherwise NULL comes
+//      back, as it does for pages past the end of the address space.
+//---------------------------------------------------------------------
+uint32 *MemoryGetPTE(PCB *pcb, uint32 vpage, int create)
+{
+    uint32 l1index = vpage >> MEM_L2TABLE_BITS;
+    int page;
+
+    if(vpage >= MEM_PAGETABLE_SIZE) return NULL;
+    if(pcb->pagetable[l1index] == 0)
+    {
+        if(!create) return NULL;
+        if((page = MemoryAllocZeroedPage()) == MEM_FAIL) return NULL;
+        pcb->pagetable[l1index] = page * MEM_PAGESIZE;
+    }
+    return ((uint32 *)(pcb->pagetable[l1index])) + (vpage & (MEM_L2TABLE_SIZE-1));
+}
+
+//---------------------------------------------------------------------
+//  MemoryFreePageTables ~ free every page mapped by a process, then the
+//      L2 tables that mapped them
+//---------------------------------------------------------------------
+void MemoryFreePageTables(PCB *pcb)
+{
+    int i, j;
+    uint32 *l2table;
+
+    for(i=0; i<MEM_L1TABLE_SIZE; i++)
+    {
+        if(pcb->pagetable[i] == 0) continue;
+        l2table = (uint32 *)(pcb->pagetable[i]);
+        for(j=0; j<MEM_L2TABLE_SIZE; j++)
+        {  if(l2table[j] & MEM_PTE_VALID) MemoryFreePTE(l2table[j]);  }
+        MemoryFreePage(pcb->pagetable[i] / MEM_PAGESIZE);
+        pcb->pagetable[i] = 0;
+    }
+}
     
 //---------------------------------------------------------------------
-//  MemoryFreePage ~ free a page given its PTE
+//  MemorySharePage ~ share a page given its PTE
+//---------------------------------------------------------------------      
+void MemorySharePage (uint32 pte)
+{
+    int p = ((pte & MEM_PTE_TO_PAGEADDRESS_MASK) / MEM_PAGESIZE);
+    int intrs = DisableIntrs();
+    frames[p].refcount += 1;
+    RestoreIntrs(intrs);
+    return;
+}
+
+//---------------------------------------------------------------------
+//  MemoryFreePage ~ drop a reference to a page, and put it back on
+//      the free list when the last one goes
 //---------------------------------------------------------------------      
 void MemoryFreePage(uint32 page)
 {
-    // Find the offset of the physical page from 32-bit intervals
-    // Use the offset to change the value of corresponding page
-    // in the freemap
-    uint32 offset = (uint32)(page & MEM_FREEMAP_PAGEOFFSET_MASK);
+    int intrs;
 
     // Debug print statement
     dbprintf('m', "MemoryFreePage: (PID:%d) function started\n",GetCurrentPid());
-    
-    // Use the page to find index in freemap of target int
-    freemap[page>>5] &= invert(0x1 << (31-offset));
+
+    // Ignore pages that aren't allocated (OS pages, or a PTE that
+    // was never set up) rather than corrupting the free list
+    intrs = DisableIntrs();
+    if(page < pagestart || page >= physicalpgmax || frames[page].refcount == 0)
+    {
+        RestoreIntrs(intrs);
+        dbprintf('m', "MemoryFreePage: page %d is not allocated\n", page);
+        return;
+    }
+    frames[page].refcount -= 1;
+    if(frames[page].refcount == 0)
+    {
+        MemoryMarkFree(page);
+        MemoryFreeListPush(page);
+        nfreepages += 1;
+    }
+    RestoreIntrs(intrs);
 }
 
 //----------------------------------------------------------------------
@@ -121,66 +344,170 @@ void MemoryFreePage(uint32 page)
 void MemoryModuleInit() 
 {
     //-----------------------------------------------------
-    // Freemap: 
-    //          An array of bits in memory representing
-    //          which pages are in use and which are not
-    // 
-    // Implementation:  
-    //          Array of integers, each integer represents
-    //          32 pages. To find an availible physical
-    //          page, loop through the freemap ints until
-    //          you find one entry that is not zero. Then
-    //          start looking at each bit one-at-a-time
-    //          until you find a bit that is a one.
+    // Frames: 
+    //          One descriptor per physical page, holding
+    //          its reference count and its links on the
+    //          free list while it's free.
     // Init:
-    //          Mark the pages in use by OS as "INUSE" and
-    //          the rest as "NOTINUSE"... But how can I 
-    //          know which pages those are??? Well, the OS
-    //          is loaded at the top of physical memory.
-    //          So, it must be starting at address 0x0,
-    //          what about ending? DLXOS defines a global
-    //          var in /os/osend.s at compile time called:
-    //          lastosaddress.  
+    //          The OS is loaded at the bottom of physical
+    //          memory, from address 0x0 up to lastosaddress
+    //          (a global set in /os/osend.s at compile time).
+    //          Those pages and any past the end of memory
+    //          stay "INUSE" forever; every other page goes
+    //          on the free list in ascending order.
     //-----------------------------------------------------
     int idx=0;
-    uint32 lastosaddr_page = (lastosaddress>>MEM_L1FIELD_FIRST_BITNUM);
-    uint32 page_freemapoffset = (lastosaddr_page & MEM_FREEMAP_PAGEOFFSET_MASK);
+    uint32 lastosaddr_page = (lastosaddress>>MEM_L2FIELD_FIRST_BITNUM);
+
+    physicalpgmax = MemoryGetSize() / MEM_PAGESIZE;
+    if(physicalpgmax > MEM_MAX_PAGES) physicalpgmax = MEM_MAX_PAGES;
+    pagestart = lastosaddr_page + 1;
 
     // Debug print statement
     dbprintf('m', "MemoryModuleInit: (PID:%d) function started\n",GetCurrentPid());
 
-    // Mark all OS pages as INUSE
-    for(idx=0; idx<(lastosaddr_page>>5); idx++) 
-    {  freemap[idx]=MEM_FREEMAP_INUSE;  }
+    // Set all pages to be in use initially
+    for(idx=0; idx<MEM_FREEMAP_WORDS; idx++) freemap[idx] = MEM_FREEMAP_INUSE;
+    freesummary = MEM_FREEMAP_INUSE;
+    for(idx=0; idx<MEM_MAX_PAGES; idx++)
+    {  frames[idx].refcount = 1; frames[idx].next = frames[idx].prev = MEM_FRAME_NONE;  }
+
+    // Free the rest, pushing from the top so the list starts low
+    freehead = MEM_FRAME_NONE;
+    nfreepages = 0;
+    zerohead = MEM_FRAME_NONE;
+    nzeropages = 0;
+    zeroer = NULL;
+    for(idx=physicalpgmax-1; idx>=(int)pagestart; idx--)
+    {
+        frames[idx].refcount = 0;
+        MemoryMarkFree(idx);
+        MemoryFreeListPush(idx);
+        nfreepages++;
+    }
+}
 
-    // Handle the last 32 pages used by OS (may not be using all 32)
-    freemap[lastosaddr_page>>5] = (uint32)(MEM_FREEMAP_INUSE<<(31-page_freemapoffset));
-    
-    // Mark the rest of the pages as NOTINUSE
-    for(idx=(lastosaddr_page>>5)+1; idx<MEM_MAX_PAGES>>5; idx++)
-    {  freemap[idx]=MEM_FREEMAP_NOTINUSE;  }
+//---------------------------------------------------------------------
+//  MemoryBenchmark ~ stress test for the page allocator, run as a
+//      system process when the OS is started with "-m rounds".  Each
+//      round takes every free page, gives them back in interleaved
+//      order so the free list ends up scrambled, then carves memory
+//      into MEM_BENCH_RUN page contiguous runs and frees those.
+//---------------------------------------------------------------------
+void MemoryBenchmark(int rounds)
+{
+    static int pages[MEM_MAX_PAGES];
+    int r, i, j, n, ops = 0;
+    int free_before = MemoryFreePageCount();
+    int start = ClkGetCurJiffies();
+
+    for(r=0; r<rounds; r++)
+    {
+        for(n=0; (pages[n] = MemoryAllocPage()) != MEM_FAIL; n++);
+        for(i=0; i<n; i+=2) MemoryFreePage(pages[i]);
+        for(i=1; i<n; i+=2) MemoryFreePage(pages[i]);
+        ops += 2*n + 1;
+        for(n=0; (pages[n] = MemoryAllocContiguousPages(MEM_BENCH_RUN)) != MEM_FAIL; n++);
+        for(i=0; i<n; i++) for(j=0; j<MEM_BENCH_RUN; j++) MemoryFreePage(pages[i] + j);
+        ops += n*(MEM_BENCH_RUN + 1) + 1;
+    }
+    printf("MemoryBenchmark: %d rounds over %d free pages, %d allocator calls in %d jiffies\n",
+           rounds, free_before, ops, ClkGetCurJiffies() - start);
+    if(MemoryFreePageCount() != free_before)
+        printf("MemoryBenchmark: %d free pages before, %d after!\n", free_before, MemoryFreePageCount());
+}
+
+//---------------------------------------------------------------------
+//  MemoryZeroer ~ body of the low priority "zeroer" system process.
+//      It takes free pages, zeroes them with interrupts on, and adds
+//      them to the zeroed pool, sleeping whenever the pool is full or
+//      there's no free page left to zero.
+//---------------------------------------------------------------------
+void MemoryZeroer(void)
+{
+    int page, intrs;
+
+    zeroer = currentPCB;
+    while(1)
+    {
+        intrs = DisableIntrs();
+        if(nzeropages >= MEM_ZERO_POOL_MAX || freehead == MEM_FRAME_NONE)
+        {  ProcessSleep(); RestoreIntrs(intrs); continue;  }
+        page = freehead;
+        MemoryFreeListRemove(page);
+        MemoryMarkInUse(page);
+        nfreepages -= 1;
+        RestoreIntrs(intrs);
+
+        MemoryZeroPage(page);
+
+        intrs = DisableIntrs();
+        frames[page].next = zerohead;
+        zerohead = page;
+        nzeropages += 1;
+        RestoreIntrs(intrs);
+    }
+}
+
+//---------------------------------------------------------------------
+//  MemoryFaultIn ~ make the page holding user address addr valid, if
+//      it's part of the program image or the user stack.  Returns
+//      MEM_FAIL for an address the process has no business touching.
+//---------------------------------------------------------------------
+static int MemoryFaultIn(PCB *pcb, uint32 addr)
+{
+    uint32 virtual_page_num = addr>>MEM_L2FIELD_FIRST_BITNUM;
+    uint32 physical_page_num;
+    uint32 stack_page_num = pcb->currentSavedFrame[PROCESS_STACK_USER_STACKPOINTER]>>MEM_L2FIELD_FIRST_BITNUM;
+    uint32 *pte;
+
+    // Code and global data pages come from the program's image
+    if(virtual_page_num < PROCESS_NUMPAGES_USERCODE_GLOBALDATA)
+    {  return ProcessImageFault(pcb, virtual_page_num);  }
+
+    // If user stack triggered Page fault, allocate a zeroed page (and
+    // the L2 table holding its PTE, if that's missing too) => return
+    // MEM_SUCCESS
+    if(virtual_page_num >= stack_page_num)
+    {
+        pte = MemoryGetPTE(pcb, virtual_page_num, 1);
+        if(pte != NULL)
+        {
+            physical_page_num = MemoryAllocZeroedPage();
+            if(physical_page_num != MEM_FAIL)
+            {
+                *pte = MemorySetupPTE(physical_page_num);
+                return MEM_SUCCESS;
+            }
+        }
+    }
+    return MEM_FAIL;
 }
 
 //----------------------------------------------------------------------
 //  MemoryTranslateUserToSystem
 //	  Translate a user address (in the process referenced by pcb)
-//	  into an OS (physical) address.  Return the physical address.
+//	  into an OS (physical) address.  Return the physical address,
+//	  or 0 if the address isn't mapped and can't be faulted in.
 //----------------------------------------------------------------------
 uint32 MemoryTranslateUserToSystem(PCB *pcb, uint32 addr)
 {
     uint32 physical_addr=0;
     int page_offset = addr & MEM_PAGE_OFFSET_MASK;
-    int page_virtual = addr >> MEM_L1FIELD_FIRST_BITNUM;
-    int pte = pcb->pagetable[page_virtual];
+    uint32 *pte = MemoryGetPTE(pcb, addr >> MEM_L2FIELD_FIRST_BITNUM, 0);
 
     // Debug print statement
     //dbprintf('m', "MemoryTranslateUserToSystem: (PID:%d) function started\n",GetCurrentPid());
 
-    // If PTE invalid, page fault
-    if((pte & MEM_PTE_VALID) == 0) return MemoryPageFaultHandler(pcb);
+    // If PTE invalid, fault the page in just as the user would have
+    if((pte == NULL) || ((*pte & MEM_PTE_VALID) == 0))
+    {
+        if(MemoryFaultIn(pcb, addr) != MEM_SUCCESS) return 0;
+        pte = MemoryGetPTE(pcb, addr >> MEM_L2FIELD_FIRST_BITNUM, 0);
+    }
 
     // Else calculate physical address and return it
-    physical_addr = (uint32)((pte&(~MEM_PAGE_OFFSET_MASK))+page_offset);
+    physical_addr = (uint32)((*pte&(~MEM_PAGE_OFFSET_MASK))+page_offset);
     return physical_addr;
 }
 
@@ -266,8 +593,9 @@ int MemoryCopyUserToSystem (PCB *pcb, unsigned char *from,unsigned char *to, int
 //      Called in traps.c whenever a page fault, or sementation fault
 //      (better known as a "seg fault") occurs.  If the address that was
 //      being accessed is on the stack, we need to allocate a new page 
-//      for the stack.  If it is not on the stack, then this is a legitimate
-//      seg fault and we should kill the process.  Returns MEM_SUCCESS
+//      for the stack.  Code and data pages are filled from the program
+//      image.  Anything else is a legitimate seg fault and we should
+//      kill the process.  Returns MEM_SUCCESS
 //      on success, and kills the current process on failure.  Note that
 //      fault_address is the beginning of the page of the virtual address that 
 //      caused the page fault, i.e. it is the vaddr with the offset zero-ed
@@ -275,142 +603,230 @@ int MemoryCopyUserToSystem (PCB *pcb, unsigned char *from,unsigned char *to, int
 //---------------------------------------------------------------------
 int MemoryPageFaultHandler(PCB *pcb) 
 {
-    // Calculate the address and virt+stack page numbers
     uint32 addr = pcb->currentSavedFrame[PROCESS_STACK_FAULT];
-    uint32 virtual_page_num = addr>>MEM_L1FIELD_FIRST_BITNUM;
-    uint32 physical_page_num;
-    uint32 stack_page_num = pcb->currentSavedFrame[PROCESS_STACK_USER_STACKPOINTER]>>MEM_L1FIELD_FIRST_BITNUM;
 
     // Debug print statement
     dbprintf('m', "MemoryPageFaultHandler: (PID:%d) function started\n",GetCurrentPid());
 
-    // If user stack triggered Page fault, allocate page
-    //  => return MEM_SUCCESS
-    if(virtual_page_num >= stack_page_num)
-    {
-        physical_page_num = MemoryAllocPage();
-        pcb->pagetable[virtual_page_num] = MemorySetupPTE(physical_page_num);
-        return MEM_SUCCESS;
-    }
-    else
-    {
-        // Else, ProcessKill => return MEM_FAIL
-        ProcessKill();
-        return MEM_FAIL;
-    }
+    if(MemoryFaultIn(pcb, addr) == MEM_SUCCESS) return MEM_SUCCESS;
+
+    // Else, ProcessKill => return MEM_FAIL
+    ProcessKill();
+    return MEM_FAIL;
 }
 
 
+//---------------------------------------------------------------------
+//  Heap management.  The heap is a run of virtual pages starting at
+//  MEM_HEAP_VPAGE, mapped as it grows (an sbrk that moves a page at a
+//  time), and heap.pagekind[] says what each mapped page is used for.
+//  Requests of more than half a page get a run of whole pages of
+//  their own.  Smaller ones come from arenas, heap pages each run as
+//  a buddy allocator: blocks are named by the number of the order-0
+//  (32 byte) block they start at, so the buddy of block b of order k
+//  is simply b ^ (1<<k).  Each order has a doubly linked list of its
+//  free blocks, and two bitmaps say where a free block and where an
+//  allocated block starts; the order of either is kept in order[].
+//  An arena only walks up or down the orders, so it's O(log page).
+//  Pages that end up unused at the top of the heap are unmapped and
+//  go back to the page allocator.
+//---------------------------------------------------------------------
+
+//---------------------------------------------------------------------
+//  bookKeeper
+//      Logs what the heap allocator does.  Only printed when the 'h'
+//      debug flag is on (-D h).
+//---------------------------------------------------------------------
 void bookKeeper(int MODE, int order, int addr, int size, int rsize, int ksize, int porder, int paddr, int psize,int border, int baddr, int bsize)
 {
     if(MODE == 0)
     {
         // FREE
-        printf(" Freed the block: ( order = (%d) | addr=(%d) | size=(%d) )\n\n",order,addr,size);
+        dbprintf('h', " Freed the block: ( order = (%d) | addr=(%d) | size=(%d) )\n\n",order,addr,size);
     }
     else if(MODE == 1)
     {
         // MALLOC
         // bookKeeper(1, order, addr, 0, rsize, ksize,0,0,0,0,0,0)
-        printf(" Allocated the block: ( order = (%d) | addr=(%d) | requested-mem-size=(%d) | block-size=(%d) )\n\n",order,addr,rsize,ksize);
+        dbprintf('h', " Allocated the block: ( order = (%d) | addr=(%d) | requested-mem-size=(%d) | block-size=(%d) )\n\n",order,addr,rsize,ksize);
     }
     else if(MODE == 2)
     {
-        // CREATE LEFT CHILD
+        // SPLIT, KEPT THE LEFT HALF
         // bookKeeper(2, order, addr, size,0,0,porder,paddr,psize,0,0,0);
-        printf(" Created a left child node: ( order = (%d) | addr=(%d) | size=(%d) )\n",order,addr,size);
-        printf("            of parent node: ( order = (%d) | addr=(%d) | size=(%d) )\n\n",porder,paddr, psize);
+        dbprintf('h', " Created a left child node: ( order = (%d) | addr=(%d) | size=(%d) )\n",order,addr,size);
+        dbprintf('h', "            of parent node: ( order = (%d) | addr=(%d) | size=(%d) )\n\n",porder,paddr, psize);
     }
     else if(MODE == 3)
     {
-        // CREATE RIGHT CHILD
+        // SPLIT, FREED THE RIGHT HALF
         // bookKeeper(3, order, addr, size,0,0,porder,paddr,psize,0,0,0);
-        printf(" Created a right child node: ( order = (%d) | addr=(%d) | size=(%d) )\n",order,addr,size);
-        printf("             of parent node: ( order = (%d) | addr=(%d) | size=(%d) )\n\n",porder,paddr, psize);
+        dbprintf('h', " Created a right child node: ( order = (%d) | addr=(%d) | size=(%d) )\n",order,addr,size);
+        dbprintf('h', "             of parent node: ( order = (%d) | addr=(%d) | size=(%d) )\n\n",porder,paddr, psize);
     }
     else if(MODE == 4)
     {
         // COALESCED BUDDIES!
         // bookKeeper(4, order, addr, size,0,0,porder,paddr,psize,border,baddr,bsize);
-        printf(" Coalesced buddy nodes: ( order = (%d) | addr=(%d) | size=(%d) )\n",order,addr,size);
-        printf("                        ( order = (%d) | addr=(%d) | size=(%d) )\n",border,baddr,bsize);
-        printf("  into the parent node: ( order = (%d) | addr=(%d) | size=(%d) )\n\n",porder,paddr, psize);
+        dbprintf('h', " Coalesced buddy nodes: ( order = (%d) | addr=(%d) | size=(%d) )\n",order,addr,size);
+        dbprintf('h', "                        ( order = (%d) | addr=(%d) | size=(%d) )\n",border,baddr,bsize);
+        dbprintf('h', "  into the parent node: ( order = (%d) | addr=(%d) | size=(%d) )\n\n",porder,paddr, psize);
     }
 }
 
-int searchForBlocks(BuddyNode * bnode, int memsize)
+// Byte offset in the page and size of block b, order k
+#define HEAP_ADDR(b) ((b) << MEM_HEAP_MIN_BLOCK_BITS)
+#define HEAP_SIZE(k) (0x1 << ((k) + MEM_HEAP_MIN_BLOCK_BITS))
+// Virtual address of heap page hp
+#define HEAP_VADDR(hp) (((hp) + MEM_HEAP_VPAGE) * MEM_PAGESIZE)
+
+static inline int heapTest(uint32 *map, int b) {  return (map[b>>5] >> (b & 0x1F)) & 0x1;  }
+static inline void heapSet(uint32 *map, int b) {  map[b>>5] |= (0x1 << (b & 0x1F));  }
+static inline void heapClear(uint32 *map, int b) {  map[b>>5] &= invert(0x1 << (b & 0x1F));  }
+
+// Puts block b on the free list of order k
+static void heapPush(MemoryHeapArena *a, int b, int k)
 {
-    int heap_address;
+    a->order[b] = k;
+    a->prev[b] = MEM_HEAP_NONE;
+    a->next[b] = a->freelist[k];
+    if(a->freelist[k] != MEM_HEAP_NONE) a->prev[a->freelist[k]] = b;
+    a->freelist[k] = b;
+    heapSet(a->freemap, b);
+}
 
-    if(bnode == NULL) return -1;
+// Takes free block b off the free list of its order
+static void heapUnlink(MemoryHeapArena *a, int b)
+{
+    int k = a->order[b];
+    if(a->prev[b] != MEM_HEAP_NONE) a->next[a->prev[b]] = a->next[b];
+    else a->freelist[k] = a->next[b];
+    if(a->next[b] != MEM_HEAP_NONE) a->prev[a->next[b]] = a->prev[b];
+    heapClear(a->freemap, b);
+}
 
-    // Recursive condition
-    if((bnode->left_child == NULL) && (bnode->used == 0))
+// Allocates a block of order at least order from arena a. Returns
+// its number, or MEM_HEAP_NONE if the arena has no block that big.
+static int heapArenaAlloc(MemoryHeapArena *a, int order, int memsize)
+{
+    int k, b, base = HEAP_VADDR(a->hpage) - HEAP_VADDR(0);
+
+    // Smallest order at or above that with a free block
+    for(k=order; k<=MEM_HEAP_MAX_ORDER && a->freelist[k] == MEM_HEAP_NONE; k++);
+    if(k > MEM_HEAP_MAX_ORDER) return MEM_HEAP_NONE;
+    b = a->freelist[k];
+    heapUnlink(a, b);
+
+    // Split it down, freeing the right halves
+    while(k > order)
     {
-        if((memsize <= bnode->size) && (memsize > (bnode->size/2)))
-        {
-            bnode->used = 1;
-            bookKeeper(1,bnode->order, bnode->addr, 0, memsize, bnode->size, 0,0,0,0,0,0);
-            return bnode->addr;
-        }
-        // We will need to make a lower order node
-        else return -1;
+        k--;
+        heapPush(a, b + (0x1<<k), k);
+        bookKeeper(2, k, base+HEAP_ADDR(b), HEAP_SIZE(k),0,0,k+1,base+HEAP_ADDR(b),HEAP_SIZE(k+1),0,0,0);
+        bookKeeper(3, k, base+HEAP_ADDR(b + (0x1<<k)), HEAP_SIZE(k),0,0,k+1,base+HEAP_ADDR(b),HEAP_SIZE(k+1),0,0,0);
     }
-    // Check the left side of the tree first to see if we have something
-    heap_address = searchForBlocks(bnode->left_child, memsize);
-    if(heap_address > -1) return heap_address;
-    // Check the right side of the tree now...
-    else return searchForBlocks(bnode->right_child, memsize);
+    a->order[b] = order;
+    heapSet(a->usedmap, b);
+    bookKeeper(1, order, base+HEAP_ADDR(b), 0, memsize, HEAP_SIZE(order), 0,0,0,0,0,0);
+    return b;
 }
 
-int makeBlocks(BuddyNode * bnode, PCB * pcb, int memsize)
+// Frees block b of arena a, merging it with its buddy for as long as
+// that's free and whole. Returns the bytes freed, -1 if b isn't an
+// allocated block.
+static int heapArenaFree(MemoryHeapArena *a, int b)
 {
-    int heap_address;
-    BuddyNode * child_L;
-    BuddyNode * child_R;
-    
-    if(bnode == NULL) return -1;
+    int order, k, buddy, base = HEAP_VADDR(a->hpage) - HEAP_VADDR(0);
+
+    if(!heapTest(a->usedmap, b)) return -1;
+    heapClear(a->usedmap, b);
+    order = k = a->order[b];
 
-    // Recursive condition
-    if((bnode->left_child == NULL) && (bnode->used == 0))
+    // Send to bookkeeper
+    bookKeeper(0, order, base+HEAP_ADDR(b), HEAP_SIZE(order),0,0,0,0,0,0,0,0);
+
+    while(k < MEM_HEAP_MAX_ORDER)
     {
-        if((memsize <= bnode->size) && (memsize > (bnode->size/2)))
-        {
-            bnode->used = 1;
-            bookKeeper(1,bnode->order, bnode->addr, 0, memsize, bnode->size, 0,0,0,0,0,0);
-            return bnode->addr;
-        }
-        // We will need to make a lower order node...
-        // First lets check if we cannot split anymore
-        if(memsize > (bnode->size/2)) return -1;
-        if(bnode->order == 0) return -1;
-        // OK, now we can divide again!
-        child_L = &pcb->heap_trees[(bnode->idx)*2];
-        child_L->parent = bnode;
-        child_L->left_child = NULL;
-        child_L->right_child = NULL;
-        child_L->size = bnode->size / 2;
-        child_L->addr = bnode->addr;
-        child_L->order = bnode->order - 1;
-        bookKeeper(2, child_L->order, child_L->addr, child_L->size,0,0,bnode->order,bnode->addr,bnode->size,0,0,0);
-        child_R = &pcb->heap_trees[(bnode->idx)*2+1];
-        child_R->parent = bnode;
-        child_R->left_child = NULL;
-        child_R->right_child = NULL;
-        child_R->size = bnode->size / 2;
-        child_R->addr = bnode->addr + child_R->size;
-        child_R->order = bnode->order - 1;
-        bookKeeper(3, child_R->order, child_R->addr, child_R->size,0,0,bnode->order,bnode->addr,bnode->size,0,0,0);
-
-        bnode->left_child = child_L;
-        bnode->right_child = child_R;
+        buddy = b ^ (0x1<<k);
+        if(!heapTest(a->freemap, buddy) || a->order[buddy] != k) break;
+        heapUnlink(a, buddy);
+        if(buddy < b) b = buddy;
+        bookKeeper(4, k, base+HEAP_ADDR(b), HEAP_SIZE(k),0,0,k+1,base+HEAP_ADDR(b),HEAP_SIZE(k+1),k,base+HEAP_ADDR(b ^ (0x1<<k)),HEAP_SIZE(k));
+        k++;
     }
+    heapPush(a, b, k);
+    return HEAP_SIZE(order);
+}
 
-    // Try recursing down the left side first...
-    heap_address = makeBlocks((bnode->left_child), pcb, memsize);
-    if(heap_address > -1) return heap_address;
-    // Check the right side now...
-    else return makeBlocks((bnode->right_child), pcb, memsize);
+// Marks npages heap pages from hp as kind, with info for the first
+static void heapSetPages(MemoryHeap *heap, int hp, int npages, int kind, int info)
+{
+    int i;
+    for(i=0; i<npages; i++)
+    {
+        heap->pagekind[hp+i] = (i == 0 || kind == MEM_HEAP_PAGE_FREE) ? kind : MEM_HEAP_PAGE_TAIL;
+        heap->pageinfo[hp+i] = (i == 0) ? info : 0;
+    }
+}
+
+// Gives the unused pages at the top of the heap back
+static void heapTrim(PCB *pcb)
+{
+    MemoryHeap *heap = &pcb->heap;
+    uint32 *pte;
+
+    while(heap->npages > 0 && heap->pagekind[heap->npages-1] == MEM_HEAP_PAGE_FREE)
+    {
+        heap->npages--;
+        pcb->npages--;
+        pte = MemoryGetPTE(pcb, heap->npages + MEM_HEAP_VPAGE, 0);
+        MemoryFreePTE(*pte);
+        *pte = 0;
+        dbprintf('h', " Shrank the heap: unmapped addr=(0x%x)\n\n", HEAP_VADDR(heap->npages));
+    }
+}
+
+// Finds npages unused heap pages in a row, first fit, growing the heap
+// if the run has to go at the top. Returns the first heap page, or
+// MEM_FAIL if the heap can't grow that far or memory runs out.
+static int heapGetPages(PCB *pcb, int npages)
+{
+    MemoryHeap *heap = &pcb->heap;
+    int hp, len = 0, page;
+    uint32 *pte;
+
+    for(hp=0; hp<heap->npages; hp++)
+    {
+        if(heap->pagekind[hp] != MEM_HEAP_PAGE_FREE) len = 0;
+        else if(++len == npages) return hp - npages + 1;
+    }
+    // Map pages past the top until the free run at the top is long enough
+    if(heap->npages - len + npages > MEM_HEAP_MAX_PAGES) return MEM_FAIL;
+    while(len < npages)
+    {
+        if((page = MemoryAllocPage()) == MEM_FAIL) {  heapTrim(pcb); return MEM_FAIL;  }
+        if((pte = MemoryGetPTE(pcb, heap->npages + MEM_HEAP_VPAGE, 1)) == NULL)
+        {  MemoryFreePage(page); heapTrim(pcb); return MEM_FAIL;  }
+        *pte = MemorySetupPTE(page);
+        dbprintf('h', " Grew the heap: mapped page (%d) at addr=(0x%x)\n\n", page, HEAP_VADDR(heap->npages));
+        heap->pagekind[heap->npages] = MEM_HEAP_PAGE_FREE;
+        heap->npages++;
+        pcb->npages++;
+        len++;
+    }
+    return heap->npages - npages;
+}
+
+//---------------------------------------------------------------------
+//  MemoryHeapInit
+//      Start pcb off with an empty heap; nothing is mapped until the
+//      first malloc.
+//---------------------------------------------------------------------
+void MemoryHeapInit(PCB *pcb)
+{
+    int i;
+    pcb->heap.npages = 0;
+    for(i=0; i<MEM_HEAP_ARENAS; i++) pcb->heap.arenas[i].hpage = MEM_HEAP_NONE;
 }
 
 //---------------------------------------------------------------------
@@ -420,14 +836,11 @@ int makeBlocks(BuddyNode * bnode, PCB * pcb, int memsize)
 //      to the corresponding starting virtual address of allocated blk.
 //      Blocks must be allocated in multiples of 32 bytes. Round up.
 //---------------------------------------------------------------------
-// Smallest possible block size is determined
-// 4 bytes = smallest possible block
-// size of order-0 block = 32 bytes
-    
-// Highest possible order? 
-// Since the heap is of size 1-page, the heap size is 4KB 
-// 2^0 = 32 bytes, 2^1 = 64 bytes, 2^7 = 128, 128*32 = 4KB
-// Highest posible order == 7
+// An arena is one 4KB page: order-0 blocks are 32 bytes and the whole
+// page is a single order-7 block.  A request takes a block of the
+// smallest order that fits.  If that order's list is empty, the first
+// larger free block is split in half repeatedly, each right half going
+// on the free list one order down, until the left half is small enough.
     
 // Example of user program requesting memory:
 // SPECS: block size = 512 bytes, highest order = 3, heap = 4KB
@@ -444,89 +857,45 @@ int makeBlocks(BuddyNode * bnode, PCB * pcb, int memsize)
 // 10.  |  2  |  2  |  2  |  2 ||| 2  |  2  |  2  |  2  |
 // 11.  |  3  |  3  |  3  |  3  |  3  |  3  |  3  |  3  |
 
-// Easy to implement with a tree: 
-//                      root = MAX_ORDER = 7
-//                         /            \
-//                        6              6
-//                     /     \        /     \
-//                    5       5      5       5
-//                   / \     / \    / \     / \
-//                  4   4   4   4  4   4   4   4 etc...
-// Each node carries metadata:
-//      1. order
-//      2. size
-//      3. inuse 
-//      4. addr 
-//      5. left/right children
-//      6. index (used to aid in multiplication)
-
 void * malloc(int memsize, PCB * pcb)
 {
-    int heap_address;
-    int size;
-    int virtual_address;
-    int physical_address;
+    MemoryHeap *heap = &pcb->heap;
+    MemoryHeapArena *a = NULL;
+    int order, npages, hp, b, i;
 
     // Check input request
-    if((memsize<=0) || (memsize > MEM_PAGESIZE)) return NULL;
-    
-    // Check for bloks of appropriate memory size starting from first node
-    heap_address = searchForBlocks(&pcb->heap_trees[1], memsize);
+    if((memsize<=0) || (memsize > MEM_HEAP_MAX_PAGES * MEM_PAGESIZE)) return NULL;
 
-    // If we found one, then lets return it
-    if(heap_address > -1)
-    {
-        size = pcb->heap_trees[heap_address].size;
-        virtual_address = ((MEM_PAGESIZE * 4)|heap_address);
-        return (void *)virtual_address;
-    }
-    
-    // Else, let's try to make a block that will work
-    heap_address = makeBlocks(&pcb->heap_trees[1], pcb, memsize);
-    if(heap_address > -1)
+    // Big requests get pages of their own
+    if(memsize > MEM_PAGESIZE/2)
     {
-        size = pcb->heap_trees[heap_address].size;
-        virtual_address = ((MEM_PAGESIZE * 4)|heap_address);
-        return (void *)virtual_address;
+        npages = (memsize + MEM_PAGESIZE - 1) / MEM_PAGESIZE;
+        if((hp = heapGetPages(pcb, npages)) == MEM_FAIL) return NULL;
+        heapSetPages(heap, hp, npages, MEM_HEAP_PAGE_RUN, npages);
+        dbprintf('h', " Allocated a page run: ( addr=(0x%x) | requested-mem-size=(%d) | pages=(%d) )\n\n", HEAP_VADDR(hp), memsize, npages);
+        return (void *)HEAP_VADDR(hp);
     }
-    // NOTHING FOUND
-    return NULL;
-}
-
-int freeHelper(BuddyNode * bnode)
-{
-    bnode->used = 0;
-    bnode->left_child = NULL;
-    bnode->right_child = NULL;
 
-    if(bnode->parent != NULL)
+    // Smallest order that holds the request, then the first arena
+    // with a block that big
+    for(order=0; HEAP_SIZE(order) < memsize; order++);
+    for(i=0; i<MEM_HEAP_ARENAS; i++)
     {
-        // Check if we are the left child
-        if(bnode == bnode->parent->left_child)
-        {
-            // Check if we can combine...
-            if(bnode->parent->right_child->used == 0) 
-            { 
-                bookKeeper(4, bnode->order, bnode->addr, bnode->size,0,0,bnode->parent->order, 
-                           bnode->parent->addr,bnode->parent->size,bnode->parent->right_child->order, 
-                           bnode->parent->right_child->addr,bnode->parent->right_child->size);
-                freeHelper(bnode->parent);
-            }   
-        }
-        // Well we must be the right child
-        if(bnode == bnode->parent->right_child)
-        {
-            // Check if we can combine...
-            if(bnode->parent->left_child->used == 0) 
-            { 
-                bookKeeper(4, bnode->order, bnode->addr, bnode->size,0,0,bnode->parent->order, 
-                           bnode->parent->addr,bnode->parent->size,bnode->parent->left_child->order, 
-                           bnode->parent->left_child->addr,bnode->parent->left_child->size);
-                freeHelper(bnode->parent);
-            }
-        }
+        if(heap->arenas[i].hpage == MEM_HEAP_NONE) {  if(a == NULL) a = &heap->arenas[i];  }
+        else if((b = heapArenaAlloc(&heap->arenas[i], order, memsize)) != MEM_HEAP_NONE)
+        {  return (void *)(HEAP_VADDR(heap->arenas[i].hpage) | HEAP_ADDR(b));  }
     }
-    return 1;
+
+    // NOTHING FOUND, start a new arena
+    if(a == NULL || (hp = heapGetPages(pcb, 1)) == MEM_FAIL) return NULL;
+    a->hpage = hp;
+    for(i=0; i<=MEM_HEAP_MAX_ORDER; i++) a->freelist[i] = MEM_HEAP_NONE;
+    bzero((char *)(a->freemap), sizeof(a->freemap));
+    bzero((char *)(a->usedmap), sizeof(a->usedmap));
+    heapPush(a, 0, MEM_HEAP_MAX_ORDER);
+    heapSetPages(heap, hp, 1, MEM_HEAP_PAGE_ARENA, a - heap->arenas);
+    b = heapArenaAlloc(a, order, memsize);
+    return (void *)(HEAP_VADDR(hp) | HEAP_ADDR(b));
 }
 
 //---------------------------------------------------------------------
@@ -544,28 +913,35 @@ int freeHelper(BuddyNode * bnode)
 //---------------------------------------------------------------------
 int mfree(void * ptr, PCB * pcb)
 {
-    int size_freed;
-    int i;
-    int order;
-    int heap_address;
-    int virtual_address;
-    int physical_address;
-    BuddyNode * bnode;
-
-    heap_address = ((int)ptr & MEM_PAGE_OFFSET_MASK);
-
-    // Find the tree node with the heap_address
-    for(i=1; i<=MEM_MAX_HEAP_NODES; i++)
+    MemoryHeap *heap = &pcb->heap;
+    MemoryHeapArena *a;
+    int offset = ((int)ptr & MEM_PAGE_OFFSET_MASK);
+    int hp = ((int)ptr >> MEM_L2FIELD_FIRST_BITNUM) - MEM_HEAP_VPAGE;
+    int freed;
+
+    // ptr has to be in the heap, at the start of an allocated block
+    if(hp < 0 || hp >= heap->npages) return -1;
+    if(heap->pagekind[hp] == MEM_HEAP_PAGE_RUN)
     {
-        if(pcb->heap_trees[i].addr == heap_address)
-        {  bnode =  &(pcb->heap_trees[i]);  }
+        if(offset != 0) return -1;
+        freed = heap->pageinfo[hp] * MEM_PAGESIZE;
+        dbprintf('h', " Freed a page run: ( addr=(0x%x) | pages=(%d) )\n\n", HEAP_VADDR(hp), heap->pageinfo[hp]);
+        heapSetPages(heap, hp, heap->pageinfo[hp], MEM_HEAP_PAGE_FREE, 0);
+    }
+    else if(heap->pagekind[hp] == MEM_HEAP_PAGE_ARENA)
+    {
+        if((offset & (HEAP_SIZE(0)-1)) != 0) return -1;
+        a = &heap->arenas[heap->pageinfo[hp]];
+        if((freed = heapArenaFree(a, offset >> MEM_HEAP_MIN_BLOCK_BITS)) < 0) return -1;
+        // An arena that's all free again gives its page up
+        if(a->freelist[MEM_HEAP_MAX_ORDER] != MEM_HEAP_NONE)
+        {
+            a->hpage = MEM_HEAP_NONE;
+            heapSetPages(heap, hp, 1, MEM_HEAP_PAGE_FREE, 0);
+        }
     }
-
-    // Send to bookkeeper
-    bookKeeper(0,bnode->order, heap_address, bnode->size,0,0,0,0,0,0,0,0);
-    size_freed = bnode->size;
-
-    if(freeHelper(bnode) == 1) return size_freed;
     else return -1;
-}
 
+    heapTrim(pcb);
+    return freed;
+}
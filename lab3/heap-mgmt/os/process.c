@@ -15,14 +15,12 @@
 #include "memory.h"
 #include "filesys.h"
 #include "clock.h"
+#include "slab.h"
 
 // Pointer to the current PCB.  This is used by the assembly language
 // routines for context switches.
 PCB		*currentPCB;
 
-// List of free PCBs.
-static Queue	freepcbs;
-
 // List of processes that are ready to run (ie, not waiting for something
 // to happen).
 static Queue	runQueue;
@@ -36,9 +34,12 @@ static Queue	waitQueue;
 // the reason that we need a separate queue for processes about to die.
 static Queue	zombieQueue;
 
-// Static area for all process control blocks.  This is necessary because
-// we can't use malloc() inside the OS.
-static PCB	pcbs[PROCESS_MAX_PROCS];
+// Process control blocks come from this cache, and a process id is its
+// PCB's handle in the cache.
+static SlabCache pcbcache;
+
+// Quanta since a low priority process last ran
+static int lowpriwait = 0;
 
 // Default value for scheduler quantum.  This could be set to any value.
 // In fact, it could even be dynamic, though that would require modifying
@@ -53,44 +54,27 @@ int ProcessGetCodeInfo(const char *file, uint32 *startAddr, uint32 *codeStart, u
 int ProcessGetFromFile(int fd, unsigned char *buf, uint32 *addr, int max);
 uint32 get_argument(char *string);
 
+int ProcessImageGet(char *name);
+
+// Program image cache, see ProcessImageGet
+static ProcessImage images[PROCESS_MAX_IMAGES];
+static int imagestamp = 0;
+
 //----------------------------------------------------------------------
 //
 //	ProcessModuleInit
 //
-//	Initialize the process module.  This involves initializing all
-//	of the process control blocks to appropriate values (ie, free
-//	and available).  We also need to initialize all of the queues.
+//	Initialize the process module.  This involves setting up the
+//	cache that process control blocks are allocated from, and
+//	initializing all of the queues.
 //
 //----------------------------------------------------------------------
 void ProcessModuleInit () {
-  int		i;
-
   dbprintf ('p', "Entering ProcessModuleInit\n");
-  AQueueInit (&freepcbs);
   AQueueInit (&runQueue);
   AQueueInit (&waitQueue);
   AQueueInit (&zombieQueue);
-  // For each PCB slot in the global pcbs array:
-  for (i = 0; i < PROCESS_MAX_PROCS; i++) {
-    dbprintf ('p', "Initializing PCB %d @ 0x%x.\n", i, (int)&(pcbs[i]));
-    // First, set the internal PCB link pointer to a newly allocated link
-    if ((pcbs[i].l = AQueueAllocLink(&pcbs[i])) == NULL) {
-      printf("FATAL ERROR: could not allocate link in ProcessModuleInit!\n");
-      exitsim();
-    }
-    // Next, set the pcb to be available
-    pcbs[i].flags = PROCESS_STATUS_FREE;
-
-    //-------------------------------------------------------
-    // STUDENT: Initialize the PCB's page table here.
-    //-------------------------------------------------------
-
-    // Finally, insert the link into the queue
-    if (AQueueInsertFirst(&freepcbs, pcbs[i].l) != QUEUE_SUCCESS) {
-      printf("FATAL ERROR: could not insert PCB link into queue in ProcessModuleInit!\n");
-      exitsim();
-    }
-  }
+  SlabCacheInit (&pcbcache, "pcbs", sizeof(PCB));
   // There are no processes running at this point, so currentPCB=NULL
   currentPCB = NULL;
   dbprintf ('p', "Leaving ProcessModuleInit\n");
@@ -117,43 +101,25 @@ void ProcessSetStatus (PCB *pcb, int status) {
 void ProcessFreeResources (PCB *pcb) 
 {
     int i = 0;
-    int userstack_page_idx;
-
-    // Allocate a new link for this pcb on the freepcbs queue
-    if ((pcb->l = AQueueAllocLink(pcb)) == NULL) {
-        printf("FATAL ERROR: could not get Queue Link in ProcessFreeResources!\n");
-        exitsim();
-    }
-    // Set the pcb's status to available
-    pcb->flags = PROCESS_STATUS_FREE;
-    // Insert the link into the freepcbs queue
-    if (AQueueInsertLast(&freepcbs, pcb->l) != QUEUE_SUCCESS) {
-        printf("FATAL ERROR: could not insert PCB link into freepcbs queue in ProcessFreeResources!\n");
-        exitsim();
-    }
 
     //------------------------------------------------------------
     // STUDENT: Free any memory resources on process death here.
     //------------------------------------------------------------
+    // Let go of the program image
+    if(pcb->image >= 0) {  images[pcb->image].users--; pcb->image = -1;  }
+
     // Free system stack pages
     for(i=0; i<PROCESS_NUMPAGES_SYSTEM_STACK; i++)
     {  MemoryFreePage((pcb->sysStackArea) / MEM_PAGESIZE); (pcb->npages)--;  }
 
-    // Free user stack pages
-    userstack_page_idx = pcb->sysStackPtr[PROCESS_STACK_USER_STACKPOINTER] >> MEM_L1FIELD_FIRST_BITNUM;
-    while((userstack_page_idx) < (MEM_MAX_VIRTUAL_ADDRESS >> MEM_L1FIELD_FIRST_BITNUM))
-    {  
-        MemoryFreePage(((pcb->pagetable)[userstack_page_idx]) >> (MEM_L1FIELD_FIRST_BITNUM));
-        userstack_page_idx++;
-    }
-    MemoryFreePage(((pcb->pagetable)[(PROCESS_PAGETABLESIZE-1)]) >> MEM_L1FIELD_FIRST_BITNUM);
-
-    // Free user code and global data pages
-    for(i=0; i<PROCESS_NUMPAGES_USERCODE_GLOBALDATA; i++)
-    {  MemoryFreePTE((pcb->pagetable)[i]); (pcb->npages)--;  }
+    // Free user code, global data and stack pages, and their L2 tables
+    MemoryFreePageTables(pcb);
+    pcb->npages = 0;
 
     pcb->sysStackArea = 0;
     ProcessSetStatus (pcb, PROCESS_STATUS_FREE);
+    // Give the PCB back to the cache
+    SlabFree(&pcbcache, pcb);
 }
 
 //----------------------------------------------------------------------
@@ -172,6 +138,24 @@ void ProcessSetResult (PCB * pcb, uint32 result) {
   pcb->currentSavedFrame[PROCESS_STACK_IREG+1] = result;
 }
 
+//----------------------------------------------------------------------
+//
+//	ProcessQueueHasNormal
+//
+//	Return 1 if the queue holds a process that isn't low priority.
+//
+//----------------------------------------------------------------------
+static int ProcessQueueHasNormal (Queue *q) {
+  Link *l;
+
+  for (l = AQueueFirst(q); l != NULL; l = AQueueNext(l)) {
+    if (!(((PCB *)AQueueObject(l))->flags & PROCESS_TYPE_LOWPRI)) {
+      return 1;
+    }
+  }
+  return 0;
+}
+
 //----------------------------------------------------------------------
 //
 //	ProcessSchedule
@@ -203,19 +187,21 @@ void ProcessSchedule () {
 
   // The OS exits if there's no runnable process.  This is a feature, not a
   // bug.  An easy solution to allowing no runnable "user" processes is to
-  // have an "idle" process that's simply an infinite loop.
-  if (AQueueEmpty(&runQueue)) {
-    if (!AQueueEmpty(&waitQueue)) {
+  // have an "idle" process that's simply an infinite loop.  Low priority
+  // processes don't count, they only do background work.
+  if (!ProcessQueueHasNormal(&runQueue)) {
+    if (ProcessQueueHasNormal(&waitQueue)) {
       printf("FATAL ERROR: no runnable processes, but there are sleeping processes waiting!\n");
       l = AQueueFirst(&waitQueue);
       while (l != NULL) {
         pcb = AQueueObject(l);
-        printf("Sleeping process %d: ", i++); printf("PID = %d\n", (int)(pcb - pcbs));
+        printf("Sleeping process %d: ", i++); printf("PID = %d\n", GetPidFromAddress(pcb));
         l = AQueueNext(l);
       }
       exitsim();
     }
     printf ("No runnable processes - exiting!\n");
+    SlabPrintStats ();
     exitsim ();	// NEVER RETURNS
   }
 
@@ -225,8 +211,19 @@ void ProcessSchedule () {
     AQueueMoveAfter(&runQueue, AQueueLast(&runQueue), AQueueFirst(&runQueue));
   }
 
+  // Pass over low priority processes, unless they've waited
+  // PROCESS_LOWPRI_PERIOD quanta.  There's a normal process to stop at.
+  if (++lowpriwait < PROCESS_LOWPRI_PERIOD) {
+    while (((PCB *)AQueueObject(AQueueFirst(&runQueue)))->flags & PROCESS_TYPE_LOWPRI) {
+      AQueueMoveAfter(&runQueue, AQueueLast(&runQueue), AQueueFirst(&runQueue));
+    }
+  }
+
   // Now, run the one at the head of the queue.
   pcb = (PCB *)AQueueObject(AQueueFirst(&runQueue));
+  if (pcb->flags & PROCESS_TYPE_LOWPRI) {
+    lowpriwait = 0;
+  }
   currentPCB = pcb;
   dbprintf ('p',"About to switch to PCB 0x%x,flags=0x%x @ 0x%x\n",
 	    (int)pcb, pcb->flags, (int)(pcb->sysStackPtr[PROCESS_STACK_IAR]));
@@ -291,7 +288,7 @@ void ProcessSuspend (PCB *suspend) {
 //
 //----------------------------------------------------------------------
 void ProcessWakeup (PCB *wakeup) {
-  dbprintf ('p',"Waking up PID %d.\n", (int)(wakeup - pcbs));
+  dbprintf ('p',"Waking up PID %d.\n", GetPidFromAddress(wakeup));
   // Make sure it's not yet a runnable process.
   ASSERT (wakeup->flags & PROCESS_STATUS_WAITING, "Trying to wake up a non-sleeping process!\n");
   ProcessSetStatus (wakeup, PROCESS_STATUS_RUNNABLE);
@@ -369,12 +366,7 @@ static void ProcessExit () {
 //----------------------------------------------------------------------
 int ProcessFork (VoidFunc func, uint32 param, char *name, int isUser) 
 {
-    int i;                   // Loop index variable
-    int fd, n;               // Used for reading code from files.
-    int start, codeS, codeL; // Used for reading code from files.
-    int dataS, dataL;        // Used for reading code from files.
-    int addr = 0;            // Used for reading code from files.
-    unsigned char buf[100];  // Used for reading code from files.
+    int start;               // Entry point of the program image.
     uint32 *stackframe;      // Stores address of current stack frame.
     PCB *pcb;                // Holds pcb while we build it for this process.
     int intrs;               // Stores previous interrupt settings.
@@ -401,13 +393,10 @@ int ProcessFork (VoidFunc func, uint32 param, char *name, int isUser)
     dbprintf ('I', "Old interrupt value was 0x%x.\n", intrs);
     dbprintf ('p', "Entering ProcessFork args=0x%x 0x%x %s %d\n", (int)func,param, name, isUser);
     
-    // Get a free PCB for the new process
-    if (AQueueEmpty(&freepcbs)) 
-    {  printf ("FATAL error: no free processes!\n"); exitsim ();  }	// NEVER RETURNS!
-    pcb = (PCB *)AQueueObject(AQueueFirst (&freepcbs));
-    dbprintf ('p', "Got a link @ 0x%x\n", (int)(pcb->l));
-    if (AQueueRemove (&(pcb->l)) != QUEUE_SUCCESS) 
-    {  printf("FATAL ERROR: could not remove link from freepcbsQueue in ProcessFork!\n"); exitsim();  }
+    // Get a new PCB for the process, it comes zeroed
+    if ((pcb = (PCB *)SlabAlloc(&pcbcache)) == NULL) 
+    {  printf ("FATAL error: no memory for a new process!\n"); exitsim ();  }	// NEVER RETURNS!
+    pcb->image = -1;
     
     // This prevents someone else from grabbing this process
     ProcessSetStatus(pcb, PROCESS_STATUS_RUNNABLE);
@@ -423,8 +412,9 @@ int ProcessFork (VoidFunc func, uint32 param, char *name, int isUser)
     //----------------------------------------------------------------------
     // This section initializes the memory for this process
     //----------------------------------------------------------------------
-    // Allocate 1 page for system stack, 1 page for user stack (at top of
-    // virtual address space), and 4 pages for user code and global data
+    // Allocate 1 page for system stack and 1 page for user stack (at top
+    // of virtual address space).  The 4 pages for user code and global
+    // data are demand-loaded.
 
     //---------------------------------------------------------
     // STUDENT: allocate pages for a new process here.  The
@@ -432,69 +422,35 @@ int ProcessFork (VoidFunc func, uint32 param, char *name, int isUser)
     // equal to the last 4-byte-aligned address in physical page
     // for the system stack.
     //---------------------------------------------------------
-   
-    // Allocate pages for user code and global data
-    for(i=0; i<PROCESS_NUMPAGES_USERCODE_GLOBALDATA; i++)
-    {
-        // Allocate a new page, check for error
-        newPage = MemoryAllocPage();
-        if(newPage == 0)
-        {  printf("FATAL: could not allocate memory - no free pages!\n"); exitsim();  }
-        
-        // Add page number to PCB pagetable
-        pcb->pagetable[i] = MemorySetupPTE(newPage);
-     
-        // Increment page counter
-        pcb->npages++;
-        
-        // Debug print statement
-        dbprintf ('m', "ProcessFork: (PID:%d), (UserCodeGloData:%d), (npages:%d)\n", GetCurrentPid(), newPage, pcb->npages);
-    }
 
-    // Allocate a page for the heap
-    newPage = MemoryAllocPage();
-    if(newPage == 0)
-    {  printf("FATAL: could not allocate memory - no free pages!\n"); exitsim();  }
-    // Add page number to PCB pagetable
-    pcb->pagetable[4] = MemorySetupPTE(newPage);
-    // Increment page counter
-    pcb->npages++;
-
-    // Initialize the BuddyNode for heap
-    for(i=1; i <= MEM_MAX_HEAP_NODES; i++)
-    {
-        pcb->heap_trees[i].parent = NULL;
-        pcb->heap_trees[i].left_child = NULL;
-        pcb->heap_trees[i].right_child = NULL;
-        pcb->heap_trees[i].size = -1;
-        pcb->heap_trees[i].idx = i;
-        pcb->heap_trees[i].addr = -1;
-        pcb->heap_trees[i].used = 0;
-        pcb->heap_trees[i].order = -1;
-    }
+    // No L2 tables yet, MemoryGetPTE adds them as pages are mapped
+    bzero((char *)(pcb->pagetable), sizeof(pcb->pagetable));
+   
+    // User code and global data pages stay invalid, they're filled in
+    // from the program image as they're touched (ProcessImageFault)
+    pcb->image = -1;
 
-    pcb->heap_trees[1].size = MEM_PAGESIZE;
-    pcb->heap_trees[1].addr = 0;
-    pcb->heap_trees[1].order = 7;
+    // The heap starts out empty, malloc maps pages as it grows
+    MemoryHeapInit(pcb);
 
     // Debug print statement
     dbprintf ('m', "ProcessFork: (PID:%d) about to start allocating pages...\n", GetCurrentPid());
 
-    // Allocate page for user stack, check for error
-    newPage = MemoryAllocPage();
-    if(newPage == 0)
+    // Allocate a zeroed page for user stack, check for error
+    newPage = MemoryAllocZeroedPage();
+    if(newPage == MEM_FAIL)
     {  printf("FATAL: could not allocate memory - no free pages!\n"); exitsim();  }
     pcb->npages++;
     
     // User stack page goes on top of virtual address space
-    pcb->pagetable[MEM_MAX_VIRTUAL_ADDRESS >> MEM_L1FIELD_FIRST_BITNUM] = MemorySetupPTE(newPage);
+    *MemoryGetPTE(pcb, MEM_MAX_VIRTUAL_ADDRESS >> MEM_L2FIELD_FIRST_BITNUM, 1) = MemorySetupPTE(newPage);
 
     // Debug print statement
     dbprintf ('m', "ProcessFork: (PID:%d), (UserStackPage:%d), (npages:%d)\n", GetCurrentPid(), newPage, pcb->npages);
 
     // Allocate page for system stack
     newPage = MemoryAllocPage();
-    if(newPage == 0)
+    if(newPage == MEM_FAIL)
     {  printf("FATAL: could not allocate memory - no free pages!\n"); exitsim();  }
     pcb->npages++;
    
@@ -534,33 +490,20 @@ int ProcessFork (VoidFunc func, uint32 param, char *name, int isUser)
     // stack frame.
     //----------------------------------------------------------------------
     stackframe[PROCESS_STACK_PTBASE] = (uint32)&(pcb->pagetable[0]);
-    stackframe[PROCESS_STACK_PTBITS] = (MEM_L1FIELD_FIRST_BITNUM | MEM_L1FIELD_FIRST_BITNUM << 16);
-    stackframe[PROCESS_STACK_PTSIZE] = PROCESS_PAGETABLESIZE;
+    stackframe[PROCESS_STACK_PTBITS] = (MEM_L1FIELD_FIRST_BITNUM | MEM_L2FIELD_FIRST_BITNUM << 16);
+    stackframe[PROCESS_STACK_PTSIZE] = MEM_L1TABLE_SIZE;
 
 
     if (isUser) 
     {
         dbprintf ('p', "About to load %s\n", name);
-        fd = ProcessGetCodeInfo (name, &start, &codeS, &codeL, &dataS, &dataL);
-        if (fd < 0) 
+        if ((pcb->image = ProcessImageGet (name)) < 0) 
         {
             // Free newpage and pcb so we don't run out...
             ProcessFreeResources (pcb);
             return (-1);
         }
-
-        dbprintf ('p', "File %s -> start=0x%08x\n", name, start);
-        dbprintf ('p', "File %s -> code @ 0x%08x (size=0x%08x)\n", name, codeS, codeL);
-        dbprintf ('p', "File %s -> data @ 0x%08x (size=0x%08x)\n", name, dataS, dataL);
-
-        while ((n = ProcessGetFromFile (fd, buf, &addr, sizeof (buf))) > 0) 
-        {
-            dbprintf ('p', "Placing %d bytes at vaddr %08x.\n", n, addr - n);
-            // Copy the data to user memory.  Note that the user memory needs to
-            // have enough space so that this copy will succeed!
-            MemoryCopySystemToUser (pcb, buf, (char *)(addr - n), n);
-        }
-        FsClose (fd);
+        start = images[pcb->image].start;
         stackframe[PROCESS_STACK_ISR] = PROCESS_INIT_ISR_USER;
 
         //----------------------------------------------------------------------
@@ -680,9 +623,8 @@ int ProcessFork (VoidFunc func, uint32 param, char *name, int isUser)
     }
 
     dbprintf ('p', "Leaving ProcessFork (%s)\n", name);
-    // Return the process number (found by subtracting the PCB number
-    // from the base of the PCB array).
-    return (pcb - pcbs);
+    // Return the process number, the PCB's handle in the cache
+    return GetPidFromAddress(pcb);
 }
 
 //----------------------------------------------------------------------
@@ -756,6 +698,230 @@ ProcessGetCodeInfo (const char *file, uint32 *startAddr,
 }
 
 
+//----------------------------------------------------------------------
+//
+//	ProcessImageEvict
+//
+//	Drop an unused image from the cache.  Frames still mapped by a
+//	process live on until it lets go of them too.
+//
+//----------------------------------------------------------------------
+static void
+ProcessImageEvict (int idx)
+{
+  int		i;
+
+  dbprintf ('p', "Evicting image %s from the cache\n", images[idx].name);
+  for (i = 0; i < PROCESS_NUMPAGES_USERCODE_GLOBALDATA; i++) {
+    if (images[idx].pages[i] != MEM_FAIL) {
+      MemoryFreePage (images[idx].pages[i]);
+      images[idx].pages[i] = MEM_FAIL;
+    }
+  }
+  images[idx].name[0] = '\0';
+}
+
+//----------------------------------------------------------------------
+//
+//	ProcessImageAllocPage
+//
+//	Allocate a zeroed page for an image being loaded, evicting the
+//	oldest images no process is running until one comes free.
+//
+//----------------------------------------------------------------------
+static int
+ProcessImageAllocPage ()
+{
+  int		page, i, victim;
+
+  while ((page = MemoryAllocZeroedPage ()) == MEM_FAIL) {
+    victim = -1;
+    for (i = 0; i < PROCESS_MAX_IMAGES; i++) {
+      if ((images[i].name[0] != '\0') && (images[i].users == 0) &&
+	  ((victim < 0) || (images[i].lastuse < images[victim].lastuse))) {
+	victim = i;
+      }
+    }
+    if (victim < 0) {
+      return (MEM_FAIL);
+    }
+    ProcessImageEvict (victim);
+  }
+  return (page);
+}
+
+//----------------------------------------------------------------------
+//
+//	ProcessImageLoad
+//
+//	Read and parse the executable file into the pages of image slot
+//	idx.  Pages holding nothing but code are marked for read-only
+//	sharing.  Returns PROCESS_FAIL if the file can't be read, is
+//	bigger than the code and data area, or memory runs out.
+//
+//----------------------------------------------------------------------
+static int
+ProcessImageLoad (int idx, char *name)
+{
+  ProcessImage	*img = &images[idx];
+  int		fd, n, i, len, vpage;
+  uint32	addr = 0, vaddr;
+  uint32	start, codeS, codeL, dataS, dataL;
+  unsigned char	buf[100];
+
+  for (i = 0; i < PROCESS_NUMPAGES_USERCODE_GLOBALDATA; i++) {
+    img->pages[i] = MEM_FAIL;
+  }
+  if ((fd = ProcessGetCodeInfo (name, &start, &codeS, &codeL, &dataS, &dataL)) < 0) {
+    return (PROCESS_FAIL);
+  }
+  dbprintf ('p', "File %s -> start=0x%08x\n", name, start);
+  dbprintf ('p', "File %s -> code @ 0x%08x (size=0x%08x)\n", name, codeS, codeL);
+  dbprintf ('p', "File %s -> data @ 0x%08x (size=0x%08x)\n", name, dataS, dataL);
+  img->start = start;
+  img->users = 0;
+
+  while ((n = ProcessGetFromFile (fd, buf, &addr, sizeof (buf))) > 0) {
+    dbprintf ('p', "Placing %d bytes at vaddr %08x.\n", n, addr - n);
+    // Copy the bytes into the image, a page at a time
+    for (i = 0; i < n; i += len) {
+      vaddr = addr - n + i;
+      vpage = vaddr >> MEM_L2FIELD_FIRST_BITNUM;
+      if (vpage >= PROCESS_NUMPAGES_USERCODE_GLOBALDATA) {
+	printf ("ProcessImageLoad: %s doesn't fit in %d pages!\n", name,
+		PROCESS_NUMPAGES_USERCODE_GLOBALDATA);
+	FsClose (fd);
+	ProcessImageEvict (idx);
+	return (PROCESS_FAIL);
+      }
+      if (img->pages[vpage] == MEM_FAIL) {
+	if ((img->pages[vpage] = ProcessImageAllocPage ()) == MEM_FAIL) {
+	  printf ("ProcessImageLoad: no free pages to load %s!\n", name);
+	  FsClose (fd);
+	  ProcessImageEvict (idx);
+	  return (PROCESS_FAIL);
+	}
+      }
+      len = min (n - i, MEM_PAGESIZE - (vaddr & MEM_PAGE_OFFSET_MASK));
+      bcopy ((char *)(buf + i), (char *)(img->pages[vpage] * MEM_PAGESIZE +
+				  (vaddr & MEM_PAGE_OFFSET_MASK)), len);
+    }
+  }
+  FsClose (fd);
+  // Only named once it's complete, so it can't be evicted while loading
+  dstrncpy (img->name, name, sizeof (img->name) - 1);
+  img->name[sizeof (img->name) - 1] = '\0';
+
+  // A page can be shared if it lies entirely within the code section
+  for (i = 0; i < PROCESS_NUMPAGES_USERCODE_GLOBALDATA; i++) {
+    vaddr = i * MEM_PAGESIZE;
+    img->readonly[i] = ((img->pages[i] != MEM_FAIL) && (vaddr >= codeS) &&
+			(vaddr + MEM_PAGESIZE <= codeS + codeL) &&
+			((vaddr + MEM_PAGESIZE <= dataS) || (vaddr >= dataS + dataL)));
+  }
+  return (PROCESS_SUCCESS);
+}
+
+//----------------------------------------------------------------------
+//
+//	ProcessImageGet
+//
+//	Find the cached image of executable name, loading it into a free
+//	slot (or the oldest unused one) if it isn't cached yet.  Returns
+//	the image's index with a use counted on it, or -1 on failure.
+//
+//----------------------------------------------------------------------
+int
+ProcessImageGet (char *name)
+{
+  int		i, idx = -1;
+
+  for (i = 0; i < PROCESS_MAX_IMAGES; i++) {
+    if ((images[i].name[0] != '\0') &&
+	(dstrncmp (images[i].name, name, sizeof (images[i].name)) == 0)) {
+      break;
+    }
+    if ((images[i].name[0] == '\0') && (idx < 0)) {
+      idx = i;
+    }
+  }
+  if (i < PROCESS_MAX_IMAGES) {
+    idx = i;
+    dbprintf ('p', "Image %s is cached in slot %d\n", name, idx);
+  } else {
+    // Not cached: take a free slot, or else throw out the oldest unused image
+    if (idx < 0) {
+      for (i = 0; i < PROCESS_MAX_IMAGES; i++) {
+	if ((images[i].users == 0) &&
+	    ((idx < 0) || (images[i].lastuse < images[idx].lastuse))) {
+	  idx = i;
+	}
+      }
+    }
+    if (idx < 0) {
+      printf ("ProcessImageGet: no free image slot for %s!\n", name);
+      return (-1);
+    }
+    if (images[idx].name[0] != '\0') {
+      ProcessImageEvict (idx);
+    }
+    if (ProcessImageLoad (idx, name) != PROCESS_SUCCESS) {
+      return (-1);
+    }
+  }
+  images[idx].users++;
+  images[idx].lastuse = ++imagestamp;
+  return (idx);
+}
+
+//----------------------------------------------------------------------
+//
+//	ProcessImageFault
+//
+//	Fill in virtual page vpage of pcb's code and global data area from
+//	its program image.  Code pages map the cached frame itself, read
+//	only.  Everything else gets a private copy, zeroed where the image
+//	has no bytes.  Returns MEM_SUCCESS or MEM_FAIL.
+//
+//----------------------------------------------------------------------
+int
+ProcessImageFault (PCB *pcb, int vpage)
+{
+  ProcessImage	*img;
+  uint32	*pte;
+  int		page;
+
+  if ((pcb->image < 0) || (vpage >= PROCESS_NUMPAGES_USERCODE_GLOBALDATA)) {
+    return (MEM_FAIL);
+  }
+  img = &images[pcb->image];
+  if ((pte = MemoryGetPTE (pcb, vpage, 1)) == NULL) {
+    return (MEM_FAIL);
+  }
+  if (img->readonly[vpage]) {
+    *pte = MemorySetupPTE (img->pages[vpage]) | MEM_PTE_READONLY;
+    MemorySharePage (*pte);
+  } else {
+    if (img->pages[vpage] == MEM_FAIL) {
+      // No bytes in the file, so the page starts out zeroed
+      if ((page = MemoryAllocZeroedPage ()) == MEM_FAIL) {
+	return (MEM_FAIL);
+      }
+    } else {
+      if ((page = MemoryAllocPage ()) == MEM_FAIL) {
+	return (MEM_FAIL);
+      }
+      bcopy ((char *)(img->pages[vpage] * MEM_PAGESIZE),
+	     (char *)(page * MEM_PAGESIZE), MEM_PAGESIZE);
+    }
+    *pte = MemorySetupPTE (page);
+  }
+  pcb->npages++;
+  dbprintf ('m', "ProcessImageFault: (PID:%d) page %d of %s%s\n", GetCurrentPid(),
+	    vpage, img->name, img->readonly[vpage] ? " (shared)" : "");
+  return (MEM_SUCCESS);
+}
+
 //----------------------------------------------------------------------
 //
 //	ProcessGetFromFile
@@ -880,6 +1046,7 @@ void main (int argc, char *argv[])
   int numargs=0;
   char allargs[SIZE_ARG_BUFF];
   int allargs_offset = 0;
+  int membench = 0;
   
   debugstr[0] = '\0';
 
@@ -928,6 +1095,9 @@ void main (int argc, char *argv[])
 	close (fd);
 	break;
       }
+      case 'm':
+	membench = dstrtol (argv[++i], (void *)0, 0);
+	break;
       case 'u':
 	userprog = argv[++i];
         base = i; // Save the location of the user program's name 
@@ -981,6 +1151,12 @@ void main (int argc, char *argv[])
   } else {
     dbprintf('i', "No user program passed!\n");
   }
+  // Stress the page allocator if asked to (-m rounds)
+  if (membench > 0) {
+    ProcessFork(MemoryBenchmark, membench, "membench", 0);
+  }
+  // Keep a pool of zeroed pages filled in the background
+  ProcessSetLowPriority(ProcessFork(MemoryZeroer, 0, "zeroer", 0));
   ClkStart();
   dbprintf ('i', "Set timer quantum to %d, about to run first process.\n",
 	    processQuantum);
@@ -992,12 +1168,12 @@ void main (int argc, char *argv[])
 
 unsigned GetCurrentPid()
 {
-  return (unsigned)(currentPCB - pcbs);
+  return (unsigned)SlabIndex(&pcbcache, currentPCB);
 }
 
 unsigned findpid(PCB *pcb)
 {
-  return (unsigned)(pcb - pcbs);
+  return (unsigned)SlabIndex(&pcbcache, pcb);
 }
 
 
@@ -1038,8 +1214,24 @@ uint32 get_argument(char *string) {
 }
 
 
+//----------------------------------------------------------------------
+//
+//	ProcessSetLowPriority
+//
+//	Mark a process as low priority, so the scheduler passes it over
+//	while other processes are runnable.
+//
+//----------------------------------------------------------------------
+void ProcessSetLowPriority (int pid) {
+  PCB *pcb = (PCB *)SlabLookup(&pcbcache, pid);
+
+  if (pcb != NULL) {
+    pcb->flags |= PROCESS_TYPE_LOWPRI;
+  }
+}
+
 int GetPidFromAddress(PCB *pcb) {
-  return (int)(pcb - pcbs);
+  return SlabIndex(&pcbcache, pcb);
 }
 
 //--------------------------------------------------------------------------
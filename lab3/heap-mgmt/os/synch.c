@@ -10,30 +10,26 @@
 #include "process.h"
 #include "synch.h"
 #include "queue.h"
+#include "slab.h"
 
-static Sem sems[MAX_SEMS]; 	// All semaphores in the system
-static Lock locks[MAX_LOCKS];   // All locks in the system
-static Cond conds[MAX_LOCKS];   // All conds in the system
+// Semaphores, locks and conds come from these caches, and a handle is
+// the object's handle in its cache.
+static SlabCache semcache;
+static SlabCache lockcache;
+static SlabCache condcache;
 
 extern struct PCB *currentPCB; 
 //----------------------------------------------------------------------
 //	SynchModuleInit
 //
-//	Initializes the synchronization primitives: the semaphores
+//	Initializes the synchronization primitives: the semaphores, locks
+//	and conds caches
 //----------------------------------------------------------------------
 int SynchModuleInit() {
-  int i; // Loop Index variable
   dbprintf ('p', "SynchModuleInit: Entering SynchModuleInit\n");
-  for(i=0; i<MAX_SEMS; i++) {
-    sems[i].inuse = 0;
-  }
-  for(i=0; i<MAX_LOCKS; i++) {
-    locks[i].inuse = 0;
-    locks[i].pid = 0;
-  }
-  for(i=0; i<MAX_CONDS; i++) {
-    conds[i].inuse = 0;
-  }
+  SlabCacheInit(&semcache, "sems", sizeof(Sem));
+  SlabCacheInit(&lockcache, "locks", sizeof(Lock));
+  SlabCacheInit(&condcache, "conds", sizeof(Cond));
   dbprintf ('p', "SynchModuleInit: Leaving SynchModuleInit\n");
   return SYNC_SUCCESS;
 }
@@ -64,22 +60,14 @@ int SemInit (Sem *sem, int count) {
 //	through this handle.  Returns SYNC_FAIL on failure.
 //----------------------------------------------------------------------
 sem_t SemCreate(int count) {
-  sem_t sem;
-  uint32 intrval;
-
-  // grabbing a semaphore should be an atomic operation
-  intrval = DisableIntrs();
-  for(sem=0; sem<MAX_SEMS; sem++) {
-    if(sems[sem].inuse==0) {
-      sems[sem].inuse = 1;
-      break;
-    }
-  }
-  RestoreIntrs(intrval);
-  if(sem==MAX_SEMS) return SYNC_FAIL;
+  Sem *sem;
+
+  // SlabAlloc is atomic
+  if ((sem = (Sem *)SlabAlloc(&semcache)) == NULL) return SYNC_FAIL;
+  sem->inuse = 1;
 
-  if (SemInit(&sems[sem], count) != SYNC_SUCCESS) return SYNC_FAIL;
-  return sem;
+  if (SemInit(sem, count) != SYNC_SUCCESS) return SYNC_FAIL;
+  return SlabIndex(&semcache, sem);
 }
 
 
@@ -102,7 +90,7 @@ int SemWait (Sem *sem) {
 
   intrval = DisableIntrs ();
   dbprintf ('I', "SemWait: Old interrupt value was 0x%x.\n", intrval);
-  dbprintf ('s', "SemWait: Proc %d waiting on sem %d, count=%d.\n", GetCurrentPid(), (int)(sem-sems), sem->count);
+  dbprintf ('s', "SemWait: Proc %d waiting on sem %d, count=%d.\n", GetCurrentPid(), SlabIndex(&semcache, sem), sem->count);
   if (sem->count <= 0) {
     dbprintf('s', "SemWait: putting process %d to sleep\n", GetCurrentPid());
     if ((l = AQueueAllocLink ((void *)currentPCB)) == NULL) {
@@ -117,17 +105,14 @@ int SemWait (Sem *sem) {
     // Don't decrement couter here because that's handled in SemSignal for us
   } else {
     sem->count--; // Decrement internal counter
-    dbprintf('s', "SemWait: Proc %d granted permission to continue by sem %d\n", GetCurrentPid(), (int)(sem-sems));
+    dbprintf('s', "SemWait: Proc %d granted permission to continue by sem %d\n", GetCurrentPid(), SlabIndex(&semcache, sem));
   }
   RestoreIntrs (intrval);
   return SYNC_SUCCESS;
 }
 
 int SemHandleWait(sem_t sem) {
-  if (sem < 0) return SYNC_FAIL;
-  if (sem >= MAX_SEMS) return SYNC_FAIL;
-  if (!sems[sem].inuse)    return SYNC_FAIL;
-  return SemWait(&sems[sem]);
+  return SemWait((Sem *)SlabLookup(&semcache, sem));
 }
 
 //----------------------------------------------------------------------
@@ -146,7 +131,7 @@ int SemSignal (Sem *sem) {
   if (!sem) return SYNC_FAIL;
 
   intrs = DisableIntrs ();
-  dbprintf ('s', "SemSignal: Process %d Signalling on sem %d, count=%d.\n", GetCurrentPid(), (int)(sem-sems), sem->count);
+  dbprintf ('s', "SemSignal: Process %d Signalling on sem %d, count=%d.\n", GetCurrentPid(), SlabIndex(&semcache, sem), sem->count);
   // Increment internal counter before checking value
   sem->count++;
   if (sem->count > 0) { // check if there is a process to wake up
@@ -168,10 +153,7 @@ int SemSignal (Sem *sem) {
 }
 
 int SemHandleSignal(sem_t sem) {
-  if (sem < 0) return SYNC_FAIL;
-  if (sem >= MAX_SEMS) return SYNC_FAIL;
-  if (!sems[sem].inuse)    return SYNC_FAIL;
-  return SemSignal(&sems[sem]);
+  return SemSignal((Sem *)SlabLookup(&semcache, sem));
 }
 
 
@@ -197,22 +179,14 @@ int SemHandleSignal(sem_t sem) {
 //	INVALID_LOCK (see synch.h).
 //-----------------------------------------------------------------------
 lock_t LockCreate() {
-  lock_t l;
-  uint32 intrval;
-
-  // grabbing a lock should be an atomic operation
-  intrval = DisableIntrs();
-  for(l=0; l<MAX_LOCKS; l++) {
-    if(locks[l].inuse==0) {
-      locks[l].inuse = 1;
-      break;
-    }
-  }
-  RestoreIntrs(intrval);
-  if(l==MAX_LOCKS) return SYNC_FAIL;
+  Lock *l;
+
+  // SlabAlloc is atomic
+  if ((l = (Lock *)SlabAlloc(&lockcache)) == NULL) return SYNC_FAIL;
+  l->inuse = 1;
 
-  if (LockInit(&locks[l]) != SYNC_SUCCESS) return SYNC_FAIL;
-  return l;
+  if (LockInit(l) != SYNC_SUCCESS) return SYNC_FAIL;
+  return SlabIndex(&lockcache, l);
 }
 
 int LockInit(Lock *l) {
@@ -247,12 +221,12 @@ int LockAcquire(Lock *k) {
 
   // Check to see if the current process owns the lock
   if (k->pid == GetCurrentPid()) {
-    dbprintf('s', "LockAcquire: Proc %d already owns lock %d\n", GetCurrentPid(), (int)(k-locks));
+    dbprintf('s', "LockAcquire: Proc %d already owns lock %d\n", GetCurrentPid(), SlabIndex(&lockcache, k));
     RestoreIntrs(intrval);
     return SYNC_SUCCESS;
   }
 
-  dbprintf ('s', "LockAcquire: Proc %d asking for lock %d.\n", GetCurrentPid(), (int)(k-locks));
+  dbprintf ('s', "LockAcquire: Proc %d asking for lock %d.\n", GetCurrentPid(), SlabIndex(&lockcache, k));
   if (k->pid >= 0) { // Lock is already in use by another process
     dbprintf('s', "LockAcquire: putting process %d to sleep\n", GetCurrentPid());
     if ((l = AQueueAllocLink ((void *)currentPCB)) == NULL) {
@@ -273,10 +247,7 @@ int LockAcquire(Lock *k) {
 }
 
 int LockHandleAcquire(lock_t lock) {
-  if (lock < 0) return SYNC_FAIL;
-  if (lock >= MAX_LOCKS) return SYNC_FAIL;
-  if (!locks[lock].inuse)    return SYNC_FAIL;
-  return LockAcquire(&locks[lock]);
+  return LockAcquire((Lock *)SlabLookup(&lockcache, lock));
 }
 
 //---------------------------------------------------------------------------
@@ -296,10 +267,10 @@ int LockRelease(Lock *k) {
   if (!k) return SYNC_FAIL;
 
   intrs = DisableIntrs ();
-  dbprintf ('s', "LockRelease: Proc %d releasing lock %d.\n", GetCurrentPid(), (int)(k-locks));
+  dbprintf ('s', "LockRelease: Proc %d releasing lock %d.\n", GetCurrentPid(), SlabIndex(&lockcache, k));
 
   if (k->pid != GetCurrentPid()) {
-    dbprintf('s', "LockRelease: Proc %d does not own lock %d.\n", GetCurrentPid(), (int)(k-locks));
+    dbprintf('s', "LockRelease: Proc %d does not own lock %d.\n", GetCurrentPid(), SlabIndex(&lockcache, k));
     return SYNC_FAIL;
   }
   k->pid = -1;
@@ -319,10 +290,7 @@ int LockRelease(Lock *k) {
 }
 
 int LockHandleRelease(lock_t lock) {
-  if (lock < 0) return SYNC_FAIL;
-  if (lock >= MAX_LOCKS) return SYNC_FAIL;
-  if (!locks[lock].inuse)    return SYNC_FAIL;
-  return LockRelease(&locks[lock]);
+  return LockRelease((Lock *)SlabLookup(&lockcache, lock));
 }
 
 //--------------------------------------------------------------------------
@@ -340,25 +308,18 @@ int LockHandleRelease(lock_t lock) {
 //	should return handle of the condition variable.
 //--------------------------------------------------------------------------
 cond_t CondCreate(lock_t lock) {
-  cond_t c;
-  uint32 intrval;
+  Cond *c;
+  Lock *k;
 
-  if (lock < 0) return SYNC_FAIL;
+  if ((k = (Lock *)SlabLookup(&lockcache, lock)) == NULL) return SYNC_FAIL;
 
-  // grabbing a cond should be an atomic operation
-  intrval = DisableIntrs();
-  for(c=0; c<MAX_LOCKS; c++) {
-    if (conds[c].inuse==0) {
-      conds[c].inuse = 1;
-      break;
-    }
-  }
-  RestoreIntrs(intrval);
-  if(c==MAX_CONDS) return SYNC_FAIL;
+  // SlabAlloc is atomic
+  if ((c = (Cond *)SlabAlloc(&condcache)) == NULL) return SYNC_FAIL;
+  c->inuse = 1;
 
-  if (CondInit(&conds[c]) != SYNC_SUCCESS) return SYNC_FAIL;
-  conds[c].lock = &locks[lock];
-  return c;
+  if (CondInit(c) != SYNC_SUCCESS) return SYNC_FAIL;
+  c->lock = k;
+  return SlabIndex(&condcache, c);
 }
 
 int CondInit(Cond *c) {
@@ -406,12 +367,12 @@ int CondWait(Cond *c) {
 
   // Check to see if the current process owns the lock
   if (c->lock->pid != GetCurrentPid()) {
-    dbprintf('s', "CondWait: Proc %d does not own cond %d\n", GetCurrentPid(), (int)(c-conds));
+    dbprintf('s', "CondWait: Proc %d does not own cond %d\n", GetCurrentPid(), SlabIndex(&condcache, c));
     RestoreIntrs(intrval);
     return SYNC_FAIL;
   }
 
-  dbprintf ('s', "CondWait: Proc %d waiting on cond %d.  Putting to sleep.\n", GetCurrentPid(), (int)(c-conds));
+  dbprintf ('s', "CondWait: Proc %d waiting on cond %d.  Putting to sleep.\n", GetCurrentPid(), SlabIndex(&condcache, c));
   if ((l = AQueueAllocLink ((void *)currentPCB)) == NULL) {
     printf("FATAL ERROR: could not allocate link for cond queue in CondWait!\n");
     exitsim();
@@ -430,10 +391,7 @@ int CondWait(Cond *c) {
 }
 
 int CondHandleWait(cond_t cond) {
-  if (cond < 0) return SYNC_FAIL;
-  if (cond >= MAX_SEMS) return SYNC_FAIL;
-  if (!conds[cond].inuse) return SYNC_FAIL;
-  return CondWait(&conds[cond]);
+  return CondWait((Cond *)SlabLookup(&condcache, cond));
 }
 
 
@@ -465,10 +423,10 @@ int CondSignal(Cond *c) {
   if (!c) return SYNC_FAIL;
 
   intrs = DisableIntrs ();
-  dbprintf ('s', "CondSignal: Proc %d signalling cond %d.\n", GetCurrentPid(), (int)(c-conds));
+  dbprintf ('s', "CondSignal: Proc %d signalling cond %d.\n", GetCurrentPid(), SlabIndex(&condcache, c));
 
   if (c->lock->pid != GetCurrentPid()) {
-    dbprintf('s', "CondSignal: Proc %d does not own cond %d.\n", GetCurrentPid(), (int)(c-conds));
+    dbprintf('s', "CondSignal: Proc %d does not own cond %d.\n", GetCurrentPid(), SlabIndex(&condcache, c));
     return SYNC_FAIL;
   }
   if (!AQueueEmpty(&c->waiting)) { // there is a process to wake up
@@ -488,10 +446,7 @@ int CondSignal(Cond *c) {
 }
 
 int CondHandleSignal(cond_t cond) {
-  if (cond < 0) return SYNC_FAIL;
-  if (cond >= MAX_CONDS) return SYNC_FAIL;
-  if (!conds[cond].inuse)    return SYNC_FAIL;
-  return CondSignal(&conds[cond]);
+  return CondSignal((Cond *)SlabLookup(&condcache, cond));
 }
 
 //---------------------------------------------------------------------------
@@ -513,23 +468,20 @@ int CondBroadcast(Cond *c) {
   if (!c) return SYNC_FAIL;
  
   if (c->lock->pid != GetCurrentPid()) {
-    dbprintf('s', "CondBroadcast: Proc %d tried to broadcast, but it doesn't own cond %d\n", GetCurrentPid(), (int)(c-conds));
+    dbprintf('s', "CondBroadcast: Proc %d tried to broadcast, but it doesn't own cond %d\n", GetCurrentPid(), SlabIndex(&condcache, c));
     return SYNC_FAIL;
   }
 
   while (!AQueueEmpty(&c->waiting)) {
     if (CondSignal(c) != SYNC_SUCCESS) {
-      dbprintf('s', "CondBroadcast: Proc %d failed in signalling cond %d\n", GetCurrentPid(), (int)(c-conds));
+      dbprintf('s', "CondBroadcast: Proc %d failed in signalling cond %d\n", GetCurrentPid(), SlabIndex(&condcache, c));
       return SYNC_FAIL;
     }
   }
   dbprintf('s', "CondBroadcast: Proc %d successful broadcast on cond %d, still needs to release lock\n", 
-                 GetCurrentPid(), (int)(c-conds));
+                 GetCurrentPid(), SlabIndex(&condcache, c));
   return SYNC_SUCCESS;
 }
 int CondHandleBroadcast(cond_t cond) {
-  if (cond < 0) return SYNC_FAIL;
-  if (cond >= MAX_CONDS) return SYNC_FAIL;
-  if (!conds[cond].inuse)  return SYNC_FAIL;
-  return CondSignal(&conds[cond]);
+  return CondSignal((Cond *)SlabLookup(&condcache, cond));
 }
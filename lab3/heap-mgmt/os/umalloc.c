@@ -0,0 +1,280 @@
+//
+//	umalloc.c
+//
+//	User-level slab allocator.  This is not part of the operating
+//	system; it is built into a library that applications link with,
+//	the same way misc.o is.
+//
+//	Requests of up to UMALLOC_MAX_SMALL bytes are rounded up to one of
+//	a few size classes.  Each class keeps slabs: pages holding a header
+//	and a row of equal-sized objects, with a bitmap of the free ones.
+//	Slab pages come out of pools, runs of UMALLOC_POOL_PAGES pages that
+//	the kernel's malloc trap hands back page aligned.  Only getting or
+//	giving back a pool takes a trap; other small allocations and frees
+//	stay in user mode.
+//
+
+#include "usertraps.h"
+#include "umalloc.h"
+
+// Bytes at the start of a slab page before the first object
+#define UMALLOC_SLAB_HDR	((sizeof(umalloc_slab) + 7) & ~7)
+#define UMALLOC_PAGE_OF(p)	((char *)((unsigned int)(p) & ~(UMALLOC_PAGE_SIZE-1)))
+
+typedef struct umalloc_pool {
+  char *base;		// First page, NULL if the pool isn't held
+  int freemap;		// Bit set = page free
+  int nfree;
+} umalloc_pool;
+
+static const short sizes[UMALLOC_NUM_CLASSES] = {
+  8, 16, 24, 32, 48, 64, 96, 128, 192, 256, 384, 512
+};
+static umalloc_slab *partial[UMALLOC_NUM_CLASSES];
+static umalloc_pool pools[UMALLOC_MAX_POOLS];
+static umalloc_stats stats;
+
+//----------------------------------------------------------------------
+//
+//	poolFind
+//
+//	Return the pool that the address falls in, or NULL if it isn't
+//	in any of them.
+//
+//----------------------------------------------------------------------
+static umalloc_pool *
+poolFind (char *addr)
+{
+  int	i;
+
+  for (i = 0; i < UMALLOC_MAX_POOLS; i++) {
+    if ((pools[i].base != NULL) && (addr >= pools[i].base) &&
+	(addr < pools[i].base + UMALLOC_POOL_PAGES * UMALLOC_PAGE_SIZE)) {
+      return (&pools[i]);
+    }
+  }
+  return (NULL);
+}
+
+//----------------------------------------------------------------------
+//
+//	poolGetPage
+//	poolPutPage
+//
+//	Take a page for a new slab, trapping for a new pool when all
+//	held pools are full.  One pool with all its pages back is kept
+//	for the next slab; a second one is returned to the kernel.
+//
+//----------------------------------------------------------------------
+static char *
+poolGetPage ()
+{
+  umalloc_pool	*pool = NULL;
+  int	i;
+
+  for (i = 0; i < UMALLOC_MAX_POOLS; i++) {
+    if ((pools[i].base != NULL) && (pools[i].nfree > 0)) {
+      pool = &pools[i];
+      break;
+    }
+    if ((pools[i].base == NULL) && (pool == NULL)) {
+      pool = &pools[i];
+    }
+  }
+  if (pool == NULL) {
+    return (NULL);
+  }
+  if (pool->base == NULL) {
+    stats.traps++;
+    pool->base = malloc (UMALLOC_POOL_PAGES * UMALLOC_PAGE_SIZE);
+    if (pool->base == NULL) {
+      return (NULL);
+    }
+    pool->freemap = (1 << UMALLOC_POOL_PAGES) - 1;
+    pool->nfree = UMALLOC_POOL_PAGES;
+    stats.poolpages += UMALLOC_POOL_PAGES;
+  }
+  for (i = 0; !(pool->freemap & (1 << i)); i++)
+    ;
+  pool->freemap &= ~(1 << i);
+  pool->nfree--;
+  stats.slabpages++;
+  return (pool->base + i * UMALLOC_PAGE_SIZE);
+}
+
+static void
+poolPutPage (umalloc_pool *pool, char *page)
+{
+  int	i;
+
+  pool->freemap |= 1 << ((page - pool->base) / UMALLOC_PAGE_SIZE);
+  pool->nfree++;
+  stats.slabpages--;
+  if (pool->nfree < UMALLOC_POOL_PAGES) {
+    return;
+  }
+  for (i = 0; i < UMALLOC_MAX_POOLS; i++) {
+    if ((&pools[i] != pool) && (pools[i].base != NULL) &&
+	(pools[i].nfree == UMALLOC_POOL_PAGES)) {
+      stats.traps++;
+      mfree (pool->base);
+      pool->base = NULL;
+      stats.poolpages -= UMALLOC_POOL_PAGES;
+      return;
+    }
+  }
+}
+
+//----------------------------------------------------------------------
+//
+//	slabLink
+//	slabUnlink
+//
+//	Put a slab on, or take it off, the list of slabs of its class
+//	that still have free objects.
+//
+//----------------------------------------------------------------------
+static void
+slabLink (umalloc_slab *slab, int class)
+{
+  slab->prev = NULL;
+  slab->next = partial[class];
+  if (partial[class] != NULL) {
+    partial[class]->prev = slab;
+  }
+  partial[class] = slab;
+  slab->onlist = 1;
+}
+
+static void
+slabUnlink (umalloc_slab *slab, int class)
+{
+  if (slab->prev != NULL) {
+    slab->prev->next = slab->next;
+  } else {
+    partial[class] = slab->next;
+  }
+  if (slab->next != NULL) {
+    slab->next->prev = slab->prev;
+  }
+  slab->onlist = 0;
+}
+
+static int
+sizeClass (int size)
+{
+  int	class;
+
+  for (class = 0; sizes[class] < size; class++)
+    ;
+  return (class);
+}
+
+//----------------------------------------------------------------------
+//
+//	umalloc
+//
+//	Allocate memsize bytes.  Small requests take the first free object
+//	in a slab of their class, starting a slab when the class has no
+//	free objects left.  Returns NULL if memory runs out.
+//
+//----------------------------------------------------------------------
+void *
+umalloc (int memsize)
+{
+  umalloc_slab	*slab;
+  int	class, w, b;
+
+  if (memsize <= 0) {
+    return (NULL);
+  }
+  if (memsize > UMALLOC_MAX_SMALL) {
+    stats.traps++;
+    return (malloc (memsize));
+  }
+
+  class = sizeClass (memsize);
+  if ((slab = partial[class]) == NULL) {
+    if ((slab = (umalloc_slab *)poolGetPage ()) == NULL) {
+      return (NULL);
+    }
+    slab->size = sizes[class];
+    slab->nobjs = (UMALLOC_PAGE_SIZE - UMALLOC_SLAB_HDR) / slab->size;
+    slab->nfree = slab->nobjs;
+    for (w = 0; w < UMALLOC_MAP_WORDS; w++) {
+      b = slab->nobjs - w * 32;
+      slab->freemap[w] = (b >= 32) ? ~0 : (b <= 0) ? 0 : ((1 << b) - 1);
+    }
+    slabLink (slab, class);
+  }
+
+  for (w = 0; slab->freemap[w] == 0; w++)
+    ;
+  for (b = 0; !(slab->freemap[w] & (1 << b)); b++)
+    ;
+  slab->freemap[w] ^= (1 << b);
+  if (--slab->nfree == 0) {
+    slabUnlink (slab, class);
+  }
+  stats.objbytes += slab->size;
+  return ((char *)slab + UMALLOC_SLAB_HDR + (w * 32 + b) * slab->size);
+}
+
+//----------------------------------------------------------------------
+//
+//	ufree
+//
+//	Free a block from umalloc.  Returns the bytes freed, which for a
+//	slab object is its class size, or -1 if ptr isn't an allocated
+//	block.  An emptied slab gives its page back to the pool.
+//
+//----------------------------------------------------------------------
+int
+ufree (void *ptr)
+{
+  umalloc_pool	*pool;
+  umalloc_slab	*slab;
+  int	offset, i, class;
+
+  if ((pool = poolFind ((char *)ptr)) == NULL) {
+    stats.traps++;
+    return (mfree (ptr));
+  }
+
+  slab = (umalloc_slab *)UMALLOC_PAGE_OF (ptr);
+  offset = (char *)ptr - (char *)slab - UMALLOC_SLAB_HDR;
+  if ((pool->freemap & (1 << (((char *)slab - pool->base) / UMALLOC_PAGE_SIZE))) ||
+      (offset < 0) || (offset % slab->size != 0)) {
+    return (-1);
+  }
+  i = offset / slab->size;
+  if ((i >= slab->nobjs) || (slab->freemap[i >> 5] & (1 << (i & 0x1F)))) {
+    return (-1);
+  }
+
+  slab->freemap[i >> 5] |= 1 << (i & 0x1F);
+  slab->nfree++;
+  stats.objbytes -= slab->size;
+  class = sizeClass (slab->size);
+  if (!slab->onlist) {
+    slabLink (slab, class);
+  }
+  if (slab->nfree == slab->nobjs) {
+    slabUnlink (slab, class);
+    poolPutPage (pool, (char *)slab);
+  }
+  return (sizes[class]);
+}
+
+//----------------------------------------------------------------------
+//
+//	umalloc_getstats
+//
+//	Copy out the trap count and how much memory the slabs hold.
+//
+//----------------------------------------------------------------------
+void
+umalloc_getstats (umalloc_stats *out)
+{
+  *out = stats;
+}
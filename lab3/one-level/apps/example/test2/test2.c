@@ -14,13 +14,13 @@ void main (int argc, char *argv[])
   s_procs_completed = dstrtol(argv[1], NULL, 10);
 
   // Access memory beyond max virtual address
-  Printf(" TEST2 (%d): Size of virtual memory       | = 1024 KB    |  = 1,048,576 bytes  |\n", getpid());
-  Printf(" TEST2 (%d): Max virtual memory address   | = (1<<20)-1  |  = 0xFFFF in hex    |\n", getpid());
-  Printf(" TEST2 (%d): Attempting to access address | = 0x10001    |\n", getpid());
+  Printf(" TEST2 (%d): Size of virtual memory       | = 64 MB      |  = 67,108,864 bytes |\n", getpid());
+  Printf(" TEST2 (%d): Max virtual memory address   | = (1<<26)-1  |  = 0x3FFFFFF in hex |\n", getpid());
+  Printf(" TEST2 (%d): Attempting to access address | = 0x4000000  |\n", getpid());
   
   // Signal the semaphore to tell the original process that we're done
   sem_signal(s_procs_completed);
 
-  Printf(" TEST2 (%d): Value at 0x10001 = %d\n", getpid(), *(unsigned int*)0x10001);
+  Printf(" TEST2 (%d): Value at 0x4000000 = %d\n", getpid(), *(unsigned int*)0x4000000);
 
 }
@@ -1,7 +1,7 @@
 #include "usertraps.h"
 #include "misc.h"
 
-#define MEM_MAX_VIRTUAL_ADDRESS (1<<20)-1
+#define MEM_MAX_VIRTUAL_ADDRESS ((1<<26)-1)
 #define MEM_PAGESIZE (0x1<<12)
 
 void main (int argc, char *argv[])
@@ -18,12 +18,12 @@ void main (int argc, char *argv[])
   s_procs_completed = dstrtol(argv[1], NULL, 10);
 
   // Access memory within max virtual address, but outside of allocated pages
-  Printf(" TEST3 (%d): Size of virtual memory       | = 1024 KB    |  = 1,048,576 bytes  |\n", getpid());
-  Printf(" TEST3 (%d): Max virtual memory address   | = (1<<20)-1  |  = 0xFFFF in hex    |\n", getpid());
+  Printf(" TEST3 (%d): Size of virtual memory       | = 64 MB      |  = 67,108,864 bytes |\n", getpid());
+  Printf(" TEST3 (%d): Max virtual memory address   | = (1<<26)-1  |  = 0x3FFFFFF in hex |\n", getpid());
   Printf(" TEST3 (%d): User stack page is located at top of virtual memory\n", getpid());
 
   Printf(" TEST3 (%d): Attempting to access page right after user stack page\n", getpid());
-  Printf(" TEST3 (%d): Target page = (0xFFFF + 1 - MEM_PAGESIZE) - 4\n", getpid());
+  Printf(" TEST3 (%d): Target page = (0x3FFFFFF + 1 - MEM_PAGESIZE) - 4\n", getpid());
   
   // Signal the semaphore to tell the original process that we're done
   sem_signal(s_procs_completed);
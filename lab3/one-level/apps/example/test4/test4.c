@@ -1,7 +1,7 @@
 #include "usertraps.h"
 #include "misc.h"
 
-#define MEM_MAX_VIRTUAL_ADDRESS (1<<20)-1
+#define MEM_MAX_VIRTUAL_ADDRESS ((1<<26)-1)
 #define MEM_PAGESIZE (0x1<<12)
 
 // Global variable used to compare pages recursively
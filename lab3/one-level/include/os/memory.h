@@ -25,8 +25,14 @@ int MemoryPageFaultHandler(PCB *pcb);
 //int mfree(void *ptr);
 //uint32 mPTE(uint32);
 int MemoryAllocPage(void);
+int MemoryAllocContiguousPages(int npages);
+int MemoryFreePageCount(void);
+void MemoryBenchmark(int rounds);
 uint32 MemorySetupPTE(uint32 page);
+uint32 *MemoryGetPTE(PCB *pcb, uint32 vpage, int create);
+void MemoryFreePageTables(PCB *pcb);
 void MemoryFreePTE(uint32);
+void MemorySharePage(uint32 pte);
 void MemoryFreePage(uint32 page);
 
 #endif	// _memory_h_
@@ -14,29 +14,48 @@
 
 //---------------------------------------------------------
 
-#define MEM_L1FIELD_FIRST_BITNUM 12
-// Use a virtual memory size of 1024KB
-#define MEM_MAX_VIRTUAL_ADDRESS (1<<20)-1
+// Two-level page tables: each L1 entry maps 4MB through an L2 table
+// that fills exactly one 4KB page (1024 PTEs).
+#define MEM_L1FIELD_FIRST_BITNUM 22
+#define MEM_L2FIELD_FIRST_BITNUM 12
+// Use a virtual memory size of 64MB
+#define MEM_MAX_VIRTUAL_ADDRESS ((1<<26)-1)
 // Use a max physical memory size of 2MB
 #define MEM_MAX_SIZE (1<<21)
-#define MEM_MAX_PAGES (MEM_MAX_SIZE>>MEM_L1FIELD_FIRST_BITNUM)
+#define MEM_MAX_PAGES (MEM_MAX_SIZE>>MEM_L2FIELD_FIRST_BITNUM)
 
 #define MEM_PTE_READONLY 0x4
 #define MEM_PTE_DIRTY 0x2
 #define MEM_PTE_VALID 0x1
 
-#define MEM_PAGESIZE (0x1<<MEM_L1FIELD_FIRST_BITNUM)
+#define MEM_PAGESIZE (0x1<<MEM_L2FIELD_FIRST_BITNUM)
 #define MEM_MAX_PAGE_OFFSET (MEM_PAGESIZE-1)
 #define MEM_PAGE_OFFSET_MASK (MEM_PAGESIZE-1)
 
-#define MEM_PAGETABLE_SIZE ((MEM_MAX_VIRTUAL_ADDRESS + 1)>>MEM_L1FIELD_FIRST_BITNUM)
+// Number of virtual pages, and how they split between the two levels
+#define MEM_PAGETABLE_SIZE ((MEM_MAX_VIRTUAL_ADDRESS + 1)>>MEM_L2FIELD_FIRST_BITNUM)
 #define MEM_MAX_PAGETABLE_INDEX (MEM_PAGETABLE_SIZE-1)
+#define MEM_L2TABLE_BITS (MEM_L1FIELD_FIRST_BITNUM-MEM_L2FIELD_FIRST_BITNUM)
+#define MEM_L2TABLE_SIZE (0x1<<MEM_L2TABLE_BITS)
+#define MEM_L1TABLE_SIZE ((MEM_MAX_VIRTUAL_ADDRESS + 1)>>MEM_L1FIELD_FIRST_BITNUM)
 
 #define MEM_PTE_TO_PAGEADDRESS_MASK ~(MEM_PTE_READONLY | MEM_PTE_DIRTY | MEM_PTE_VALID)
 
 #define MEM_FREEMAP_PAGEOFFSET_MASK (uint32)0x1F
 #define MEM_FREEMAP_INUSE 0xFFFFFFFF
 #define MEM_FREEMAP_NOTINUSE 0x00000000
+#define MEM_FREEMAP_WORDS (MEM_MAX_PAGES>>5) // at most 32, one freesummary bit each
+
+// Per-page descriptor of the page frame allocator
+#define MEM_FRAME_NONE -1
+typedef struct MemoryFrame {
+    int next;       // Free list links while the page is free
+    int prev;
+    char refcount;  // References to the page, 0 when free
+} MemoryFrame;
+
+// Contiguous run length used by MemoryBenchmark
+#define MEM_BENCH_RUN 8
 
 //---------------------------------------------------------
 #endif	// _memory_constants_h_
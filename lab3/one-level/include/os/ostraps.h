@@ -16,6 +16,7 @@ int write(int fd, char *buf, int numbytes);
 int lseek(int fd, int offset, int where);
 int close(int fd);
 void bcopy(char *source, char *destination, int numbytes);
+void bzero(char *destination, int numbytes);
 void exitsim();
 void TimerSet(int us);
 
@@ -53,6 +53,12 @@ int ProcessGetCodeInfo(const char *file, uint32 *startAddr, uint32 *codeStart, u
 int ProcessGetFromFile(int fd, unsigned char *buf, uint32 *addr, int max);
 uint32 get_argument(char *string);
 
+int ProcessImageGet(char *name);
+
+// Program image cache, see ProcessImageGet
+static ProcessImage images[PROCESS_MAX_IMAGES];
+static int imagestamp = 0;
+
 //----------------------------------------------------------------------
 //
 //	ProcessModuleInit
@@ -84,6 +90,7 @@ void ProcessModuleInit () {
     //-------------------------------------------------------
     // STUDENT: Initialize the PCB's page table here.
     //-------------------------------------------------------
+    pcbs[i].image = -1;
 
     // Finally, insert the link into the queue
     if (AQueueInsertFirst(&freepcbs, pcbs[i].l) != QUEUE_SUCCESS) {
@@ -117,7 +124,6 @@ void ProcessSetStatus (PCB *pcb, int status) {
 void ProcessFreeResources (PCB *pcb) 
 {
     int i = 0;
-    int userstack_page_idx;
 
     // Allocate a new link for this pcb on the freepcbs queue
     if ((pcb->l = AQueueAllocLink(pcb)) == NULL) {
@@ -135,22 +141,16 @@ void ProcessFreeResources (PCB *pcb)
     //------------------------------------------------------------
     // STUDENT: Free any memory resources on process death here.
     //------------------------------------------------------------
+    // Let go of the program image
+    if(pcb->image >= 0) {  images[pcb->image].users--; pcb->image = -1;  }
+
     // Free system stack pages
     for(i=0; i<PROCESS_NUMPAGES_SYSTEM_STACK; i++)
     {  MemoryFreePage((pcb->sysStackArea) / MEM_PAGESIZE); (pcb->npages)--;  }
 
-    // Free user stack pages
-    userstack_page_idx = pcb->sysStackPtr[PROCESS_STACK_USER_STACKPOINTER] >> MEM_L1FIELD_FIRST_BITNUM;
-    while((userstack_page_idx) < (MEM_MAX_VIRTUAL_ADDRESS >> MEM_L1FIELD_FIRST_BITNUM))
-    {  
-        MemoryFreePage(((pcb->pagetable)[userstack_page_idx]) >> (MEM_L1FIELD_FIRST_BITNUM));
-        userstack_page_idx++;
-    }
-    MemoryFreePage(((pcb->pagetable)[(PROCESS_PAGETABLESIZE-1)]) >> MEM_L1FIELD_FIRST_BITNUM);
-
-    // Free user code and global data pages
-    for(i=0; i<PROCESS_NUMPAGES_USERCODE_GLOBALDATA; i++)
-    {  MemoryFreePTE((pcb->pagetable)[i]); (pcb->npages)--;  }
+    // Free user code, global data and stack pages, and their L2 tables
+    MemoryFreePageTables(pcb);
+    pcb->npages = 0;
 
     pcb->sysStackArea = 0;
     ProcessSetStatus (pcb, PROCESS_STATUS_FREE);
@@ -369,12 +369,7 @@ static void ProcessExit () {
 //----------------------------------------------------------------------
 int ProcessFork (VoidFunc func, uint32 param, char *name, int isUser) 
 {
-    int i;                   // Loop index variable
-    int fd, n;               // Used for reading code from files.
-    int start, codeS, codeL; // Used for reading code from files.
-    int dataS, dataL;        // Used for reading code from files.
-    int addr = 0;            // Used for reading code from files.
-    unsigned char buf[100];  // Used for reading code from files.
+    int start;               // Entry point of the program image.
     uint32 *stackframe;      // Stores address of current stack frame.
     PCB *pcb;                // Holds pcb while we build it for this process.
     int intrs;               // Stores previous interrupt settings.
@@ -423,8 +418,9 @@ int ProcessFork (VoidFunc func, uint32 param, char *name, int isUser)
     //----------------------------------------------------------------------
     // This section initializes the memory for this process
     //----------------------------------------------------------------------
-    // Allocate 1 page for system stack, 1 page for user stack (at top of
-    // virtual address space), and 4 pages for user code and global data
+    // Allocate 1 page for system stack and 1 page for user stack (at top
+    // of virtual address space).  The 4 pages for user code and global
+    // data are demand-loaded.
 
     //---------------------------------------------------------
     // STUDENT: allocate pages for a new process here.  The
@@ -436,39 +432,28 @@ int ProcessFork (VoidFunc func, uint32 param, char *name, int isUser)
     // Debug print statement
     dbprintf ('m', "ProcessFork: (PID:%d) about to start allocating pages...\n", GetCurrentPid());
 
-    // Allocate pages for user code and global data
-    for(i=0; i<PROCESS_NUMPAGES_USERCODE_GLOBALDATA; i++)
-    {
-        // Allocate a new page, check for error
-        newPage = MemoryAllocPage();
-        if(newPage == 0)
-        {  printf("FATAL: could not allocate memory - no free pages!\n"); exitsim();  }
-        
-        // Add page number to PCB pagetable
-        pcb->pagetable[i] = MemorySetupPTE(newPage);
-     
-        // Increment page counter
-        pcb->npages++;
-        
-        // Debug print statement
-        dbprintf ('m', "ProcessFork: (PID:%d), (UserCodeGloData:%d), (npages:%d)\n", GetCurrentPid(), newPage, pcb->npages);
-    }
+    // No L2 tables yet, MemoryGetPTE adds them as pages are mapped
+    bzero((char *)(pcb->pagetable), sizeof(pcb->pagetable));
+
+    // User code and global data pages stay invalid, they're filled in
+    // from the program image as they're touched (ProcessImageFault)
+    pcb->image = -1;
 
     // Allocate page for user stack, check for error
     newPage = MemoryAllocPage();
-    if(newPage == 0)
+    if(newPage == MEM_FAIL)
     {  printf("FATAL: could not allocate memory - no free pages!\n"); exitsim();  }
     pcb->npages++;
     
     // User stack page goes on top of virtual address space
-    pcb->pagetable[MEM_MAX_VIRTUAL_ADDRESS >> MEM_L1FIELD_FIRST_BITNUM] = MemorySetupPTE(newPage);
+    *MemoryGetPTE(pcb, MEM_MAX_VIRTUAL_ADDRESS >> MEM_L2FIELD_FIRST_BITNUM, 1) = MemorySetupPTE(newPage);
 
     // Debug print statement
     dbprintf ('m', "ProcessFork: (PID:%d), (UserStackPage:%d), (npages:%d)\n", GetCurrentPid(), newPage, pcb->npages);
 
     // Allocate page for system stack
     newPage = MemoryAllocPage();
-    if(newPage == 0)
+    if(newPage == MEM_FAIL)
     {  printf("FATAL: could not allocate memory - no free pages!\n"); exitsim();  }
     pcb->npages++;
    
@@ -508,33 +493,20 @@ int ProcessFork (VoidFunc func, uint32 param, char *name, int isUser)
     // stack frame.
     //----------------------------------------------------------------------
     stackframe[PROCESS_STACK_PTBASE] = (uint32)&(pcb->pagetable[0]);
-    stackframe[PROCESS_STACK_PTBITS] = (MEM_L1FIELD_FIRST_BITNUM | MEM_L1FIELD_FIRST_BITNUM << 16);
-    stackframe[PROCESS_STACK_PTSIZE] = PROCESS_PAGETABLESIZE;
+    stackframe[PROCESS_STACK_PTBITS] = (MEM_L1FIELD_FIRST_BITNUM | MEM_L2FIELD_FIRST_BITNUM << 16);
+    stackframe[PROCESS_STACK_PTSIZE] = MEM_L1TABLE_SIZE;
 
 
     if (isUser) 
     {
         dbprintf ('p', "About to load %s\n", name);
-        fd = ProcessGetCodeInfo (name, &start, &codeS, &codeL, &dataS, &dataL);
-        if (fd < 0) 
+        if ((pcb->image = ProcessImageGet (name)) < 0) 
         {
             // Free newpage and pcb so we don't run out...
             ProcessFreeResources (pcb);
             return (-1);
         }
-
-        dbprintf ('p', "File %s -> start=0x%08x\n", name, start);
-        dbprintf ('p', "File %s -> code @ 0x%08x (size=0x%08x)\n", name, codeS, codeL);
-        dbprintf ('p', "File %s -> data @ 0x%08x (size=0x%08x)\n", name, dataS, dataL);
-
-        while ((n = ProcessGetFromFile (fd, buf, &addr, sizeof (buf))) > 0) 
-        {
-            dbprintf ('p', "Placing %d bytes at vaddr %08x.\n", n, addr - n);
-            // Copy the data to user memory.  Note that the user memory needs to
-            // have enough space so that this copy will succeed!
-            MemoryCopySystemToUser (pcb, buf, (char *)(addr - n), n);
-        }
-        FsClose (fd);
+        start = images[pcb->image].start;
         stackframe[PROCESS_STACK_ISR] = PROCESS_INIT_ISR_USER;
 
         //----------------------------------------------------------------------
@@ -730,6 +702,228 @@ ProcessGetCodeInfo (const char *file, uint32 *startAddr,
 }
 
 
+//----------------------------------------------------------------------
+//
+//	ProcessImageEvict
+//
+//	Drop an unused image from the cache.  Frames still mapped by a
+//	process live on until it lets go of them too.
+//
+//----------------------------------------------------------------------
+static void
+ProcessImageEvict (int idx)
+{
+  int		i;
+
+  dbprintf ('p', "Evicting image %s from the cache\n", images[idx].name);
+  for (i = 0; i < PROCESS_NUMPAGES_USERCODE_GLOBALDATA; i++) {
+    if (images[idx].pages[i] != MEM_FAIL) {
+      MemoryFreePage (images[idx].pages[i]);
+      images[idx].pages[i] = MEM_FAIL;
+    }
+  }
+  images[idx].name[0] = '\0';
+}
+
+//----------------------------------------------------------------------
+//
+//	ProcessImageAllocPage
+//
+//	Allocate a page for an image being loaded, evicting the oldest
+//	images no process is running until one comes free.
+//
+//----------------------------------------------------------------------
+static int
+ProcessImageAllocPage ()
+{
+  int		page, i, victim;
+
+  while ((page = MemoryAllocPage ()) == MEM_FAIL) {
+    victim = -1;
+    for (i = 0; i < PROCESS_MAX_IMAGES; i++) {
+      if ((images[i].name[0] != '\0') && (images[i].users == 0) &&
+	  ((victim < 0) || (images[i].lastuse < images[victim].lastuse))) {
+	victim = i;
+      }
+    }
+    if (victim < 0) {
+      return (MEM_FAIL);
+    }
+    ProcessImageEvict (victim);
+  }
+  return (page);
+}
+
+//----------------------------------------------------------------------
+//
+//	ProcessImageLoad
+//
+//	Read and parse the executable file into the pages of image slot
+//	idx.  Pages holding nothing but code are marked for read-only
+//	sharing.  Returns PROCESS_FAIL if the file can't be read, is
+//	bigger than the code and data area, or memory runs out.
+//
+//----------------------------------------------------------------------
+static int
+ProcessImageLoad (int idx, char *name)
+{
+  ProcessImage	*img = &images[idx];
+  int		fd, n, i, len, vpage;
+  uint32	addr = 0, vaddr;
+  uint32	start, codeS, codeL, dataS, dataL;
+  unsigned char	buf[100];
+
+  for (i = 0; i < PROCESS_NUMPAGES_USERCODE_GLOBALDATA; i++) {
+    img->pages[i] = MEM_FAIL;
+  }
+  if ((fd = ProcessGetCodeInfo (name, &start, &codeS, &codeL, &dataS, &dataL)) < 0) {
+    return (PROCESS_FAIL);
+  }
+  dbprintf ('p', "File %s -> start=0x%08x\n", name, start);
+  dbprintf ('p', "File %s -> code @ 0x%08x (size=0x%08x)\n", name, codeS, codeL);
+  dbprintf ('p', "File %s -> data @ 0x%08x (size=0x%08x)\n", name, dataS, dataL);
+  img->start = start;
+  img->users = 0;
+
+  while ((n = ProcessGetFromFile (fd, buf, &addr, sizeof (buf))) > 0) {
+    dbprintf ('p', "Placing %d bytes at vaddr %08x.\n", n, addr - n);
+    // Copy the bytes into the image, a page at a time
+    for (i = 0; i < n; i += len) {
+      vaddr = addr - n + i;
+      vpage = vaddr >> MEM_L2FIELD_FIRST_BITNUM;
+      if (vpage >= PROCESS_NUMPAGES_USERCODE_GLOBALDATA) {
+	printf ("ProcessImageLoad: %s doesn't fit in %d pages!\n", name,
+		PROCESS_NUMPAGES_USERCODE_GLOBALDATA);
+	FsClose (fd);
+	ProcessImageEvict (idx);
+	return (PROCESS_FAIL);
+      }
+      if (img->pages[vpage] == MEM_FAIL) {
+	if ((img->pages[vpage] = ProcessImageAllocPage ()) == MEM_FAIL) {
+	  printf ("ProcessImageLoad: no free pages to load %s!\n", name);
+	  FsClose (fd);
+	  ProcessImageEvict (idx);
+	  return (PROCESS_FAIL);
+	}
+	bzero ((char *)(img->pages[vpage] * MEM_PAGESIZE), MEM_PAGESIZE);
+      }
+      len = min (n - i, MEM_PAGESIZE - (vaddr & MEM_PAGE_OFFSET_MASK));
+      bcopy ((char *)(buf + i), (char *)(img->pages[vpage] * MEM_PAGESIZE +
+				  (vaddr & MEM_PAGE_OFFSET_MASK)), len);
+    }
+  }
+  FsClose (fd);
+  // Only named once it's complete, so it can't be evicted while loading
+  dstrncpy (img->name, name, sizeof (img->name) - 1);
+  img->name[sizeof (img->name) - 1] = '\0';
+
+  // A page can be shared if it lies entirely within the code section
+  for (i = 0; i < PROCESS_NUMPAGES_USERCODE_GLOBALDATA; i++) {
+    vaddr = i * MEM_PAGESIZE;
+    img->readonly[i] = ((img->pages[i] != MEM_FAIL) && (vaddr >= codeS) &&
+			(vaddr + MEM_PAGESIZE <= codeS + codeL) &&
+			((vaddr + MEM_PAGESIZE <= dataS) || (vaddr >= dataS + dataL)));
+  }
+  return (PROCESS_SUCCESS);
+}
+
+//----------------------------------------------------------------------
+//
+//	ProcessImageGet
+//
+//	Find the cached image of executable name, loading it into a free
+//	slot (or the oldest unused one) if it isn't cached yet.  Returns
+//	the image's index with a use counted on it, or -1 on failure.
+//
+//----------------------------------------------------------------------
+int
+ProcessImageGet (char *name)
+{
+  int		i, idx = -1;
+
+  for (i = 0; i < PROCESS_MAX_IMAGES; i++) {
+    if ((images[i].name[0] != '\0') &&
+	(dstrncmp (images[i].name, name, sizeof (images[i].name)) == 0)) {
+      break;
+    }
+    if ((images[i].name[0] == '\0') && (idx < 0)) {
+      idx = i;
+    }
+  }
+  if (i < PROCESS_MAX_IMAGES) {
+    idx = i;
+    dbprintf ('p', "Image %s is cached in slot %d\n", name, idx);
+  } else {
+    // Not cached: take a free slot, or else throw out the oldest unused image
+    if (idx < 0) {
+      for (i = 0; i < PROCESS_MAX_IMAGES; i++) {
+	if ((images[i].users == 0) &&
+	    ((idx < 0) || (images[i].lastuse < images[idx].lastuse))) {
+	  idx = i;
+	}
+      }
+    }
+    if (idx < 0) {
+      printf ("ProcessImageGet: no free image slot for %s!\n", name);
+      return (-1);
+    }
+    if (images[idx].name[0] != '\0') {
+      ProcessImageEvict (idx);
+    }
+    if (ProcessImageLoad (idx, name) != PROCESS_SUCCESS) {
+      return (-1);
+    }
+  }
+  images[idx].users++;
+  images[idx].lastuse = ++imagestamp;
+  return (idx);
+}
+
+//----------------------------------------------------------------------
+//
+//	ProcessImageFault
+//
+//	Fill in virtual page vpage of pcb's code and global data area from
+//	its program image.  Code pages map the cached frame itself, read
+//	only.  Everything else gets a private copy, zeroed where the image
+//	has no bytes.  Returns MEM_SUCCESS or MEM_FAIL.
+//
+//----------------------------------------------------------------------
+int
+ProcessImageFault (PCB *pcb, int vpage)
+{
+  ProcessImage	*img;
+  uint32	*pte;
+  int		page;
+
+  if ((pcb->image < 0) || (vpage >= PROCESS_NUMPAGES_USERCODE_GLOBALDATA)) {
+    return (MEM_FAIL);
+  }
+  img = &images[pcb->image];
+  if ((pte = MemoryGetPTE (pcb, vpage, 1)) == NULL) {
+    return (MEM_FAIL);
+  }
+  if (img->readonly[vpage]) {
+    *pte = MemorySetupPTE (img->pages[vpage]) | MEM_PTE_READONLY;
+    MemorySharePage (*pte);
+  } else {
+    if ((page = MemoryAllocPage ()) == MEM_FAIL) {
+      return (MEM_FAIL);
+    }
+    if (img->pages[vpage] == MEM_FAIL) {
+      bzero ((char *)(page * MEM_PAGESIZE), MEM_PAGESIZE);
+    } else {
+      bcopy ((char *)(img->pages[vpage] * MEM_PAGESIZE),
+	     (char *)(page * MEM_PAGESIZE), MEM_PAGESIZE);
+    }
+    *pte = MemorySetupPTE (page);
+  }
+  pcb->npages++;
+  dbprintf ('m', "ProcessImageFault: (PID:%d) page %d of %s%s\n", GetCurrentPid(),
+	    vpage, img->name, img->readonly[vpage] ? " (shared)" : "");
+  return (MEM_SUCCESS);
+}
+
 //----------------------------------------------------------------------
 //
 //	ProcessGetFromFile
@@ -854,6 +1048,7 @@ void main (int argc, char *argv[])
   int numargs=0;
   char allargs[SIZE_ARG_BUFF];
   int allargs_offset = 0;
+  int membench = 0;
   
   debugstr[0] = '\0';
 
@@ -902,6 +1097,9 @@ void main (int argc, char *argv[])
 	close (fd);
 	break;
       }
+      case 'm':
+	membench = dstrtol (argv[++i], (void *)0, 0);
+	break;
       case 'u':
 	userprog = argv[++i];
         base = i; // Save the location of the user program's name 
@@ -955,6 +1153,10 @@ void main (int argc, char *argv[])
   } else {
     dbprintf('i', "No user program passed!\n");
   }
+  // Stress the page allocator if asked to (-m rounds)
+  if (membench > 0) {
+    ProcessFork(MemoryBenchmark, membench, "membench", 0);
+  }
   ClkStart();
   dbprintf ('i', "Set timer quantum to %d, about to run first process.\n",
 	    processQuantum);
@@ -2,13 +2,30 @@
 #include "misc.h"
 #include "files_shared.h"
 
+// Larger than a page, so transfers cross user page boundaries
+#define DFSAPITEST_BIG_BYTES (3*4096 + 100)
+char big[DFSAPITEST_BIG_BYTES];
+
+// Returns how many bytes of buf differ from the pattern the big file
+// holds at file offsets start .. start+n-1
+static int patternErrors(char *buf, int start, int n)
+{
+    int i, errors = 0;
+    for(i=0; i<n; i++) if(buf[i] != (char)((start + i) % 251)) errors++;
+    return errors;
+}
+
 void main (int argc, char *argv[])
 {
     // Variable declarations
-    int handle, i;
+    int handle, i, id;
+    sem_t done;
+    char * mapped;
     char * fname= "astpier-file1";
     char * strout = " ECE595LAB4";
     char rbuff[11];
+    char vbuff[3][10];
+    file_iovec iov[3];
 
     Printf("");
     Printf("\n\n"); 
@@ -41,6 +58,79 @@ void main (int argc, char *argv[])
     i = file_read(handle,rbuff,11);
     if(i == FILE_FAIL) Printf(" dfsAPItest.c : FILE READ FAILED\n");
     Printf("   Read from file:  %s\n",rbuff);
+
+    // 6. Map the file and read it through memory instead
+    Printf("  Mapping file \"astpier-file1\"... file_mmap(fhandle, 0, 11)\n");
+    mapped = file_mmap(handle, 0, 11);
+    if(mapped == (char *)FILE_FAIL) Printf(" dfsAPItest.c : FILE MMAP FAILED\n");
+    else
+    {
+        Printf("   Mapped at 0x%x:  %s\n", (int)mapped, mapped);
+        if(file_munmap(mapped) == FILE_FAIL) Printf(" dfsAPItest.c : FILE MUNMAP FAILED\n");
+    }
+    file_close(handle);
+
+    // 7. Move more than a page in one call, through the cursor
+    Printf("  Writing %d bytes to \"astpier-big\" in one file_write...\n", DFSAPITEST_BIG_BYTES);
+    for(i=0; i<DFSAPITEST_BIG_BYTES; i++) big[i] = (char)(i % 251);
+    handle = file_open("astpier-big", "w");
+    Printf("   file_write   =    %d (expecting %d)\n", file_write(handle, big, DFSAPITEST_BIG_BYTES), DFSAPITEST_BIG_BYTES);
+    file_close(handle);
+    for(i=0; i<DFSAPITEST_BIG_BYTES; i++) big[i] = 0;
+    handle = file_open("astpier-big", "r");
+    Printf("   file_read    =    %d (expecting %d)\n", file_read(handle, big, DFSAPITEST_BIG_BYTES), DFSAPITEST_BIG_BYTES);
+    Printf("   %d bytes differ (expecting 0)\n", patternErrors(big, 0, DFSAPITEST_BIG_BYTES));
+
+    // 8. Positional reads leave the cursor alone and stop at EOF
+    Printf("  Reading \"astpier-big\" at offsets with file_pread...\n");
+    Printf("   file_pread   =    %d (expecting 100)\n", file_pread(handle, big, 100, 5000));
+    Printf("   %d bytes differ (expecting 0)\n", patternErrors(big, 5000, 100));
+    Printf("   file_pread   =    %d (expecting 10, at EOF)\n", file_pread(handle, big, 100, DFSAPITEST_BIG_BYTES - 10));
+    file_close(handle);
+
+    // 9. Gather a write, patch it in place, then scatter it back
+    Printf("  Writing \"abc\", \"defgh\", \"ij\" to \"astpier-vec\" with file_writev...\n");
+    handle = file_open("astpier-vec", "w");
+    iov[0].base = "abc"; iov[0].len = 3;
+    iov[1].base = "defgh"; iov[1].len = 5;
+    iov[2].base = "ij"; iov[2].len = 2;
+    Printf("   file_writev  =    %d (expecting 10)\n", file_writev(handle, iov, 3));
+    Printf("   file_pwrite  =    %d (expecting 2, \"XY\" at byte 3)\n", file_pwrite(handle, "XY", 2, 3));
+    Printf("   file_write   =    %d (expecting 1, the cursor is still at 10)\n", file_write(handle, "k", 1));
+    file_close(handle);
+    Printf("  Reading it back into 4, 10 and 4 byte buffers with file_readv...\n");
+    handle = file_open("astpier-vec", "r");
+    for(i=0; i<30; i++) vbuff[i/10][i%10] = '-';
+    iov[0].base = vbuff[0]; iov[0].len = 4;
+    iov[1].base = vbuff[1]; iov[1].len = 10;
+    iov[2].base = vbuff[2]; iov[2].len = 4;
+    Printf("   file_readv   =    %d (expecting 11, short in the second buffer)\n", file_readv(handle, iov, 3));
+    vbuff[0][4] = vbuff[1][7] = vbuff[2][4] = '\0';
+    Printf("   buffers      =    %s %s %s (expecting abcX Yfghijk ----)\n", vbuff[0], vbuff[1], vbuff[2]);
+    file_close(handle);
+
+    // 10. Queue the big read, then wait on the semaphore for it
+    Printf("  Reading \"astpier-big\" with aio_submit...\n");
+    done = sem_create(0);
+    for(i=0; i<DFSAPITEST_BIG_BYTES; i++) big[i] = 0;
+    handle = file_open("astpier-big", "r");
+    Printf("   aio write    =    %d (expecting -1 through a read handle)\n", aio_submit(handle, FILE_AIO_WRITE, big, 10, 0, done));
+    id = aio_submit(handle, FILE_AIO_READ, big, DFSAPITEST_BIG_BYTES, 0, done);
+    if(id == FILE_FAIL) Printf(" dfsAPItest.c : AIO SUBMIT FAILED\n");
+    sem_wait(done);
+    Printf("   aio_status   =    %d (expecting %d)\n", aio_status(id), DFSAPITEST_BIG_BYTES);
+    Printf("   aio_status   =    %d (expecting -1, the id was freed)\n", aio_status(id));
+    Printf("   %d bytes differ (expecting 0)\n", patternErrors(big, 0, DFSAPITEST_BIG_BYTES));
+    file_close(handle);
+    Printf("  Writing \"astpier-aio\" with aio_submit, polling aio_status...\n");
+    handle = file_open("astpier-aio", "w");
+    id = aio_submit(handle, FILE_AIO_WRITE, strout, 11, 4096, done);
+    while((i = aio_status(id)) == FILE_AIO_PENDING);
+    sem_wait(done);
+    Printf("   aio_status   =    %d (expecting 11)\n", i);
+    Printf("   file_pread   =    %d (expecting 11)\n", file_pread(handle, rbuff, 11, 4096));
+    Printf("   Read from file:  %s\n", rbuff);
+    file_close(handle);
     
     Printf("============================================================\n"); 
     Printf(" dfsAPItest.c (PID: %d): DFS API test complete, process ending...\n", getpid()); 
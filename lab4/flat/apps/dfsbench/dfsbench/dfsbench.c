@@ -0,0 +1,78 @@
+#include "usertraps.h"
+#include "misc.h"
+#include "files_shared.h"
+
+#include "dfsbench.h"
+
+char buffer[DFSBENCH_CHUNK_BYTES];
+
+// Runs the write/read benchmark on one file opened with the
+// given write mode ("w" plain, "wc" compressed) and prints
+// throughput and the disk space the data took up.
+void RunBench(char *fname, char *mode)
+{
+    // Variable declarations
+    int handle, i, pass, stored;
+    int start, write_jiffies, read_jiffies;
+    int total = DFSBENCH_CHUNK_BYTES * DFSBENCH_NUM_CHUNKS;
+
+    // 1. Write the file sequentially in large chunks
+    file_delete(fname);
+    handle = file_open(fname, mode);
+    if(handle == FILE_FAIL) {  Printf(" dfsbench.c : FILE OPEN FOR WRITE FAILED\n"); Exit();  }
+    start = get_jiffies();
+    for(i=0; i<DFSBENCH_NUM_CHUNKS; i++)
+    {
+        if(file_write(handle, buffer, DFSBENCH_CHUNK_BYTES) == FILE_FAIL)
+        {  Printf(" dfsbench.c : FILE WRITE FAILED at chunk %d\n", i); Exit();  }
+    }
+    write_jiffies = get_jiffies() - start;
+    stored = file_stored_bytes(handle);
+    file_close(handle);
+
+    // 2. Read it back several times, later passes hit the buffer cache
+    start = get_jiffies();
+    for(pass=0; pass<DFSBENCH_NUM_PASSES; pass++)
+    {
+        handle = file_open(fname, "r");
+        if(handle == FILE_FAIL) {  Printf(" dfsbench.c : FILE OPEN FOR READ FAILED\n"); Exit();  }
+        for(i=0; i<DFSBENCH_NUM_CHUNKS; i++)
+        {
+            if(file_read(handle, buffer, DFSBENCH_CHUNK_BYTES) == FILE_FAIL)
+            {  Printf(" dfsbench.c : FILE READ FAILED at chunk %d\n", i); Exit();  }
+        }
+        file_close(handle);
+    }
+    read_jiffies = get_jiffies() - start;
+    file_delete(fname);
+
+    // 3. Report, in bytes per jiffy (guarding against a zero interval)
+    if(write_jiffies == 0) write_jiffies = 1;
+    if(read_jiffies == 0) read_jiffies = 1;
+    if(stored <= 0) stored = total;
+    Printf("  file_open(\"%s\", \"%s\")\n", fname, mode);
+    Printf("   wrote %d bytes in %d jiffies   = %d bytes/jiffy\n", total, write_jiffies, total/write_jiffies);
+    Printf("   read  %d bytes in %d jiffies   = %d bytes/jiffy\n", total*DFSBENCH_NUM_PASSES, read_jiffies, (total*DFSBENCH_NUM_PASSES)/read_jiffies);
+    Printf("   stored in %d disk bytes        = %d.%d:1 compression\n", stored, total/stored, (10*total/stored)%10);
+}
+
+void main (int argc, char *argv[])
+{
+    // Variable declarations
+    int i;
+    char * text = "DLXOS file system benchmark, highly compressible log text. ";
+
+    Printf("\n\n");
+    Printf("============================================================\n");
+    Printf(" dfsbench.c (PID: %d): DFS sequential throughput\n", getpid());
+    Printf("============================================================\n");
+    for(i=0; i<DFSBENCH_CHUNK_BYTES; i++) buffer[i] = text[i % dstrlen(text)];
+
+    RunBench("dfsbench-plain", "w");
+    RunBench("dfsbench-compressed", "wc");
+
+    Printf("============================================================\n");
+    Printf(" dfsbench.c (PID: %d): benchmark complete, process ending...\n", getpid());
+    Printf("============================================================\n");
+    Printf("\n\n");
+}
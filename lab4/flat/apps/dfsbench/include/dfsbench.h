@@ -0,0 +1,12 @@
+#ifndef __DFSBENCH_H__
+#define __DFSBENCH_H__
+
+#define DFSBENCH_CHUNK_BYTES 4096   // bytes per file_read/file_write
+#define DFSBENCH_NUM_CHUNKS 32      // 128KB file in total
+#define DFSBENCH_NUM_PASSES 4       // times the file is read back
+
+#ifndef NULL
+#define NULL (void *)0x0
+#endif
+
+#endif
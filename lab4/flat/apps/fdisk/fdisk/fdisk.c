@@ -6,6 +6,7 @@
 dfs_superblock sb;
 dfs_inode inodes[DFS_INODE_NMAX_NUM];
 uint32 fbv[DFS_FBV_MAX_NUM_WORDS];
+char zeroblock[DFS_MAX_BLOCKSIZE];  // for the per-block byte tables
 
 uint32 disk_bsize = 0;      // These are global in order to speed things up
 uint32 disksize = 0;        // (i.e. fewer traps to OS to get the same number)
@@ -25,38 +26,57 @@ void main (int argc, char *argv[])
     Printf(" fdisk.c (PID: %d): Q1, user program to format disk\n", getpid()); 
     Printf("============================================================\n"); 
 
-    // 1. argc check
-    if (argc != 1) 
-    {  Printf("ERROR: no input expected, %s\n", argv[0]); Exit();  }
+    // 1. argc check, optional DFS block size (1024, 2048 or 4096),
+    //    number of disk images to stripe over and stripe unit (in
+    //    DFS blocks)
+    if (argc > 4) 
+    {  Printf("Usage: %s [blocksize [ndisks [stripe_blocks]]]\n", argv[0]); Exit();  }
+    sb.bsize = FDISK_DFS_BLOCKSIZE;
+    sb.ndisks = 1;
+    i = FDISK_STRIPE_BLOCKS;
+    if (argc >= 2) sb.bsize = dstrtol(argv[1], NULL, 10);
+    if (argc >= 3) sb.ndisks = dstrtol(argv[2], NULL, 10);
+    if (argc >= 4) i = dstrtol(argv[3], NULL, 10);
+    if (sb.bsize != 1024 && sb.bsize != 2048 && sb.bsize != 4096)
+    {  Printf("ERROR: block size must be 1024, 2048 or 4096, not %d\n", sb.bsize); Exit();  }
+    if (i < 1) {  Printf("ERROR: stripe unit must be at least one block\n"); Exit();  }
     
     // 2. Use sys calls to calculate basic filesystem parameters (GLOBALS)
     Printf("  Calculating essential DFS parameters using system calls...\n");
     if(sizeof(dfs_inode) != 128)
     {  Printf("ERROR: Size of inode isn't 128 bytes %d\n"); Exit();  }
     Printf("   sizeof(dfs_inode)            = %d bytes\n",sizeof(dfs_inode)); 
-    disksize = disk_size();     
-    Printf("   disk_size()                  = %d bytes\n",disksize);
-    for(i=0; i<disk_bsize;i++) diskblock_buffer[i]=0;
+    for(j=0; j<disk_blocksize();j++) diskblock_buffer[j]=0;
     disk_bsize = disk_blocksize();
     Printf("   disk_blocksize()             = %d bytes\n",disk_bsize);
+    sb.stripe = i * (sb.bsize / disk_bsize);
+    if(disk_set_stripe(sb.ndisks, sb.stripe) == DISK_FAIL)
+    {  Printf("ERROR: can't stripe over %d disks\n", sb.ndisks); Exit();  }
+    Printf("   disk_set_stripe()            = %d disks, %d blocks/stripe\n",sb.ndisks,sb.stripe);
+    disksize = disk_size();     
+    Printf("   disk_size()                  = %d bytes\n",disksize);
     
     // 3. Invalidate filesystem before writing to it to make sure OS
     //    does not wipe out what we do here with old version in mem
     sb.valid = 0;
     Printf("  Initializing superblock...\n");
-    sb.bsize = DFS_BLOCKSIZE;
     Printf("   sb.bsize                     = %d bytes\n",sb.bsize);
     sb.nblocks = disksize / sb.bsize;
+    if(sb.nblocks > DFS_MAX_NUM_BLOCKS) sb.nblocks = DFS_MAX_NUM_BLOCKS; // driver's limit
     Printf("   sb.nblocks                   = %d blocks\n",sb.nblocks);
     sb.ninodes = FDISK_NUM_INODES;
     Printf("   sb.ninodes                   = %d inodes\n",sb.ninodes);
     sb.inodeBstart = FDISK_INODE_BLOCK_START;
-    sb.fbvBstart = FDISK_FBV_BLOCK_START;
-    sb.dataBstart = FDISK_FBV_BLOCK_START + (((sb.nblocks+31)/32*4) + (sb.bsize-1))/sb.bsize;
+    sb.fbvBstart = FDISK_FBV_BLOCK_START(sb.bsize);
+    sb.refBstart = sb.fbvBstart + (((sb.nblocks+31)/32*4) + (sb.bsize-1))/sb.bsize;
+    sb.compBstart = sb.refBstart + (sb.nblocks + (sb.bsize-1))/sb.bsize;
+    sb.dataBstart = sb.compBstart + (sb.nblocks + (sb.bsize-1))/sb.bsize;
     Printf("  DLXOS File System (DFS) structure...\n");
     Printf("   Block 0                      = master boot record + sb\n");
     Printf("   Blocks %d --> %d              = arr inode structures\n",sb.inodeBstart,(sb.fbvBstart-1));
-    Printf("   Blocks %d --> %d             = free block vector\n",sb.fbvBstart,(sb.dataBstart-1));
+    Printf("   Blocks %d --> %d             = free block vector\n",sb.fbvBstart,(sb.refBstart-1));
+    Printf("   Blocks %d --> %d             = block share counts\n",sb.refBstart,(sb.compBstart-1));
+    Printf("   Blocks %d --> %d            = compressed block sizes\n",sb.compBstart,(sb.dataBstart-1));
     Printf("   Blocks %d --> %d          = data blocks\n",sb.dataBstart,(sb.nblocks));
     
     // 4. Make sure the disk exists before doing anything else
@@ -70,21 +90,35 @@ void main (int argc, char *argv[])
     {
         inodes[i].inuse = 0;
         inodes[i].fsize = 0;
-        inodes[i].fname[0] = '\0';
+        inodes[i].type = DFS_INODE_TYPE_FILE;
+        inodes[i].flags = 0;
+        inodes[i].parent = DFS_ROOT_INODE;
+        for(j=0; j<DFS_INODE_IDATA_LENGTH; j++) inodes[i].idata[j] = 0;
         for(j=0; j<DFS_INODE_BTABLE_SIZE; j++) inodes[i].btable[j] = -1;
         inodes[i].ibtable = -1;
         inodes[i].iibtable = -1;
     }
+    // Inode 0 is the (empty) root directory, its own parent
+    Printf("  Creating the root directory in inode %d...\n", DFS_ROOT_INODE); 
+    inodes[DFS_ROOT_INODE].inuse = 1;
+    inodes[DFS_ROOT_INODE].type = DFS_INODE_TYPE_DIR;
     ptr = (char *)inodes;
     for(i=sb.inodeBstart; i<sb.fbvBstart; i++) FdiskWriteBlock(i,&ptr);
 
     // 6. Next, setup free block vector (fbv) and write fbv to the disk
     Printf("  Clearing the free block vector...\n"); 
-    fbv[0] = 0xFFFFFF00; //using 24 blocks for dfs
-    for(i=1; i<DFS_FBV_MAX_NUM_WORDS; i++) fbv[i] = 0;  // Initialize by clearing all
+    for(i=0; i<DFS_FBV_MAX_NUM_WORDS; i++) fbv[i] = 0;  // Initialize by clearing all
+    // Boot block, superblock, inodes and fbv are in use, and so are
+    // the bits past the last block in the final fbv word
+    for(i=0; i<sb.dataBstart; i++) fbv[i/32] |= (0x80000000 >> (i%32));
+    for(i=sb.nblocks; i<(sb.nblocks+31)/32*32; i++) fbv[i/32] |= (0x80000000 >> (i%32));
     Printf("  Writing free block vector to disk...\n"); 
     ptr = (char *)fbv;
-    for(i=sb.fbvBstart; i<sb.dataBstart; i++) FdiskWriteBlock(i,&ptr);
+    for(i=sb.fbvBstart; i<sb.refBstart; i++) FdiskWriteBlock(i,&ptr);
+
+    // No block is shared by a clone or compressed yet
+    Printf("  Clearing the block share counts and compressed sizes...\n"); 
+    for(i=sb.refBstart; i<sb.dataBstart; i++) {  ptr = zeroblock; FdiskWriteBlock(i,&ptr);  }
 
 
     // 7. Finally, setup superblock as valid filesystem & write to disk
@@ -9,8 +9,9 @@ typedef unsigned int uint32;
 
 // Number of file system blocks to use for inodes
 #define FDISK_NUM_INODES 128
-#define FDISK_INODE_NUM_BLOCKS FDISK_NUM_INODES*sizeof(dfs_inode)/DFS_BLOCKSIZE // = 16blocks
-#define FDISK_FBV_BLOCK_START FDISK_INODE_NUM_BLOCKS+FDISK_INODE_BLOCK_START // = 17
+// (depends on the block size chosen on the command line)
+#define FDISK_INODE_NUM_BLOCKS(bsize) (FDISK_NUM_INODES*sizeof(dfs_inode)/(bsize)) // = 16blocks @ 1K
+#define FDISK_FBV_BLOCK_START(bsize) (FDISK_INODE_NUM_BLOCKS(bsize)+FDISK_INODE_BLOCK_START) // = 17 @ 1K
 // Where boot record and superblock reside in the filesystem
 #define FDISK_BOOT_FILESYSTEM_BLOCKNUM 0
 #ifndef NULL
@@ -18,6 +19,7 @@ typedef unsigned int uint32;
 #endif
 
 //STUDENT: define additional parameters here, if any
-#define FDISK_DFS_BLOCKSIZE DFS_BLOCKSIZE
+#define FDISK_DFS_BLOCKSIZE DFS_BLOCKSIZE // default when no size is given
+#define FDISK_STRIPE_BLOCKS 4 // default stripe unit, in DFS blocks
 
 #endif
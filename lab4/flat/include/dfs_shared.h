@@ -10,37 +10,93 @@ typedef struct dfs_superblock {
     int ninodes;
     int inodeBstart;
     int fbvBstart; 
+    int refBstart;  // block share counts, see below
+    int compBstart; // compressed block sizes, see below
     int dataBstart; 
+    int ndisks;     // disk images the blocks are striped over
+    int stripe;     // stripe unit, in disk blocks
 } dfs_superblock;
 
 // --------------------------------------------------------
 // DFS block type definition
-// DFS disk blocksize = 512 bytes (int multiple == 2)
-#define DFS_BLOCKSIZE 1024  // Integer mult of disk blksze
+// DFS disk blocksize = 512 bytes. fdisk picks the DFS block
+// size (1K, 2K or 4K, an integer mult of the disk blksze) 
+// and stores it in sb.bsize; everything else is sized from
+// sb.bsize at runtime. dfs_block is big enough for any.
+#define DFS_MIN_BLOCKSIZE 1024
+#define DFS_MAX_BLOCKSIZE 4096
+#define DFS_BLOCKSIZE DFS_MIN_BLOCKSIZE  // fdisk default
 typedef struct dfs_block {
-  char data[DFS_BLOCKSIZE];
+  char data[DFS_MAX_BLOCKSIZE];
 } dfs_block;
 
 // --------------------------------------------------------
 // DFS Inode type definitions and constants
-#define DFS_INODE_MAX_FNAME_LENGTH 72
 #define DFS_INODE_BTABLE_SIZE 10
+#define DFS_INODE_TYPE_FILE 0
+#define DFS_INODE_TYPE_DIR 1
+// File contents live in the inode itself (idata running on
+// into btable/ibtable/iibtable) while the file is small.
+#define DFS_INODE_FLAG_INLINE 0x1
+// Data blocks of the file are LZ compressed when written.
+#define DFS_INODE_FLAG_COMPRESS 0x2
+#define DFS_INODE_IDATA_LENGTH 64
 typedef struct dfs_inode {
     int inuse;
-    int fsize; 
-    char fname[DFS_INODE_MAX_FNAME_LENGTH];
+    int fsize;      // bytes for files, number of entries for dirs
+    short type;     // DFS_INODE_TYPE_FILE or DFS_INODE_TYPE_DIR
+    short flags;    // DFS_INODE_FLAG_*
+    int parent;     // inode number of the containing directory
+    char idata[DFS_INODE_IDATA_LENGTH]; // start of inline data
     int btable[DFS_INODE_BTABLE_SIZE];
     int ibtable;
     int iibtable;
     // Total size: 128 bytes
-    // 16+40 = 56
-    // 128-56 = 72
+    // 16+64+40+8 = 128
 } dfs_inode;
+// Inline capacity: idata plus the block pointers it overlays
+#define DFS_INODE_INLINE_MAX (DFS_INODE_IDATA_LENGTH + (DFS_INODE_BTABLE_SIZE+2)*4) // = 112
 
-#define DFS_MAX_FILESYSTEM_SIZE 0x10000000  // 64MB 
-#define DFS_MAX_NUM_BLOCKS (DFS_MAX_FILESYSTEM_SIZE / DFS_BLOCKSIZE)
-// 8 dfs blocks for fbv => 1024*8=8192bytes / 4(bytes/word) = 1024
-#define DFS_FBV_MAX_NUM_WORDS (DFS_BLOCKSIZE*8)/4
+// --------------------------------------------------------
+// Directory entry type definitions and constants
+// A directory's data blocks are the hash buckets of a
+// table of name->inode entries. The bucket for a name is
+// DfsNameHash(name) % DFS_DIR_NUM_BUCKETS, and each bucket
+// is one of the direct blocks of the directory inode, so a
+// lookup touches a single block unless its bucket is full
+// (then it probes the next bucket). Unallocated buckets
+// (btable entry of -1) are empty and cost no disk I/O.
+#define DFS_DIRENT_NAME_LENGTH 60
+#define DFS_DIRENT_FREE -1      // never used, ends a probe
+#define DFS_DIRENT_DELETED -2   // removed, probe continues
+typedef struct dfs_dirent {
+    int inode;
+    char name[DFS_DIRENT_NAME_LENGTH];
+    // Total size: 64 bytes
+} dfs_dirent;
+#define DFS_DIR_NUM_BUCKETS DFS_INODE_BTABLE_SIZE
+#define DFS_ROOT_INODE 0
+#define DFS_MAX_PATH_LENGTH 256
+
+// The driver's tables are sized for this many blocks, so a
+// file system is at most 64MB with 1K blocks and 256MB (a
+// 4 disk stripe) with 4K blocks. fdisk clamps nblocks.
+#define DFS_MAX_NUM_BLOCKS 0x10000
+#define DFS_MAX_FILESYSTEM_SIZE (DFS_MAX_NUM_BLOCKS * DFS_MAX_BLOCKSIZE)  // 256MB 
+// 65536 blocks / 32 (blocks/word) = 2048 words = 8192 bytes
+#define DFS_FBV_MAX_NUM_WORDS ((DFS_MAX_NUM_BLOCKS+31)/32)
+
+// One byte per block, stored between the FBV and the data
+// blocks: how many inodes share the block beyond the first
+// (0 for an unshared or free block). Set by file clones.
+#define DFS_REFCOUNT_MAX 255
+
+// One byte per block, after the share counts: the number of
+// disk blocks a compressed DFS block was stored in, or 0 if
+// it is stored uncompressed. DFS_CSECTORS_UNWRITTEN marks a block
+// reserved by preallocation and never written, which reads
+// as zeros without touching the disk.
+#define DFS_CSECTORS_UNWRITTEN 0xFF
 #define DFS_INODE_NMAX_NUM 128
 #define DFS_SB_PBLOCK 1 // where write sb on disk
 #define DFS_FAIL -1
@@ -6,18 +6,31 @@
 #define FILE_SEEK_END 2
 #define FILE_SEEK_CUR 3
 
-#define FILE_MAX_FILENAME_LENGTH 72
-#define FILE_MAX_READWRITE_BYTES 4096
+#define FILE_MAX_FILENAME_LENGTH 256 // full path, see DFS_MAX_PATH_LENGTH
+#define FILE_MAX_DIRENT_NAME_LENGTH 60 // matches DFS_DIRENT_NAME_LENGTH
+// An entry of the kernel's open file table. A process's file
+// handles index its own descriptor table, whose entries point
+// here, so several processes can have the same file open.
 typedef struct file_descriptor {
     int inuse;
-    char fname[FILE_MAX_FILENAME_LENGTH];
     int inodeHandle;
     int eof;
     int cpos;
-    int mypid;
     char mode;
 } file_descriptor;
 
+// One buffer of a file_readv/file_writev batch
+typedef struct file_iovec {
+    char *base;
+    int len;
+} file_iovec;
+#define FILE_MAX_IOVECS 16 // buffers per batch
+
+// aio_submit operations, and what aio_status reports until one is done
+#define FILE_AIO_READ 0
+#define FILE_AIO_WRITE 1
+#define FILE_AIO_PENDING -2
+
 #define FILE_FAIL -1
 #define FILE_EOF -1
 #define FILE_SUCCESS 1
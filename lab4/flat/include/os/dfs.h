@@ -3,16 +3,51 @@
 
 #include "dfs_shared.h"
 
+// Directory entry (dentry) cache: maps (parent inode, name)
+// to an inode so repeated path walks skip the dir blocks
+#define DFS_DCACHE_SIZE 64
+typedef struct dfs_dentry {
+    int inuse;
+    uint32 parent;
+    uint32 inode;
+    char name[DFS_DIRENT_NAME_LENGTH];
+} dfs_dentry;
+
+// Buffer cache: a fixed pool of bytes carved into sb.bsize
+// buffers when the file system is opened. Write-through,
+// least recently used buffer is replaced on a miss.
+#define DFS_CACHE_POOL_BYTES (32*1024)
+#define DFS_CACHE_MAX_BUFFERS (DFS_CACHE_POOL_BYTES / DFS_MIN_BLOCKSIZE)
+typedef struct dfs_cache_buffer {
+    int blocknum;   // DFS block held here, -1 if empty
+    int lastused;   // LRU stamp
+    char *data;     // sb.bsize bytes inside the pool
+} dfs_cache_buffer;
+
+// Swap area: a run of blocks the memory manager pages out
+// to, set aside each time the file system is opened.
+#define DFS_SWAP_BYTES (8*1024*1024)
+
 // Function prototypes
 void DfsInvalidate();
 uint32 DfsFBVChecker(uint32 blocknum);
 void DfsFBVSet(uint32 blocknum, uint32 val);
 uint32 DfsAllocateBlock();
+uint32 DfsAllocateBlockRun(int count);
+int DfsBlockShare(uint32 blocknum);
+int DfsBlockIsShared(uint32 blocknum);
+int DfsWriteBlockCompressed(uint32 blocknum, dfs_block *b);
+int DfsBlockStoredBytes(uint32 blocknum);
+int DfsSwapBytes();
+int DfsSwapRead(int start_byte, void *mem, int num_bytes);
+int DfsSwapWrite(int start_byte, void *mem, int num_bytes);
 int DfsFreeBlock(uint32 blocknum);
 int DfsReadBlock(uint32 blocknum, dfs_block *b); 
 int DfsWriteBlock(uint32 blocknum, dfs_block *b);
 int DfsOpenFileSystem();
 void DfsModuleInit();
+void DfsCacheInit();
+uint32 DfsBlockSize();
 int DfsCloseFileSystem();
 uint32 DfsInodeFilenameExists(char *filename);
 uint32 DfsInodeOpen(char *filename);
@@ -20,7 +55,22 @@ int DfsInodeDelete(uint32 handle);
 int DfsInodeReadBytes(uint32 handle, void *mem, int start_byte, int num_bytes);
 int DfsInodeWriteBytes(uint32 handle, void *mem, int start_byte, int num_bytes);
 uint32 DfsInodeFilesize(uint32 handle);
+int DfsInodePunchHole(uint32 handle, int start_byte, int num_bytes);
+int DfsInodePreallocate(uint32 handle, int num_bytes);
+uint32 DfsInodeClone(uint32 handle, char *path);
+int DfsInodeEnableCompression(uint32 handle);
+int DfsInodeStoredBytes(uint32 handle);
 uint32 DfsInodeAllocateVirtualBlock(uint32 handle, uint32 virtual_blocknum);
+int DfsInodeFreeVirtualBlock(uint32 handle, uint32 virtual_blocknum);
 uint32 DfsInodeTranslateVirtualToFilesys(uint32 handle, uint32 virtual_blocknum);
+uint32 DfsNameHash(char *name);
+uint32 DfsDirLookup(uint32 dir, char *name);
+int DfsDirAddEntry(uint32 dir, char *name, uint32 inode);
+int DfsDirRemoveInode(uint32 dir, uint32 inode);
+uint32 DfsInodeWalkPath(char *path, char *name);
+int DfsInodeIsDir(uint32 handle);
+uint32 DfsInodeMkdir(char *path);
+int DfsInodeRmdir(char *path);
+int DfsInodeReaddir(uint32 handle, int pos, char *name);
 
 #endif
@@ -4,6 +4,14 @@
 // Name of file which represents the "hard disk".
 #define DISK_FILENAME "/tmp/ee469g77.img"
 
+// The disk can be striped (RAID-0) over up to this many 
+// image files, the first of which is DISK_FILENAME. A 
+// stripe unit of at least 2 disk blocks keeps blocks 0 and 
+// 1 (boot record, superblock) on the first image.
+#define DISK_MAX_MEMBERS 4
+#define DISK_MEMBER_FILENAMES { DISK_FILENAME, "/tmp/ee469g77-1.img", "/tmp/ee469g77-2.img", "/tmp/ee469g77-3.img" }
+#define DISK_MIN_STRIPE 2
+
 // Number of bytes in one physical disk block
 #define DISK_BLOCKSIZE 512 
 
@@ -12,7 +20,7 @@ typedef struct disk_block {
     char data[DISK_BLOCKSIZE]; // DISK_BLOCKSIZE % 4 = 0 (byte alignment)
 } disk_block;
 
-// Total size of this disk, in units of 512-byte blocks
+// Size of each disk image, in units of 512-byte blocks
 //  64-megabytes / 512-bytes = 125,000 blocks
 #define DISK_NUMBLOCKS 125000
 
@@ -22,6 +30,7 @@ typedef struct disk_block {
 int DiskBytesPerBlock();
 int DiskSize();
 int DiskCreate();
+int DiskSetStripe(int members, int stripe);
 int DiskWriteBlock (uint32 blocknum, disk_block *b);
 int DiskReadBlock (uint32 blocknum, disk_block *b);
 
@@ -2,18 +2,54 @@
 #define __FILES_H__
 
 #include "dfs.h"
+#include "process.h"
+#include "synch.h"
 #include "files_shared.h"
 
 // Definitions
-#define FILE_MAX_OPEN_FILES 15
 #define FMODE_R 1
 #define FMODE_W 2
+#define FILE_AIO_MAX_REQUESTS 32 // system wide, queued or awaiting aio_status
+
+// An asynchronous request, carried out by the "aio" system process
+typedef struct file_aio_request {
+    int inuse;
+    PCB *pcb;           // Owner, NULL if buf is a system address
+    int inodeHandle;    // Pinned until the request completes
+    int op;             // FILE_AIO_READ or FILE_AIO_WRITE
+    char *buf;
+    int len;
+    int offset;
+    sem_t sem;          // Signalled on completion
+    int seq;            // Requests run in submission order
+    int status;         // FILE_AIO_PENDING, then bytes moved or FILE_FAIL
+} file_aio_request;
 
 // Function prototypes
+void FileModuleInit();
+void FileInitDescriptors(PCB *pcb);
+void FileCloseAll(PCB *pcb);
 uint32 FileOpen(char * filename, char * mode);
 int FileClose(uint32 handle);
 int FileRead(uint32 handle, void * mem, int num_bytes);
 int FileWrite(uint32 handle, void * mem, int num_bytes);
 int FileSeek(uint32 handle, int num_bytes, int from_where);
+int FilePread(uint32 handle, void * mem, int num_bytes, int offset);
+int FilePwrite(uint32 handle, void * mem, int num_bytes, int offset);
+int FileTell(uint32 handle);
 int FileDelete(char * filename);
+int FileMkdir(char *path);
+int FileRmdir(char *path);
+int FileReaddir(char *path, int pos, char *name);
+int FilePunchHole(uint32 handle, int start_byte, int num_bytes);
+int FilePreallocate(uint32 handle, int num_bytes);
+int FileClone(char *src, char *dst);
+int FileStoredBytes(uint32 handle);
+uint32 FileMmap(uint32 handle, int offset, int length);
+int FileMunmap(uint32 addr);
+void FileUnmapAll(PCB *pcb);
+int FileMmapFault(PCB *pcb, int vpage);
+int FileAioSubmit(uint32 handle, int op, char *buf, int len, int offset, sem_t sem, int sysMode);
+int FileAioStatus(int id);
+void FileAioCancelAll(PCB *pcb);
 #endif
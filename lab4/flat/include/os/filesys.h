@@ -39,6 +39,7 @@ typedef struct Fs {
   int	(*Read)(int, char *, int);
   int	(*Write)(int, char *, int);
   int	(*Seek)(int, int, int);
+  int	(*Truncate)(int, int, int);
   int	(*Close)(int);
   int	(*Delete)(const char *);
 } Fs;
@@ -66,6 +67,7 @@ extern int	FsOpen (const char *, int);
 extern int	FsRead (int, char *, int);
 extern int	FsWrite (int, char *, int);
 extern int	FsSeek (int, int, int);
+extern int	FsTruncate (int, int, int);
 extern int	FsClose (int);
 extern int	FsDelete (const char *);
 
@@ -0,0 +1,19 @@
+#ifndef __LZ_H__
+#define __LZ_H__
+
+// Small LZSS codec used to compress DFS data blocks. Output
+// is groups of up to 8 items, each group led by a flag byte 
+// (bit k set = item k is a match). A literal is one byte, a 
+// match is two: a 12-bit back offset and a 4-bit length.
+#define LZ_MIN_MATCH 3
+#define LZ_MAX_MATCH (LZ_MIN_MATCH + 15)
+#define LZ_MAX_OFFSET 4095
+#define LZ_HASH_SIZE 1024
+#define LZ_HASH(s,i) ((((s)[i] << 6) ^ ((s)[(i)+1] << 3) ^ (s)[(i)+2]) & (LZ_HASH_SIZE-1))
+
+#define LZ_FAIL -1
+
+int LzCompress(char *src, int srclen, char *dst, int dstmax);
+int LzDecompress(char *src, int srclen, char *dst, int dstmax);
+
+#endif
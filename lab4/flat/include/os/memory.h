@@ -13,8 +13,10 @@
 // is available on the system.
 #define	DLX_MEMSIZE_ADDRESS	0xffff0000
 
-// We currently support 64 KB pages.  This is done as 64 KB pages in
-// the level 1 page table and no level 2 page table
+// We currently support 64 KB pages, mapped through a two-level page
+// table.  Each L1 entry covers 16 MB with an L2 table of 256 PTEs
+// (1 KB), and 64 of those are carved out of every page set aside
+// for L2 tables.
 // These two constants should be set as follows:
 // L1_PAGE_SIZE_BITS -> amount mapped by a single entry in the L1 table
 // L2_PAGE_SIZE_BITS -> amount mapped by a single entry in the L2 table
@@ -22,9 +24,11 @@
 // For example, if you have 4KB pages and each L2 page table has 512 entries,
 // you'd have 2MB per entry in a L1 table.  That would mean L1_BITS=21 and
 // L2_BITS=12.
-#define	MEMORY_L1_PAGE_SIZE_BITS 16	// each entry in L1 is 64 KB
+#define	MEMORY_L1_PAGE_SIZE_BITS 24	// each entry in L1 is 16 MB
 #define	MEMORY_L2_PAGE_SIZE_BITS 16	// if L1 == L2, there's no L2 tables
 #define	MEMORY_PAGE_SIZE	(1 << MEMORY_L2_PAGE_SIZE_BITS)
+#define	MEMORY_L2_TABLE_ENTRIES	(1 << (MEMORY_L1_PAGE_SIZE_BITS - MEMORY_L2_PAGE_SIZE_BITS))
+#define	MEMORY_L2_TABLE_SIZE	(MEMORY_L2_TABLE_ENTRIES * sizeof (uint32))
 
 #define	MEMORY_PAGE_MASK	(MEMORY_PAGE_SIZE-1)
 #define	MEMORY_MAX_PAGES	0x10000
@@ -36,16 +40,37 @@
 // The page has been referenced if this bit is set in the PTE
 #define	MEMORY_PTE_REFERENCED	0x00000004
 #define	MEMORY_PTE_MASK		(~(MEMORY_PTE_VALID|MEMORY_PTE_DIRTY|MEMORY_PTE_REFERENCED))
+// An invalid PTE with this bit set is for a page that was paged out.
+// The swap slot holding it is kept where the frame address would be.
+#define	MEMORY_PTE_SWAPPED	0x00000008
+
+// Page replacement.  Only the first MEMORY_MAX_FRAMES frames can be
+// paged out, and at most MEMORY_MAX_SWAP_SLOTS pages of the swap area
+// are used.  Once fewer than PAGEOUT_LOW frames are free, pages are
+// put out at every process quantum until PAGEOUT_HIGH are.
+#define	MEMORY_MAX_FRAMES	1024
+#define	MEMORY_MAX_SWAP_SLOTS	1024
+#define	MEMORY_PAGEOUT_LOW	4
+#define	MEMORY_PAGEOUT_HIGH	8
+
+#define	MEM_FAIL	-1
+#define	MEM_SUCCESS	1
 
 extern int	lastosaddress;		// Defined in an assembly file
 extern int	MemoryGetSize ();
 extern int	MemoryAllocPage ();
 extern void	MemoryFreePage (uint32 page);
+extern void	MemorySetPageOwner ();
+extern void	MemoryPageout ();
 extern uint32	MemorySetupPte (uint32 page);
 extern void	MemoryFreePte (uint32 pte);
+extern uint32	*MemoryGetPte ();
+extern void	MemoryFreePageTables ();
 extern uint32	MemoryPteToPage ();
 extern void	MemoryModuleInit ();
 extern uint32	MemoryTranslateUserToSystem ();
+extern uint32	MemoryTranslateUserForWrite ();
+extern int	MemoryPageFaultHandler ();
 extern int	MemoryCopySystemToUser ();
 extern int	MemoryCopyUserToSystem ();
 
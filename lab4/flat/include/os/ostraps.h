@@ -15,6 +15,9 @@ int read(int fd, char *buf, int numbytes);
 int write(int fd, char *buf, int numbytes);
 int lseek(int fd, int offset, int where);
 int close(int fd);
+// Sets the length of an open host file to nunits*unitsize bytes,
+// growing it sparsely (trap 0x2015 in the simulator).
+int ftruncate(int fd, int nunits, int unitsize);
 void bcopy(char *source, char *destination, int numbytes);
 void exitsim();
 void TimerSet(int us);
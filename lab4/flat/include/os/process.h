@@ -11,12 +11,11 @@
 
 #include "dlxos.h"
 #include "queue.h"
+#include "memory.h"
 
 #define PROCESS_FAIL 0
 #define PROCESS_SUCCESS 1
 
-#define	PROCESS_MAX_PROCS	32	// Maximum number of active processes
-
 #define	PROCESS_INIT_ISR_SYS	0x140	// Initial status reg value for system processes
 #define	PROCESS_INIT_ISR_USER	0x100	// Initial status reg value for user processes
 
@@ -31,6 +30,29 @@
 
 typedef	void (*VoidFunc)();
 
+// File handles per process. One word of PCB.fdfree covers them,
+// so finding a free handle takes constant time.
+#define PROCESS_MAX_FDS 32
+
+// Virtual pages per process (64 MB). Page 0 holds the program and its
+// stack, the rest are left invalid for file mappings. Only the L1 table
+// lives in the PCB, L2 tables are added as pages get mapped.
+#define PROCESS_MAX_PAGES 1024
+#define PROCESS_L1_ENTRIES (PROCESS_MAX_PAGES / MEMORY_L2_TABLE_ENTRIES)
+
+// Memory-mapped file regions per process, see FileMmap
+#define PROCESS_MAX_MMAPS 4
+
+typedef struct mmap_region {
+  int		inuse;
+  int		vpage;		// First virtual page of the region
+  int		npages;
+  int		inodeHandle;	// Pinned for as long as the region exists
+  int		offset;		// File offset mapped at the start of vpage
+  int		length;		// Bytes of the file the region covers
+  int		writable;	// Dirty pages go back to the file
+} mmap_region;
+
 // Process control block
 typedef struct PCB {
   uint32	*currentSavedFrame; // -> current saved frame.  MUST BE 1ST!
@@ -38,7 +60,7 @@ typedef struct PCB {
   uint32	sysStackArea;	// System stack area for this process
   unsigned int	flags;
   char		name[80];	// Process name
-  uint32	pagetable[16];	// Statically allocated page table
+  uint32	pagetable[PROCESS_L1_ENTRIES]; // L1 table: L2 table addresses, 0 if none
   int		npages;		// Number of pages allocated to this process
   Link		*l;		// Used for keeping PCB in queues
 
@@ -57,6 +79,10 @@ typedef struct PCB {
   int           base_prio;      // Base priority (50 for user processes)
 
   int           isidle;         // Indicates if this PCB is the idle process
+
+  int           fds[PROCESS_MAX_FDS]; // File handle -> open file's cache handle, -1 if free
+  uint32        fdfree;         // Bit i set = file handle i is free
+  mmap_region   mmaps[PROCESS_MAX_MMAPS]; // Mapped files, faulted in on first touch
 } PCB;
 
 // Offsets of various registers from the stack pointer in the register
@@ -14,8 +14,6 @@
 #define	NULL	((void *)0)
 #endif
 
-#define	QUEUE_MAX_LINKS		400
-
 #define QUEUE_FAIL 0
 #define QUEUE_SUCCESS 1
 
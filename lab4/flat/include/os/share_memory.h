@@ -15,8 +15,6 @@
 
 #define MEMORY_MAX_SHARED_PAGES 32 //Maximum number of pages that can be
 				   //shared amongst different processes
-#define PROCESS_MAX_PAGES 16	   //Maximum number of pages allowed in Level
-				   //1 page table
 
 void SharedInitModule();	//Turns on the shared memory module
 uint32 MemoryCreateSharedPage(PCB *pcb);
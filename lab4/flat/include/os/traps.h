@@ -86,6 +86,7 @@
 #define TRAP_DISK_WRITE_BLOCK   0x467
 #define TRAP_DISK_SIZE          0x468
 #define TRAP_DISK_BLOCKSIZE     0x469
+#define TRAP_DISK_SET_STRIPE    0x46A
 #define TRAP_DISK_CREATE        0x470
 
 // Traps for DFS filesystem
@@ -98,8 +99,24 @@
 #define TRAP_FILE_READ          0x475
 #define TRAP_FILE_WRITE         0x476
 #define TRAP_FILE_SEEK          0x477
+#define TRAP_FILE_MKDIR         0x478
+#define TRAP_FILE_RMDIR         0x479
+#define TRAP_FILE_READDIR       0x47A
+#define TRAP_FILE_PUNCH_HOLE    0x47B
+#define TRAP_FILE_PREALLOCATE   0x47C
+#define TRAP_FILE_CLONE         0x47D
+#define TRAP_FILE_STORED_BYTES  0x47E
+#define TRAP_FILE_MMAP          0x47F
+#define TRAP_FILE_MUNMAP        0x480
+#define TRAP_FILE_PREAD         0x481
+#define TRAP_FILE_PWRITE        0x482
+#define TRAP_FILE_READV         0x483
+#define TRAP_FILE_WRITEV        0x484
+#define TRAP_AIO_SUBMIT         0x485
+#define TRAP_AIO_STATUS         0x486
 
 // Misc. Traps
+#define TRAP_GET_JIFFIES        0x4FE
 #define TRAP_TESTOS             0x4FF
 
 #define TRAP_USER_EXIT          0x500
@@ -52,6 +52,7 @@ int cond_broadcast(cond_t cond);	//trap 0x459
 int disk_write_block(int blocknum, char *b); //trap 0x467
 int disk_size();                        //trap 0x468
 int disk_blocksize();                   //trap 0x469
+int disk_set_stripe(int ndisks, int stripe); //trap 0x46A
 int disk_create();                      //trap 0x470
 
 // Related to DFS file system
@@ -64,10 +65,29 @@ int file_delete(char *filename);
 int file_read(unsigned int handle, void *mem, int num_bytes);
 int file_write(unsigned int handle, void *mem, int num_bytes);
 int file_seek(unsigned int handle, int num_bytes, int from_where);
+int file_punch_hole(unsigned int handle, int start_byte, int num_bytes); //trap 0x47B
+int file_preallocate(unsigned int handle, int num_bytes); //trap 0x47C
+int file_clone(char *src, char *dst);   //trap 0x47D
+int file_stored_bytes(unsigned int handle); //trap 0x47E
+void *file_mmap(unsigned int handle, int offset, int length); //trap 0x47F
+int file_munmap(void *addr);            //trap 0x480
+int file_pread(unsigned int handle, void *mem, int num_bytes, int offset); //trap 0x481
+int file_pwrite(unsigned int handle, void *mem, int num_bytes, int offset); //trap 0x482
+struct file_iovec;                      // see files_shared.h
+int file_readv(unsigned int handle, struct file_iovec *iov, int iovcnt); //trap 0x483
+int file_writev(unsigned int handle, struct file_iovec *iov, int iovcnt); //trap 0x484
+int aio_submit(unsigned int handle, int op, void *buf, int len, int offset, sem_t sem); //trap 0x485
+int aio_status(int id);                 //trap 0x486
+
+// Related to directories
+int mkdir(char *path);                  //trap 0x478
+int rmdir(char *path);                  //trap 0x479
+int readdir(char *path, int pos, char *name); //trap 0x47A
 
 
 
 // Miscellaneous traps
+int get_jiffies();                      //trap 0x4FE
 void run_os_tests();
 
 #ifndef NULL
@@ -5,16 +5,29 @@
 #include "disk.h"
 #include "dfs.h"
 #include "synch.h"
+#include "lz.h"
 
 // Global file system parameters
 static dfs_inode inodes[DFS_INODE_NMAX_NUM];
 static dfs_superblock sb;
 static int fbv[DFS_FBV_MAX_NUM_WORDS];
+static unsigned char refcounts[DFS_MAX_NUM_BLOCKS];
+static unsigned char csectors[DFS_MAX_NUM_BLOCKS];
+static dfs_dentry dcache[DFS_DCACHE_SIZE];
+static char cache_pool[DFS_CACHE_POOL_BYTES];
+static dfs_cache_buffer cache[DFS_CACHE_MAX_BUFFERS];
+static int cache_nbuffers = 0;
+static int cache_clock = 0;
 static int dfsOpen = 0;
+static uint32 swapBstart = 0;   // first block of the swap area
+static int swapBlocks = 0;      // its length, 0 if there is none
 static int negativeone = 0xFFFFFFFF;
 static inline int invert(int n) { return n ^ negativeone; }
 inline uint32 DFS_PHY_RATIO(){ return sb.bsize / DiskBytesPerBlock(); }
 inline uint32 DFS_TO_PHY_BNUM(uint32 n){ return (n*DFS_PHY_RATIO()); }
+inline uint32 DFS_FBV_NUM_WORDS(){ return (sb.nblocks + 31) / 32; }
+inline uint32 DFS_DIRENTS_PER_BLOCK(){ return sb.bsize / sizeof(dfs_dirent); }
+inline uint32 DFS_INODE_MAX_VBLOCKS(){ return DFS_INODE_BTABLE_SIZE + sb.bsize/4; }
 
 // Using locks for the free block vector and the inodes
 lock_t lock_fbv;
@@ -44,11 +57,76 @@ void DfsModuleInit()
     // Create the locks for synchronization
     lock_fbv = LockCreate();
     lock_inodes = LockCreate();
+
+    // Start with an empty dentry cache
+    bzero((char *)dcache, sizeof(dcache));
     
-    // Open file system using DfsOpenFileSystem()
-    
+    // Open file system using DfsOpenFileSystem(), which also
+    // carves the buffer cache up for this disk's block size
     DfsOpenFileSystem();
-    // Later steps... initialize buffer cache-here.
+}
+
+// DfsBlockSize ===========================================
+// Returns the block size fdisk formatted the disk with.
+// ========================================================
+uint32 DfsBlockSize()
+{
+    return sb.bsize;
+}
+
+// DfsCacheInit ===========================================
+// Splits the buffer cache pool into as many sb.bsize 
+// buffers as fit (32 x 1K, 16 x 2K or 8 x 4K) and marks
+// them all empty.
+// ========================================================
+void DfsCacheInit()
+{
+    int i;
+    cache_nbuffers = DFS_CACHE_POOL_BYTES / sb.bsize;
+    for(i=0; i<cache_nbuffers; i++)
+    {
+        cache[i].blocknum = -1;
+        cache[i].lastused = 0;
+        cache[i].data = cache_pool + i*sb.bsize;
+    }
+    cache_clock = 0;
+}
+
+// DfsCacheFind ===========================================
+// Returns the cache buffer holding blocknum, or NULL.
+// ========================================================
+static dfs_cache_buffer *DfsCacheFind(uint32 blocknum)
+{
+    int i;
+    for(i=0; i<cache_nbuffers; i++) if(cache[i].blocknum == blocknum) return &cache[i];
+    return NULL;
+}
+
+// DfsCacheClaim ==========================================
+// Returns the buffer for blocknum, reusing its buffer if 
+// cached or else the least recently used one, and marks 
+// it most recently used.
+// ========================================================
+static dfs_cache_buffer *DfsCacheClaim(uint32 blocknum)
+{
+    int i;
+    dfs_cache_buffer *cb = DfsCacheFind(blocknum);
+    if(cb == NULL)
+    {
+        cb = &cache[0];
+        for(i=1; i<cache_nbuffers; i++) if(cache[i].lastused < cb->lastused) cb = &cache[i];
+        cb->blocknum = blocknum;
+    }
+    cb->lastused = ++cache_clock;
+    return cb;
+}
+
+// DfsCacheFill ===========================================
+// Copies a block's contents into the cache.
+// ========================================================
+static void DfsCacheFill(uint32 blocknum, dfs_block *b)
+{
+    bcopy(b->data, DfsCacheClaim(blocknum)->data, sb.bsize);
 }
 
 // DfsFBVChecker ==========================================
@@ -96,22 +174,93 @@ uint32 DfsAllocateBlock()
     // Grab the lock
     while(LockHandleAcquire(lock_fbv) != SYNC_SUCCESS);
     
-    // First let's find a packet with at least one zero
+    // First let's find a packet with at least one zero. The
+    // number of packets depends on the block size fdisk used
     while(fbv[i] == 0xFFFFFFFF)
-    {  i++; if(i >= DFS_FBV_MAX_NUM_WORDS) return DFS_FAIL; pack=i;  }
+    {  
+        i++; pack=i;
+        if(i >= DFS_FBV_NUM_WORDS()) 
+        {  while(LockHandleRelease(lock_fbv) != SYNC_SUCCESS); return DFS_FAIL;  }
+    }
     // Now, let's find that zero bit (first apperance)
     for(j=0; j<32; j++)
     {
-        if((fbv[pack]<<j)>>(31-j)==0){  pos = j; break;  }
+        if((fbv[pack] & (0x80000000 >> j)) == 0){  pos = j; break;  }
     }
     fbv[pack] = fbv[pack] | (1 << (31-pos));
     while(LockHandleRelease(lock_fbv) != SYNC_SUCCESS);
     return 32*pack+pos;
 }
 
+// DfsAllocateBlockRun ====================================
+// Allocates count physically contiguous DFS blocks in a 
+// single pass over the free block vector (first fit). 
+// Returns DFS_FAIL if no free run is long enough, and the
+// first block number of the run on success.
+// ========================================================
+uint32 DfsAllocateBlockRun(int count)
+{
+    // Initialize variables and parameters
+    int i=0, start=0, len=0;
+
+    // Make sure that filesystem is already open
+    if(sb.valid != 1 || dfsOpen != 1 || count <= 0) return DFS_FAIL;
+
+    // Grab the lock
+    while(LockHandleAcquire(lock_fbv) != SYNC_SUCCESS);
+
+    // Walk the blocks, skipping fully used packets 32 at a time
+    for(i=0; i<sb.nblocks && len<count; )
+    {
+        if((i & 0x1F) == 0 && fbv[i>>5] == 0xFFFFFFFF) {  len = 0; i += 32; continue;  }
+        if(DfsFBVChecker(i)) len = 0;
+        else {  if(len == 0) start = i; len++;  }
+        i++;
+    }
+    if(len < count) 
+    {  while(LockHandleRelease(lock_fbv) != SYNC_SUCCESS); return DFS_FAIL;  }
+
+    // Mark the run inuse
+    for(i=start; i<start+count; i++) DfsFBVSet(i,1);
+    while(LockHandleRelease(lock_fbv) != SYNC_SUCCESS);
+    return start;
+}
+
+// DfsBlockShare ==========================================
+// Adds a reference to an allocated block that another 
+// inode is going to share (see DfsInodeClone). Returns 
+// DFS_FAIL if the block is already shared as widely as 
+// the share count allows, and DFS_SUCCESS otherwise.
+// ========================================================
+int DfsBlockShare(uint32 blocknum)
+{
+    // Initialize variables and parameters
+    int ret = DFS_SUCCESS;
+
+    // Make sure that filesystem is already open
+    if(sb.valid != 1 || dfsOpen != 1) return DFS_FAIL;
+
+    // The share counts are protected by the fbv lock
+    while(LockHandleAcquire(lock_fbv) != SYNC_SUCCESS);
+    if(refcounts[blocknum] == DFS_REFCOUNT_MAX) ret = DFS_FAIL;
+    else refcounts[blocknum]++;
+    while(LockHandleRelease(lock_fbv) != SYNC_SUCCESS);
+    return ret;
+}
+
+// DfsBlockIsShared =======================================
+// Returns 1 if more than one inode points at the block.
+// ========================================================
+int DfsBlockIsShared(uint32 blocknum)
+{
+    return (refcounts[blocknum] != 0);
+}
+
 // DfsFreeBlock ===========================================
-// Deallocates a DFS block. Returns DFS_FAIL on failure,
-// and DFS_SUCCESS on good freeing.
+// Deallocates a DFS block. A shared block just loses one
+// reference and stays allocated for the other inodes. 
+// Returns DFS_FAIL on failure, and DFS_SUCCESS on good 
+// freeing.
 // ========================================================
 int DfsFreeBlock(uint32 blocknum) 
 {
@@ -120,46 +269,112 @@ int DfsFreeBlock(uint32 blocknum)
 
     // Grab the lock
     while(LockHandleAcquire(lock_fbv) != SYNC_SUCCESS);
+
+    // Still in use by somebody else?
+    if(refcounts[blocknum] != 0)
+    {
+        refcounts[blocknum]--;
+        while(LockHandleRelease(lock_fbv) != SYNC_SUCCESS);
+        return DFS_SUCCESS;
+    }
     
-    // Mark it !inuse
+    // Mark it !inuse, and drop any cached copy
     DfsFBVSet(blocknum,0);
+    csectors[blocknum] = 0;
+    if(DfsCacheFind(blocknum) != NULL) DfsCacheFind(blocknum)->blocknum = -1;
     
     // Release the lock
     while(LockHandleRelease(lock_fbv) != SYNC_SUCCESS);
     return DFS_SUCCESS;
 }
 
-// DfsReadBlock ==========================================
-// Reads an allocated DFS block from the disk (which could 
-// span multiple physical disk blocks). The block must be 
-// allocated in order to read from it. Returns DFS_FAIL on 
-// failure, and the number of bytes read on success.
+// DfsReadCompressedBlock =================================
+// Reads the csectors[blocknum] disk blocks holding a
+// compressed DFS block (an int length, then LZ data) and
+// expands them into data. Returns DFS_FAIL on failure, 
+// and sb.bsize on success.
 // ========================================================
-int DfsReadBlock(uint32 blocknum, dfs_block *b) 
+static int DfsReadCompressedBlock(uint32 blocknum, char *data)
 {
     // Initialize variables and parameters
-    int bytes_read=0, i=0;
+    int i=0, clen=0;
     uint32 phydisk_blocknum = DFS_TO_PHY_BNUM(blocknum);
-    disk_block diskblock_buffer;
-    char * ptr = b->data;
+    dfs_block compressed;
+
+    for(i=0; i<csectors[blocknum]; i++)
+    {
+        if(DiskReadBlock(phydisk_blocknum + i, (disk_block *)(compressed.data + i*DISK_BLOCKSIZE)) == DISK_FAIL) return DFS_FAIL;
+    }
+    bcopy(compressed.data, (char *)&clen, sizeof(int));
+    if(clen < 0 || clen + sizeof(int) > csectors[blocknum] * DISK_BLOCKSIZE
+       || LzDecompress(compressed.data + sizeof(int), clen, data, sb.bsize) != sb.bsize)
+    {  printf("ERR: compressed DFS block %d is corrupt\n", blocknum); return DFS_FAIL;  }
+    return sb.bsize;
+}
+
+// DfsReadBlockCached =====================================
+// Returns a pointer to the contents of an allocated DFS 
+// block in the buffer cache, reading it from the disk 
+// straight into a cache buffer if it isn't there. The 
+// pointer is good until the next block is read or 
+// written. Returns NULL on failure.
+// ========================================================
+static char *DfsReadBlockCached(uint32 blocknum)
+{
+    // Initialize variables and parameters
+    int i=0;
+    uint32 phydisk_blocknum = DFS_TO_PHY_BNUM(blocknum);
+    dfs_cache_buffer *cb;
     
     // Make sure that filesystem is already open
     if(sb.valid != 1) 
-    {  printf("ERR: sb.valid != 1\n"); return DFS_FAIL;  }
+    {  printf("ERR: sb.valid != 1\n"); return NULL;  }
 
     // Use the freeblock vector checker to determine if allocated
     if(DfsFBVChecker(blocknum) == 0)
-    {  printf("ERR: fbv said block isn't allocated\n"); return DFS_FAIL;  }
+    {  printf("ERR: fbv said block isn't allocated\n"); return NULL;  }
 
-    // Read from disk in intervals of physical disk's blocksize
-    for(i=phydisk_blocknum; i<(phydisk_blocknum + DFS_PHY_RATIO()); i++)
+    // Serve it from the buffer cache if we can
+    if((cb = DfsCacheFind(blocknum)) != NULL)
     {
-        DiskReadBlock(i, &diskblock_buffer);
-        bcopy(diskblock_buffer.data, ptr, DISK_BLOCKSIZE);
-        bytes_read+=DISK_BLOCKSIZE;
-        ptr+=DISK_BLOCKSIZE;   
+        cb->lastused = ++cache_clock;
+        return cb->data;
+    }
+
+    // Otherwise the disk blocks land directly in the buffer. A 
+    // compressed block only occupies its first few disk blocks
+    cb = DfsCacheClaim(blocknum);
+    if(csectors[blocknum] == DFS_CSECTORS_UNWRITTEN)
+    {
+        bzero(cb->data, sb.bsize);
+        return cb->data;
+    }
+    if(csectors[blocknum] != 0)
+    {
+        if(DfsReadCompressedBlock(blocknum, cb->data) != sb.bsize) {  cb->blocknum = -1; return NULL;  }
+        return cb->data;
+    }
+    for(i=0; i<DFS_PHY_RATIO(); i++)
+    {
+        if(DiskReadBlock(phydisk_blocknum + i, (disk_block *)(cb->data + i*DISK_BLOCKSIZE)) == DISK_FAIL)
+        {  cb->blocknum = -1; return NULL;  }
     }
-    return bytes_read;
+    return cb->data;
+}
+
+// DfsReadBlock ==========================================
+// Reads an allocated DFS block from the disk (which could 
+// span multiple physical disk blocks). The block must be 
+// allocated in order to read from it. Returns DFS_FAIL on 
+// failure, and the number of bytes read on success.
+// ========================================================
+int DfsReadBlock(uint32 blocknum, dfs_block *b) 
+{
+    char *data;
+
+    if((data = DfsReadBlockCached(blocknum)) == NULL) return DFS_FAIL;
+    bcopy(data, b->data, sb.bsize);
+    return sb.bsize;
 }
 
 // DfsWriteBlock ==========================================
@@ -173,7 +388,6 @@ int DfsWriteBlock(uint32 blocknum, dfs_block *b)
     // Initialize variables and parameters
     int bytes_written=0, i=0;
     uint32 phydisk_blocknum = DFS_TO_PHY_BNUM(blocknum);
-    disk_block diskblock_buffer;
     char * ptr = b->data;
     
     // Make sure that filesystem is already open
@@ -184,17 +398,140 @@ int DfsWriteBlock(uint32 blocknum, dfs_block *b)
     if(DfsFBVChecker(blocknum) == 0)
     {  printf("ERR: fbv said block isn't allocated\n"); return DFS_FAIL;  }
 
-    // Read from disk in intervals of physical disk's blocksize
+    // Write to disk in intervals of physical disk's blocksize.
+    // The cache is write-through, so the disk is never stale
     for(i=phydisk_blocknum; i<(phydisk_blocknum + DFS_PHY_RATIO()); i++)
     {
-        bcopy(ptr, diskblock_buffer.data, DISK_BLOCKSIZE);
-        DiskWriteBlock(i, &diskblock_buffer);
+        DiskWriteBlock(i, (disk_block *)ptr);
         bytes_written+=DISK_BLOCKSIZE;
         ptr+=DISK_BLOCKSIZE;
     }
+    csectors[blocknum] = 0;
+    DfsCacheFill(blocknum, b);
     return bytes_written;
 }
 
+// DfsWriteBlockCompressed ================================
+// Like DfsWriteBlock, but LZ compresses the block first and
+// writes only the disk blocks the result needs, recording
+// that count in the block's csectors entry. Blocks that 
+// don't save at least one disk block are written as is.
+// Returns DFS_FAIL on failure, and sb.bsize on success.
+// ========================================================
+int DfsWriteBlockCompressed(uint32 blocknum, dfs_block *b)
+{
+    // Initialize variables and parameters
+    int i=0, clen=0, nsectors=0;
+    uint32 phydisk_blocknum = DFS_TO_PHY_BNUM(blocknum);
+    dfs_block compressed;
+
+    // Make sure that filesystem is already open
+    if(sb.valid != 1) 
+    {  printf("ERR: sb.valid != 1\n"); return DFS_FAIL;  }
+
+    // Use the freeblock vector checker to determine if allocated
+    if(DfsFBVChecker(blocknum) == 0)
+    {  printf("ERR: fbv said block isn't allocated\n"); return DFS_FAIL;  }
+
+    // Compress, leaving room for the length in front
+    clen = LzCompress(b->data, sb.bsize, compressed.data + sizeof(int), sb.bsize - DISK_BLOCKSIZE - sizeof(int));
+    if(clen == LZ_FAIL) return DfsWriteBlock(blocknum, b);
+    bcopy((char *)&clen, compressed.data, sizeof(int));
+    nsectors = (clen + sizeof(int) + DISK_BLOCKSIZE - 1) / DISK_BLOCKSIZE;
+
+    for(i=0; i<nsectors; i++)
+    {
+        DiskWriteBlock(phydisk_blocknum + i, (disk_block *)(compressed.data + i*DISK_BLOCKSIZE));
+    }
+    csectors[blocknum] = nsectors;
+    DfsCacheFill(blocknum, b);
+    return sb.bsize;
+}
+
+// DfsBlockStoredBytes ====================================
+// Returns how many bytes of disk a DFS block occupies.
+// ========================================================
+int DfsBlockStoredBytes(uint32 blocknum)
+{
+    if(csectors[blocknum] != 0 && csectors[blocknum] != DFS_CSECTORS_UNWRITTEN) return csectors[blocknum] * DISK_BLOCKSIZE;
+    return sb.bsize;
+}
+
+// DfsSwapReserve =========================================
+// Sets aside one contiguous run of blocks as the swap area
+// the memory manager pages out to. The run is only marked
+// inuse in memory and is given back before the free block
+// vector goes to disk, so nothing about it is persistent.
+// Without a free run that long there is no swap area.
+// ========================================================
+static void DfsSwapReserve()
+{
+    swapBlocks = DFS_SWAP_BYTES / sb.bsize;
+    if((swapBstart = DfsAllocateBlockRun(swapBlocks)) == DFS_FAIL)
+    {  printf(" DfsSwapReserve(): no room for a swap area, paging is off\n"); swapBlocks = 0;  }
+}
+
+// DfsSwapRelease =========================================
+// Hands the swap area's blocks back to the free block
+// vector when the file system is closed.
+// ========================================================
+static void DfsSwapRelease()
+{
+    int i;
+    for(i=0; i<swapBlocks; i++) DfsFBVSet(swapBstart + i, 0);
+    swapBlocks = 0;
+}
+
+// DfsSwapBytes ===========================================
+// Returns the size of the swap area, 0 if there is none.
+// ========================================================
+int DfsSwapBytes()
+{
+    if(sb.valid != 1 || dfsOpen != 1) return 0;
+    return swapBlocks * sb.bsize;
+}
+
+// DfsSwapTransfer ========================================
+// Moves num_bytes between mem and the swap area starting
+// at start_byte, both multiples of the disk block size.
+// The transfer goes straight to the disk: swap blocks are
+// never read back through the buffer cache, so filling it
+// with them would only push out file system blocks. Takes
+// no locks, so it's safe from an interrupt handler. Return
+// DFS_FAIL on failure and DFS_SUCCESS on success.
+// ========================================================
+static int DfsSwapTransfer(int start_byte, char *mem, int num_bytes, int write)
+{
+    // Initialize variables and parameters
+    int i=0, n=0;
+    uint32 phydisk_blocknum;
+
+    if(start_byte < 0 || num_bytes < 0 || start_byte + num_bytes > DfsSwapBytes()) return DFS_FAIL;
+    if((start_byte % DISK_BLOCKSIZE) != 0 || (num_bytes % DISK_BLOCKSIZE) != 0) return DFS_FAIL;
+    phydisk_blocknum = DFS_TO_PHY_BNUM(swapBstart) + start_byte / DISK_BLOCKSIZE;
+    for(i=0; i<num_bytes/DISK_BLOCKSIZE; i++)
+    {
+        if(write) n = DiskWriteBlock(phydisk_blocknum + i, (disk_block *)mem);
+        else n = DiskReadBlock(phydisk_blocknum + i, (disk_block *)mem);
+        if(n != DISK_BLOCKSIZE) return DFS_FAIL;
+        mem+=DISK_BLOCKSIZE;
+    }
+    return DFS_SUCCESS;
+}
+
+// DfsSwapRead, DfsSwapWrite ==============================
+// Read or write num_bytes of the swap area at start_byte.
+// ========================================================
+int DfsSwapRead(int start_byte, void *mem, int num_bytes)
+{
+    return DfsSwapTransfer(start_byte, (char *)mem, num_bytes, 0);
+}
+
+int DfsSwapWrite(int start_byte, void *mem, int num_bytes)
+{
+    return DfsSwapTransfer(start_byte, (char *)mem, num_bytes, 1);
+}
+
 // DfsOpenFileSystem ======================================
 // Loads the fil system metadata from the disk into 
 // memory. Returns DFS_FAIL on failure. 
@@ -217,6 +554,15 @@ int DfsOpenFileSystem()
     // Copy the data from the block we just read into the superblock in mem
     bcopy(diskblock_buffer.data, (char *)(&sb), sizeof(dfs_superblock));
 
+    // Only block sizes fdisk knows how to lay out are usable
+    if(sb.bsize < DFS_MIN_BLOCKSIZE || sb.bsize > DFS_MAX_BLOCKSIZE || (sb.bsize % DiskBytesPerBlock()) != 0)
+    {  printf("ERR: unsupported DFS block size %d, run fdisk\n", sb.bsize); dfsOpen = 0; return DFS_FAIL;  }
+
+    // Everything past the superblock may be striped over several images
+    if(DiskSetStripe(sb.ndisks, sb.stripe) != DISK_SUCCESS || sb.nblocks * sb.bsize > DiskSize())
+    {  printf("ERR: bad disk stripe in superblock, run fdisk\n"); dfsOpen = 0; return DFS_FAIL;  }
+    DfsCacheInit();
+
     // Read the inodes 
     ptr = (char *)inodes; // destination address
     for(i=DFS_TO_PHY_BNUM(sb.inodeBstart); i<DFS_TO_PHY_BNUM(sb.fbvBstart); i++)
@@ -229,7 +575,27 @@ int DfsOpenFileSystem()
 
     // Read the free block vector
     ptr = (char *)fbv; // destination address
-    for(i=DFS_TO_PHY_BNUM(sb.fbvBstart); i<DFS_TO_PHY_BNUM(sb.dataBstart); i++)
+    for(i=DFS_TO_PHY_BNUM(sb.fbvBstart); i<DFS_TO_PHY_BNUM(sb.refBstart); i++)
+    {
+        if(DiskReadBlock(i, &diskblock_buffer) != DISK_BLOCKSIZE) 
+        {  printf("ERR: DiskReadBlock didnt read number of disk block bytes\n"); return DFS_FAIL;  }
+        bcopy(diskblock_buffer.data, ptr, DISK_BLOCKSIZE);
+        ptr+=DISK_BLOCKSIZE;   
+    }
+
+    // Read the block share counts
+    ptr = (char *)refcounts; // destination address
+    for(i=DFS_TO_PHY_BNUM(sb.refBstart); i<DFS_TO_PHY_BNUM(sb.compBstart); i++)
+    {
+        if(DiskReadBlock(i, &diskblock_buffer) != DISK_BLOCKSIZE) 
+        {  printf("ERR: DiskReadBlock didnt read number of disk block bytes\n"); return DFS_FAIL;  }
+        bcopy(diskblock_buffer.data, ptr, DISK_BLOCKSIZE);
+        ptr+=DISK_BLOCKSIZE;   
+    }
+
+    // Read the compressed block sizes
+    ptr = (char *)csectors; // destination address
+    for(i=DFS_TO_PHY_BNUM(sb.compBstart); i<DFS_TO_PHY_BNUM(sb.dataBstart); i++)
     {
         if(DiskReadBlock(i, &diskblock_buffer) != DISK_BLOCKSIZE) 
         {  printf("ERR: DiskReadBlock didnt read number of disk block bytes\n"); return DFS_FAIL;  }
@@ -248,6 +614,9 @@ int DfsOpenFileSystem()
 
     // Change it back to be valid in memory 
     sb.valid = 1;
+
+    // Set aside the swap area
+    DfsSwapReserve();
     printf(" DfsOpenFileSystem(): DFS has successfully been opened\n");
     return DFS_SUCCESS;
 }
@@ -267,6 +636,9 @@ int DfsCloseFileSystem()
     if(dfsOpen == 0) return DFS_SUCCESS;
     dfsOpen = 0; // closing now
 
+    // The swap area doesn't outlive this boot
+    DfsSwapRelease();
+
     // Write back the inodes 
     ptr = (char *)inodes; // reference address
     for(i=DFS_TO_PHY_BNUM(sb.inodeBstart); i<DFS_TO_PHY_BNUM(sb.fbvBstart); i++)
@@ -279,7 +651,27 @@ int DfsCloseFileSystem()
 
     // Write back the free block vector
     ptr = (char *)fbv; // reference address
-    for(i=DFS_TO_PHY_BNUM(sb.fbvBstart); i<DFS_TO_PHY_BNUM(sb.dataBstart); i++)
+    for(i=DFS_TO_PHY_BNUM(sb.fbvBstart); i<DFS_TO_PHY_BNUM(sb.refBstart); i++)
+    {
+        bcopy(ptr, diskblock_buffer.data, DISK_BLOCKSIZE);
+        if(DiskWriteBlock(i, &diskblock_buffer) != DISK_BLOCKSIZE) 
+        {  printf("ERR: DiskWriteBlock didnt write number of disk block bytes\n"); return DFS_FAIL;  }
+        ptr+=DISK_BLOCKSIZE;   
+    }
+
+    // Write back the block share counts
+    ptr = (char *)refcounts; // reference address
+    for(i=DFS_TO_PHY_BNUM(sb.refBstart); i<DFS_TO_PHY_BNUM(sb.compBstart); i++)
+    {
+        bcopy(ptr, diskblock_buffer.data, DISK_BLOCKSIZE);
+        if(DiskWriteBlock(i, &diskblock_buffer) != DISK_BLOCKSIZE) 
+        {  printf("ERR: DiskWriteBlock didnt write number of disk block bytes\n"); return DFS_FAIL;  }
+        ptr+=DISK_BLOCKSIZE;   
+    }
+
+    // Write back the compressed block sizes
+    ptr = (char *)csectors; // reference address
+    for(i=DFS_TO_PHY_BNUM(sb.compBstart); i<DFS_TO_PHY_BNUM(sb.dataBstart); i++)
     {
         bcopy(ptr, diskblock_buffer.data, DISK_BLOCKSIZE);
         if(DiskWriteBlock(i, &diskblock_buffer) != DISK_BLOCKSIZE) 
@@ -304,59 +696,180 @@ int DfsCloseFileSystem()
 // Inode-based functions
 ///////////////////////////////////////////////////////////////////////////////
 
+// DfsNameEquals ==========================================
+// Exact string compare of two path components (dstrncmp 
+// treats a prefix as a match, which we can't use here).
+// ========================================================
+static int DfsNameEquals(char *a, char *b)
+{
+    while(*a != '\0' && *a == *b) {  a++; b++;  }
+    return (*a == *b);
+}
+
+// DfsInodeClearBlocks ====================================
+// Marks every block pointer of an inode as unallocated.
+// ========================================================
+static void DfsInodeClearBlocks(uint32 handle)
+{
+    int i=0;
+    for(i=0; i<DFS_INODE_BTABLE_SIZE; i++) inodes[handle].btable[i] = -1;
+    inodes[handle].ibtable = -1;
+    inodes[handle].iibtable = -1;
+}
+
+// DfsInodeAllocate =======================================
+// Grabs a free inode, links it into directory dir under 
+// name, and returns its handle. New files start out with 
+// their (empty) data inline. Caller holds lock_inodes.
+// Returns DFS_FAIL if no inode or dir slot is available.
+// ========================================================
+static uint32 DfsInodeAllocate(uint32 dir, char *name, int type)
+{
+    int i=0;
+    for(i=0; i<DFS_INODE_NMAX_NUM; i++) if(inodes[i].inuse != 1) break;
+    if(i == DFS_INODE_NMAX_NUM) return DFS_FAIL;
+    inodes[i].inuse = 1;
+    inodes[i].fsize = 0;
+    inodes[i].type = type;
+    inodes[i].parent = dir;
+    if(type == DFS_INODE_TYPE_FILE)
+    {
+        inodes[i].flags = DFS_INODE_FLAG_INLINE;
+        bzero(inodes[i].idata, DFS_INODE_INLINE_MAX);
+    }
+    else
+    {
+        inodes[i].flags = 0;
+        DfsInodeClearBlocks(i);
+    }
+    if(DfsDirAddEntry(dir, name, i) != DFS_SUCCESS)
+    {  inodes[i].inuse = 0; return DFS_FAIL;  }
+    return i;
+}
+
+// DfsInodePromoteInline ==================================
+// Moves an inline file's bytes out to a real data block
+// (virtual block 0) so it can grow past the inline
+// capacity. The block is written before the inode stops
+// being inline, so a failure leaves the file as it was.
+// Returns DFS_FAIL on failure and DFS_SUCCESS on success.
+// ========================================================
+static int DfsInodePromoteInline(uint32 handle)
+{
+    int dfsblocknum=-1;
+    dfs_block dfsblock_buffer;
+
+    // The block pointers overlay idata, so they can't be set
+    // until the bytes are safely on disk
+    if(inodes[handle].fsize != 0)
+    {
+        bzero(dfsblock_buffer.data, sb.bsize);
+        bcopy(inodes[handle].idata, dfsblock_buffer.data, inodes[handle].fsize);
+        if((dfsblocknum = DfsAllocateBlock()) == DFS_FAIL) return DFS_FAIL;
+        if(DfsWriteBlock(dfsblocknum, &dfsblock_buffer) != sb.bsize)
+        {  DfsFreeBlock(dfsblocknum); return DFS_FAIL;  }
+    }
+    inodes[handle].flags &= ~DFS_INODE_FLAG_INLINE;
+    DfsInodeClearBlocks(handle);
+    inodes[handle].btable[0] = dfsblocknum;
+    return DFS_SUCCESS;
+}
+
+// DfsInodeWriteDataBlock =================================
+// Writes one of the inode's data blocks, compressed if the
+// file asked for it. Returns what DfsWriteBlock does.
+// ========================================================
+static int DfsInodeWriteDataBlock(uint32 handle, uint32 blocknum, dfs_block *b)
+{
+    if(inodes[handle].flags & DFS_INODE_FLAG_COMPRESS) return DfsWriteBlockCompressed(blocknum, b);
+    return DfsWriteBlock(blocknum, b);
+}
+
+// DfsInodeSetVirtualBlock ================================
+// Points virtual_blocknum of the inode at blocknum, which
+// must be in the direct table or an existing indirect one.
+// Returns DFS_FAIL on failure and DFS_SUCCESS on success.
+// ========================================================
+static int DfsInodeSetVirtualBlock(uint32 handle, uint32 virtual_blocknum, uint32 blocknum)
+{
+    dfs_block dfsblock_buffer;
+    int * ibt = (int *)dfsblock_buffer.data;
+
+    if(virtual_blocknum < DFS_INODE_BTABLE_SIZE)
+    {
+        inodes[handle].btable[virtual_blocknum] = blocknum;
+        return DFS_SUCCESS;
+    }
+    if(inodes[handle].ibtable == -1) return DFS_FAIL;
+    if(DfsReadBlock(inodes[handle].ibtable, &dfsblock_buffer) != sb.bsize) return DFS_FAIL;
+    ibt[virtual_blocknum-DFS_INODE_BTABLE_SIZE] = blocknum;
+    if(DfsWriteBlock(inodes[handle].ibtable, &dfsblock_buffer) != sb.bsize) return DFS_FAIL;
+    return DFS_SUCCESS;
+}
+
+// DfsInodeUnshareVirtualBlock ============================
+// Copy-on-write: if the block behind virtual_blocknum is
+// shared with a clone, give this inode a private block 
+// in its place and drop its reference to the shared one.
+// The caller writes the new contents. Returns the block 
+// to write to, or DFS_FAIL.
+// ========================================================
+static uint32 DfsInodeUnshareVirtualBlock(uint32 handle, uint32 virtual_blocknum, uint32 blocknum)
+{
+    int newblocknum=0;
+
+    if(!DfsBlockIsShared(blocknum)) return blocknum;
+    if((newblocknum = DfsAllocateBlock()) == DFS_FAIL) return DFS_FAIL;
+    if(DfsInodeSetVirtualBlock(handle, virtual_blocknum, newblocknum) != DFS_SUCCESS)
+    {  DfsFreeBlock(newblocknum); return DFS_FAIL;  }
+    DfsFreeBlock(blocknum);
+    return newblocknum;
+}
+
 // DfsInodeFilenameExists =================================
-// Looks through all the inuse inodes for the given 
-// filename. If the filename is found, return the handle
-// of the inode. Else, return DFS_FAIL.
+// Resolves the given path (see DfsInodeWalkPath) to an 
+// inode. If the path is found, return the handle of the 
+// inode. Else, return DFS_FAIL.
 // ========================================================
 uint32 DfsInodeFilenameExists(char *filename) 
 {
     // Initialize variables and parameters
-    int i;
+    char name[DFS_DIRENT_NAME_LENGTH];
+    uint32 dir;
 
     // Check that filesystem is open
     if(sb.valid != 1 || dfsOpen != 1) return DFS_FAIL;
 
-    // Do a string compare on the in-use inodes filenames
-    for(i=0; i<DFS_INODE_NMAX_NUM; i++)
-    {
-        if(inodes[i].inuse == 1)
-        {
-            // This inode is in-use, lets compare filenames
-            if(dstrncmp(filename, inodes[i].fname, dstrlen(filename)) == 0)
-            {  return i;  }
-        }
-    }
-    return DFS_FAIL;
+    // Walk to the containing directory, then look up the last component
+    if((dir = DfsInodeWalkPath(filename, name)) == DFS_FAIL) return DFS_FAIL;
+    if(name[0] == '\0') return dir; 
+    return DfsDirLookup(dir, name);
 }
 
 // DfsInodeOpen ===========================================
-// Search the list of all inuse inodes for the specified 
-// filename. If exists, return the handle of the inode. 
-// Else, allocate a new inode for this filename and return
-// its handle. Return DFS_FAIL on failure. Remember to
-// use locks whenever you allocate a new inode. 
+// Resolve the path to an inode. If exists, return the 
+// handle of the inode. Else, allocate a new file inode in 
+// the containing directory (which must already exist) and
+// return its handle. Return DFS_FAIL on failure. Remember 
+// to use locks whenever you allocate a new inode. 
 // ========================================================
 uint32 DfsInodeOpen(char * filename) 
 {
     // Initialize variables and parameters
-    int i=0;
-    uint32 inode_handle;
+    char name[DFS_DIRENT_NAME_LENGTH];
+    uint32 dir, inode_handle;
 
     // Check that filesystem is open
     if(sb.valid != 1 || dfsOpen != 1) return DFS_FAIL;
 
-    // Check if this filename exists
-    if((inode_handle=DfsInodeFilenameExists(filename)) != DFS_FAIL) return inode_handle;
+    // Find the containing directory, a missing one is an error
+    if((dir = DfsInodeWalkPath(filename, name)) == DFS_FAIL) return DFS_FAIL;
+    if(name[0] == '\0') return DFS_FAIL;
 
-    // If here, we need to allocate an inode for the filename
-    for(i=0; i<DFS_INODE_NMAX_NUM; i++) {if(inodes[i].inuse != 1) {  inode_handle = i; break;  }}
-    
-    // Let's grab the lock
+    // Let's grab the lock, someone may be creating the same name
     while(LockHandleAcquire(lock_inodes) != SYNC_SUCCESS);
-    inodes[inode_handle].fsize = 0;
-    inodes[inode_handle].inuse = 1;
-    dstrncpy(inodes[inode_handle].fname, filename, dstrlen(filename));
+    if((inode_handle = DfsDirLookup(dir, name)) == DFS_FAIL)
+    {  inode_handle = DfsInodeAllocate(dir, name, DFS_INODE_TYPE_FILE);  }
     // Release the lock
     while(LockHandleRelease(lock_inodes) != SYNC_SUCCESS);
     return inode_handle;
@@ -366,26 +879,51 @@ uint32 DfsInodeOpen(char * filename)
 // De-allocates any data blocks used by this inode, 
 // including the indirect addressing block if necessary.
 // Also, including the double indirect addressing block,
-// if necesarry. Then mark the inode as no longer inuse.
-// Use locks when modifying the inuse flag in an inode. 
-// Return DFS_FAIL on failure and DFS_SUCCESS on good. 
+// if necesarry. Then unlinks it from its directory and
+// marks the inode as no longer inuse. Directories must be
+// empty. Use locks when modifying the inuse flag in an 
+// inode. Return DFS_FAIL on failure and DFS_SUCCESS on good. 
 // ========================================================
 int DfsInodeDelete(uint32 handle) 
 {
     // Initialize variables and parameters
     int i=0;
+    dfs_block dfsblock_buffer;
+    int * ibt;
 
     // Check that filesystem is open
     if(sb.valid != 1 || dfsOpen != 1) return DFS_FAIL;
 
-    // Let's grab the lock
+    // Let's grab the lock first, so nothing is added to a directory
+    // between the check that it's empty and its removal
     while(LockHandleAcquire(lock_inodes) != SYNC_SUCCESS);
+
+    // The root can't go, and neither can a non-empty directory
+    if(handle == DFS_ROOT_INODE || inodes[handle].inuse != 1
+       || (inodes[handle].type == DFS_INODE_TYPE_DIR && inodes[handle].fsize != 0))
+    {  while(LockHandleRelease(lock_inodes) != SYNC_SUCCESS); return DFS_FAIL;  }
+    DfsDirRemoveInode(inodes[handle].parent, handle);
     inodes[handle].fsize = 0;
     inodes[handle].inuse = 0;
-    inodes[handle].fname[0] = '\0';
-    for(i=0; i<DFS_INODE_BTABLE_SIZE; i++) inodes[handle].btable[i] = -1;
+    if(inodes[handle].flags & DFS_INODE_FLAG_INLINE)
+    {
+        // Data lived in the inode, there are no blocks to free
+        inodes[handle].flags = 0;
+        DfsInodeClearBlocks(handle);
+    }
+    for(i=0; i<DFS_INODE_BTABLE_SIZE; i++) 
+    {
+        if(inodes[handle].btable[i] != -1) DfsFreeBlock(inodes[handle].btable[i]);
+        inodes[handle].btable[i] = -1;
+    }
     if(inodes[handle].ibtable != -1) 
     {
+        // Free the data blocks it points to (skipping holes), then it
+        if(DfsReadBlock(inodes[handle].ibtable, &dfsblock_buffer) == sb.bsize)
+        {
+            ibt = (int *)dfsblock_buffer.data;
+            for(i=0; i<sb.bsize/4; i++) if(ibt[i] != -1) DfsFreeBlock(ibt[i]);
+        }
         DfsFreeBlock(inodes[handle].ibtable);
         inodes[handle].ibtable = -1; 
     }
@@ -399,134 +937,407 @@ int DfsInodeDelete(uint32 handle)
 // DfsInodeReadBytes ======================================
 // Reads num_bytes from the file represented by the inode
 // handle, starting at virtual byte start_byte, copying
-// the data to the address pointed to by mem. Return 
-// DFS_FAIL on failure, and the number of bytes read on 
-// success.
+// the data to the address pointed to by mem. Reads stop
+// at the end of the file, and holes (blocks never written
+// or punched out) and reserved blocks that were never
+// written read as zeros without touching the disk.
+// Data is copied to mem straight out of the buffer cache.
+// Return DFS_FAIL on failure, and the number of bytes 
+// read on success.
 // ========================================================
 int DfsInodeReadBytes(uint32 handle, void *mem, int start_byte, int num_bytes) 
 {
     // Initialize variables and parameters
-    int dfsblocknum=0, read_bytes=0;
+    int dfsblocknum=0, read_bytes=0, n=0;
     int cpos = start_byte % sb.bsize;
     int vblocknum = start_byte / sb.bsize;
-    dfs_block btable_buffer;
     char * ptr = mem;
-    int * ibt;
+    char * data;
     
     // Check that filesystem is open
     if(sb.valid != 1 || dfsOpen != 1) return DFS_FAIL;
 
-    // Check if this filename exists
+    // Check if this filename exists, and that it's a regular file
     if(inodes[handle].inuse != 1) return DFS_FAIL;
+    if(inodes[handle].type != DFS_INODE_TYPE_FILE) return DFS_FAIL;
+    if(start_byte < 0 || num_bytes < 0) return DFS_FAIL;
 
-    while(read_bytes < num_bytes)
+    // Nothing past the end of the file
+    if(start_byte >= inodes[handle].fsize) return 0;
+    num_bytes = min(num_bytes, inodes[handle].fsize - start_byte);
+
+    // Inline files are served straight out of the inode, no disk I/O
+    if(inodes[handle].flags & DFS_INODE_FLAG_INLINE)
     {
-        if(vblocknum < 10) dfsblocknum = inodes[handle].btable[vblocknum];
-        else
-        {
-            if(inodes[handle].ibtable == -1) inodes[handle].ibtable = DfsAllocateBlock();
-            if(DfsReadBlock(inodes[handle].ibtable, &btable_buffer) != sb.bsize) return DFS_FAIL;
-            ibt = (int *)btable_buffer.data;
-            dfsblocknum = ibt[vblocknum-10];
-        }
-        if(DfsReadBlock(dfsblocknum, &btable_buffer) != sb.bsize) return DFS_FAIL;
+        bcopy(inodes[handle].idata + start_byte, ptr, num_bytes);
+        return num_bytes;
+    }
 
-        if((num_bytes - read_bytes) > (sb.bsize - cpos))
-        {
-            bcopy(btable_buffer.data + cpos, ptr, sb.bsize - cpos);
-            ptr += sb.bsize - cpos;
-            read_bytes += sb.bsize - cpos;
-            cpos = 0;
-            vblocknum++;
-        }
+    while(read_bytes < num_bytes)
+    {
+        n = min(num_bytes - read_bytes, sb.bsize - cpos);
+        dfsblocknum = DfsInodeTranslateVirtualToFilesys(handle, vblocknum);
+        if(dfsblocknum == -1 || csectors[dfsblocknum] == DFS_CSECTORS_UNWRITTEN) bzero(ptr, n); // a hole
         else
         {
-            bcopy(btable_buffer.data + cpos, ptr, num_bytes - read_bytes);
-            read_bytes += sb.bsize - cpos;
-            return read_bytes;
+            if((data = DfsReadBlockCached(dfsblocknum)) == NULL) return DFS_FAIL;
+            bcopy(data + cpos, ptr, n);
         }
+        ptr += n;
+        read_bytes += n;
+        cpos = 0;
+        vblocknum++;
     }
-    return DFS_FAIL;
+    return read_bytes;
 }
 
 // DfsInodeWriteBytes =====================================
 // Writes num_bytes from the memory pointed to by mem to 
 // the file represented by the inode handle, starting at 
-// virtual byte start_byte. Note that if you are only 
-// writing part of a given file system block, you'll need 
-// to read that block from the disk first. Return DFS_FAIL 
-// on failure and the number of bytes written on success.
+// virtual byte start_byte. Only blocks actually written 
+// get allocated, so writing past the end of the file 
+// leaves a hole. A partially written block is read first,
+// unless it was just allocated (then it starts as zeros).
+// Whole blocks are written straight from mem.
+// Return DFS_FAIL on failure and the number of bytes 
+// written on success.
 // ========================================================
 int DfsInodeWriteBytes(uint32 handle, void *mem, int start_byte, int num_bytes) 
 {
     // Initialize variables and parameters
-    int dfsblocknum=0, written_bytes=0;
+    int dfsblocknum=0, written_bytes=0, n=0, fresh=0, valid=0;
     int cpos = start_byte % sb.bsize;
-    
     int wblocknum = start_byte / sb.bsize;
     dfs_block btable_buffer;
+    dfs_block * src;
     char * ptr = mem;
-    int * ibt = NULL;
     
     // Check that filesystem is open
     if(sb.valid != 1 || dfsOpen != 1) return DFS_FAIL;
 
-    // Check if this filename exists
+    // Check if this filename exists, and that it's a regular file
     if(inodes[handle].inuse != 1) return DFS_FAIL;
+    if(inodes[handle].type != DFS_INODE_TYPE_FILE) return DFS_FAIL;
+    if(start_byte < 0 || num_bytes < 0) return DFS_FAIL;
+
+    // Inline files stay in the inode until they outgrow it
+    if(inodes[handle].flags & DFS_INODE_FLAG_INLINE)
+    {
+        if(start_byte + num_bytes <= DFS_INODE_INLINE_MAX)
+        {
+            bcopy(ptr, inodes[handle].idata + start_byte, num_bytes);
+            if(start_byte + num_bytes > inodes[handle].fsize)
+            {  inodes[handle].fsize = start_byte + num_bytes;  }
+            return num_bytes;
+        }
+        if(DfsInodePromoteInline(handle) != DFS_SUCCESS) return DFS_FAIL;
+    }
 
     while(written_bytes < num_bytes)
     {
-        if(wblocknum < 10) 
+        n = min(num_bytes - written_bytes, sb.bsize - cpos);
+        dfsblocknum = DfsInodeTranslateVirtualToFilesys(handle, wblocknum);
+        fresh = (dfsblocknum == -1);
+        if(fresh)
         {
-            dfsblocknum = inodes[handle].btable[wblocknum];
-            if(dfsblocknum == -1)
-            {
-                dfsblocknum=DfsInodeAllocateVirtualBlock(handle,wblocknum);
-                if(dfsblocknum==DFS_FAIL) return DFS_FAIL;
-            }
+            if((dfsblocknum = DfsInodeAllocateVirtualBlock(handle, wblocknum)) == DFS_FAIL) return DFS_FAIL;
         }
-        else
+        else fresh = (csectors[dfsblocknum] == DFS_CSECTORS_UNWRITTEN);
+        if(n != sb.bsize)
         {
-            if(ibt == NULL)
+            // A fresh or reserved block starts as zeros, and anything
+            // at or past EOF was never written, so only the part below
+            // EOF is read
+            valid = inodes[handle].fsize - wblocknum*sb.bsize;
+            if(fresh || valid <= 0) bzero(btable_buffer.data, sb.bsize);
+            else
             {
-                if(inodes[handle].ibtable == -1) 
-                {
-                    dfsblocknum = DfsInodeAllocateVirtualBlock(handle, wblocknum);
-                }
-                if(DfsReadBlock(inodes[handle].ibtable, &btable_buffer) != sb.bsize) return DFS_FAIL;
-                ibt = (int *)btable_buffer.data;
+                if(DfsReadBlock(dfsblocknum, &btable_buffer) != sb.bsize) return DFS_FAIL;
+                if(valid < sb.bsize) bzero(btable_buffer.data + valid, sb.bsize - valid);
             }
-            dfsblocknum = ibt[wblocknum - 10];
-            if(dfsblocknum == -1) 
+        }
+        // A block shared with a clone is copied before it changes
+        if((dfsblocknum = DfsInodeUnshareVirtualBlock(handle, wblocknum, dfsblocknum)) == DFS_FAIL) return DFS_FAIL;
+        if(n == sb.bsize) src = (dfs_block *)ptr;
+        else {  bcopy(ptr, btable_buffer.data + cpos, n); src = &btable_buffer;  }
+        if(DfsInodeWriteDataBlock(handle, dfsblocknum, src) != sb.bsize) return DFS_FAIL;
+        ptr += n;
+        written_bytes += n;
+        cpos = 0;
+        wblocknum++;
+    }
+    if(start_byte + num_bytes > inodes[handle].fsize)
+    { inodes[handle].fsize = start_byte + num_bytes;  }
+    return written_bytes;
+}
+
+// DfsInodePunchHole ======================================
+// Turns num_bytes of the file starting at start_byte into
+// a hole. Blocks entirely inside the range are freed, and
+// the parts of the blocks at either edge are zeroed. The
+// file size doesn't change. Return DFS_FAIL on failure 
+// and DFS_SUCCESS on success.
+// ========================================================
+int DfsInodePunchHole(uint32 handle, int start_byte, int num_bytes)
+{
+    // Initialize variables and parameters
+    int dfsblocknum=0, done=0, n=0, i=0;
+    int cpos = start_byte % sb.bsize;
+    int vblocknum = start_byte / sb.bsize;
+    dfs_block btable_buffer;
+    int * ibt;
+
+    // Check that filesystem is open
+    if(sb.valid != 1 || dfsOpen != 1) return DFS_FAIL;
+
+    // Check if this filename exists, and that it's a regular file
+    if(inodes[handle].inuse != 1) return DFS_FAIL;
+    if(inodes[handle].type != DFS_INODE_TYPE_FILE) return DFS_FAIL;
+    if(start_byte < 0 || num_bytes < 0) return DFS_FAIL;
+
+    // Only the part of the range inside the file matters
+    if(start_byte >= inodes[handle].fsize) return DFS_SUCCESS;
+    num_bytes = min(num_bytes, inodes[handle].fsize - start_byte);
+
+    if(inodes[handle].flags & DFS_INODE_FLAG_INLINE)
+    {
+        bzero(inodes[handle].idata + start_byte, num_bytes);
+        return DFS_SUCCESS;
+    }
+
+    while(done < num_bytes)
+    {
+        n = min(num_bytes - done, sb.bsize - cpos);
+        dfsblocknum = DfsInodeTranslateVirtualToFilesys(handle, vblocknum);
+        if(dfsblocknum != -1)
+        {
+            if(n == sb.bsize) DfsInodeFreeVirtualBlock(handle, vblocknum);
+            else
             {
-                dfsblocknum = DfsInodeAllocateVirtualBlock(handle, wblocknum);
-                if(dfsblocknum==DFS_FAIL) return DFS_FAIL;
+                if(DfsReadBlock(dfsblocknum, &btable_buffer) != sb.bsize) return DFS_FAIL;
+                bzero(btable_buffer.data + cpos, n);
+                if((dfsblocknum = DfsInodeUnshareVirtualBlock(handle, vblocknum, dfsblocknum)) == DFS_FAIL) return DFS_FAIL;
+                if(DfsInodeWriteDataBlock(handle, dfsblocknum, &btable_buffer) != sb.bsize) return DFS_FAIL;
             }
         }
-        if(DfsReadBlock(dfsblocknum, &btable_buffer) != sb.bsize) return DFS_FAIL;
+        done += n;
+        cpos = 0;
+        vblocknum++;
+    }
 
-        if((num_bytes - written_bytes) > (sb.bsize - cpos))
+    // Drop the indirect table once nothing is left in it
+    if(inodes[handle].ibtable != -1)
+    {
+        if(DfsReadBlock(inodes[handle].ibtable, &btable_buffer) != sb.bsize) return DFS_FAIL;
+        ibt = (int *)btable_buffer.data;
+        for(i=0; i<sb.bsize/4; i++) if(ibt[i] != -1) break;
+        if(i == sb.bsize/4)
         {
-            bcopy(ptr, btable_buffer.data + cpos, sb.bsize - cpos);
-            if(DfsWriteBlock(dfsblocknum, &btable_buffer) != sb.bsize) return DFS_FAIL;
-            ptr += sb.bsize - cpos;
-            written_bytes += sb.bsize - cpos;
-            cpos = 0;
-            wblocknum++;
+            DfsFreeBlock(inodes[handle].ibtable);
+            inodes[handle].ibtable = -1;
         }
-        else
+    }
+    return DFS_SUCCESS;
+}
+
+// DfsInodePreallocate ====================================
+// Reserves blocks for the first num_bytes of the file so
+// later writes don't have to allocate them one at a time.
+// The missing blocks are taken as one contiguous run when
+// the disk has one (else one by one) and recorded in the
+// translation table. Nothing is written to them: they are
+// marked DFS_CSECTORS_UNWRITTEN, so they read as zeros 
+// until their first write. The file size doesn't change.
+// Return DFS_FAIL on failure and DFS_SUCCESS on success.
+// ========================================================
+int DfsInodePreallocate(uint32 handle, int num_bytes)
+{
+    // Initialize variables and parameters
+    int nvblocks=0, missing=0, run=0, i=0, newibt=0, ret=DFS_SUCCESS;
+    uint32 taken[(DFS_INODE_BTABLE_SIZE + DFS_MAX_BLOCKSIZE/4 + 31)/32];
+    dfs_block dfsblock_buffer;
+    int * ibt = (int *)dfsblock_buffer.data;
+    int * slot;
+
+    // Check that filesystem is open
+    if(sb.valid != 1 || dfsOpen != 1) return DFS_FAIL;
+
+    // Check if this filename exists, and that it's a regular file
+    if(inodes[handle].inuse != 1) return DFS_FAIL;
+    if(inodes[handle].type != DFS_INODE_TYPE_FILE) return DFS_FAIL;
+    if(num_bytes < 0) return DFS_FAIL;
+    nvblocks = (num_bytes + sb.bsize - 1) / sb.bsize;
+    if(nvblocks > DFS_INODE_MAX_VBLOCKS()) return DFS_FAIL;
+
+    // If it still fits in the inode there is nothing to reserve
+    if(inodes[handle].flags & DFS_INODE_FLAG_INLINE)
+    {
+        if(num_bytes <= DFS_INODE_INLINE_MAX) return DFS_SUCCESS;
+        if(DfsInodePromoteInline(handle) != DFS_SUCCESS) return DFS_FAIL;
+    }
+
+    // Get the indirect table first, so it doesn't split the run
+    if(nvblocks > DFS_INODE_BTABLE_SIZE)
+    {
+        if(inodes[handle].ibtable == -1)
         {
-            bcopy(ptr, btable_buffer.data + cpos, num_bytes - written_bytes);
-            if(DfsWriteBlock(dfsblocknum, &btable_buffer) != sb.bsize) return DFS_FAIL;
-            written_bytes += num_bytes - written_bytes;
-            if(start_byte + num_bytes > inodes[handle].fsize)
-            { inodes[handle].fsize = start_byte + num_bytes;  }
-            return written_bytes;
+            for(i=0; i<sb.bsize/4; i++) ibt[i] = -1;
+            if((inodes[handle].ibtable = DfsAllocateBlock()) == DFS_FAIL) return DFS_FAIL;
+            newibt = 1;
         }
+        else if(DfsReadBlock(inodes[handle].ibtable, &dfsblock_buffer) != sb.bsize) return DFS_FAIL;
+    }
+
+    // Count the holes, then fill them in order from one run
+    for(i=0; i<nvblocks; i++)
+    {
+        slot = (i < DFS_INODE_BTABLE_SIZE) ? &inodes[handle].btable[i] : &ibt[i-DFS_INODE_BTABLE_SIZE];
+        if(*slot == -1) missing++;
+    }
+    run = DfsAllocateBlockRun(missing);
+    bzero((char *)taken, sizeof(taken));
+    for(i=0; i<nvblocks && missing>0; i++)
+    {
+        slot = (i < DFS_INODE_BTABLE_SIZE) ? &inodes[handle].btable[i] : &ibt[i-DFS_INODE_BTABLE_SIZE];
+        if(*slot != -1) continue;
+        if(run != DFS_FAIL) *slot = run++;
+        else if((*slot = DfsAllocateBlock()) == DFS_FAIL) {  *slot = -1; ret = DFS_FAIL; break;  }
+        csectors[*slot] = DFS_CSECTORS_UNWRITTEN;
+        taken[i>>5] |= (1 << (i & 0x1F));
+        missing--;
+    }
+    // Whatever part of the run wasn't recorded goes back
+    if(run != DFS_FAIL) while(missing-- > 0) DfsFreeBlock(run++);
+
+    if(nvblocks > DFS_INODE_BTABLE_SIZE && DfsWriteBlock(inodes[handle].ibtable, &dfsblock_buffer) != sb.bsize)
+    {
+        // The indirect slots filled above never reached the disk
+        for(i=DFS_INODE_BTABLE_SIZE; i<nvblocks; i++)
+        {
+            if(taken[i>>5] & (1 << (i & 0x1F))) DfsFreeBlock(ibt[i-DFS_INODE_BTABLE_SIZE]);
+        }
+        if(newibt) {  DfsFreeBlock(inodes[handle].ibtable); inodes[handle].ibtable = -1;  }
+        return DFS_FAIL;
+    }
+    return ret;
+}
+
+// DfsInodeClone ==========================================
+// Creates a new file at path with the same contents as 
+// the file handle, without copying any data: the new 
+// inode gets its own indirect table but points at the 
+// same data blocks, each of which gains a reference. 
+// Either copy is unshared block by block as it is 
+// written (see DfsInodeWriteBytes). A block that can't 
+// take another reference is copied instead. If any copy
+// fails, the references taken so far are dropped and the
+// new file is deleted. Returns the new inode handle, or 
+// DFS_FAIL.
+// ========================================================
+uint32 DfsInodeClone(uint32 handle, char *path)
+{
+    // Initialize variables and parameters
+    int i=0, n=0, dst=0;
+    dfs_block dfsblock_buffer, data_buffer;
+    int * ibt = (int *)dfsblock_buffer.data;
+    int * slot;
+
+    // Check that filesystem is open
+    if(sb.valid != 1 || dfsOpen != 1) return DFS_FAIL;
+
+    // The source must be a regular file, the destination new
+    if(inodes[handle].inuse != 1) return DFS_FAIL;
+    if(inodes[handle].type != DFS_INODE_TYPE_FILE) return DFS_FAIL;
+    if(DfsInodeFilenameExists(path) != DFS_FAIL) return DFS_FAIL;
+    if((dst = DfsInodeOpen(path)) == DFS_FAIL) return DFS_FAIL;
+
+    // Same size, and the same inline bytes or block pointers
+    inodes[dst].fsize = inodes[handle].fsize;
+    inodes[dst].flags = inodes[handle].flags;
+    bcopy(inodes[handle].idata, inodes[dst].idata, DFS_INODE_INLINE_MAX);
+    if(inodes[dst].flags & DFS_INODE_FLAG_INLINE) return dst;
+    inodes[dst].ibtable = -1;
+    inodes[dst].iibtable = -1;
+
+    // The indirect table itself is copied, not shared
+    n = DFS_INODE_BTABLE_SIZE;
+    if(inodes[handle].ibtable != -1)
+    {
+        if(DfsReadBlock(inodes[handle].ibtable, &dfsblock_buffer) != sb.bsize
+           || (inodes[dst].ibtable = DfsAllocateBlock()) == DFS_FAIL) 
+        {  DfsInodeClearBlocks(dst); DfsInodeDelete(dst); return DFS_FAIL;  }
+        n = DFS_INODE_MAX_VBLOCKS();
     }
+
+    // Every data block gains a reference (or is copied). Slots
+    // below i hold a reference or copy of the clone's own
+    for(i=0; i<n; i++)
+    {
+        slot = (i < DFS_INODE_BTABLE_SIZE) ? &inodes[dst].btable[i] : &ibt[i-DFS_INODE_BTABLE_SIZE];
+        if(*slot == -1 || DfsBlockShare(*slot) == DFS_SUCCESS) continue;
+        if(DfsReadBlock(*slot, &data_buffer) != sb.bsize) break;
+        if((*slot = DfsAllocateBlock()) == DFS_FAIL) break;
+        if(DfsWriteBlock(*slot, &data_buffer) != sb.bsize) {  i++; break;  }
+    }
+    if(i == n && (inodes[dst].ibtable == -1 || DfsWriteBlock(inodes[dst].ibtable, &dfsblock_buffer) == sb.bsize)) return dst;
+
+    // Out of space: give back what the clone took, then drop it
+    while(i-- > 0)
+    {
+        slot = (i < DFS_INODE_BTABLE_SIZE) ? &inodes[dst].btable[i] : &ibt[i-DFS_INODE_BTABLE_SIZE];
+        if(*slot != -1) DfsFreeBlock(*slot);
+    }
+    if(inodes[dst].ibtable != -1) DfsFreeBlock(inodes[dst].ibtable);
+    DfsInodeClearBlocks(dst);
+    DfsInodeDelete(dst);
     return DFS_FAIL;
 }
 
+// DfsInodeEnableCompression ==============================
+// Makes the file's data blocks be stored LZ compressed from
+// now on. Only an empty file can be switched, so a file is
+// always either compressed or not. Return DFS_FAIL on 
+// failure and DFS_SUCCESS on success.
+// ========================================================
+int DfsInodeEnableCompression(uint32 handle)
+{
+    // Check that filesystem is open
+    if(sb.valid != 1 || dfsOpen != 1) return DFS_FAIL;
+
+    // Check if this filename exists, and that it's an empty file
+    if(inodes[handle].inuse != 1) return DFS_FAIL;
+    if(inodes[handle].type != DFS_INODE_TYPE_FILE) return DFS_FAIL;
+    if(inodes[handle].fsize != 0) return DFS_FAIL;
+    inodes[handle].flags |= DFS_INODE_FLAG_COMPRESS;
+    return DFS_SUCCESS;
+}
+
+// DfsInodeStoredBytes ====================================
+// Returns how many bytes of disk the file's data blocks 
+// take up (not counting the indirect table), which is 
+// less than the file size for compressed or sparse files.
+// Return DFS_FAIL on failure.
+// ========================================================
+int DfsInodeStoredBytes(uint32 handle)
+{
+    // Initialize variables and parameters
+    int i=0, stored=0, dfsblocknum=0;
+    int nvblocks = (inodes[handle].fsize + sb.bsize - 1) / sb.bsize;
+
+    // Check that filesystem is open
+    if(sb.valid != 1 || dfsOpen != 1) return DFS_FAIL;
+
+    // Check if this filename exists
+    if(inodes[handle].inuse != 1) return DFS_FAIL;
+    if(inodes[handle].flags & DFS_INODE_FLAG_INLINE) return 0;
+    for(i=0; i<nvblocks; i++)
+    {
+        dfsblocknum = DfsInodeTranslateVirtualToFilesys(handle, i);
+        if(dfsblocknum != -1) stored += DfsBlockStoredBytes(dfsblocknum);
+    }
+    return stored;
+}
+
 // DfsInodeFilesize =======================================
 // Simply returns the size of an inode's file. This is 
 // defined as the maximum virtual byte number that has 
@@ -548,16 +1359,17 @@ uint32 DfsInodeFilesize(uint32 handle)
 // storing its blocknumber at index virtual_blocknumber in 
 // the translation table. If the virtual_blocknumber 
 // resides in the indirect address space, and there is not 
-// an allocated indirect addressing table, allocate it. 
-// Return DFS_FAIL on failure, and the newly allocated file 
-// system block number on success.
+// an allocated indirect addressing table, allocate it 
+// (with every entry a hole). Return DFS_FAIL on failure,
+// and the newly allocated file system block number on 
+// success.
 // ========================================================
 uint32 DfsInodeAllocateVirtualBlock(uint32 handle, uint32 virtual_blocknum) 
 {
     // Initialize variables and parameters
-    int dfsblocknum=0;
+    int dfsblocknum=0, i=0;
     dfs_block dfsblock_buffer;
-    int * ibt = NULL;
+    int * ibt = (int *)dfsblock_buffer.data;
     
     // Check that filesystem is open
     if(sb.valid != 1 || dfsOpen != 1) return DFS_FAIL;
@@ -565,30 +1377,78 @@ uint32 DfsInodeAllocateVirtualBlock(uint32 handle, uint32 virtual_blocknum)
     // Check if this filename exists
     if(inodes[handle].inuse != 1) return DFS_FAIL;
 
-    if(virtual_blocknum < 0 || virtual_blocknum >= 10 + sb.bsize/4) return DFS_FAIL;
-    if(virtual_blocknum < 10) 
+    if(inodes[handle].flags & DFS_INODE_FLAG_INLINE) return DFS_FAIL;
+    if(virtual_blocknum >= DFS_INODE_MAX_VBLOCKS()) return DFS_FAIL;
+    if(virtual_blocknum < DFS_INODE_BTABLE_SIZE) 
     {
         if(inodes[handle].btable[virtual_blocknum] != -1) return DFS_FAIL;
-        dfsblocknum = DfsAllocateBlock();
+        if((dfsblocknum = DfsAllocateBlock()) == DFS_FAIL) return DFS_FAIL;
         inodes[handle].btable[virtual_blocknum] = dfsblocknum;
     }
     else
     {
         if(inodes[handle].ibtable == -1) 
-        {  inodes[handle].ibtable = DfsAllocateBlock();  }
-        if(DfsReadBlock(inodes[handle].ibtable, &dfsblock_buffer) != sb.bsize) return DFS_FAIL;
-        ibt = (int *)dfsblock_buffer.data;
-        dfsblocknum = DfsAllocateBlock();
-        ibt[virtual_blocknum-10] = dfsblocknum;
+        {
+            for(i=0; i<sb.bsize/4; i++) ibt[i] = -1;
+            if((dfsblocknum = DfsAllocateBlock()) == DFS_FAIL) return DFS_FAIL;
+            if((inodes[handle].ibtable = DfsAllocateBlock()) == DFS_FAIL) 
+            {  DfsFreeBlock(dfsblocknum); return DFS_FAIL;  }
+        }
+        else
+        {
+            if(DfsReadBlock(inodes[handle].ibtable, &dfsblock_buffer) != sb.bsize) return DFS_FAIL;
+            if(ibt[virtual_blocknum-DFS_INODE_BTABLE_SIZE] != -1) return DFS_FAIL;
+            if((dfsblocknum = DfsAllocateBlock()) == DFS_FAIL) return DFS_FAIL;
+        }
+        ibt[virtual_blocknum-DFS_INODE_BTABLE_SIZE] = dfsblocknum;
         if(DfsWriteBlock(inodes[handle].ibtable, &dfsblock_buffer) != sb.bsize) return DFS_FAIL;
     }
     return dfsblocknum; 
 }
 
+// DfsInodeFreeVirtualBlock ===============================
+// Frees the filesystem block behind virtual_blocknum and
+// marks that spot in the translation table as a hole.
+// Return DFS_FAIL on failure and DFS_SUCCESS on success.
+// ========================================================
+int DfsInodeFreeVirtualBlock(uint32 handle, uint32 virtual_blocknum)
+{
+    // Initialize variables and parameters
+    int dfsblocknum=0;
+    dfs_block dfsblock_buffer;
+    int * ibt = (int *)dfsblock_buffer.data;
+
+    // Check that filesystem is open
+    if(sb.valid != 1 || dfsOpen != 1) return DFS_FAIL;
+
+    // Check if this filename exists
+    if(inodes[handle].inuse != 1) return DFS_FAIL;
+
+    if(inodes[handle].flags & DFS_INODE_FLAG_INLINE) return DFS_FAIL;
+    if(virtual_blocknum >= DFS_INODE_MAX_VBLOCKS()) return DFS_FAIL;
+    if(virtual_blocknum < DFS_INODE_BTABLE_SIZE)
+    {
+        dfsblocknum = inodes[handle].btable[virtual_blocknum];
+        inodes[handle].btable[virtual_blocknum] = -1;
+    }
+    else
+    {
+        if(inodes[handle].ibtable == -1) return DFS_SUCCESS;
+        if(DfsReadBlock(inodes[handle].ibtable, &dfsblock_buffer) != sb.bsize) return DFS_FAIL;
+        dfsblocknum = ibt[virtual_blocknum-DFS_INODE_BTABLE_SIZE];
+        if(dfsblocknum == -1) return DFS_SUCCESS;
+        ibt[virtual_blocknum-DFS_INODE_BTABLE_SIZE] = -1;
+        if(DfsWriteBlock(inodes[handle].ibtable, &dfsblock_buffer) != sb.bsize) return DFS_FAIL;
+    }
+    if(dfsblocknum != -1) DfsFreeBlock(dfsblocknum);
+    return DFS_SUCCESS;
+}
+
 // DfsInodeTranslateVirtualToFilesys ======================
 // Translates the virtual_blocknum to the corresponding 
 // file system block using the inode identified by handle. 
-// Return DFS_FAIL on failure.
+// Returns -1 (DFS_FAIL) for a hole as well as on failure,
+// neither of which has a block behind it.
 // ========================================================
 uint32 DfsInodeTranslateVirtualToFilesys(uint32 handle, uint32 virtual_blocknum) 
 {
@@ -603,9 +1463,10 @@ uint32 DfsInodeTranslateVirtualToFilesys(uint32 handle, uint32 virtual_blocknum)
     // Check if this filename exists
     if(inodes[handle].inuse != 1) return DFS_FAIL;
 
-    if(virtual_blocknum < 10) 
+    if(inodes[handle].flags & DFS_INODE_FLAG_INLINE) return DFS_FAIL;
+    if(virtual_blocknum >= DFS_INODE_MAX_VBLOCKS()) return DFS_FAIL;
+    if(virtual_blocknum < DFS_INODE_BTABLE_SIZE) 
     {
-        if(inodes[handle].btable[virtual_blocknum] != -1) return DFS_FAIL;
         dfsblocknum = inodes[handle].btable[virtual_blocknum];
     }
     else
@@ -613,7 +1474,301 @@ uint32 DfsInodeTranslateVirtualToFilesys(uint32 handle, uint32 virtual_blocknum)
         if(inodes[handle].ibtable == -1) return DFS_FAIL;
         if(DfsReadBlock(inodes[handle].ibtable, &dfsblock_buffer) != sb.bsize) return DFS_FAIL;
         ibt = (int *)dfsblock_buffer.data;
-        dfsblocknum = ibt[virtual_blocknum-10];
+        dfsblocknum = ibt[virtual_blocknum-DFS_INODE_BTABLE_SIZE];
     }
     return dfsblocknum;
 }
+
+
+///////////////////////////////////////////////////////////////////////////////
+// Directory-based functions
+///////////////////////////////////////////////////////////////////////////////
+
+// DfsNameHash ============================================
+// Hashes a path component (djb2). Picks the bucket block 
+// of a directory and the slot in the dentry cache.
+// ========================================================
+uint32 DfsNameHash(char *name)
+{
+    uint32 h = 5381;
+    while(*name != '\0') h = ((h << 5) + h) + (uint32)(*name++);
+    return h;
+}
+
+// DfsDcacheSlot ==========================================
+// Returns the dentry cache slot for (parent, name).
+// ========================================================
+static dfs_dentry *DfsDcacheSlot(uint32 dir, char *name)
+{  return &dcache[(DfsNameHash(name) + dir * 31) % DFS_DCACHE_SIZE];  }
+
+// DfsDcacheLookup ========================================
+// Returns the cached inode of (dir, name), else DFS_FAIL.
+// ========================================================
+static uint32 DfsDcacheLookup(uint32 dir, char *name)
+{
+    dfs_dentry *d = DfsDcacheSlot(dir, name);
+    if(d->inuse && d->parent == dir && DfsNameEquals(d->name, name)) return d->inode;
+    return DFS_FAIL;
+}
+
+// DfsDcacheInsert ========================================
+// Caches (dir, name) -> inode, evicting whatever shared 
+// its slot.
+// ========================================================
+static void DfsDcacheInsert(uint32 dir, char *name, uint32 inode)
+{
+    dfs_dentry *d = DfsDcacheSlot(dir, name);
+    d->inuse = 1;
+    d->parent = dir;
+    d->inode = inode;
+    dstrncpy(d->name, name, DFS_DIRENT_NAME_LENGTH);
+}
+
+// DfsDcacheRemove ========================================
+// Drops (dir, name) from the dentry cache, if present.
+// ========================================================
+static void DfsDcacheRemove(uint32 dir, char *name)
+{
+    dfs_dentry *d = DfsDcacheSlot(dir, name);
+    if(d->inuse && d->parent == dir && DfsNameEquals(d->name, name)) d->inuse = 0;
+}
+
+// DfsDirLookup ===========================================
+// Looks up name in directory dir. Checks the dentry cache
+// first, then probes the dir's bucket blocks starting at 
+// the name's hash bucket. The probe stops at the first 
+// unallocated bucket or at a bucket with a never-used 
+// slot. Returns the inode number or DFS_FAIL.
+// ========================================================
+uint32 DfsDirLookup(uint32 dir, char *name)
+{
+    // Initialize variables and parameters
+    int i=0, k=0, bucket=0, more=0;
+    uint32 inode;
+    dfs_block dirblock;
+    dfs_dirent *ents = (dfs_dirent *)dirblock.data;
+
+    if(inodes[dir].inuse != 1 || inodes[dir].type != DFS_INODE_TYPE_DIR) return DFS_FAIL;
+    if((inode = DfsDcacheLookup(dir, name)) != DFS_FAIL) return inode;
+
+    bucket = DfsNameHash(name) % DFS_DIR_NUM_BUCKETS;
+    for(k=0; k<DFS_DIR_NUM_BUCKETS; k++)
+    {
+        if(inodes[dir].btable[bucket] == -1) return DFS_FAIL;
+        if(DfsReadBlock(inodes[dir].btable[bucket], &dirblock) != sb.bsize) return DFS_FAIL;
+        more = 1;
+        for(i=0; i<DFS_DIRENTS_PER_BLOCK(); i++)
+        {
+            if(ents[i].inode == DFS_DIRENT_FREE) {  more = 0; continue;  }
+            if(ents[i].inode == DFS_DIRENT_DELETED) continue;
+            if(DfsNameEquals(ents[i].name, name))
+            {
+                DfsDcacheInsert(dir, name, ents[i].inode);
+                return ents[i].inode;
+            }
+        }
+        if(!more) return DFS_FAIL;
+        bucket = (bucket + 1) % DFS_DIR_NUM_BUCKETS;
+    }
+    return DFS_FAIL;
+}
+
+// DfsDirAddEntry =========================================
+// Adds name -> inode to directory dir, in the first free 
+// slot along the name's probe sequence. Allocates (and 
+// clears) bucket blocks on first use. The caller must 
+// make sure the name isn't already there. Returns 
+// DFS_FAIL on failure and DFS_SUCCESS on success.
+// ========================================================
+int DfsDirAddEntry(uint32 dir, char *name, uint32 inode)
+{
+    // Initialize variables and parameters
+    int i=0, k=0, bucket=0, dfsblocknum=0;
+    dfs_block dirblock;
+    dfs_dirent *ents = (dfs_dirent *)dirblock.data;
+
+    if(inodes[dir].inuse != 1 || inodes[dir].type != DFS_INODE_TYPE_DIR) return DFS_FAIL;
+    if(dstrlen(name) >= DFS_DIRENT_NAME_LENGTH) return DFS_FAIL;
+
+    bucket = DfsNameHash(name) % DFS_DIR_NUM_BUCKETS;
+    for(k=0; k<DFS_DIR_NUM_BUCKETS; k++)
+    {
+        if((dfsblocknum = inodes[dir].btable[bucket]) == -1)
+        {
+            // Fresh bucket, every slot starts out never-used
+            if((dfsblocknum = DfsInodeAllocateVirtualBlock(dir, bucket)) == DFS_FAIL) return DFS_FAIL;
+            for(i=0; i<DFS_DIRENTS_PER_BLOCK(); i++) ents[i].inode = DFS_DIRENT_FREE;
+        }
+        else if(DfsReadBlock(dfsblocknum, &dirblock) != sb.bsize) return DFS_FAIL;
+
+        for(i=0; i<DFS_DIRENTS_PER_BLOCK(); i++)
+        {
+            if(ents[i].inode != DFS_DIRENT_FREE && ents[i].inode != DFS_DIRENT_DELETED) continue;
+            ents[i].inode = inode;
+            dstrncpy(ents[i].name, name, DFS_DIRENT_NAME_LENGTH);
+            if(DfsWriteBlock(dfsblocknum, &dirblock) != sb.bsize) return DFS_FAIL;
+            inodes[dir].fsize += 1;
+            DfsDcacheInsert(dir, name, inode);
+            return DFS_SUCCESS;
+        }
+        bucket = (bucket + 1) % DFS_DIR_NUM_BUCKETS;
+    }
+    return DFS_FAIL;
+}
+
+// DfsDirRemoveInode ======================================
+// Removes the entry for inode from directory dir, leaving
+// a tombstone so probes for names further along the 
+// sequence still work. The inode doesn't record its own 
+// name, so every allocated bucket is scanned (at most 
+// DFS_DIR_NUM_BUCKETS blocks). Returns DFS_FAIL on failure
+// and DFS_SUCCESS on success.
+// ========================================================
+int DfsDirRemoveInode(uint32 dir, uint32 inode)
+{
+    // Initialize variables and parameters
+    int i=0, bucket=0;
+    dfs_block dirblock;
+    dfs_dirent *ents = (dfs_dirent *)dirblock.data;
+
+    if(inodes[dir].inuse != 1 || inodes[dir].type != DFS_INODE_TYPE_DIR) return DFS_FAIL;
+
+    for(bucket=0; bucket<DFS_DIR_NUM_BUCKETS; bucket++)
+    {
+        if(inodes[dir].btable[bucket] == -1) continue;
+        if(DfsReadBlock(inodes[dir].btable[bucket], &dirblock) != sb.bsize) return DFS_FAIL;
+        for(i=0; i<DFS_DIRENTS_PER_BLOCK(); i++)
+        {
+            if(ents[i].inode != inode) continue;
+            DfsDcacheRemove(dir, ents[i].name);
+            ents[i].inode = DFS_DIRENT_DELETED;
+            if(DfsWriteBlock(inodes[dir].btable[bucket], &dirblock) != sb.bsize) return DFS_FAIL;
+            inodes[dir].fsize -= 1;
+            return DFS_SUCCESS;
+        }
+    }
+    return DFS_FAIL;
+}
+
+// DfsInodeWalkPath =======================================
+// Walks every component of path except the last, starting
+// at the root ('/' separated, leading '/' optional, "." 
+// and ".." understood). Copies the last component into 
+// name (empty if the path names the root) and returns the
+// inode of the directory that should hold it. The cost is
+// one DfsDirLookup per component. Returns DFS_FAIL if a 
+// component is missing, isn't a directory, or is too long.
+// ========================================================
+uint32 DfsInodeWalkPath(char *path, char *name)
+{
+    // Initialize variables and parameters
+    uint32 dir = DFS_ROOT_INODE, next;
+    int len=0;
+
+    name[0] = '\0';
+    while(1)
+    {
+        while(*path == '/') path++;
+        if(*path == '\0') return dir;
+
+        // Cut the next component out of the path
+        for(len=0; path[len] != '/' && path[len] != '\0'; len++)
+        {
+            if(len >= DFS_DIRENT_NAME_LENGTH-1) return DFS_FAIL;
+            name[len] = path[len];
+        }
+        name[len] = '\0';
+        path += len;
+        while(*path == '/') path++;
+
+        // Last component goes back to the caller unresolved
+        if(*path == '\0') 
+        {
+            if(DfsNameEquals(name, ".")) {  name[0] = '\0'; return dir;  }
+            if(DfsNameEquals(name, "..")) {  name[0] = '\0'; return inodes[dir].parent;  }
+            return dir;
+        }
+
+        if(DfsNameEquals(name, ".")) continue;
+        if(DfsNameEquals(name, "..")) {  dir = inodes[dir].parent; continue;  }
+        if((next = DfsDirLookup(dir, name)) == DFS_FAIL) return DFS_FAIL;
+        if(inodes[next].type != DFS_INODE_TYPE_DIR) return DFS_FAIL;
+        dir = next;
+    }
+}
+
+// DfsInodeIsDir ==========================================
+// Returns 1 if the inode is a directory, else 0.
+// ========================================================
+int DfsInodeIsDir(uint32 handle)
+{
+    if(handle >= DFS_INODE_NMAX_NUM || inodes[handle].inuse != 1) return 0;
+    return (inodes[handle].type == DFS_INODE_TYPE_DIR);
+}
+
+// DfsInodeMkdir ==========================================
+// Creates an empty directory at path. The parent must 
+// exist and the name must be unused. Returns the new 
+// directory's inode or DFS_FAIL.
+// ========================================================
+uint32 DfsInodeMkdir(char *path)
+{
+    // Initialize variables and parameters
+    char name[DFS_DIRENT_NAME_LENGTH];
+    uint32 dir, inode_handle = DFS_FAIL;
+
+    // Check that filesystem is open
+    if(sb.valid != 1 || dfsOpen != 1) return DFS_FAIL;
+
+    if((dir = DfsInodeWalkPath(path, name)) == DFS_FAIL) return DFS_FAIL;
+    if(name[0] == '\0') return DFS_FAIL;
+
+    while(LockHandleAcquire(lock_inodes) != SYNC_SUCCESS);
+    if(DfsDirLookup(dir, name) == DFS_FAIL)
+    {  inode_handle = DfsInodeAllocate(dir, name, DFS_INODE_TYPE_DIR);  }
+    while(LockHandleRelease(lock_inodes) != SYNC_SUCCESS);
+    return inode_handle;
+}
+
+// DfsInodeRmdir ==========================================
+// Removes the empty directory at path. Returns DFS_FAIL 
+// on failure and DFS_SUCCESS on success.
+// ========================================================
+int DfsInodeRmdir(char *path)
+{
+    uint32 handle;
+
+    if((handle = DfsInodeFilenameExists(path)) == DFS_FAIL) return DFS_FAIL;
+    if(!DfsInodeIsDir(handle)) return DFS_FAIL;
+    return DfsInodeDelete(handle);
+}
+
+// DfsInodeReaddir ========================================
+// Copies the name of the first entry of directory handle
+// at or after slot pos into name. Returns the slot to pass
+// in next time, or DFS_FAIL when there are no more.
+// ========================================================
+int DfsInodeReaddir(uint32 handle, int pos, char *name)
+{
+    // Initialize variables and parameters
+    int bucket=0, i=0;
+    dfs_block dirblock;
+    dfs_dirent *ents = (dfs_dirent *)dirblock.data;
+
+    if(sb.valid != 1 || dfsOpen != 1) return DFS_FAIL;
+    if(!DfsInodeIsDir(handle) || pos < 0) return DFS_FAIL;
+
+    for(bucket=pos/DFS_DIRENTS_PER_BLOCK(); bucket<DFS_DIR_NUM_BUCKETS; bucket++)
+    {
+        i = (bucket == pos/DFS_DIRENTS_PER_BLOCK()) ? pos%DFS_DIRENTS_PER_BLOCK() : 0;
+        if(inodes[handle].btable[bucket] == -1) continue;
+        if(DfsReadBlock(inodes[handle].btable[bucket], &dirblock) != sb.bsize) return DFS_FAIL;
+        for(; i<DFS_DIRENTS_PER_BLOCK(); i++)
+        {
+            if(ents[i].inode < 0) continue;
+            dstrncpy(name, ents[i].name, DFS_DIRENT_NAME_LENGTH);
+            return bucket*DFS_DIRENTS_PER_BLOCK() + i + 1;
+        }
+    }
+    return DFS_FAIL;
+}
@@ -4,6 +4,11 @@
 #include "disk.h"
 #include "filesys.h"
 
+// Member image files of the (possibly striped) disk
+static char *disk_filenames[DISK_MAX_MEMBERS] = DISK_MEMBER_FILENAMES;
+static int disk_members = 1;
+static int disk_stripe = DISK_MIN_STRIPE;
+
 //----------------------------------------------------------------------------
 // DiskBytesPerBlock returns the number of bytes in each physical block
 // on the disk.
@@ -13,50 +18,98 @@ int DiskBytesPerBlock() {
   return DISK_BLOCKSIZE;
 }
 
+//----------------------------------------------------------------------------
+// DiskNumBlocks returns the number of blocks on the whole disk. With more
+// than one member, only whole stripe rows are used.
+//----------------------------------------------------------------------------
+
+static int DiskNumBlocks() {
+  if (disk_members == 1) return DISK_NUMBLOCKS;
+  return (DISK_NUMBLOCKS / disk_stripe) * disk_stripe * disk_members;
+}
+
 //----------------------------------------------------------------------------
 // DiskSize returns the size of the hard disk, in bytes.
 //----------------------------------------------------------------------------
 
 int DiskSize() {
-  return DISK_BLOCKSIZE * DISK_NUMBLOCKS;
+  return DISK_BLOCKSIZE * DiskNumBlocks();
 }
 
 //----------------------------------------------------------------------------
-// DiskCreate opens the filesystem for writing, which will erase whatever
-// was there before.  You need to call this only when formattig the
-// disk to make sure that the file actually exists.
+// DiskSetStripe sets how many image files the disk is striped across, and
+// the stripe unit in disk blocks. Consecutive runs of stripe blocks go to
+// consecutive members. fdisk picks these, and the DFS driver sets them
+// from the superblock when it opens the file system. Returns DISK_FAIL
+// on bad parameters.
 //----------------------------------------------------------------------------
 
-int DiskCreate() {
-  char *filename = NULL;
-  int fsfd = -1;
-  disk_block b;
-  int i;
+int DiskSetStripe(int members, int stripe) {
+  if ((members < 1) || (members > DISK_MAX_MEMBERS) || (stripe < DISK_MIN_STRIPE)) {
+    printf("DiskSetStripe: can't stripe over %d disks with a unit of %d blocks\n", members, stripe);
+    return DISK_FAIL;
+  }
+  disk_members = members;
+  disk_stripe = stripe;
+  return DISK_SUCCESS;
+}
+
+//----------------------------------------------------------------------------
+// DiskMapBlock translates a disk block number into the member image that
+// holds it (returned in member) and the block number inside that image.
+//----------------------------------------------------------------------------
 
-  // Check that you remembered to rename the filename for your group
-  filename = DISK_FILENAME;
+static uint32 DiskMapBlock(uint32 blocknum, int *member) {
+  uint32 stripenum = blocknum / disk_stripe;
+  *member = stripenum % disk_members;
+  return (stripenum / disk_members) * disk_stripe + (blocknum % disk_stripe);
+}
+
+//----------------------------------------------------------------------------
+// DiskCheckFilename makes sure you remembered to rename the filename for
+// your group.
+//----------------------------------------------------------------------------
+
+static void DiskCheckFilename(char *filename, char *caller) {
   if (filename[11] == 'X') {
-    printf("DiskCreate: you didn't change the filesystem filename in include/os/disk.h.  Cowardly refusing to do anything.\n");
+    printf("%s: you didn't change the filesystem filename in include/os/disk.h.  Cowardly refusing to do anything.\n", caller);
     GracefulExit();
   }
-  // Open the hard disk file
-  if ((fsfd = FsOpen(DISK_FILENAME, FS_MODE_WRITE)) < 0) {
-    printf ("DiskCreate: File system %s cannot be opened!\n", DISK_FILENAME);
-    return DISK_FAIL;
-  }
+}
 
-  // Write all zeros to the hard disk file to make sure it is the right size.
-  // You need to do this because the writeblock/readblock operations are allowed in
-  // random order.
-  bzero(b.data, DISK_BLOCKSIZE);
-  for(i=0; i<DISK_NUMBLOCKS; i++) {
-    FsWrite(fsfd, b.data, DISK_BLOCKSIZE);
-  }
-  
-  // Close the hard disk file
-  if (FsClose(fsfd) < 0) {
-    printf("DiskCreate: unable to close open file!\n");
-    return DISK_FAIL;
+//----------------------------------------------------------------------------
+// DiskCreate opens the filesystem for writing, which will erase whatever
+// was there before.  You need to call this only when formattig the
+// disk to make sure that the file actually exists. Every member image of
+// the current stripe is created.
+//----------------------------------------------------------------------------
+
+int DiskCreate() {
+  int fsfd = -1;
+  int m;
+
+  for (m=0; m<disk_members; m++) {
+    DiskCheckFilename(disk_filenames[m], "DiskCreate");
+    // Open the hard disk file
+    if ((fsfd = FsOpen(disk_filenames[m], FS_MODE_WRITE)) < 0) {
+      printf ("DiskCreate: File system %s cannot be opened!\n", disk_filenames[m]);
+      return DISK_FAIL;
+    }
+
+    // Size the (now empty) file to the whole disk in one go. The simulator
+    // grows it sparsely, so the blocks read back as zeros without being
+    // written, and writeblock/readblock can be used in any order.
+    if (FsTruncate(fsfd, DISK_NUMBLOCKS, DISK_BLOCKSIZE) < 0) {
+      printf("DiskCreate: unable to size %s!\n", disk_filenames[m]);
+      FsClose(fsfd);
+      return DISK_FAIL;
+    }
+
+    // Close the hard disk file
+    if (FsClose(fsfd) < 0) {
+      printf("DiskCreate: unable to close open file!\n");
+      return DISK_FAIL;
+    }
   }
   return DISK_SUCCESS;
 }
@@ -70,33 +123,31 @@ int DiskCreate() {
 int DiskWriteBlock (uint32 blocknum, disk_block *b) {
   int fsfd = -1;
   uint32 intrvals = 0;
-  char *filename = NULL;
+  int member = 0;
+  uint32 memberblock = 0;
 
-  if (blocknum >= DISK_NUMBLOCKS) {
+  if (blocknum >= DiskNumBlocks()) {
     printf("DiskWriteBlock: cannot write to block larger than filesystem size\n");
     return DISK_FAIL;
   }
-
-  // Check that you remembered to rename the filename for your group
-  filename = DISK_FILENAME;
-  if (filename[11] == 'X') {
-    printf("DiskWriteBlock: you didn't change the filesystem filename in include/os/disk.h.  Cowardly refusing to do anything.\n");
-    GracefulExit();
-  }
+  memberblock = DiskMapBlock(blocknum, &member);
+  DiskCheckFilename(disk_filenames[member], "DiskWriteBlock");
 
   intrvals = DisableIntrs();
 
   // Open the hard disk file
-  if ((fsfd = FsOpen(DISK_FILENAME, FS_MODE_RW)) < 0) {
-    printf ("DiskWriteBlock: File system %s cannot be opened!\n", DISK_FILENAME);
+  if ((fsfd = FsOpen(disk_filenames[member], FS_MODE_RW)) < 0) {
+    printf ("DiskWriteBlock: File system %s cannot be opened!\n", disk_filenames[member]);
+    RestoreIntrs(intrvals);
     return DISK_FAIL;
   }
 
   // Write data to virtual disk
-  FsSeek(fsfd, blocknum * DISK_BLOCKSIZE, FS_SEEK_SET);
+  FsSeek(fsfd, memberblock * DISK_BLOCKSIZE, FS_SEEK_SET);
   if (FsWrite(fsfd, b->data, DISK_BLOCKSIZE) != DISK_BLOCKSIZE) {
     printf ("DiskWriteBlock: Block %d could not be written!\n", blocknum);
     FsClose (fsfd);
+    RestoreIntrs(intrvals);
     return DISK_FAIL;
   }
 
@@ -116,31 +167,31 @@ int DiskWriteBlock (uint32 blocknum, disk_block *b) {
 int DiskReadBlock (uint32 blocknum, disk_block *b) {
   int fsfd = -1;
   uint32 intrvals = 0;
-  char *filename = NULL;
+  int member = 0;
+  uint32 memberblock = 0;
 
-  if (blocknum >= DISK_NUMBLOCKS) {
+  if (blocknum >= DiskNumBlocks()) {
     printf("DiskReadBlock: cannot read from block larger than filesystem size\n");
     return DISK_FAIL;
   }
-
-  if (filename[11] == 'X') {
-    printf("DiskReadBlock: you didn't change the filesystem filename in include/os/disk.h.  Cowardly refusing to do anything.\n");
-    GracefulExit();
-  }
+  memberblock = DiskMapBlock(blocknum, &member);
+  DiskCheckFilename(disk_filenames[member], "DiskReadBlock");
 
   intrvals = DisableIntrs();
 
   // Open the hard disk file
-  if ((fsfd = FsOpen(DISK_FILENAME, FS_MODE_READ)) < 0) {
-    printf ("DiskReadBlock: File system %s cannot be opened!\n", DISK_FILENAME);
+  if ((fsfd = FsOpen(disk_filenames[member], FS_MODE_READ)) < 0) {
+    printf ("DiskReadBlock: File system %s cannot be opened!\n", disk_filenames[member]);
+    RestoreIntrs(intrvals);
     return DISK_FAIL;
   }
 
   // Read data from virtual disk
-  FsSeek(fsfd, blocknum * DISK_BLOCKSIZE, FS_SEEK_SET);
+  FsSeek(fsfd, memberblock * DISK_BLOCKSIZE, FS_SEEK_SET);
   if (FsRead(fsfd, b->data, DISK_BLOCKSIZE) != DISK_BLOCKSIZE) {
     printf ("DiskReadBlock: Block %d could not be read!\n", blocknum);
     FsClose (fsfd);
+    RestoreIntrs(intrvals);
     return DISK_FAIL;
   }
 
@@ -150,5 +201,3 @@ int DiskReadBlock (uint32 blocknum, disk_block *b) {
   RestoreIntrs(intrvals);
   return DISK_BLOCKSIZE;
 }
-
-
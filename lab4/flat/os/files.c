@@ -1,15 +1,24 @@
 #include "ostraps.h"
 #include "dlxos.h"
 #include "process.h"
+#include "memory.h"
 #include "dfs.h"
 #include "files.h"
 #include "synch.h"
+#include "slab.h"
 
 // Global declarations
-static file_descriptor files[DFS_INODE_NMAX_NUM]; // 128 files
+// Open files, shared by every process's descriptor table, which
+// holds their handles in the cache. Each inode counts the opens
+// (and writers) pointing at it.
+static SlabCache filecache;
+static int inode_opens[DFS_INODE_NMAX_NUM];
+static int inode_writers[DFS_INODE_NMAX_NUM];
 static lock_t lock;
-
-static int openFiles = -1;
+// Asynchronous requests, and whether the process serving them is alive
+static file_aio_request aioreqs[FILE_AIO_MAX_REQUESTS];
+static int aio_seq = 0;
+static int aio_worker_running = 0;
 
 int getModeNum(char mode)
 {
@@ -18,62 +27,101 @@ int getModeNum(char mode)
     else return FILE_FAIL;
 }
 
-int getFileHandle(int inodehandle)
+// Returns the number of the lowest set bit of a nonzero word,
+// a fixed five steps however many handles are in use.
+static int LowestSetBit(uint32 w)
 {
-    // Variable declarations
-    int i=0;
-    // Scan files for matching inode handles
-    for(i=0; i<DFS_INODE_NMAX_NUM; i++)
-    {  if(files[i].inodeHandle == inodehandle) return i;  }
-    return FILE_FAIL;
+    int b=0;
+    if((w & 0xFFFF) == 0) {  b += 16; w >>= 16;  }
+    if((w & 0xFF) == 0) {  b += 8; w >>= 8;  }
+    if((w & 0xF) == 0) {  b += 4; w >>= 4;  }
+    if((w & 0x3) == 0) {  b += 2; w >>= 2;  }
+    if((w & 0x1) == 0) {  b += 1;  }
+    return b;
 }
 
-int getAnotherFileDescriptor()
+// Returns the open file behind the calling process's handle,
+// or NULL if the handle isn't open.
+static file_descriptor *getOpenFile(uint32 handle)
 {
-    // Variable declarations
-    int i=0;
-    // Scan files for free inode handles
-    for(i=0; i<DFS_INODE_NMAX_NUM; i++)
-    {  if(files[i].inodeHandle == -1) return i;  }
-    return FILE_FAIL;
+    if(handle >= PROCESS_MAX_FDS || currentPCB->fds[handle] == -1) return NULL;
+    return (file_descriptor *)SlabLookup(&filecache, currentPCB->fds[handle]);
 }
 
-void CleanFileDescriptor(uint32 handle)
+// Drops pcb's handle and the open file behind it. Caller holds
+// the lock.
+static void CloseDescriptor(PCB *pcb, int handle)
 {
-    bzero(files[handle].fname, FILE_MAX_FILENAME_LENGTH);
-    files[handle].inodeHandle = -1;
-    files[handle].mypid = -1;
-    files[handle].cpos = -1;
-    files[handle].eof = -1;
-    files[handle].mode = '\0';
+    file_descriptor *f = (file_descriptor *)SlabLookup(&filecache, pcb->fds[handle]);
+
+    inode_opens[f->inodeHandle] -= 1;
+    if(f->mode == 'w') inode_writers[f->inodeHandle] -= 1;
+    SlabFree(&filecache, f);
+    pcb->fds[handle] = -1;
+    pcb->fdfree |= (1 << handle);
 }
 
-void InitFileAPI()
-{  int i; for(i=0; i<DFS_INODE_NMAX_NUM; i++) CleanFileDescriptor(i);  }
+void FileModuleInit()
+{
+    int i;
+    lock = LockCreate();
+    SlabCacheInit(&filecache, "open files", sizeof(file_descriptor));
+    for(i=0; i<DFS_INODE_NMAX_NUM; i++) {  inode_opens[i] = 0; inode_writers[i] = 0;  }
+    for(i=0; i<FILE_AIO_MAX_REQUESTS; i++) aioreqs[i].inuse = 0;
+    aio_worker_running = 0;
+}
+
+// Gives a new process an empty descriptor table and no mappings.
+void FileInitDescriptors(PCB *pcb)
+{
+    int i;
+    for(i=0; i<PROCESS_MAX_FDS; i++) pcb->fds[i] = -1;
+    pcb->fdfree = 0xFFFFFFFF;
+    for(i=0; i<PROCESS_MAX_MMAPS; i++) pcb->mmaps[i].inuse = 0;
+}
+
+// Closes everything a dying process left open.
+void FileCloseAll(PCB *pcb)
+{
+    uint32 used = ~pcb->fdfree;
+    if(used == 0) return;
+    while(LockHandleAcquire(lock) != SYNC_SUCCESS);
+    while(used != 0)
+    {
+        CloseDescriptor(pcb, LowestSetBit(used));
+        used = ~pcb->fdfree;
+    }
+    while(LockHandleRelease(lock) != SYNC_SUCCESS);
+}
 
 uint32 FileOpen(char * filename, char * mode) 
 {
     // Variable declarations
-    int m, inodehandle, fhandle;
+    int m, inodehandle, fhandle = FILE_FAIL;
+    file_descriptor *f = NULL;
 
-    // Check that MAX_OPEN_FILES < 15
-    if(openFiles >= FILE_MAX_OPEN_FILES) 
-    {  printf(" ERR: too many files open...\n"); return -1;  }
-    else if(openFiles == -1) { openFiles = 0; InitFileAPI(); }
+    // Use helper function to convert mode to number
+    if((m = getModeNum(mode[0])) == FILE_FAIL)
+    {  printf(" ERR: unrecognized mode... usage: \"r\"= read, \"w\"=write\n"); return FILE_FAIL;  }
+
+    // Grab the lock, we are going to alter the open files
+    while(LockHandleAcquire(lock) != SYNC_SUCCESS);
+    if(currentPCB->fdfree == 0 || (f = (file_descriptor *)SlabAlloc(&filecache)) == NULL)
+    {
+        printf(" ERR: too many files open...\n");
+        while(LockHandleRelease(lock) != SYNC_SUCCESS);
+        return FILE_FAIL;
+    }
 
-    // Check that filename is not open in another file_descriptor
+    // Any number of readers can share a file, but a writer
+    // recreates it, so it has to be the only one
     inodehandle = DfsInodeFilenameExists(filename);
     if(inodehandle != DFS_FAIL)
     {
-        fhandle = getFileHandle(inodehandle);
-        // File is being used by another process! Don't open this file!
-        if((fhandle != FILE_FAIL) && (GetCurrentPid() != files[fhandle].mypid)) return FILE_FAIL;
+        if((m == FMODE_W && inode_opens[inodehandle] > 0) || inode_writers[inodehandle] > 0)
+        {  SlabFree(&filecache, f); while(LockHandleRelease(lock) != SYNC_SUCCESS); return FILE_FAIL;  }
     }
-    else printf(" User provided a non-preexisting filename... Creating new file if not in \"r\"...\n"); 
-
-    // Use helper function to convert mode to number
-    if((m = getModeNum(mode[0])) == FILE_FAIL)
-    {  printf(" ERR: unrecognized mode... usage: \"r\"= read, \"w\"=write\n"); return FILE_FAIL;  }
+    else if(m == FMODE_R) printf(" User provided a non-preexisting filename...\n"); 
     
     // If we are in W mode, we want to do the following...
     if(m == FMODE_W)
@@ -83,27 +131,35 @@ uint32 FileOpen(char * filename, char * mode)
         {
             // 2. Delete the current inode
             if(DfsInodeDelete(inodehandle) != DFS_SUCCESS)
-            {  printf(" ERR: issue deleting inode before opening for write mode\n"); return FILE_FAIL;  }
+            {  
+                printf(" ERR: issue deleting inode before opening for write mode\n"); 
+                SlabFree(&filecache, f);
+                while(LockHandleRelease(lock) != SYNC_SUCCESS);
+                return FILE_FAIL;  
+            }
         }
-        // 3. Reopen inode
+        // 3. Reopen inode, "wc" asks for its blocks to be compressed
         inodehandle = DfsInodeOpen(filename);
+        if((inodehandle != DFS_FAIL) && ((mode[1] == 'c') || (mode[1] == 'C')))
+        {  DfsInodeEnableCompression(inodehandle);  }
     }
 
-    // If file is nonexistent, handle this, because
-    // you cannot read from an empty file...
-    if(inodehandle == DFS_FAIL) return FILE_FAIL;
+    // If file is nonexistent, handle this, because you cannot read 
+    // from an empty file... Directories are read with FileReaddir
+    if(inodehandle == DFS_FAIL || DfsInodeIsDir(inodehandle))
+    {  SlabFree(&filecache, f); while(LockHandleRelease(lock) != SYNC_SUCCESS); return FILE_FAIL;  }
 
-    // Grab the lock, we are going to alter files structure
-    while(LockHandleAcquire(lock) != SYNC_SUCCESS);
-
-    // Our fhandle was taken while waiting for lock or something, grab another
-    if(fhandle == FILE_FAIL) fhandle = getAnotherFileDescriptor();
+    // Take a handle from the process, pointing at the new open file
+    fhandle = LowestSetBit(currentPCB->fdfree);
+    currentPCB->fdfree &= ~(1 << fhandle);
+    currentPCB->fds[fhandle] = SlabIndex(&filecache, f);
 
-    // Assign values to data structure
-    dstrncpy(files[fhandle].fname, filename, dstrlen(filename));
-    files[fhandle].inodeHandle = inodehandle;
-    files[fhandle].mypid = GetCurrentPid();
-    openFiles += 1;
+    // Assign values to data structure, cpos and eof come zeroed
+    f->inuse = 1;
+    f->inodeHandle = inodehandle;
+    f->mode = (m == FMODE_W) ? 'w' : 'r';
+    inode_opens[inodehandle] += 1;
+    if(m == FMODE_W) inode_writers[inodehandle] += 1;
 
     // Release the lock, we return the new file handle
     while(LockHandleRelease(lock) != SYNC_SUCCESS);
@@ -113,14 +169,11 @@ uint32 FileOpen(char * filename, char * mode)
 
 int FileClose(uint32 handle) 
 {
-    // Variable declarations
-    // Check that calling process was the process who opened file
-    if(files[handle].mypid != GetCurrentPid()) return FILE_FAIL;
-    // Grab the lock, we are going to alter files structure
+    // Check that the calling process has this handle open
+    if(getOpenFile(handle) == NULL) return FILE_FAIL;
+    // Grab the lock, we are going to alter the open file table
     while(LockHandleAcquire(lock) != SYNC_SUCCESS);
-    // Delete the file descriptor
-    CleanFileDescriptor(handle);
-    openFiles -= 1;
+    CloseDescriptor(currentPCB, handle);
     // Release the lock, we return FILE_SUCCESS if nothing fails
     while(LockHandleRelease(lock) != SYNC_SUCCESS);
     return FILE_SUCCESS;
@@ -130,15 +183,16 @@ int FileRead(uint32 handle, void * mem, int num_bytes)
 {
     // Variable declarations
     int bytes_read=0;
-    // Check that calling process was the process who opened file
-    if(files[handle].mypid != GetCurrentPid()) return FILE_FAIL;
-    // Check that num_bytes > 0 && < FILE_MAX_READWRITE_BYTES
-    if(num_bytes <= 0 || num_bytes > FILE_MAX_READWRITE_BYTES) return FILE_FAIL;
+    file_descriptor *f;
+    // Check that the calling process has this handle open
+    if((f = getOpenFile(handle)) == NULL) return FILE_FAIL;
+    // Any size goes, the trap handler hands us one user page at a time
+    if(num_bytes <= 0) return FILE_FAIL;
     // Perform reading
-    bytes_read = DfsInodeReadBytes(files[handle].inodeHandle, mem, files[handle].cpos, num_bytes);
+    bytes_read = DfsInodeReadBytes(f->inodeHandle, mem, f->cpos, num_bytes);
     if(bytes_read == DFS_FAIL) return FILE_FAIL;
-    files[handle].cpos += bytes_read;
-    if(bytes_read < num_bytes) {  files[handle].eof = 1; return FILE_FAIL;  }
+    f->cpos += bytes_read;
+    if(bytes_read < num_bytes) {  f->eof = 1; return FILE_FAIL;  }
     return bytes_read;
 }
 
@@ -146,58 +200,451 @@ int FileWrite(uint32 handle, void * mem, int num_bytes)
 {
     // Variable declarations
     int bytes_written=0;
-    // Check that calling process was the process who opened file
-    if(files[handle].mypid != GetCurrentPid()) return FILE_FAIL;
-    // Check that num_bytes > 0 && < FILE_MAX_READWRITE_BYTES
-    if(num_bytes <= 0 || num_bytes > FILE_MAX_READWRITE_BYTES) return FILE_FAIL;
-    // Perform reading
-    bytes_written = DfsInodeWriteBytes(files[handle].inodeHandle, mem, files[handle].cpos, num_bytes);
+    file_descriptor *f;
+    // Check that the calling process has this handle open
+    if((f = getOpenFile(handle)) == NULL) return FILE_FAIL;
+    // Readers exclude writers, so a read handle can't write
+    if(f->mode != 'w') return FILE_FAIL;
+    // Any size goes, the trap handler hands us one user page at a time
+    if(num_bytes <= 0) return FILE_FAIL;
+    // Perform writing, which may leave a hole if we seeked past the end
+    bytes_written = DfsInodeWriteBytes(f->inodeHandle, mem, f->cpos, num_bytes);
+    if(bytes_written == DFS_FAIL) return FILE_FAIL;
+    f->cpos += bytes_written;
+    return bytes_written;
+}
+
+// Reads num_bytes at offset without using or moving the cursor.
+// Returns the bytes read, fewer (down to 0) at the end of the file.
+int FilePread(uint32 handle, void * mem, int num_bytes, int offset)
+{
+    // Variable declarations
+    int bytes_read;
+    file_descriptor *f;
+    // Check that the calling process has this handle open
+    if((f = getOpenFile(handle)) == NULL) return FILE_FAIL;
+    if(num_bytes <= 0 || offset < 0) return FILE_FAIL;
+    bytes_read = DfsInodeReadBytes(f->inodeHandle, mem, offset, num_bytes);
+    if(bytes_read == DFS_FAIL) return FILE_FAIL;
+    return bytes_read;
+}
+
+// Writes num_bytes at offset without using or moving the cursor.
+int FilePwrite(uint32 handle, void * mem, int num_bytes, int offset)
+{
+    // Variable declarations
+    int bytes_written;
+    file_descriptor *f;
+    // Check that the calling process has this handle open
+    if((f = getOpenFile(handle)) == NULL) return FILE_FAIL;
+    if(f->mode != 'w' || num_bytes <= 0 || offset < 0) return FILE_FAIL;
+    bytes_written = DfsInodeWriteBytes(f->inodeHandle, mem, offset, num_bytes);
     if(bytes_written == DFS_FAIL) return FILE_FAIL;
     return bytes_written;
 }
 
+// Returns the cursor of an open handle.
+int FileTell(uint32 handle)
+{
+    file_descriptor *f;
+    if((f = getOpenFile(handle)) == NULL) return FILE_FAIL;
+    return f->cpos;
+}
+
 int FileSeek(uint32 handle, int num_bytes, int from_where) 
 {
     // Variable declarations
+    int cpos;
+    file_descriptor *f;
 
-    // Check that calling process was the process who opened file
-    if(files[handle].mypid != GetCurrentPid()) return FILE_FAIL;
+    // Check that the calling process has this handle open
+    if((f = getOpenFile(handle)) == NULL) return FILE_FAIL;
  
     // Determinite what from_where is, and how to approach problem
-    if(from_where == FILE_SEEK_SET) files[handle].cpos = num_bytes;
-    else if(from_where == FILE_SEEK_END) files[handle].cpos = DfsInodeFilesize(files[handle].inodeHandle);
-    else if(from_where == FILE_SEEK_CUR) files[handle].cpos += num_bytes;
+    if(from_where == FILE_SEEK_SET) cpos = num_bytes;
+    else if(from_where == FILE_SEEK_END) cpos = DfsInodeFilesize(f->inodeHandle) + num_bytes;
+    else if(from_where == FILE_SEEK_CUR) cpos = f->cpos + num_bytes;
     else return FILE_FAIL;
 
-    // Check that current position is valid
-    if(files[handle].cpos < 0 || files[handle].cpos > DfsInodeFilesize(files[handle].inodeHandle)) return FILE_FAIL;
-    files[handle].eof = 0;
+    // Seeking past the end is fine (a later write leaves a hole),
+    // but not before the start
+    if(cpos < 0) return FILE_FAIL;
+    f->cpos = cpos;
+    f->eof = 0;
     return FILE_SUCCESS;
 }
 
 int FileDelete(char *filename) 
 {
     // Variable declarations
-    int inodeh, fhndl=-1;
+    int inodeh, result=FILE_FAIL;
 
-    // Check if opened by another proc
+    // Grab the lock, the file must not be open anywhere
+    while(LockHandleAcquire(lock) != SYNC_SUCCESS);
     inodeh = DfsInodeFilenameExists(filename);
-    if(inodeh != DFS_FAIL) 
+    // Directories are removed with FileRmdir
+    if(inodeh != DFS_FAIL && inode_opens[inodeh] == 0 && !DfsInodeIsDir(inodeh))
+    {
+        if(DfsInodeDelete(inodeh) == DFS_SUCCESS) result = 0;
+    }
+    while(LockHandleRelease(lock) != SYNC_SUCCESS);
+    return result;
+}
+
+int FileMkdir(char *path)
+{
+    // Create the directory, the parent must already exist
+    if(DfsInodeMkdir(path) == DFS_FAIL) return FILE_FAIL;
+    return FILE_SUCCESS;
+}
+
+int FileRmdir(char *path)
+{
+    // Remove the directory, which must be empty
+    if(DfsInodeRmdir(path) != DFS_SUCCESS) return FILE_FAIL;
+    return FILE_SUCCESS;
+}
+
+int FileReaddir(char *path, int pos, char *name)
+{
+    // Variable declarations
+    int inodeh;
+
+    // Find the directory, then hand back the entry at/after pos
+    if((inodeh = DfsInodeFilenameExists(path)) == DFS_FAIL) return FILE_FAIL;
+    return DfsInodeReaddir(inodeh, pos, name);
+}
+
+int FilePunchHole(uint32 handle, int start_byte, int num_bytes)
+{
+    file_descriptor *f;
+    // Check that the calling process has this handle open
+    if((f = getOpenFile(handle)) == NULL) return FILE_FAIL;
+    if(f->mode != 'w') return FILE_FAIL;
+    // Free the blocks in the range, the file keeps its size
+    if(DfsInodePunchHole(f->inodeHandle, start_byte, num_bytes) != DFS_SUCCESS) return FILE_FAIL;
+    return FILE_SUCCESS;
+}
+
+int FilePreallocate(uint32 handle, int num_bytes)
+{
+    file_descriptor *f;
+    // Check that the calling process has this handle open
+    if((f = getOpenFile(handle)) == NULL) return FILE_FAIL;
+    if(f->mode != 'w') return FILE_FAIL;
+    // Reserve (contiguous, if possible) blocks up to num_bytes
+    if(DfsInodePreallocate(f->inodeHandle, num_bytes) != DFS_SUCCESS) return FILE_FAIL;
+    return FILE_SUCCESS;
+}
+
+int FileClone(char *src, char *dst)
+{
+    // Variable declarations
+    int inodeh;
+
+    // Only regular files can be cloned, and dst must not exist yet
+    if((inodeh = DfsInodeFilenameExists(src)) == DFS_FAIL) return FILE_FAIL;
+    if(DfsInodeIsDir(inodeh)) return FILE_FAIL;
+    if(DfsInodeClone(inodeh, dst) == DFS_FAIL) return FILE_FAIL;
+    return FILE_SUCCESS;
+}
+
+int FileStoredBytes(uint32 handle)
+{
+    file_descriptor *f;
+    // Check that the calling process has this handle open
+    if((f = getOpenFile(handle)) == NULL) return FILE_FAIL;
+    // Disk bytes behind the file's data (compressed/sparse files use less)
+    return DfsInodeStoredBytes(f->inodeHandle);
+}
+
+// Returns the mapped region of pcb that covers virtual page vpage,
+// or NULL.
+static mmap_region *getRegion(PCB *pcb, int vpage)
+{
+    int i;
+    for(i=0; i<PROCESS_MAX_MMAPS; i++)
     {
-        fhndl = getFileHandle(inodeh);
-        if((fhndl != FILE_FAIL) && (GetCurrentPid() != files[fhndl].mypid)) return FILE_FAIL;
+        mmap_region *r = &pcb->mmaps[i];
+        if(r->inuse && vpage >= r->vpage && vpage < r->vpage + r->npages) return r;
     }
-    else return FILE_FAIL; // does not exist!
+    return NULL;
+}
 
-    if(DfsInodeDelete(inodeh) != DFS_SUCCESS) return FILE_FAIL;
-    if(fhndl != -1) 
+// Writes back the region's dirty pages, frees its frames and drops
+// the pin on its file. Caller holds the lock.
+static void UnmapRegion(PCB *pcb, mmap_region *r)
+{
+    int i, start;
+    uint32 *pte;
+
+    for(i=0; i<r->npages; i++)
+    {
+        pte = MemoryGetPte(pcb, r->vpage + i, 0);
+        if(pte == NULL || !(*pte & MEMORY_PTE_VALID)) continue; // never touched
+        if(r->writable && (*pte & MEMORY_PTE_DIRTY))
+        {
+            start = i * MEMORY_PAGE_SIZE;
+            if(DfsInodeWriteBytes(r->inodeHandle, (char *)MemoryPteToPage(*pte), r->offset + start,
+                                  min(MEMORY_PAGE_SIZE, r->length - start)) == DFS_FAIL)
+                printf(" ERR: lost a dirty page of a mapped file (inode %d)\n", r->inodeHandle);
+        }
+        MemoryFreePte(*pte);
+        *pte = 0;
+    }
+    inode_opens[r->inodeHandle] -= 1;
+    if(r->writable) inode_writers[r->inodeHandle] -= 1;
+    r->inuse = 0;
+}
+
+// Maps length bytes of the file from offset into the caller's address
+// space and returns the address they start at. Nothing is read yet,
+// the page table entries stay invalid and each page is filled from
+// the buffer cache when it's first touched (FileMmapFault). Pages of
+// a handle opened for writing go back to the file when they're dirty
+// at unmap or exit time; others are private, as the page table has
+// no read-only bit to stop stores to them.
+uint32 FileMmap(uint32 handle, int offset, int length)
+{
+    // Variable declarations
+    int i, vpage, npages, filesize;
+    uint32 *pte;
+    mmap_region *r = NULL;
+    file_descriptor *f;
+
+    // Check that the calling process has this handle open
+    if((f = getOpenFile(handle)) == NULL) return FILE_FAIL;
+    if(offset < 0 || length <= 0) return FILE_FAIL;
+    // A read-only mapping can't reach past the end of the file
+    if(f->mode != 'w')
+    {
+        filesize = DfsInodeFilesize(f->inodeHandle);
+        if(offset >= filesize) return FILE_FAIL;
+        length = min(length, filesize - offset);
+    }
+    npages = (length + MEMORY_PAGE_SIZE - 1) / MEMORY_PAGE_SIZE;
+
+    // Grab the lock, the mapping pins the file like an open does
+    while(LockHandleAcquire(lock) != SYNC_SUCCESS);
+    for(i=0; i<PROCESS_MAX_MMAPS; i++) if(!currentPCB->mmaps[i].inuse) {  r = &currentPCB->mmaps[i]; break;  }
+    // First fit over the pages the program doesn't use
+    for(vpage=currentPCB->npages; r != NULL && vpage + npages <= PROCESS_MAX_PAGES; vpage++)
+    {
+        for(i=0; i<npages; i++)
+        {
+            pte = MemoryGetPte(currentPCB, vpage + i, 0);
+            if((pte != NULL && *pte != 0) || getRegion(currentPCB, vpage + i) != NULL) break;
+        }
+        if(i == npages) break;
+    }
+    if(r == NULL || vpage + npages > PROCESS_MAX_PAGES)
+    {
+        printf(" ERR: no room to map %d bytes...\n", length);
+        while(LockHandleRelease(lock) != SYNC_SUCCESS);
+        return FILE_FAIL;
+    }
+    r->inuse = 1;
+    r->vpage = vpage;
+    r->npages = npages;
+    r->inodeHandle = f->inodeHandle;
+    r->offset = offset;
+    r->length = length;
+    r->writable = (f->mode == 'w');
+    inode_opens[r->inodeHandle] += 1;
+    if(r->writable) inode_writers[r->inodeHandle] += 1;
+    while(LockHandleRelease(lock) != SYNC_SUCCESS);
+    return vpage * MEMORY_PAGE_SIZE;
+}
+
+// Unmaps the region FileMmap returned addr for.
+int FileMunmap(uint32 addr)
+{
+    mmap_region *r;
+    if(addr % MEMORY_PAGE_SIZE != 0) return FILE_FAIL;
+    if((r = getRegion(currentPCB, addr / MEMORY_PAGE_SIZE)) == NULL || r->vpage * MEMORY_PAGE_SIZE != addr) return FILE_FAIL;
+    while(LockHandleAcquire(lock) != SYNC_SUCCESS);
+    UnmapRegion(currentPCB, r);
+    while(LockHandleRelease(lock) != SYNC_SUCCESS);
+    return FILE_SUCCESS;
+}
+
+// Unmaps everything a dying process left mapped.
+void FileUnmapAll(PCB *pcb)
+{
+    int i;
+    while(LockHandleAcquire(lock) != SYNC_SUCCESS);
+    for(i=0; i<PROCESS_MAX_MMAPS; i++) if(pcb->mmaps[i].inuse) UnmapRegion(pcb, &pcb->mmaps[i]);
+    while(LockHandleRelease(lock) != SYNC_SUCCESS);
+}
+
+// Fills virtual page vpage of pcb from its mapped file. The bytes
+// come out of the buffer cache, the rest of the page is zeroed.
+int FileMmapFault(PCB *pcb, int vpage)
+{
+    // Variable declarations
+    int page, start, n;
+    char *frame;
+    uint32 *pte;
+    mmap_region *r;
+
+    if((r = getRegion(pcb, vpage)) == NULL) return FILE_FAIL;
+    if((pte = MemoryGetPte(pcb, vpage, 1)) == NULL) {  printf(" ERR: no room for a page table...\n"); return FILE_FAIL;  }
+    if((page = MemoryAllocPage()) == 0) {  printf(" ERR: no free page for a mapped file...\n"); return FILE_FAIL;  }
+    frame = (char *)(page * MEMORY_PAGE_SIZE);
+    start = (vpage - r->vpage) * MEMORY_PAGE_SIZE;
+    n = DfsInodeReadBytes(r->inodeHandle, frame, r->offset + start, min(MEMORY_PAGE_SIZE, r->length - start));
+    if(n == DFS_FAIL) {  MemoryFreePage(page); return FILE_FAIL;  }
+    bzero(frame + n, MEMORY_PAGE_SIZE - n);
+    *pte = MemorySetupPte(page);
+    return FILE_SUCCESS;
+}
+
+// Carries out one asynchronous request a page of the buffer at a
+// time, then wakes the submitter. Each page is moved holding the lock
+// with interrupts off, so it can't interleave with a trap handler's
+// use of the file system, but the timer can switch away between pages.
+// If the submitter dies part way through, the rest is dropped.
+static void AioPerform(file_aio_request *r)
+{
+    // Variable declarations
+    int n, intrs, seq = r->seq, ret = 0, done = 0;
+    char *mem;
+
+    while(done < r->len)
     {
-        // Grab the lock, we are going to alter files structure
         while(LockHandleAcquire(lock) != SYNC_SUCCESS);
-        // Delete the file descriptor
-        CleanFileDescriptor(fhndl);
-        // Release the lock, we return 0 if nothing fails
+        intrs = DisableIntrs();
+        if(!r->inuse || r->seq != seq)
+        {
+            RestoreIntrs(intrs);
+            while(LockHandleRelease(lock) != SYNC_SUCCESS);
+            return;
+        }
+        n = min(r->len - done, MEMORY_PAGE_SIZE - ((uint32)(r->buf + done) % MEMORY_PAGE_SIZE));
+        if(r->pcb == NULL) mem = r->buf + done;
+        else if(r->op == FILE_AIO_WRITE) mem = (char *)MemoryTranslateUserToSystem(r->pcb, (uint32)(r->buf + done));
+        else mem = (char *)MemoryTranslateUserForWrite(r->pcb, (uint32)(r->buf + done));
+        if(mem == NULL) ret = DFS_FAIL;
+        else if(r->op == FILE_AIO_WRITE) ret = DfsInodeWriteBytes(r->inodeHandle, mem, r->offset + done, n);
+        else ret = DfsInodeReadBytes(r->inodeHandle, mem, r->offset + done, n);
+        RestoreIntrs(intrs);
         while(LockHandleRelease(lock) != SYNC_SUCCESS);
+        if(ret == DFS_FAIL) break;
+        done += ret;
+        if(ret < n) break; // end of file
     }
-    return 0;
+    while(LockHandleAcquire(lock) != SYNC_SUCCESS);
+    if(r->inuse && r->seq == seq)
+    {
+        r->status = (ret == DFS_FAIL && done == 0) ? FILE_FAIL : done;
+        inode_opens[r->inodeHandle] -= 1;
+        SemHandleSignal(r->sem);
+    }
+    while(LockHandleRelease(lock) != SYNC_SUCCESS);
+}
+
+// Body of the "aio" system process. It serves the oldest pending
+// request until there are none left, then exits; FileAioSubmit starts
+// a new one when needed.
+static void AioWorker()
+{
+    // Variable declarations
+    int i;
+    file_aio_request *next;
+
+    while(1)
+    {
+        while(LockHandleAcquire(lock) != SYNC_SUCCESS);
+        next = NULL;
+        for(i=0; i<FILE_AIO_MAX_REQUESTS; i++)
+        {
+            if(aioreqs[i].inuse && aioreqs[i].status == FILE_AIO_PENDING
+               && (next == NULL || aioreqs[i].seq - next->seq < 0)) next = &aioreqs[i];
+        }
+        if(next == NULL) aio_worker_running = 0;
+        while(LockHandleRelease(lock) != SYNC_SUCCESS);
+        if(next == NULL) return;
+        AioPerform(next);
+    }
+}
+
+// Queues len bytes of I/O between buf and the file at offset, and
+// returns a request id for FileAioStatus straight away. sem is
+// signalled when the request completes.
+int FileAioSubmit(uint32 handle, int op, char *buf, int len, int offset, sem_t sem, int sysMode)
+{
+    // Variable declarations
+    int i;
+    file_descriptor *f;
+    file_aio_request *r;
+
+    // Check that the calling process has this handle open
+    if((f = getOpenFile(handle)) == NULL) return FILE_FAIL;
+    if((op != FILE_AIO_READ && op != FILE_AIO_WRITE) || len <= 0 || offset < 0) return FILE_FAIL;
+    if(op == FILE_AIO_WRITE && f->mode != 'w') return FILE_FAIL;
+    while(LockHandleAcquire(lock) != SYNC_SUCCESS);
+    for(i=0; i<FILE_AIO_MAX_REQUESTS; i++) if(!aioreqs[i].inuse) break;
+    if(i == FILE_AIO_MAX_REQUESTS)
+    {
+        while(LockHandleRelease(lock) != SYNC_SUCCESS);
+        printf(" ERR: too many asynchronous requests...\n");
+        return FILE_FAIL;
+    }
+    r = &aioreqs[i];
+    r->inuse = 1;
+    r->pcb = sysMode ? NULL : currentPCB;
+    r->inodeHandle = f->inodeHandle;
+    r->op = op;
+    r->buf = buf;
+    r->len = len;
+    r->offset = offset;
+    r->sem = sem;
+    r->seq = aio_seq++;
+    r->status = FILE_AIO_PENDING;
+    // Like an open, a queued request keeps the file from being deleted
+    inode_opens[r->inodeHandle] += 1;
+    if(!aio_worker_running)
+    {
+        aio_worker_running = 1;
+        if(ProcessFork(AioWorker, 0, "aio", 0) < 0)
+        {
+            aio_worker_running = 0;
+            inode_opens[r->inodeHandle] -= 1;
+            r->inuse = 0;
+            while(LockHandleRelease(lock) != SYNC_SUCCESS);
+            printf(" ERR: could not start the aio process...\n");
+            return FILE_FAIL;
+        }
+    }
+    while(LockHandleRelease(lock) != SYNC_SUCCESS);
+    return i;
+}
+
+// Returns FILE_AIO_PENDING while request id is queued, then its result
+// (as for FilePread/FilePwrite), which also frees the id.
+int FileAioStatus(int id)
+{
+    int status = FILE_FAIL;
+    if(id < 0 || id >= FILE_AIO_MAX_REQUESTS) return FILE_FAIL;
+    while(LockHandleAcquire(lock) != SYNC_SUCCESS);
+    if(aioreqs[id].inuse && (aioreqs[id].pcb == NULL || aioreqs[id].pcb == currentPCB))
+    {
+        if((status = aioreqs[id].status) != FILE_AIO_PENDING) aioreqs[id].inuse = 0;
+    }
+    while(LockHandleRelease(lock) != SYNC_SUCCESS);
+    return status;
+}
+
+// Drops every request a dying process left behind, run or not.
+void FileAioCancelAll(PCB *pcb)
+{
+    int i;
+    while(LockHandleAcquire(lock) != SYNC_SUCCESS);
+    for(i=0; i<FILE_AIO_MAX_REQUESTS; i++)
+    {
+        if(!aioreqs[i].inuse || aioreqs[i].pcb != pcb) continue;
+        if(aioreqs[i].status == FILE_AIO_PENDING) inode_opens[aioreqs[i].inodeHandle] -= 1;
+        aioreqs[i].inuse = 0;
+    }
+    while(LockHandleRelease(lock) != SYNC_SUCCESS);
 }
@@ -183,6 +183,23 @@ FsSeek (int fd, int offset, int whence)
   return (fs[openfiles[fd].fs].Seek (fd, offset, whence));
 }
 
+//----------------------------------------------------------------------
+//
+//	FsTruncate
+//
+//	Set the length of a file to nunits*unitsize bytes.  A file grown
+//	this way reads back as zeros.
+//
+//----------------------------------------------------------------------
+int
+FsTruncate (int fd, int nunits, int unitsize)
+{
+  if (!FdValid (fd)) {
+    return (-1);
+  }
+  return (fs[openfiles[fd].fs].Truncate (fd, nunits, unitsize));
+}
+
 
 //----------------------------------------------------------------------
 //
@@ -211,6 +228,7 @@ FsDelete (const char *name)
 //	FsUnixRead
 //	FsUnixWrite
 //	FsUnixSeek
+//	FsUnixTruncate
 //	FsUnixClose
 //
 //	Unix file I/O routines.  These are pretty simple, and just call
@@ -247,6 +265,14 @@ FsUnixSeek (int x, int offset, int where)
   return (lseek (openfiles[x].u.Unix.fd, offset, where));
 }
 
+int
+FsUnixTruncate (int x, int nunits, int unitsize)
+{
+  // The simulator extends the host file sparsely, so this takes
+  // the same time however big the file gets.
+  return (ftruncate (openfiles[x].u.Unix.fd, nunits, unitsize));
+}
+
 int
 FsUnixClose (int x)
 {
@@ -341,6 +367,19 @@ FsDlxSeek (int f, int offset, int whence)
   return (openfiles[f].u.Dlx.curpos);
 }
 
+//----------------------------------------------------------------------
+//
+//	FsDlxTruncate
+//
+//	Set the length of a DLX file system file.  Not supported.
+//
+//----------------------------------------------------------------------
+int
+FsDlxTruncate (int f, int nunits, int unitsize)
+{
+  return (-1);
+}
+
 //----------------------------------------------------------------------
 //
 //	FsDlxClose
@@ -391,6 +430,7 @@ FsModuleInit ()
   fs[0].Read = FsUnixRead;
   fs[0].Write = FsUnixWrite;
   fs[0].Seek = FsUnixSeek;
+  fs[0].Truncate = FsUnixTruncate;
   fs[0].Delete = FsUnixDelete;
 
   fs[1].Open = FsDlxOpen;
@@ -398,5 +438,6 @@ FsModuleInit ()
   fs[1].Read = FsDlxRead;
   fs[1].Write = FsDlxWrite;
   fs[1].Seek = FsDlxSeek;
+  fs[1].Truncate = FsDlxTruncate;
   fs[1].Delete = FsDlxDelete;
 }
@@ -0,0 +1,98 @@
+#include "lz.h"
+
+// LzCompress =============================================
+// Compresses srclen bytes (srclen <= 4096) from src into 
+// dst. Matches are found through a table holding the last 
+// position each 3-byte prefix hash was seen at, which is 
+// fast and good enough for text. Returns the compressed 
+// length, or LZ_FAIL if it doesn't fit in dstmax bytes.
+// ========================================================
+int LzCompress(char *src, int srclen, char *dst, int dstmax)
+{
+    // Initialize variables and parameters
+    short head[LZ_HASH_SIZE];
+    unsigned char *s = (unsigned char *)src;
+    int i=0, j=0, out=0, flagpos=0, nitems=8;
+    int h=0, cand=0, len=0, maxlen=0, off=0;
+
+    for(j=0; j<LZ_HASH_SIZE; j++) head[j] = -1;
+    while(i < srclen)
+    {
+        // Start a new group with its flag byte
+        if(nitems == 8)
+        {
+            if(out >= dstmax) return LZ_FAIL;
+            flagpos = out++;
+            dst[flagpos] = 0;
+            nitems = 0;
+        }
+
+        // Longest match at the last place this prefix was seen
+        len = 0;
+        if(i + LZ_MIN_MATCH <= srclen)
+        {
+            h = LZ_HASH(s, i);
+            cand = head[h];
+            head[h] = i;
+            if(cand >= 0 && i - cand <= LZ_MAX_OFFSET)
+            {
+                maxlen = srclen - i;
+                if(maxlen > LZ_MAX_MATCH) maxlen = LZ_MAX_MATCH;
+                while(len < maxlen && s[cand+len] == s[i+len]) len++;
+            }
+        }
+
+        if(len >= LZ_MIN_MATCH)
+        {
+            if(out + 2 > dstmax) return LZ_FAIL;
+            off = i - cand;
+            dst[flagpos] |= (1 << nitems);
+            dst[out++] = (off >> 4) & 0xFF;
+            dst[out++] = ((off & 0xF) << 4) | (len - LZ_MIN_MATCH);
+            for(j=i+1; j<i+len && j+LZ_MIN_MATCH<=srclen; j++) head[LZ_HASH(s, j)] = j;
+            i += len;
+        }
+        else
+        {
+            if(out >= dstmax) return LZ_FAIL;
+            dst[out++] = src[i++];
+        }
+        nitems++;
+    }
+    return out;
+}
+
+// LzDecompress ===========================================
+// Expands srclen bytes of LzCompress output from src into
+// dst. Returns the number of bytes produced, or LZ_FAIL 
+// if the input is corrupt or overflows dstmax bytes.
+// ========================================================
+int LzDecompress(char *src, int srclen, char *dst, int dstmax)
+{
+    // Initialize variables and parameters
+    unsigned char *s = (unsigned char *)src;
+    int in=0, out=0, k=0, flags=0, off=0, len=0;
+
+    while(in < srclen)
+    {
+        flags = s[in++];
+        for(k=0; k<8 && in<srclen; k++)
+        {
+            if(flags & (1 << k))
+            {
+                if(in + 2 > srclen) return LZ_FAIL;
+                off = (s[in] << 4) | (s[in+1] >> 4);
+                len = (s[in+1] & 0xF) + LZ_MIN_MATCH;
+                in += 2;
+                if(off == 0 || off > out || out + len > dstmax) return LZ_FAIL;
+                while(len-- > 0) {  dst[out] = dst[out-off]; out++;  }
+            }
+            else
+            {
+                if(out >= dstmax) return LZ_FAIL;
+                dst[out++] = src[in++];
+            }
+        }
+    }
+    return out;
+}
@@ -10,12 +10,26 @@
 #include "memory.h"
 #include "process.h"
 #include "queue.h"
+#include "files.h"
+#include "dfs.h"
+
+// What page replacement knows about a frame: the user page held in
+// it, and the swap slot that still has a copy of that page, if any.
+typedef struct MemoryFrame {
+  PCB		*pcb;		// NULL if the frame can't be paged out
+  int		vpage;
+  int		slot;		// -1 if none
+} MemoryFrame;
 
 static uint32	pagestart;
 static int	freemapmax;
 static int	nfreepages;
 static uint32	freepages[MEMORY_MAX_PAGES/32];
 static uint32	negativeone = 0xffffffff;
+static uint32	*l2freelist = NULL;	// Unused L2 tables, linked by 1st word
+static int	framemax;
+static MemoryFrame frames[MEMORY_MAX_FRAMES];
+static uint32	swapmap[MEMORY_MAX_SWAP_SLOTS/32];
 
 //----------------------------------------------------------------------
 //
@@ -96,14 +110,154 @@ MemoryModuleInit ()
     nfreepages += 1;
     MemorySetFreemap (curpage, 1);
   }
+  framemax = (maxpage < MEMORY_MAX_FRAMES) ? maxpage : MEMORY_MAX_FRAMES;
+  for (i = 0; i < framemax; i++) {
+    frames[i].pcb = NULL;
+    frames[i].slot = -1;
+  }
+  bzero ((char *)swapmap, sizeof (swapmap));
   dbprintf ('m', "Initialized %d free pages.\n", nfreepages);
 }
 
+//----------------------------------------------------------------------
+//
+//	MemorySwapSlotAlloc, MemorySwapSlotFree
+//
+//	Allocate and free page-sized slots of the swap area.  Alloc
+//	returns -1 if there's no swap area or it's full.
+//
+//----------------------------------------------------------------------
+static
+int
+MemorySwapSlotAlloc ()
+{
+  int		nslots = DfsSwapBytes () / MEMORY_PAGE_SIZE;
+  int		slot;
+
+  if (nslots > MEMORY_MAX_SWAP_SLOTS) {
+    nslots = MEMORY_MAX_SWAP_SLOTS;
+  }
+  for (slot = 0; slot < nslots; slot++) {
+    if (!(swapmap[slot / 32] & (1 << (slot % 32)))) {
+      swapmap[slot / 32] |= (1 << (slot % 32));
+      return (slot);
+    }
+  }
+  return (-1);
+}
+
+static
+void
+MemorySwapSlotFree (int slot)
+{
+  int		intrs = DisableIntrs ();
+
+  swapmap[slot / 32] &= invert(1 << (slot % 32));
+  RestoreIntrs (intrs);
+}
+
+//----------------------------------------------------------------------
+//
+//	MemorySetPageOwner
+//
+//	Make the frame page, mapped at virtual page vpage of pcb,
+//	one that page replacement may take.  Frames that are never
+//	given an owner (system stacks, L2 tables) stay put.
+//
+//----------------------------------------------------------------------
+void
+MemorySetPageOwner (uint32 page, PCB *pcb, int vpage)
+{
+  if (page < framemax) {
+    frames[page].pcb = pcb;
+    frames[page].vpage = vpage;
+  }
+}
+
+//----------------------------------------------------------------------
+//
+//	MemoryEvictPage
+//
+//	Page out one page, picked with the clock (second chance)
+//	algorithm: the hand passes over frames whose referenced bit
+//	is set, clearing it, and stops at the first one it finds
+//	clear.  The page is only written to swap if it's dirty or has
+//	no copy there yet; either way its PTE is left pointing at the
+//	slot and the frame is freed.  Returns MEM_FAIL if no page could
+//	be put out.  Called with interrupts off.
+//
+//----------------------------------------------------------------------
+static
+int
+MemoryEvictPage ()
+{
+  static int	hand = 0;
+  int		i, frame;
+  uint32	*pte;
+  MemoryFrame	*f;
+
+  // Two passes, since the first may only clear referenced bits
+  for (i = 0; i < 2 * framemax; i++) {
+    frame = hand;
+    hand = (hand + 1) % framemax;
+    f = &frames[frame];
+    if (f->pcb == NULL) {
+      continue;
+    }
+    pte = MemoryGetPte (f->pcb, f->vpage, 0);
+    if (*pte & MEMORY_PTE_REFERENCED) {
+      *pte &= invert(MEMORY_PTE_REFERENCED);
+      continue;
+    }
+    if ((f->slot < 0) || (*pte & MEMORY_PTE_DIRTY)) {
+      if ((f->slot < 0) && ((f->slot = MemorySwapSlotAlloc ()) < 0)) {
+        // Swap is full, only clean pages can go
+        continue;
+      }
+      if (DfsSwapWrite (f->slot * MEMORY_PAGE_SIZE,
+			(char *)(frame * MEMORY_PAGE_SIZE),
+			MEMORY_PAGE_SIZE) != DFS_SUCCESS) {
+        return (MEM_FAIL);
+      }
+    }
+    dbprintf ('m', "Paged out page %d of PID %d to slot %d.\n", f->vpage,
+	      GetPidFromAddress (f->pcb), f->slot);
+    // The slot now belongs to the PTE
+    *pte = (f->slot << MEMORY_L2_PAGE_SIZE_BITS) | MEMORY_PTE_SWAPPED;
+    f->slot = -1;
+    MemoryFreePage (frame);
+    return (MEM_SUCCESS);
+  }
+  return (MEM_FAIL);
+}
+
+//----------------------------------------------------------------------
+//
+//	MemoryPageout
+//
+//	Background page replacement, run from the timer interrupt at
+//	every process quantum.  When free frames run low, pages are put
+//	out until there are enough again, so that most allocations
+//	don't have to wait on the disk.
+//
+//----------------------------------------------------------------------
+void
+MemoryPageout ()
+{
+  if (nfreepages >= MEMORY_PAGEOUT_LOW) {
+    return;
+  }
+  while ((nfreepages < MEMORY_PAGEOUT_HIGH) &&
+	 (MemoryEvictPage () == MEM_SUCCESS)) {
+  }
+}
+
 //----------------------------------------------------------------------
 //
 //	MemoryAllocPage
 //
-//	Allocate a page of memory.
+//	Allocate a page of memory.  If none are free, a page is put
+//	out to swap to make room.
 //
 //----------------------------------------------------------------------
 inline
@@ -113,8 +267,10 @@ MemoryAllocPage ()
   static int	mapnum = 0;
   int		bitnum;
   uint32	v;
+  int		intrs = DisableIntrs ();
 
-  if (nfreepages == 0) {
+  if ((nfreepages == 0) && (MemoryEvictPage () != MEM_SUCCESS)) {
+    RestoreIntrs (intrs);
     return (0);
   }
   dbprintf ('m', "Allocating memory, starting with page %d\n", mapnum);
@@ -132,6 +288,7 @@ MemoryAllocPage ()
   dbprintf ('m', "Allocated memory, from map %d, page %d, map=0x%x.\n",
 	    mapnum, v, freepages[mapnum]);
   nfreepages -= 1;
+  RestoreIntrs (intrs);
   return (v);
 }
 
@@ -145,19 +302,71 @@ MemoryAllocPage ()
 void
 MemoryFreePage(uint32 page)
 {
+  int		intrs = DisableIntrs ();
+
+  if (page < framemax) {
+    frames[page].pcb = NULL;
+    if (frames[page].slot >= 0) {
+      MemorySwapSlotFree (frames[page].slot);
+      frames[page].slot = -1;
+    }
+  }
   MemorySetFreemap (page, 1);
   nfreepages += 1;
+  RestoreIntrs (intrs);
   dbprintf ('m',"Freed page 0x%x, %d remaining.\n", page, nfreepages);
 }
 
+//----------------------------------------------------------------------
+//
+// MemoryFaultIn
+//
+//	Make virtual page page of pcb valid.  A page that was paged out
+//	is read back from its swap slot, which keeps the copy in case
+//	the page is put out again before it's written.  Any other
+//	invalid page must belong to a mapped file.
+//
+//----------------------------------------------------------------------
+static
+int
+MemoryFaultIn (PCB *pcb, int page)
+{
+  uint32	*pte = MemoryGetPte (pcb, page, 0);
+  int		slot, newPage;
+
+  if ((pte == NULL) || !(*pte & MEMORY_PTE_SWAPPED)) {
+    return ((FileMmapFault (pcb, page) == FILE_SUCCESS) ? MEM_SUCCESS : MEM_FAIL);
+  }
+  slot = *pte >> MEMORY_L2_PAGE_SIZE_BITS;
+  if ((newPage = MemoryAllocPage ()) == 0) {
+    return (MEM_FAIL);
+  }
+  if (DfsSwapRead (slot * MEMORY_PAGE_SIZE, (char *)(newPage * MEMORY_PAGE_SIZE),
+		   MEMORY_PAGE_SIZE) != DFS_SUCCESS) {
+    MemoryFreePage (newPage);
+    return (MEM_FAIL);
+  }
+  dbprintf ('m', "Paged in page %d of PID %d from slot %d.\n", page,
+	    GetPidFromAddress (pcb), slot);
+  *pte = MemorySetupPte (newPage) | MEMORY_PTE_REFERENCED;
+  MemorySetPageOwner (newPage, pcb, page);
+  if (newPage < framemax) {
+    frames[newPage].slot = slot;
+  } else {
+    MemorySwapSlotFree (slot);
+  }
+  return (MEM_SUCCESS);
+}
+
 //----------------------------------------------------------------------
 //
 // MemoryTranslateUserToSystem
 //
 //	Translate a user address (in the process referenced by pcb)
-//	into an OS (physical) address.  This works for simple one-level
-//	page tables, but will have to be modified for two-level page
-//	tables.
+//	into an OS (physical) address.  A page that was paged out, or
+//	a page of a mapped file that hasn't been touched yet, is read
+//	in first, just as if the user had faulted on it.  The access
+//	counts as a reference for page replacement.
 //
 //----------------------------------------------------------------------
 uint32
@@ -165,13 +374,66 @@ MemoryTranslateUserToSystem (PCB *pcb, uint32 addr)
 {
     int	page = addr / MEMORY_PAGE_SIZE;
     int offset = addr % MEMORY_PAGE_SIZE;
+    uint32 *pte = MemoryGetPte (pcb, page, 0);
 
-    if (page > pcb->npages) {
+    if (page >= PROCESS_MAX_PAGES) {
       return (0);
     }
-    return ((pcb->pagetable[page] & MEMORY_PTE_MASK) + offset);
+    if ((pte == NULL) || !(*pte & MEMORY_PTE_VALID)) {
+      if (MemoryFaultIn (pcb, page) != MEM_SUCCESS) {
+        return (0);
+      }
+      pte = MemoryGetPte (pcb, page, 0);
+    }
+    *pte |= MEMORY_PTE_REFERENCED;
+    return ((*pte & MEMORY_PTE_MASK) + offset);
 }
-
+
+//----------------------------------------------------------------------
+//
+// MemoryTranslateUserForWrite
+//
+//	Same as MemoryTranslateUserToSystem, for an address the OS is
+//	about to store into.  The simulator only sets the dirty bit on
+//	user stores, so it's set here instead.
+//
+//----------------------------------------------------------------------
+uint32
+MemoryTranslateUserForWrite (PCB *pcb, uint32 addr)
+{
+  uint32	sysaddr = MemoryTranslateUserToSystem (pcb, addr);
+
+  if (sysaddr != 0) {
+    *MemoryGetPte (pcb, addr / MEMORY_PAGE_SIZE, 0) |= MEMORY_PTE_DIRTY;
+  }
+  return (sysaddr);
+}
+
+//----------------------------------------------------------------------
+//
+// MemoryPageFaultHandler
+//
+//	Handle a page fault by the current user process.  The only
+//	invalid pages a process may touch are ones that were paged out,
+//	which come back from swap, and those of its mapped files, which
+//	are read in from the file on first use.  Returns MEM_FAIL for any
+//	other address, and the caller kills the process.
+//
+//----------------------------------------------------------------------
+int
+MemoryPageFaultHandler (PCB *pcb)
+{
+  uint32	addr = pcb->currentSavedFrame[PROCESS_STACK_FAULT];
+  int		page = addr / MEMORY_PAGE_SIZE;
+
+  dbprintf ('m', "Page fault at 0x%x (page %d) in PID %d.\n", addr, page,
+	    GetPidFromAddress (pcb));
+  if ((page >= PROCESS_MAX_PAGES) || (MemoryFaultIn (pcb, page) != MEM_SUCCESS)) {
+    return (MEM_FAIL);
+  }
+  return (MEM_SUCCESS);
+}
+
 //----------------------------------------------------------------------
 //
 //	moveBetweenSpaces
@@ -203,7 +465,11 @@ moveBetweenSpaces (PCB *pcb, unsigned char *s, unsigned char *u,
   while (n > 0) {
     // Translate current user page to system address.  If this fails, return
     // the number of bytes copied so far.
-    curUser = (unsigned char *)MemoryTranslateUserToSystem (pcb, (uint32)u);
+    if (dir >= 0) {
+      curUser = (unsigned char *)MemoryTranslateUserForWrite (pcb, (uint32)u);
+    } else {
+      curUser = (unsigned char *)MemoryTranslateUserToSystem (pcb, (uint32)u);
+    }
     if (curUser == (unsigned char *)0) {
       // Leave the loop if translation fails.
       break;
@@ -276,6 +542,82 @@ MemoryFreePte (uint32 pte)
   MemoryFreePage ((pte & MEMORY_PTE_MASK) / MEMORY_PAGE_SIZE);
 }
 
+//----------------------------------------------------------------------
+//
+// MemoryGetPte
+//
+//	Return a pointer to the PTE for virtual page number page of pcb,
+//	or NULL if the page is outside the address space or its L2 table
+//	doesn't exist.  If create is set, a missing L2 table is added,
+//	with all of its PTEs invalid.  L2 tables come from pages taken
+//	from the page allocator, split up into MEMORY_L2_TABLE_SIZE pieces.
+//
+//----------------------------------------------------------------------
+uint32 *
+MemoryGetPte (PCB *pcb, int page, int create)
+{
+  int		l1 = page / MEMORY_L2_TABLE_ENTRIES;
+  int		newPage, i;
+  uint32	*l2;
+
+  if ((page < 0) || (page >= PROCESS_MAX_PAGES)) {
+    return (NULL);
+  }
+  if (pcb->pagetable[l1] == 0) {
+    if (!create) {
+      return (NULL);
+    }
+    if (l2freelist == NULL) {
+      if ((newPage = MemoryAllocPage ()) == 0) {
+        return (NULL);
+      }
+      for (i = 0; i < MEMORY_PAGE_SIZE; i += MEMORY_L2_TABLE_SIZE) {
+        l2 = (uint32 *)(newPage * MEMORY_PAGE_SIZE + i);
+        *l2 = (uint32)l2freelist;
+        l2freelist = l2;
+      }
+      dbprintf ('m', "Split page %d into L2 tables.\n", newPage);
+    }
+    l2 = l2freelist;
+    l2freelist = (uint32 *)(*l2);
+    bzero ((char *)l2, MEMORY_L2_TABLE_SIZE);
+    pcb->pagetable[l1] = (uint32)l2;
+  }
+  return ((uint32 *)(pcb->pagetable[l1]) + (page % MEMORY_L2_TABLE_ENTRIES));
+}
+
+//----------------------------------------------------------------------
+//
+// MemoryFreePageTables
+//
+//	Free every page mapped by pcb, and the swap slots of its pages
+//	that are paged out, and put its L2 tables back on the list of
+//	unused ones.
+//
+//----------------------------------------------------------------------
+void
+MemoryFreePageTables (PCB *pcb)
+{
+  int		i, j;
+  uint32	*l2;
+
+  for (i = 0; i < PROCESS_L1_ENTRIES; i++) {
+    if ((l2 = (uint32 *)(pcb->pagetable[i])) == NULL) {
+      continue;
+    }
+    for (j = 0; j < MEMORY_L2_TABLE_ENTRIES; j++) {
+      if (l2[j] & MEMORY_PTE_VALID) {
+        MemoryFreePte (l2[j]);
+      } else if (l2[j] & MEMORY_PTE_SWAPPED) {
+        MemorySwapSlotFree (l2[j] >> MEMORY_L2_PAGE_SIZE_BITS);
+      }
+    }
+    *l2 = (uint32)l2freelist;
+    l2freelist = l2;
+    pcb->pagetable[i] = 0;
+  }
+}
+
 //----------------------------------------------------------------------
 //
 //	MemoryPteToPage
@@ -4,13 +4,19 @@
 #include "disk.h"
 #include "dfs.h"
 #include "misc.h"
+#include "files.h"
+
+// Blocks taken to fill the disk in the clone test
+static uint32 fillmap[DFS_FBV_MAX_NUM_WORDS];
 
 void RunOSTests() 
 {
     char writeclass[6] = "ece595";
     char readclass[6];
-    uint32 file_handle;
+    char readname[DFS_DIRENT_NAME_LENGTH];
+    uint32 file_handle, second_handle;
     uint32 i=0;
+    int j=0, held=0, shared=0;
  
     printf("\n\n");
     printf("============================================================\n");
@@ -39,6 +45,16 @@ void RunOSTests()
     for(i=0;i<6;i++) printf("%c",readclass[i]);
     printf("\n");
     
+    printf("  'andrew' is %d bytes, so it should still be inline in its inode\n", DfsInodeFilesize(file_handle));
+    printf("   DfsInodeTranslateVirtualToFilesys(fhandle, 0) = %d (expecting -1)\n", DfsInodeTranslateVirtualToFilesys(file_handle, 0));
+    printf("  Writing past the inline capacity (%d bytes) at byte 200...\n", DFS_INODE_INLINE_MAX);
+    DfsInodeWriteBytes(file_handle, &writeclass, 200, 6);
+    for(i=0;i<6;i++) readclass[i] = 0;
+    DfsInodeReadBytes(file_handle, &readclass, 20, 6);
+    printf("  Read back the original bytes after promotion:  ");
+    for(i=0;i<6;i++) printf("%c",readclass[i]);
+    printf("\n");
+
     printf("  Attempting to delete the file 'andrew'... DfsInodeDelete()\n");
     DfsInodeDelete(file_handle);
     printf("  Now, having deleted the file 'andrew', check existence...\n");
@@ -49,6 +65,128 @@ void RunOSTests()
     file_handle = DfsInodeOpen("andrew");
     printf("   fsize        =    %d bytes\n",DfsInodeFilesize(file_handle));
 
+    DfsInodeDelete(file_handle);
+
+    printf("============================================================\n");
+    printf("  Now let's test directories... DfsInodeMkdir('/ece595')\n");
+    if(DfsInodeMkdir("/ece595") == DFS_FAIL) printf("   mkdir /ece595 FAILED!\n");
+    if(DfsInodeMkdir("/ece595/lab4") == DFS_FAIL) printf("   mkdir /ece595/lab4 FAILED!\n");
+    file_handle = DfsInodeOpen("/ece595/lab4/andrew");
+    DfsInodeWriteBytes(file_handle, &writeclass, 0, 6);
+    printf("  Resolving '/ece595/lab4/andrew'... (expecting handle %d)\n", file_handle);
+    printf("   fhandle      =    %d\n", DfsInodeFilenameExists("/ece595/lab4/andrew"));
+    printf("  Resolving 'ece595/./lab4/../lab4/andrew'... (expecting handle %d)\n", file_handle);
+    printf("   fhandle      =    %d\n", DfsInodeFilenameExists("ece595/./lab4/../lab4/andrew"));
+    printf("  Removing non-empty '/ece595/lab4'... (expecting failure)\n");
+    if(DfsInodeRmdir("/ece595/lab4") == DFS_FAIL) printf("   rmdir refused, good\n");
+    printf("  Listing '/ece595/lab4'...\n");
+    i = 0;
+    while((i = DfsInodeReaddir(DfsInodeFilenameExists("/ece595/lab4"), i, readname)) != DFS_FAIL)
+    {  printf("   entry        =    %s\n", readname);  }
+    DfsInodeDelete(file_handle);
+    DfsInodeRmdir("/ece595/lab4");
+    DfsInodeRmdir("/ece595");
+    if(DfsInodeFilenameExists("/ece595") == DFS_FAIL)
+    {  printf("   directory: /ece595, removed\n");  }
+    else printf("   directory: /ece595, OH NO, STILL EXISTS!\n");
+
+    printf("============================================================\n");
+    printf("  Now let's test sparse files... writing 'ece595' at byte 20*bsize\n");
+    file_handle = DfsInodeOpen("sparse");
+    DfsInodeWriteBytes(file_handle, &writeclass, 20*DfsBlockSize(), 6);
+    printf("   fsize        =    %d bytes (expecting %d)\n", DfsInodeFilesize(file_handle), 20*DfsBlockSize()+6);
+    printf("   vblock 0     =    %d (expecting -1, a hole)\n", DfsInodeTranslateVirtualToFilesys(file_handle, 0));
+    DfsInodeReadBytes(file_handle, &readclass, 5*DfsBlockSize(), 6);
+    printf("  Read from the hole (expecting zeros):  ");
+    for(i=0;i<6;i++) printf("%d",readclass[i]);
+    printf("\n");
+    DfsInodeWriteBytes(file_handle, &writeclass, 3*DfsBlockSize(), 6);
+    printf("  Punching out virtual block 3 after writing to it...\n");
+    DfsInodePunchHole(file_handle, 3*DfsBlockSize(), DfsBlockSize());
+    printf("   vblock 3     =    %d (expecting -1, a hole)\n", DfsInodeTranslateVirtualToFilesys(file_handle, 3));
+    DfsInodeReadBytes(file_handle, &readclass, 20*DfsBlockSize(), 6);
+    printf("  Data past the holes is untouched:  ");
+    for(i=0;i<6;i++) printf("%c",readclass[i]);
+    printf("\n");
+    DfsInodeDelete(file_handle);
+
+    printf("============================================================\n");
+    printf("  Now let's preallocate 16 blocks for a new file 'prealloc'...\n");
+    file_handle = DfsInodeOpen("prealloc");
+    DfsInodePreallocate(file_handle, 16*DfsBlockSize());
+    printf("   fsize        =    %d bytes (expecting 0)\n", DfsInodeFilesize(file_handle));
+    printf("   vblock 0     =    %d\n", DfsInodeTranslateVirtualToFilesys(file_handle, 0));
+    printf("   vblock 15    =    %d (expecting vblock 0 + 15)\n", DfsInodeTranslateVirtualToFilesys(file_handle, 15));
+    DfsInodeWriteBytes(file_handle, &writeclass, 10*DfsBlockSize(), 6);
+    DfsInodeReadBytes(file_handle, &readclass, 3*DfsBlockSize(), 6);
+    printf("  Reserved block 3 is now below EOF, reading it (expecting zeros):  ");
+    for(i=0;i<6;i++) printf("%d",readclass[i]);
+    printf("\n");
+    DfsInodeWriteBytes(file_handle, &writeclass, 19*DfsBlockSize(), 6);
+    DfsInodePreallocate(file_handle, 20*DfsBlockSize());
+    DfsInodeReadBytes(file_handle, &readclass, 17*DfsBlockSize(), 6);
+    printf("  Hole 17 below EOF, filled by a second preallocate (expecting zeros):  ");
+    for(i=0;i<6;i++) printf("%d",readclass[i]);
+    printf("\n");
+    DfsInodeDelete(file_handle);
+
+    printf("============================================================\n");
+    printf("  Now let's clone a 2-block file 'orig' to 'copy'...\n");
+    file_handle = DfsInodeOpen("orig");
+    DfsInodeWriteBytes(file_handle, &writeclass, DfsBlockSize(), 6);
+    i = DfsInodeClone(file_handle, "copy");
+    printf("   vblock 1     =    %d and %d (expecting the same block)\n", 
+           DfsInodeTranslateVirtualToFilesys(file_handle, 1), DfsInodeTranslateVirtualToFilesys(i, 1));
+    DfsInodeWriteBytes(i, "ECE", DfsBlockSize(), 3);
+    printf("   after writing 'ECE' to the copy: %d and %d (expecting different)\n", 
+           DfsInodeTranslateVirtualToFilesys(file_handle, 1), DfsInodeTranslateVirtualToFilesys(i, 1));
+    DfsInodeReadBytes(file_handle, &readclass, DfsBlockSize(), 6);
+    printf("  The original still reads:  ");
+    for(i=0;i<6;i++) printf("%c",readclass[i]);
+    printf("\n");
+    DfsInodeDelete(DfsInodeFilenameExists("copy"));
+    printf("  Saturating the share count of the original's block 1...\n");
+    shared = DfsInodeTranslateVirtualToFilesys(file_handle, 1);
+    for(j=0; j<DFS_REFCOUNT_MAX; j++) DfsBlockShare(shared);
+    i = DfsInodeClone(file_handle, "copy");
+    printf("   vblock 1     =    %d and %d (expecting different, it was copied)\n", 
+           shared, DfsInodeTranslateVirtualToFilesys(i, 1));
+    DfsInodeReadBytes(i, &readclass, DfsBlockSize(), 6);
+    printf("  The copied clone reads:  ");
+    for(i=0;i<6;i++) printf("%c",readclass[i]);
+    printf("\n");
+    DfsInodeDelete(DfsInodeFilenameExists("copy"));
+    printf("  Filling the disk, then cloning again...\n");
+    for(held=0; (j = DfsAllocateBlock()) != DFS_FAIL; held++) fillmap[j>>5] |= (1 << (j & 0x1F));
+    printf("   clone        =    %d (expecting -1, no room for the copy)\n", DfsInodeClone(file_handle, "copy"));
+    printf("   'copy'       =    %d (expecting -1, nothing left behind)\n", DfsInodeFilenameExists("copy"));
+    for(j=0; held>0; j++)
+    {
+        if(fillmap[j>>5] & (1 << (j & 0x1F))) {  DfsFreeBlock(j); held--;  }
+    }
+    for(j=0; j<DFS_REFCOUNT_MAX; j++) DfsFreeBlock(shared);
+    DfsInodeDelete(file_handle);
+
+    printf("============================================================\n");
+    printf("  Now let's open 'shared' for reading twice through FileOpen...\n");
+    file_handle = FileOpen("shared", "w");
+    FileWrite(file_handle, &writeclass, 6);
+    FileClose(file_handle);
+    file_handle = FileOpen("shared", "r");
+    second_handle = FileOpen("shared", "r");
+    printf("   handles      =    %d and %d (expecting two different handles)\n", file_handle, second_handle);
+    FileRead(second_handle, &readclass, 6);
+    printf("  The second reader has its own position:  ");
+    for(i=0;i<6;i++) printf("%c",readclass[i]);
+    printf("\n");
+    printf("   write open   =    %d (expecting -1 while readers have it)\n", FileOpen("shared", "w"));
+    printf("   write        =    %d (expecting -1 through a read handle)\n", FileWrite(file_handle, &writeclass, 6));
+    printf("   punch hole   =    %d (expecting -1 through a read handle)\n", FilePunchHole(file_handle, 0, 6));
+    printf("   delete       =    %d (expecting -1 while open)\n", FileDelete("shared"));
+    FileClose(file_handle);
+    FileClose(second_handle);
+    printf("   delete       =    %d (expecting 0 once all closed)\n", FileDelete("shared"));
+
     printf("============================================================\n");
     printf("============================================================\n\n");
 }
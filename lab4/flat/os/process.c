@@ -17,14 +17,13 @@
 #include "clock.h"
 #include "traps.h"
 #include "dfs.h"
+#include "files.h"
+#include "slab.h"
 
 // Pointer to the current PCB.  This is used by the assembly language
 // routines for context switches.
 PCB		*currentPCB;
 
-// List of free PCBs.
-static Queue	freepcbs;
-
 // List of processes that are ready to run (ie, not waiting for something
 // to happen).
 static Queue	runQueue;
@@ -38,9 +37,9 @@ static Queue	waitQueue;
 // the reason that we need a separate queue for processes about to die.
 static Queue	zombieQueue;
 
-// Static area for all process control blocks.  This is necessary because
-// we can't use malloc() inside the OS.
-static PCB	pcbs[PROCESS_MAX_PROCS];
+// Process control blocks come from this cache, and a process id is its
+// PCB's handle in the cache.
+static SlabCache pcbcache;
 
 // String listing debugging options to print out.
 char	debugstr[200];
@@ -56,35 +55,17 @@ uint32 get_argument(char *string);
 //
 //	ProcessModuleInit
 //
-//	Initialize the process module.  This involves initializing all
-//	of the process control blocks to appropriate values (ie, free
-//	and available).  We also need to initialize all of the queues.
+//	Initialize the process module.  This involves setting up the
+//	cache that process control blocks are allocated from, and
+//	initializing all of the queues.
 //
 //----------------------------------------------------------------------
 void ProcessModuleInit () {
-  int		i;
-
   dbprintf ('p', "ProcessModuleInit: function started\n");
-  AQueueInit (&freepcbs);
   AQueueInit(&runQueue);
   AQueueInit (&waitQueue);
   AQueueInit (&zombieQueue);
-  // For each PCB slot in the global pcbs array:
-  for (i = 0; i < PROCESS_MAX_PROCS; i++) {
-    dbprintf ('p', "Initializing PCB %d @ 0x%x.\n", i, (int)&(pcbs[i]));
-    // First, set the internal PCB link pointer to a newly allocated link
-    if ((pcbs[i].l = AQueueAllocLink(&pcbs[i])) == NULL) {
-      printf("FATAL ERROR: could not allocate link in ProcessModuleInit!\n");
-      GracefulExit();
-    }
-    // Next, set the pcb to be available
-    pcbs[i].flags = PROCESS_STATUS_FREE;
-    // Finally, insert the link into the queue
-    if (AQueueInsertFirst(&freepcbs, pcbs[i].l) != QUEUE_SUCCESS) {
-      printf("FATAL ERROR: could not insert PCB link into queue in ProcessModuleInit!\n");
-      GracefulExit();
-    }
-  }
+  SlabCacheInit (&pcbcache, "pcbs", sizeof(PCB));
   // There are no processes running at this point, so currentPCB=NULL
   currentPCB = NULL;
   dbprintf ('p', "ProcessModuleInit: function complete\n");
@@ -111,30 +92,15 @@ void ProcessSetStatus (PCB *pcb, int status) {
 //
 //----------------------------------------------------------------------
 void ProcessFreeResources (PCB *pcb) {
-  int i = 0;
-
   dbprintf ('p', "ProcessFreeResources: function started\n");
 
-  // Allocate a new link for this pcb on the freepcbs queue
-  if ((pcb->l = AQueueAllocLink(pcb)) == NULL) {
-    printf("FATAL ERROR: could not get Queue Link in ProcessFreeResources!\n");
-    GracefulExit();
-  }
-  // Set the pcb's status to available
-  pcb->flags = PROCESS_STATUS_FREE;
-  // Insert the link into the freepcbs queue
-  if (AQueueInsertLast(&freepcbs, pcb->l) != QUEUE_SUCCESS) {
-    printf("FATAL ERROR: could not insert PCB link into freepcbs queue in ProcessFreeResources!\n");
-    GracefulExit();
-  }
-
-  // Free the process's memory.
-  for (i = 0; i < pcb->npages; i++) {
-    MemoryFreePte (pcb->pagetable[i]);
-  }
+  // Free the process's memory, and its L2 page tables.
+  MemoryFreePageTables (pcb);
   // Free the page allocated for the system stack
   MemoryFreePage (pcb->sysStackArea / MEMORY_PAGE_SIZE);
   ProcessSetStatus (pcb, PROCESS_STATUS_FREE);
+  // Give the PCB back to the cache
+  SlabFree (&pcbcache, pcb);
   dbprintf ('p', "ProcessFreeResources: function complete\n");
 }
 
@@ -192,12 +158,13 @@ void ProcessSchedule () {
       l = AQueueFirst(&waitQueue);
       while (l != NULL) {
         pcb = AQueueObject(l);
-        printf("Sleeping process %d: ", i++); printf("PID = %d\n", (int)(pcb - pcbs));
+        printf("Sleeping process %d: ", i++); printf("PID = %d\n", GetPidFromAddress(pcb));
         l = AQueueNext(l);
       }
       GracefulExit();
     }
     printf ("No runnable processes - exiting!\n");
+    SlabPrintStats ();
     GracefulExit ();	// NEVER RETURNS
   }
 
@@ -270,7 +237,7 @@ void ProcessSuspend (PCB *suspend) {
 //
 //----------------------------------------------------------------------
 void ProcessWakeup (PCB *wakeup) {
-  dbprintf ('p',"Waking up PID %d.\n", (int)(wakeup - pcbs));
+  dbprintf ('p',"Waking up PID %d.\n", GetPidFromAddress(wakeup));
   // Make sure it's not yet a runnable process.
   ASSERT (wakeup->flags & PROCESS_STATUS_WAITING, "Trying to wake up a non-sleeping process!\n");
   ProcessSetStatus (wakeup, PROCESS_STATUS_RUNNABLE);
@@ -305,6 +272,9 @@ void ProcessWakeup (PCB *wakeup) {
 //----------------------------------------------------------------------
 void ProcessDestroy (PCB *pcb) {
   dbprintf ('p', "ProcessDestroy (%d): function started\n", GetCurrentPid());
+  FileAioCancelAll (pcb);
+  FileUnmapAll (pcb);
+  FileCloseAll (pcb);
   ProcessSetStatus (pcb, PROCESS_STATUS_ZOMBIE);
   if (AQueueRemove(&(pcb->l)) != QUEUE_SUCCESS) {
     printf("FATAL ERROR: could not remove link from queue in ProcessDestroy!\n");
@@ -349,9 +319,10 @@ static void ProcessExit () {
 //
 //----------------------------------------------------------------------
 int ProcessFork (VoidFunc func, uint32 param, char *name, int isUser) {
-  int		fd, n;
+  int		fd, n, i;
   int		start, codeS, codeL, dataS, dataL;
   uint32	*stackframe;
+  uint32	*pte;
   int		newPage;
   PCB		*pcb;
   int	addr = 0;
@@ -365,19 +336,15 @@ int ProcessFork (VoidFunc func, uint32 param, char *name, int isUser) {
   dbprintf ('I', "Old interrupt value was 0x%x.\n", intrs);
   dbprintf ('p', "Entering ProcessFork args=0x%x 0x%x %s %d\n", (int)func,
 	    param, name, isUser);
-  // Get a free PCB for the new process
-  if (AQueueEmpty(&freepcbs)) {
-    printf ("FATAL error: no free processes!\n");
+  // Get a new PCB for the process, it comes zeroed
+  if ((pcb = (PCB *)SlabAlloc(&pcbcache)) == NULL) {
+    printf ("FATAL error: no memory for a new process!\n");
     GracefulExit ();	// NEVER RETURNS!
   }
-  pcb = (PCB *)AQueueObject(AQueueFirst (&freepcbs));
-  dbprintf ('p', "Got a link @ 0x%x\n", (int)(pcb->l));
-  if (AQueueRemove (&(pcb->l)) != QUEUE_SUCCESS) {
-    printf("FATAL ERROR: could not remove link from freepcbsQueue in ProcessFork!\n");
-    GracefulExit();
-  }
   // This prevents someone else from grabbing this process
   ProcessSetStatus (pcb, PROCESS_STATUS_RUNNABLE);
+  // No files open yet
+  FileInitDescriptors (pcb);
 
   // At this point, the PCB is allocated and nobody else can get it.
   // However, it's not in the run queue, so it won't be run.  Thus, we
@@ -397,13 +364,21 @@ int ProcessFork (VoidFunc func, uint32 param, char *name, int isUser) {
   // For system processes, though, all pages must be contiguous.
   // Of course, system processes probably need just a single page for
   // their stack, and don't need any code or data pages allocated for them.
+  // Pages past npages stay invalid until a file is mapped there.
   pcb->npages = 1;
+  for (i = 0; i < PROCESS_L1_ENTRIES; i++) {
+    pcb->pagetable[i] = 0;
+  }
   newPage = MemoryAllocPage ();
   if (newPage == 0) {
     printf ("aFATAL: couldn't allocate memory - no free pages!\n");
     GracefulExit ();	// NEVER RETURNS!
   }
-  pcb->pagetable[0] = MemorySetupPte (newPage);
+  if ((pte = MemoryGetPte (pcb, 0, 1)) == NULL) {
+    printf ("cFATAL: couldn't allocate a page table - no free pages!\n");
+    GracefulExit ();	// NEVER RETURNS!
+  }
+  *pte = MemorySetupPte (newPage);
   newPage = MemoryAllocPage ();
   if (newPage == 0) {
     printf ("bFATAL: couldn't allocate system stack - no free pages!\n");
@@ -425,7 +400,7 @@ int ProcessFork (VoidFunc func, uint32 param, char *name, int isUser) {
 
   dbprintf ('p',
 	    "Setting up PCB @ 0x%x (sys stack=0x%x, mem=0x%x, size=0x%x)\n",
-	    (int)pcb, pcb->sysStackArea, pcb->pagetable[0],
+	    (int)pcb, pcb->sysStackArea, *pte,
 	    pcb->npages * MEMORY_PAGE_SIZE);
 
   //----------------------------------------------------------------------
@@ -440,15 +415,14 @@ int ProcessFork (VoidFunc func, uint32 param, char *name, int isUser) {
   // previous frame.
   stackframe[PROCESS_STACK_PREV_FRAME] = 0;
 
-  // Set the base of the level 1 page table.  If there's only one page
-  // table level, this is it.  For 2-level page tables, put the address
-  // of the level 1 page table here.  For 2-level page tables, we'll also
-  // have to build up the necessary tables....
+  // Set the base of the level 1 page table.  Its entries point at the
+  // level 2 tables, and a zero entry faults like an invalid PTE does.
   stackframe[PROCESS_STACK_PTBASE] = (uint32)&(pcb->pagetable[0]);
 
   // Set the size (maximum number of entries) of the level 1 page table.
-  // In our case, it's just one page, but it could be larger.
-  stackframe[PROCESS_STACK_PTSIZE] = pcb->npages;
+  // The whole table is visible so that touching a mapped file's page
+  // faults instead of being an illegal access.
+  stackframe[PROCESS_STACK_PTSIZE] = PROCESS_L1_ENTRIES;
 
   // Set the number of bits for both the level 1 and level 2 page tables.
   // This can be changed on a per-process basis if desired.  For now,
@@ -533,6 +507,11 @@ int ProcessFork (VoidFunc func, uint32 param, char *name, int isUser) {
 
   // Place PCB onto run queue
   intrs = DisableIntrs ();
+  // A user page may be paged out from here on.  Not before, since the
+  // program was loaded into it with interrupts on.
+  if (isUser) {
+    MemorySetPageOwner (MemoryPteToPage (*pte) / MEMORY_PAGE_SIZE, pcb, 0);
+  }
   if ((pcb->l = AQueueAllocLink(pcb)) == NULL) {
     printf("FATAL ERROR: could not get link for forked PCB in ProcessFork!\n");
     GracefulExit();
@@ -550,11 +529,10 @@ int ProcessFork (VoidFunc func, uint32 param, char *name, int isUser) {
   }
 
   dbprintf ('p', "Leaving ProcessFork (%s)\n", name);
-  // Return the process number (found by subtracting the PCB number
-  // from the base of the PCB array).
+  // Return the process number, the PCB's handle in the cache
   dbprintf ('p', "ProcessFork (%d): function complete\n", GetCurrentPid());
 
-  return (pcb - pcbs);
+  return GetPidFromAddress(pcb);
 }
 
 //----------------------------------------------------------------------
@@ -838,6 +816,7 @@ void main (int argc, char *argv[])
   FsClose (i);
 
   DfsModuleInit();
+  FileModuleInit();
   dbprintf ('i', "After initializing dfs filesystem.\n");
 
   // Setup command line arguments
@@ -870,12 +849,12 @@ void main (int argc, char *argv[])
 
 unsigned GetCurrentPid()
 {
-  return (unsigned)(currentPCB - pcbs);
+  return (unsigned)SlabIndex(&pcbcache, currentPCB);
 }
 
 unsigned findpid(PCB *pcb)
 {
-  return (unsigned)(pcb - pcbs);
+  return (unsigned)SlabIndex(&pcbcache, pcb);
 }
 
 //----------------------------------------------------------------
@@ -920,7 +899,7 @@ uint32 get_argument(char *string)
 }
 
 int GetPidFromAddress(PCB *pcb) {
-  return (int)(pcb - pcbs);
+  return SlabIndex(&pcbcache, pcb);
 }
 
 
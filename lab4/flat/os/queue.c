@@ -9,9 +9,9 @@
 #include "dlxos.h"
 #include "traps.h"
 #include "queue.h"
+#include "slab.h"
 
-Queue		freeLinks;  // Stores all the free links in the system
-static Link	linkpool[QUEUE_MAX_LINKS]; // Memory space for each link, since we can't use malloc()
+static SlabCache linkcache; // Links come from here as queues need them
 
 //-------------------------------------------------------------------------
 
@@ -36,23 +36,7 @@ int testfuncint() {
 int retzero();
 
 int AQueueModuleInit() {
-  int i;
-  if (AQueueInit(&freeLinks) != QUEUE_SUCCESS) {
-    printf("FATAL ERROR: could not initialize freeLinks queue in AQueueModuleInit!\n");
-    GracefulExit();
-  }
-  dbprintf ('q', "Initializing %d links.\n", QUEUE_MAX_LINKS);
-  for (i = 0; i < QUEUE_MAX_LINKS; i++) {
-    // Initialize link structure
-    linkpool[i].next = NULL;
-    linkpool[i].prev = NULL;
-    linkpool[i].object = NULL;
-    // Add link to freeLinks queue
-    if (AQueueInsertLast(&freeLinks, &(linkpool[i])) != QUEUE_SUCCESS) {
-      printf("FATAL ERROR: could not insert link into freeLinks in AQueueModuleInit!\n"); // Adds structure to global queue of free links
-      GracefulExit();
-    }
-  }
+  SlabCacheInit (&linkcache, "links", sizeof(Link));
   return QUEUE_SUCCESS;
 }
 
@@ -79,41 +63,16 @@ int AQueueInit (Queue *q) {
 //-------------------------------------------------------------------------
 
 ///////////////////////////////////////////////////////
-// Gets an empty link structure from the global queue
-// of empty links.
+// Gets an empty link structure from the link cache.
 ///////////////////////////////////////////////////////
 Link *AQueueAllocLink (void *obj_to_store) {
-  extern Queue	freeLinks;
   Link	*l=NULL;
 
   dbprintf('q', "AQueueAllocLink: allocating link\n");
-  if (AQueueEmpty(&freeLinks)) {
+  if ((l = (Link *)SlabAlloc(&linkcache)) == NULL) {
     dbprintf('q', "AQueueAllocLink: no free links!\n");
     return NULL;
   }
-  l = AQueueFirst(&freeLinks);
-  if (!l) {
-    dbprintf('q', "AQueueAllocLink: first link in freeLinks is NULL!\n");
-    return NULL;
-  }
-
-  // Can't use QueueRemove because it puts the link back onto
-  // the list of free links.  Therefore, we must remove it
-  // manually.
-  
-  // First fix freeLinks structure
-  if (freeLinks.first == l) freeLinks.first = l->next;
-  if (freeLinks.last == l) freeLinks.last = l->prev;
-  freeLinks.nitems--;
-
-  // Next, fix list around l
-  if (l->prev) l->prev->next = l->next;
-  if (l->next) l->next->prev = l->prev;
-
-  // Finally, reset l's internal pointers to NULL for safety
-  l->next = NULL;
-  l->prev = NULL;
-  l->queue = NULL;
   l->object = obj_to_store;
 
   return l;
@@ -121,10 +80,9 @@ Link *AQueueAllocLink (void *obj_to_store) {
 
 /////////////////////////////////////////////////////////////////
 // Removes link "l" from the queue that it belongs to, and
-// adds it back to the global queue of free links.
+// frees it.
 /////////////////////////////////////////////////////////////////
 int AQueueRemove (Link **pl) {
-  extern Queue freeLinks;
   Link *l = NULL;
 
   dbprintf('q', "AQueueRemove: removing link\n");
@@ -145,8 +103,8 @@ int AQueueRemove (Link **pl) {
   // Update the number of items in the queue
   l->queue->nitems--;
 
-  // Clear the link, and add it back to the link back to the list of free links
-  AQueueInsertLast(&freeLinks, l);
+  // Give the link back to the link cache
+  SlabFree(&linkcache, l);
 
   *pl = NULL;
   return QUEUE_SUCCESS;
@@ -0,0 +1,294 @@
+//
+//	slab.c
+//
+//	Kernel object caches.  A cache keeps pages from MemoryAllocPage,
+//	each starting with a SlabPage header followed by a row of objects.
+//	Free objects in a page are chained through their first word, and
+//	the pages with a free object are on the cache's partial list, so
+//	SlabAlloc and SlabFree take constant time.  A page is added when
+//	the partial list runs dry, and given back when its last object is
+//	freed, as long as the cache has another page with room.
+//
+//	An object's handle is its page's slot in cache->pages times the
+//	objects per page, plus its place in the page.  SlabLookup turns a
+//	handle back into the object, or NULL if nothing is allocated there.
+//
+
+#include "ostraps.h"
+#include "dlxos.h"
+#include "traps.h"
+#include "process.h"
+#include "memory.h"
+#include "slab.h"
+
+// Bytes at the start of a page before its first object
+#define SLAB_HEADER	((sizeof(SlabPage) + 7) & ~7)
+#define SLAB_PAGE_OF(obj) ((SlabPage *)((uint32)(obj) & ~MEMORY_PAGE_MASK))
+#define SLAB_OBJECT(p, i) ((char *)(p) + SLAB_HEADER + (i) * (p)->cache->size)
+
+// Every cache that has been set up, for SlabPrintStats
+static SlabCache *caches = NULL;
+
+//----------------------------------------------------------------------
+//
+//	SlabCacheInit
+//
+//	Set up an empty cache of objects of the given size.  No memory is
+//	taken until the first SlabAlloc.
+//
+//----------------------------------------------------------------------
+void
+SlabCacheInit (SlabCache *cache, char *name, int size)
+{
+  int		i;
+
+  size = (size + 3) & ~3;
+  if (size < SLAB_MIN_OBJECT) {
+    size = SLAB_MIN_OBJECT;
+  }
+  if (size > MEMORY_PAGE_SIZE - SLAB_HEADER) {
+    printf ("FATAL ERROR: %s objects (%d bytes) don't fit in a slab page!\n", name, size);
+    GracefulExit ();
+  }
+  cache->name = name;
+  cache->size = size;
+  cache->perpage = (MEMORY_PAGE_SIZE - SLAB_HEADER) / size;
+  cache->partial = NULL;
+  for (i = 0; i < SLAB_MAX_PAGES; i++) {
+    cache->pages[i] = NULL;
+  }
+  cache->npages = cache->inuse = cache->peak = 0;
+  cache->allocs = cache->frees = cache->fails = 0;
+  cache->nextcache = caches;
+  caches = cache;
+  dbprintf ('k', "SlabCacheInit: %s, %d objects of %d bytes per page\n", name, cache->perpage, size);
+}
+
+//----------------------------------------------------------------------
+//
+//	SlabLink
+//	SlabUnlink
+//
+//	Put a page on, or take it off, its cache's partial list.
+//
+//----------------------------------------------------------------------
+static void
+SlabLink (SlabCache *cache, SlabPage *p)
+{
+  p->prev = NULL;
+  p->next = cache->partial;
+  if (cache->partial != NULL) {
+    cache->partial->prev = p;
+  }
+  cache->partial = p;
+}
+
+static void
+SlabUnlink (SlabCache *cache, SlabPage *p)
+{
+  if (p->prev != NULL) {
+    p->prev->next = p->next;
+  } else {
+    cache->partial = p->next;
+  }
+  if (p->next != NULL) {
+    p->next->prev = p->prev;
+  }
+  p->next = p->prev = NULL;
+}
+
+//----------------------------------------------------------------------
+//
+//	SlabGrow
+//
+//	Add a page to the cache, with all its objects free.  Returns the
+//	page, or NULL if the cache is full or memory has run out.
+//
+//----------------------------------------------------------------------
+static SlabPage *
+SlabGrow (SlabCache *cache)
+{
+  SlabPage	*p;
+  int		i, page;
+
+  for (i = 0; (i < SLAB_MAX_PAGES) && (cache->pages[i] != NULL); i++)
+    ;
+  if (i == SLAB_MAX_PAGES) {
+    return (NULL);
+  }
+  if ((page = MemoryAllocPage ()) == 0) {
+    return (NULL);
+  }
+  p = (SlabPage *)(page * MEMORY_PAGE_SIZE);
+  p->cache = cache;
+  p->index = i;
+  p->nfree = cache->perpage;
+  p->freelist = NULL;
+  for (i = cache->perpage - 1; i >= 0; i--) {
+    *(void **)SLAB_OBJECT (p, i) = p->freelist;
+    p->freelist = SLAB_OBJECT (p, i);
+  }
+  for (i = 0; i < SLAB_MAP_WORDS; i++) {
+    p->usedmap[i] = 0;
+  }
+  cache->pages[p->index] = p;
+  cache->npages++;
+  SlabLink (cache, p);
+  dbprintf ('k', "SlabGrow: %s now has %d pages\n", cache->name, cache->npages);
+  return (p);
+}
+
+//----------------------------------------------------------------------
+//
+//	SlabAlloc
+//
+//	Allocate a zeroed object from the cache.  Returns NULL if there is
+//	no memory left for it.
+//
+//----------------------------------------------------------------------
+void *
+SlabAlloc (SlabCache *cache)
+{
+  SlabPage	*p;
+  char		*obj;
+  int		i, intrs;
+
+  intrs = DisableIntrs ();
+  if (((p = cache->partial) == NULL) && ((p = SlabGrow (cache)) == NULL)) {
+    cache->fails++;
+    RestoreIntrs (intrs);
+    dbprintf ('k', "SlabAlloc: out of memory for %s\n", cache->name);
+    return (NULL);
+  }
+  obj = p->freelist;
+  p->freelist = *(void **)obj;
+  i = (obj - SLAB_OBJECT (p, 0)) / cache->size;
+  p->usedmap[i >> 5] |= (1 << (i & 0x1f));
+  if (--p->nfree == 0) {
+    SlabUnlink (cache, p);
+  }
+  cache->allocs++;
+  if (++cache->inuse > cache->peak) {
+    cache->peak = cache->inuse;
+  }
+  RestoreIntrs (intrs);
+  bzero (obj, cache->size);
+  return (obj);
+}
+
+//----------------------------------------------------------------------
+//
+//	SlabFree
+//
+//	Return an object to its cache.  Returns SLAB_FAIL if it isn't an
+//	allocated object of this cache.
+//
+//----------------------------------------------------------------------
+int
+SlabFree (SlabCache *cache, void *obj)
+{
+  SlabPage	*p;
+  int		i, intrs;
+
+  if ((i = SlabIndex (cache, obj)) == SLAB_FAIL) {
+    return (SLAB_FAIL);
+  }
+  p = SLAB_PAGE_OF (obj);
+  i %= cache->perpage;
+
+  intrs = DisableIntrs ();
+  p->usedmap[i >> 5] ^= (1 << (i & 0x1f));
+  *(void **)obj = p->freelist;
+  p->freelist = obj;
+  if (p->nfree++ == 0) {
+    SlabLink (cache, p);
+  }
+  cache->frees++;
+  cache->inuse--;
+  // An empty page goes back, unless it's the only one with room
+  if ((p->nfree == cache->perpage) && ((p->prev != NULL) || (p->next != NULL))) {
+    SlabUnlink (cache, p);
+    cache->pages[p->index] = NULL;
+    cache->npages--;
+    MemoryFreePage ((uint32)p / MEMORY_PAGE_SIZE);
+    dbprintf ('k', "SlabFree: %s now has %d pages\n", cache->name, cache->npages);
+  }
+  RestoreIntrs (intrs);
+  return (SLAB_SUCCESS);
+}
+
+//----------------------------------------------------------------------
+//
+//	SlabIndex
+//
+//	Return the handle of an allocated object, or SLAB_FAIL if it isn't
+//	one of this cache's.
+//
+//----------------------------------------------------------------------
+int
+SlabIndex (SlabCache *cache, void *obj)
+{
+  SlabPage	*p;
+  int		offset, i;
+
+  if (obj == NULL) {
+    return (SLAB_FAIL);
+  }
+  p = SLAB_PAGE_OF (obj);
+  if ((p->index < 0) || (p->index >= SLAB_MAX_PAGES) || (cache->pages[p->index] != p)) {
+    return (SLAB_FAIL);
+  }
+  offset = (char *)obj - SLAB_OBJECT (p, 0);
+  i = offset / cache->size;
+  if ((offset < 0) || (offset % cache->size != 0) || (i >= cache->perpage) ||
+      !(p->usedmap[i >> 5] & (1 << (i & 0x1f)))) {
+    return (SLAB_FAIL);
+  }
+  return (p->index * cache->perpage + i);
+}
+
+//----------------------------------------------------------------------
+//
+//	SlabLookup
+//
+//	Return the object with the given handle, or NULL if no object is
+//	allocated under it.
+//
+//----------------------------------------------------------------------
+void *
+SlabLookup (SlabCache *cache, int handle)
+{
+  SlabPage	*p;
+  int		i;
+
+  if ((handle < 0) || (handle >= SLAB_MAX_PAGES * cache->perpage)) {
+    return (NULL);
+  }
+  if ((p = cache->pages[handle / cache->perpage]) == NULL) {
+    return (NULL);
+  }
+  i = handle % cache->perpage;
+  if (!(p->usedmap[i >> 5] & (1 << (i & 0x1f)))) {
+    return (NULL);
+  }
+  return (SLAB_OBJECT (p, i));
+}
+
+//----------------------------------------------------------------------
+//
+//	SlabPrintStats
+//
+//	Print the usage of every cache, with the 'k' debug flag.
+//
+//----------------------------------------------------------------------
+void
+SlabPrintStats ()
+{
+  SlabCache	*cache;
+
+  for (cache = caches; cache != NULL; cache = cache->nextcache) {
+    dbprintf ('k', "%s (%d bytes): %d in use, peak %d, %d pages, %d allocs, %d frees, %d failed\n",
+	      cache->name, cache->size, cache->inuse, cache->peak, cache->npages,
+	      cache->allocs, cache->frees, cache->fails);
+  }
+}
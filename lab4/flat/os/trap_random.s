@@ -21,3 +21,11 @@ _srandom:
 	nop
 .endproc _srandom
 
+
+.proc _ftruncate
+.global _ftruncate
+_ftruncate:		
+	trap	#0x2015
+	jr	r31
+	nop
+.endproc _ftruncate
@@ -133,13 +133,46 @@ int TrapFileDeleteHandler(uint32 *trapArgs, int sysMode) {
   return FileDelete(filename);
 }
 
+//----------------------------------------------------------------------
+// TrapFileTransfer moves num_bytes between an open file and the buffer
+// at user_mem without a bounce buffer. Each page of a user buffer is
+// translated and handed to the file layer on its own, so the data
+// is copied once, between the buffer cache and the user's frame, and
+// there's no limit on the size. A pos of -1 goes through the cursor
+// with FileRead/FileWrite (a short read is FILE_FAIL, as for FileRead);
+// otherwise FilePread/FilePwrite work at pos and a short read returns
+// what it got. Returns the number of bytes moved, or FILE_FAIL.
+//----------------------------------------------------------------------
+static int TrapFileTransfer(uint32 handle, char *user_mem, int num_bytes, int pos, int sysMode, int write) {
+  char *sys_mem;
+  int n, ret, done = 0;
+
+  if (num_bytes <= 0) return FILE_FAIL;
+  while (done < num_bytes) {
+    if (sysMode) {
+      sys_mem = user_mem + done;
+      n = num_bytes - done;
+    } else {
+      if (write) sys_mem = (char *)MemoryTranslateUserToSystem(currentPCB, (uint32)(user_mem + done));
+      else sys_mem = (char *)MemoryTranslateUserForWrite(currentPCB, (uint32)(user_mem + done));
+      if (sys_mem == NULL) return FILE_FAIL;
+      n = MEMORY_PAGE_SIZE - ((uint32)(user_mem + done) % MEMORY_PAGE_SIZE);
+      if (n > num_bytes - done) n = num_bytes - done;
+    }
+    if (pos < 0) ret = write ? FileWrite(handle, sys_mem, n) : FileRead(handle, sys_mem, n);
+    else ret = write ? FilePwrite(handle, sys_mem, n, pos + done) : FilePread(handle, sys_mem, n, pos + done);
+    if (ret == FILE_FAIL) return FILE_FAIL;
+    done += ret;
+    if (ret < n) break; // end of file
+  }
+  return done;
+}
+
 // file_read(uint32 handle, void *mem, int num_bytes)
 int TrapFileReadHandler(uint32 *trapArgs, int sysMode) {
   uint32 handle;
   char *user_mem;
-  char mem[FILE_MAX_READWRITE_BYTES];
   int num_bytes;
-  int ret;
 
   // If we're not in system mode, we need to copy everything from the
   // user-space virtual address to the kernel space address
@@ -157,33 +190,14 @@ int TrapFileReadHandler(uint32 *trapArgs, int sysMode) {
     user_mem = (char *)(trapArgs[1]);
     num_bytes = trapArgs[2];
   }
- 
-  if (num_bytes > FILE_MAX_READWRITE_BYTES) {
-    printf("TrapFileReadHandler: ERROR: you cannot read more than %d bytes at a time!\n", num_bytes);
-    return FILE_FAIL;
-  }
-  
-  if ((ret = FileRead(handle, mem, num_bytes)) == FILE_FAIL) {
-    return FILE_FAIL;
-  }
-
-  // Copy bytes that we just read into user mem
-  if (!sysMode) {
-    MemoryCopySystemToUser(currentPCB, mem, user_mem, num_bytes);
-  } else {
-    bcopy(mem, user_mem, num_bytes);
-  }
-  
-  return ret;
+  return TrapFileTransfer(handle, user_mem, num_bytes, -1, sysMode, 0);
 }
 
 // file_write(uint32 handle, void *mem, int num_bytes)
 int TrapFileWriteHandler(uint32 *trapArgs, int sysMode) {
   uint32 handle;
   char *user_mem;
-  char mem[FILE_MAX_READWRITE_BYTES];
   int num_bytes;
-  int ret;
 
   // If we're not in system mode, we need to copy everything from the
   // user-space virtual address to the kernel space address
@@ -195,29 +209,78 @@ int TrapFileWriteHandler(uint32 *trapArgs, int sysMode) {
     MemoryCopyUserToSystem (currentPCB, (trapArgs+1), &user_mem, sizeof(uint32));
     // Argument 2: integer number of bytes to write
     MemoryCopyUserToSystem (currentPCB, (trapArgs+2), &num_bytes, sizeof(uint32));
-    
-    // Now copy bytes from userland to kernel buffer for writing
-    if (num_bytes > FILE_MAX_READWRITE_BYTES) {
-      printf("TrapFileWriteHandler: ERROR: you cannot write more than %d bytes at a time!\n", num_bytes);
-      return FILE_FAIL;
-    }
-    MemoryCopyUserToSystem(currentPCB, user_mem, mem, num_bytes);
   } else {
     // Already in kernel space, no address translation necessary
     handle = trapArgs[0];
     user_mem = (char *)(trapArgs[1]);
     num_bytes = trapArgs[2];
-    if (num_bytes > FILE_MAX_READWRITE_BYTES) {
-      printf("TrapFileWriteHandler: ERROR: you cannot write more than %d bytes at a time!\n", num_bytes);
-      return FILE_FAIL;
-    }
-    bcopy(user_mem, mem, num_bytes);
   }
+  return TrapFileTransfer(handle, user_mem, num_bytes, -1, sysMode, 1);
+}
 
-  return FileWrite(handle, mem, num_bytes);
+// file_pread(uint32 handle, void *mem, int num_bytes, int offset) and
+// file_pwrite, which share the argument layout
+int TrapFilePositionalHandler(uint32 *trapArgs, int sysMode, int write) {
+  uint32 args[4];
 
-  return ret;
+  // All four arguments come over in one copy
+  if (!sysMode) {
+    MemoryCopyUserToSystem (currentPCB, trapArgs, args, sizeof(args));
+  } else {
+    bcopy ((char *)trapArgs, (char *)args, sizeof(args));
+  }
+  if ((int)args[3] < 0) return FILE_FAIL;
+  return TrapFileTransfer(args[0], (char *)args[1], args[2], args[3], sysMode, write);
+}
+
+// file_readv(uint32 handle, file_iovec *iov, int iovcnt) and
+// file_writev. The buffers are filled (or drained) in order starting
+// at the cursor, which then moves past everything transferred. A
+// short read ends the batch. Returns the total number of bytes.
+int TrapFileVectorHandler(uint32 *trapArgs, int sysMode, int write) {
+  uint32 args[3];
+  file_iovec iov[FILE_MAX_IOVECS];
+  int i, pos, ret, total = 0;
+
+  if (!sysMode) {
+    MemoryCopyUserToSystem (currentPCB, trapArgs, args, sizeof(args));
+  } else {
+    bcopy ((char *)trapArgs, (char *)args, sizeof(args));
+  }
+  if ((int)args[2] <= 0 || args[2] > FILE_MAX_IOVECS) return FILE_FAIL;
+  // The whole vector comes over in one copy as well
+  if (!sysMode) {
+    if (MemoryCopyUserToSystem (currentPCB, (char *)args[1], iov, args[2] * sizeof(file_iovec))
+	!= args[2] * sizeof(file_iovec)) return FILE_FAIL;
+  } else {
+    bcopy ((char *)args[1], (char *)iov, args[2] * sizeof(file_iovec));
+  }
 
+  if ((pos = FileTell(args[0])) == FILE_FAIL) return FILE_FAIL;
+  for (i = 0; i < args[2]; i++) {
+    if (iov[i].len <= 0) continue;
+    ret = TrapFileTransfer(args[0], iov[i].base, iov[i].len, pos + total, sysMode, write);
+    if (ret == FILE_FAIL) {
+      if (total == 0) return FILE_FAIL;
+      break;
+    }
+    total += ret;
+    if (ret < iov[i].len) break;
+  }
+  FileSeek(args[0], pos + total, FILE_SEEK_SET);
+  return total;
+}
+
+// aio_submit(uint32 handle, int op, void *buf, int len, int offset, sem_t sem)
+int TrapAioSubmitHandler(uint32 *trapArgs, int sysMode) {
+  uint32 args[6];
+
+  if (!sysMode) {
+    MemoryCopyUserToSystem (currentPCB, trapArgs, args, sizeof(args));
+  } else {
+    bcopy ((char *)trapArgs, (char *)args, sizeof(args));
+  }
+  return FileAioSubmit(args[0], args[1], (char *)args[2], args[3], args[4], args[5], sysMode);
 }
 
 // file_seek(uint32 handle, int num_bytes, int from_where)
@@ -245,6 +308,190 @@ int TrapFileSeekHandler(uint32 *trapArgs, int sysMode) {
   return FileSeek(handle, num_bytes, from_where);
 }
 
+// Copies a path string argument into the kernel buffer path
+// (FILE_MAX_FILENAME_LENGTH bytes). Returns FILE_FAIL if the
+// string doesn't fit.
+static int TrapCopyPathArg(uint32 *trapArg, char *path, int sysMode) {
+  char *user_path = NULL;
+  int i;
+
+  if (!sysMode) {
+    MemoryCopyUserToSystem (currentPCB, trapArg, &user_path, sizeof(uint32));
+    for(i=0; i<FILE_MAX_FILENAME_LENGTH; i++) {
+      MemoryCopyUserToSystem(currentPCB, (user_path+i), &(path[i]), sizeof(char));
+      if (path[i] == '\0') break;
+    }
+    if (i == FILE_MAX_FILENAME_LENGTH) return FILE_FAIL;
+  } else {
+    dstrncpy(path, (char *)(*trapArg), FILE_MAX_FILENAME_LENGTH);
+  }
+  return FILE_SUCCESS;
+}
+
+// mkdir(char *path)
+int TrapFileMkdirHandler(uint32 *trapArgs, int sysMode) {
+  char path[FILE_MAX_FILENAME_LENGTH];
+
+  if (TrapCopyPathArg(trapArgs+0, path, sysMode) != FILE_SUCCESS) {
+    printf("TrapFileMkdirHandler: length of path longer than allowed!\n");
+    return FILE_FAIL;
+  }
+  return FileMkdir(path);
+}
+
+// rmdir(char *path)
+int TrapFileRmdirHandler(uint32 *trapArgs, int sysMode) {
+  char path[FILE_MAX_FILENAME_LENGTH];
+
+  if (TrapCopyPathArg(trapArgs+0, path, sysMode) != FILE_SUCCESS) {
+    printf("TrapFileRmdirHandler: length of path longer than allowed!\n");
+    return FILE_FAIL;
+  }
+  return FileRmdir(path);
+}
+
+// file_punch_hole(uint32 handle, int start_byte, int num_bytes)
+int TrapFilePunchHoleHandler(uint32 *trapArgs, int sysMode) {
+  uint32 handle;
+  int start_byte;
+  int num_bytes;
+
+  // If we're not in system mode, we need to copy everything from the
+  // user-space virtual address to the kernel space address
+  if (!sysMode) {
+    // Argument 0: handle to file descriptor
+    MemoryCopyUserToSystem (currentPCB, (trapArgs+0), &handle, sizeof(uint32));
+    // Argument 1: first byte of the hole
+    MemoryCopyUserToSystem (currentPCB, (trapArgs+1), &start_byte, sizeof(uint32));
+    // Argument 2: length of the hole in bytes
+    MemoryCopyUserToSystem (currentPCB, (trapArgs+2), &num_bytes, sizeof(uint32));
+  } else {
+    handle = trapArgs[0];
+    start_byte = trapArgs[1];
+    num_bytes = trapArgs[2];
+  }
+
+  return FilePunchHole(handle, start_byte, num_bytes);
+}
+
+// file_preallocate(uint32 handle, int num_bytes)
+int TrapFilePreallocateHandler(uint32 *trapArgs, int sysMode) {
+  uint32 handle;
+  int num_bytes;
+
+  // If we're not in system mode, we need to copy everything from the
+  // user-space virtual address to the kernel space address
+  if (!sysMode) {
+    // Argument 0: handle to file descriptor
+    MemoryCopyUserToSystem (currentPCB, (trapArgs+0), &handle, sizeof(uint32));
+    // Argument 1: number of bytes to reserve blocks for
+    MemoryCopyUserToSystem (currentPCB, (trapArgs+1), &num_bytes, sizeof(uint32));
+  } else {
+    handle = trapArgs[0];
+    num_bytes = trapArgs[1];
+  }
+
+  return FilePreallocate(handle, num_bytes);
+}
+
+// file_clone(char *src, char *dst)
+int TrapFileCloneHandler(uint32 *trapArgs, int sysMode) {
+  char src[FILE_MAX_FILENAME_LENGTH];
+  char dst[FILE_MAX_FILENAME_LENGTH];
+
+  // Argument 0: path of the existing file, argument 1: path of the copy
+  if ((TrapCopyPathArg(trapArgs+0, src, sysMode) != FILE_SUCCESS) ||
+      (TrapCopyPathArg(trapArgs+1, dst, sysMode) != FILE_SUCCESS)) {
+    printf("TrapFileCloneHandler: length of path longer than allowed!\n");
+    return FILE_FAIL;
+  }
+  return FileClone(src, dst);
+}
+
+// file_stored_bytes(uint32 handle)
+int TrapFileStoredBytesHandler(uint32 *trapArgs, int sysMode) {
+  uint32 handle;
+
+  // If we're not in system mode, we need to copy everything from the
+  // user-space virtual address to the kernel space address
+  if (!sysMode) {
+    // Argument 0: handle to file descriptor
+    MemoryCopyUserToSystem (currentPCB, (trapArgs+0), &handle, sizeof(uint32));
+  } else {
+    handle = trapArgs[0];
+  }
+
+  return FileStoredBytes(handle);
+}
+
+// file_mmap(uint32 handle, int offset, int length)
+int TrapFileMmapHandler(uint32 *trapArgs, int sysMode) {
+  uint32 handle;
+  int offset, length;
+
+  if (!sysMode) {
+    // Argument 0: handle to file descriptor
+    MemoryCopyUserToSystem (currentPCB, (trapArgs+0), &handle, sizeof(uint32));
+    // Argument 1: file offset of the first mapped byte
+    MemoryCopyUserToSystem (currentPCB, (trapArgs+1), &offset, sizeof(uint32));
+    // Argument 2: number of bytes to map
+    MemoryCopyUserToSystem (currentPCB, (trapArgs+2), &length, sizeof(uint32));
+  } else {
+    handle = trapArgs[0];
+    offset = trapArgs[1];
+    length = trapArgs[2];
+  }
+  return FileMmap(handle, offset, length);
+}
+
+// file_munmap(void *addr)
+int TrapFileMunmapHandler(uint32 *trapArgs, int sysMode) {
+  uint32 addr;
+
+  if (!sysMode) {
+    // Argument 0: address file_mmap returned
+    MemoryCopyUserToSystem (currentPCB, (trapArgs+0), &addr, sizeof(uint32));
+  } else {
+    addr = trapArgs[0];
+  }
+  return FileMunmap(addr);
+}
+
+// readdir(char *path, int pos, char *name)
+int TrapFileReaddirHandler(uint32 *trapArgs, int sysMode) {
+  char path[FILE_MAX_FILENAME_LENGTH];
+  char name[FILE_MAX_DIRENT_NAME_LENGTH];
+  char *user_name;
+  int pos;
+  int ret;
+
+  if (TrapCopyPathArg(trapArgs+0, path, sysMode) != FILE_SUCCESS) {
+    printf("TrapFileReaddirHandler: length of path longer than allowed!\n");
+    return FILE_FAIL;
+  }
+  if (!sysMode) {
+    // Argument 1: slot to resume the listing from
+    MemoryCopyUserToSystem (currentPCB, (trapArgs+1), &pos, sizeof(uint32));
+    // Argument 2: userland buffer for the entry name
+    MemoryCopyUserToSystem (currentPCB, (trapArgs+2), &user_name, sizeof(uint32));
+  } else {
+    pos = trapArgs[1];
+    user_name = (char *)(trapArgs[2]);
+  }
+
+  if ((ret = FileReaddir(path, pos, name)) == FILE_FAIL) {
+    return FILE_FAIL;
+  }
+
+  // Copy the entry name out to the user's buffer
+  if (!sysMode) {
+    MemoryCopySystemToUser(currentPCB, name, user_name, dstrlen(name)+1);
+  } else {
+    dstrcpy(user_name, name);
+  }
+  return ret;
+}
+
 
 //----------------------------------------------------------------------
 //
@@ -564,6 +811,28 @@ static int TrapDiskWriteBlockHandler(uint32 *trapArgs, int sysMode) {
   return DiskWriteBlock(blocknum, &b);
 }
 
+//---------------------------------------------------------------------
+//   Disk set stripe handler
+//
+//   handle trap that calls DiskSetStripe()
+//   disk_set_stripe(int ndisks, int stripe)
+//----------------------------------------------------------------------
+static int TrapDiskSetStripeHandler(uint32 *trapArgs, int sysMode) {
+  int ndisks;
+  int stripe;
+
+  if (!sysMode) {
+    // Argument 0: number of member images
+    MemoryCopyUserToSystem (currentPCB, (trapArgs+0), &ndisks, sizeof(uint32));
+    // Argument 1: stripe unit in disk blocks
+    MemoryCopyUserToSystem (currentPCB, (trapArgs+1), &stripe, sizeof(uint32));
+  } else {
+    ndisks = trapArgs[0];
+    stripe = trapArgs[1];
+  }
+  return DiskSetStripe(ndisks, stripe);
+}
+
 //----------------------------------------------------------------------
 //
 //	doInterrupt
@@ -735,6 +1004,9 @@ dointerrupt (unsigned int cause, unsigned int iar, unsigned int isr,
     case TRAP_DISK_BLOCKSIZE:
         ProcessSetResult(currentPCB, DiskBytesPerBlock());
       break;
+    case TRAP_DISK_SET_STRIPE:
+        ProcessSetResult(currentPCB, TrapDiskSetStripeHandler(trapArgs, isr & DLX_STATUS_SYSMODE));
+      break;
     case TRAP_DISK_CREATE:
         ProcessSetResult(currentPCB, DiskCreate());
       break;
@@ -760,9 +1032,59 @@ dointerrupt (unsigned int cause, unsigned int iar, unsigned int isr,
     case TRAP_FILE_WRITE:
         ProcessSetResult(currentPCB, TrapFileWriteHandler(trapArgs, isr & DLX_STATUS_SYSMODE));
       break;
+    case TRAP_FILE_PREAD:
+        ProcessSetResult(currentPCB, TrapFilePositionalHandler(trapArgs, isr & DLX_STATUS_SYSMODE, 0));
+      break;
+    case TRAP_FILE_PWRITE:
+        ProcessSetResult(currentPCB, TrapFilePositionalHandler(trapArgs, isr & DLX_STATUS_SYSMODE, 1));
+      break;
+    case TRAP_FILE_READV:
+        ProcessSetResult(currentPCB, TrapFileVectorHandler(trapArgs, isr & DLX_STATUS_SYSMODE, 0));
+      break;
+    case TRAP_FILE_WRITEV:
+        ProcessSetResult(currentPCB, TrapFileVectorHandler(trapArgs, isr & DLX_STATUS_SYSMODE, 1));
+      break;
+    case TRAP_AIO_SUBMIT:
+        ProcessSetResult(currentPCB, TrapAioSubmitHandler(trapArgs, isr & DLX_STATUS_SYSMODE));
+      break;
+    case TRAP_AIO_STATUS:
+        ProcessSetResult(currentPCB, FileAioStatus(GetIntFromTrapArg(trapArgs, isr & DLX_STATUS_SYSMODE)));
+      break;
     case TRAP_FILE_SEEK:
         ProcessSetResult(currentPCB, TrapFileSeekHandler(trapArgs, isr & DLX_STATUS_SYSMODE));
       break;
+    case TRAP_FILE_MKDIR:
+        ProcessSetResult(currentPCB, TrapFileMkdirHandler(trapArgs, isr & DLX_STATUS_SYSMODE));
+      break;
+    case TRAP_FILE_RMDIR:
+        ProcessSetResult(currentPCB, TrapFileRmdirHandler(trapArgs, isr & DLX_STATUS_SYSMODE));
+      break;
+    case TRAP_FILE_READDIR:
+        ProcessSetResult(currentPCB, TrapFileReaddirHandler(trapArgs, isr & DLX_STATUS_SYSMODE));
+      break;
+    case TRAP_FILE_PUNCH_HOLE:
+        ProcessSetResult(currentPCB, TrapFilePunchHoleHandler(trapArgs, isr & DLX_STATUS_SYSMODE));
+      break;
+    case TRAP_FILE_PREALLOCATE:
+        ProcessSetResult(currentPCB, TrapFilePreallocateHandler(trapArgs, isr & DLX_STATUS_SYSMODE));
+      break;
+    case TRAP_FILE_CLONE:
+        ProcessSetResult(currentPCB, TrapFileCloneHandler(trapArgs, isr & DLX_STATUS_SYSMODE));
+      break;
+    case TRAP_FILE_STORED_BYTES:
+        ProcessSetResult(currentPCB, TrapFileStoredBytesHandler(trapArgs, isr & DLX_STATUS_SYSMODE));
+      break;
+    case TRAP_FILE_MMAP:
+        ProcessSetResult(currentPCB, TrapFileMmapHandler(trapArgs, isr & DLX_STATUS_SYSMODE));
+      break;
+    case TRAP_FILE_MUNMAP:
+        ProcessSetResult(currentPCB, TrapFileMunmapHandler(trapArgs, isr & DLX_STATUS_SYSMODE));
+      break;
+
+    // Clock reading, used by benchmark programs
+    case TRAP_GET_JIFFIES:
+        ProcessSetResult(currentPCB, ClkGetCurJiffies());
+      break;
 
     // Traps for running OS testing code
     case TRAP_TESTOS:
@@ -780,8 +1102,10 @@ dointerrupt (unsigned int cause, unsigned int iar, unsigned int isr,
     case TRAP_TIMER:
       dbprintf ('t', "Got a timer interrupt!\n");
       // ClkInterrupt returns 1 when 1 "process quantum" has passed, meaning
-      // that it's time to call ProcessSchedule again.
+      // that it's time to call ProcessSchedule again.  Page replacement
+      // gets its turn first.
       if (ClkInterrupt()) {
+        MemoryPageout ();
         ProcessSchedule ();
       }
       break;
@@ -809,9 +1133,22 @@ dointerrupt (unsigned int cause, unsigned int iar, unsigned int isr,
       GracefulExit ();
       break;
     case TRAP_PAGEFAULT:
-      printf ("Exiting after page fault at iar=0x%x, isr=0x%x\n",
-	      iar, isr);
-      GracefulExit ();
+      if (isr & DLX_STATUS_SYSMODE) {
+	printf ("Exiting after page fault at iar=0x%x, isr=0x%x\n",
+		iar, isr);
+	GracefulExit ();
+      }
+      // User pages of mapped files are filled on first touch, and the
+      // faulting instruction runs again on return
+      if (MemoryPageFaultHandler (currentPCB) == MEM_SUCCESS) {
+	break;
+      }
+      printf ("Killing PID %d after page fault at 0x%x (iar=0x%x)\n",
+	      GetCurrentPid(), currentPCB->currentSavedFrame[PROCESS_STACK_FAULT],
+	      iar);
+      ProcessDestroy (currentPCB);
+      ProcessSchedule ();
+      ClkResetProcess();
       break;
     default:
       printf ("Got an unrecognized system interrupt (0x%x) - exiting!\n",
@@ -266,6 +266,14 @@ _disk_blocksize:
 	nop
 .endproc _disk_blocksize
 
+.proc _disk_set_stripe
+.global _disk_set_stripe
+_disk_set_stripe:
+	trap	#0x46A
+	jr	r31
+	nop
+.endproc _disk_set_stripe
+
 .proc _disk_create
 .global _disk_create
 _disk_create:
@@ -330,6 +338,134 @@ _file_seek:
 	nop
 .endproc _file_seek
 
+.proc _mkdir
+.global _mkdir
+_mkdir:
+	trap	#0x478
+	jr	r31
+	nop
+.endproc _mkdir
+
+.proc _rmdir
+.global _rmdir
+_rmdir:
+	trap	#0x479
+	jr	r31
+	nop
+.endproc _rmdir
+
+.proc _readdir
+.global _readdir
+_readdir:
+	trap	#0x47A
+	jr	r31
+	nop
+.endproc _readdir
+
+.proc _file_punch_hole
+.global _file_punch_hole
+_file_punch_hole:
+	trap	#0x47B
+	jr	r31
+	nop
+.endproc _file_punch_hole
+
+.proc _file_preallocate
+.global _file_preallocate
+_file_preallocate:
+	trap	#0x47C
+	jr	r31
+	nop
+.endproc _file_preallocate
+
+.proc _file_clone
+.global _file_clone
+_file_clone:
+	trap	#0x47D
+	jr	r31
+	nop
+.endproc _file_clone
+
+.proc _file_stored_bytes
+.global _file_stored_bytes
+_file_stored_bytes:
+	trap	#0x47E
+	jr	r31
+	nop
+.endproc _file_stored_bytes
+
+.proc _file_mmap
+.global _file_mmap
+_file_mmap:
+	trap	#0x47F
+	jr	r31
+	nop
+.endproc _file_mmap
+
+.proc _file_munmap
+.global _file_munmap
+_file_munmap:
+	trap	#0x480
+	jr	r31
+	nop
+.endproc _file_munmap
+
+.proc _file_pread
+.global _file_pread
+_file_pread:
+	trap	#0x481
+	jr	r31
+	nop
+.endproc _file_pread
+
+.proc _file_pwrite
+.global _file_pwrite
+_file_pwrite:
+	trap	#0x482
+	jr	r31
+	nop
+.endproc _file_pwrite
+
+.proc _file_readv
+.global _file_readv
+_file_readv:
+	trap	#0x483
+	jr	r31
+	nop
+.endproc _file_readv
+
+.proc _file_writev
+.global _file_writev
+_file_writev:
+	trap	#0x484
+	jr	r31
+	nop
+.endproc _file_writev
+
+.proc _aio_submit
+.global _aio_submit
+_aio_submit:
+	trap	#0x485
+	jr	r31
+	nop
+.endproc _aio_submit
+
+.proc _aio_status
+.global _aio_status
+_aio_status:
+	trap	#0x486
+	jr	r31
+	nop
+.endproc _aio_status
+
+.proc _get_jiffies
+.global _get_jiffies
+_get_jiffies:
+	trap	#0x4FE
+	jr	r31
+	nop
+.endproc _get_jiffies
+
 .proc _run_os_tests
 .global _run_os_tests
 _run_os_tests:
@@ -0,0 +1,932 @@
+//----------------------------------------------------------------------------
+// dfstool.cc
+//
+// Host side tool for DFS disk images. It formats images (the same layout
+// fdisk writes, but as sparse files so it takes no time), copies host files
+// and directories into the file system and back out, and dumps or checks
+// the metadata. It works directly on the image files, so don't run it while
+// the simulator has the disk open.
+//
+// The simulator keeps DLX memory big-endian and the disk driver copies it
+// to the image verbatim, so every int and short in the on-disk structures
+// is big-endian. Only the layout comes from dfs_shared.h, never the host's
+// in-memory representation of it.
+//----------------------------------------------------------------------------
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdarg.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <dirent.h>
+#include <sys/stat.h>
+#include <arpa/inet.h>
+
+#include <algorithm>
+#include <string>
+#include <vector>
+
+typedef unsigned int uint32;
+
+#include "dfs_shared.h"
+#include "os/disk.h"
+
+extern "C" {
+#include "os/lz.h"
+}
+
+#define DFSTOOL_NUM_INODES 128      // same as fdisk
+#define DFSTOOL_STRIPE_BLOCKS 4     // default stripe unit, in DFS blocks
+#define DFSTOOL_INODE_BYTES 128     // on-disk size of a dfs_inode
+#define DFSTOOL_INODE_TAIL 16       // offset of idata, the raw part
+
+//----------------------------------------------------------------------------
+// Big-endian accessors for on-disk fields
+//----------------------------------------------------------------------------
+
+static int GetBE32(const char *p) {
+  uint32 v;
+  memcpy(&v, p, 4);
+  return (int)ntohl(v);
+}
+
+static void PutBE32(char *p, int v) {
+  uint32 n = htonl((uint32)v);
+  memcpy(p, &n, 4);
+}
+
+static short GetBE16(const char *p) {
+  unsigned short v;
+  memcpy(&v, p, 2);
+  return (short)ntohs(v);
+}
+
+static void PutBE16(char *p, short v) {
+  unsigned short n = htons((unsigned short)v);
+  memcpy(p, &n, 2);
+}
+
+// Same djb2 hash as DfsNameHash, names must land in the same bucket.
+static uint32 DfsToolNameHash(const char *name) {
+  uint32 h = 5381;
+  while (*name != '\0') h = ((h << 5) + h) + (uint32)(*name++);
+  return h;
+}
+
+//----------------------------------------------------------------------------
+// An inode, with the header fields in host order. The rest of it (inline
+// data or the block pointers) is kept as raw disk bytes, so inline data
+// survives untouched and the pointers are read through GetBE32.
+//----------------------------------------------------------------------------
+
+struct DfsToolInode {
+  int inuse;
+  int fsize;
+  short type;
+  short flags;
+  int parent;
+  char tail[DFS_INODE_INLINE_MAX];
+
+  int Block(int i) const { return GetBE32(tail + DFS_INODE_IDATA_LENGTH + 4*i); }
+  void SetBlock(int i, int b) { PutBE32(tail + DFS_INODE_IDATA_LENGTH + 4*i, b); }
+  int Indirect() const { return Block(DFS_INODE_BTABLE_SIZE); }
+  void SetIndirect(int b) { SetBlock(DFS_INODE_BTABLE_SIZE, b); }
+  void ClearBlocks() {
+    memset(tail, 0, DFS_INODE_IDATA_LENGTH);
+    for (int i = 0; i < DFS_INODE_BTABLE_SIZE + 2; i++) SetBlock(i, -1);
+  }
+};
+
+//----------------------------------------------------------------------------
+// An open (possibly striped) DFS image
+//----------------------------------------------------------------------------
+
+class DfsImage {
+public:
+  dfs_superblock sb;                  // host order
+  std::vector<DfsToolInode> inodes;
+  std::vector<unsigned char> fbv;     // raw, bit 0x80 of byte 0 is block 0
+  std::vector<unsigned char> refcounts;
+  std::vector<unsigned char> csectors;
+
+  DfsImage(const std::vector<std::string> &names) : filenames(names) {}
+  ~DfsImage();
+
+  int Format(int bsize, int ndisks, int stripe_blocks);
+  int Open();
+  int Flush();
+
+  int ReadBlock(int blocknum, char *data);
+  int WriteBlock(int blocknum, const char *data);
+  int ReadDataBlock(int blocknum, char *data);
+
+  bool BlockUsed(int b) const { return (fbv[b >> 3] & (0x80 >> (b & 7))) != 0; }
+  void SetBlockUsed(int b, bool used) {
+    if (used) fbv[b >> 3] |= (0x80 >> (b & 7));
+    else fbv[b >> 3] &= ~(0x80 >> (b & 7));
+  }
+  int AllocateRun(int n);
+  int MaxVBlocks() const { return DFS_INODE_BTABLE_SIZE + sb.bsize / 4; }
+  int DirentsPerBlock() const { return sb.bsize / sizeof(dfs_dirent); }
+
+  int VirtualBlock(int handle, int vblock);
+  int DirLookup(int dir, const char *name);
+  int DirAddEntry(int dir, const char *name, int inode);
+  int WalkPath(const char *path, std::string &name);
+  int Lookup(const char *path);
+  int AllocateInode(int dir, const char *name, int type);
+
+private:
+  std::vector<std::string> filenames;
+  std::vector<int> fds;
+  int ndisks = 1;
+  int stripe = DISK_MIN_STRIPE;
+
+  int DiskNumBlocks() const;
+  int DiskIO(int blocknum, char *data, bool write);
+  int Region(int start, int end, char *bytes, int len, bool write);
+};
+
+DfsImage::~DfsImage() {
+  for (size_t i = 0; i < fds.size(); i++) close(fds[i]);
+}
+
+// Same as DiskNumBlocks in os/disk.c: whole stripe rows only.
+int DfsImage::DiskNumBlocks() const {
+  if (ndisks == 1) return DISK_NUMBLOCKS;
+  return (DISK_NUMBLOCKS / stripe) * stripe * ndisks;
+}
+
+// Reads or writes one 512 byte disk block, mapped like DiskMapBlock.
+int DfsImage::DiskIO(int blocknum, char *data, bool write) {
+  int stripenum = blocknum / stripe;
+  int member = stripenum % ndisks;
+  off_t off = ((off_t)(stripenum / ndisks) * stripe + blocknum % stripe) * DISK_BLOCKSIZE;
+  ssize_t n;
+
+  if (blocknum < 0 || blocknum >= DiskNumBlocks()) return DFS_FAIL;
+  if (write) n = pwrite(fds[member], data, DISK_BLOCKSIZE, off);
+  else n = pread(fds[member], data, DISK_BLOCKSIZE, off);
+  return (n == DISK_BLOCKSIZE) ? DFS_SUCCESS : DFS_FAIL;
+}
+
+int DfsImage::ReadBlock(int blocknum, char *data) {
+  int ratio = sb.bsize / DISK_BLOCKSIZE;
+  for (int i = 0; i < ratio; i++) {
+    if (DiskIO(blocknum*ratio + i, data + i*DISK_BLOCKSIZE, false) != DFS_SUCCESS) return DFS_FAIL;
+  }
+  return DFS_SUCCESS;
+}
+
+int DfsImage::WriteBlock(int blocknum, const char *data) {
+  int ratio = sb.bsize / DISK_BLOCKSIZE;
+  for (int i = 0; i < ratio; i++) {
+    if (DiskIO(blocknum*ratio + i, (char *)data + i*DISK_BLOCKSIZE, true) != DFS_SUCCESS) return DFS_FAIL;
+  }
+  return DFS_SUCCESS;
+}
+
+// Reads a file data block, expanding it if it was stored compressed
+// (a 4 byte length and the LZ payload, see DfsWriteBlockCompressed).
+int DfsImage::ReadDataBlock(int blocknum, char *data) {
+  char packed[DFS_MAX_BLOCKSIZE];
+  int clen;
+
+  if (csectors[blocknum] == 0) return ReadBlock(blocknum, data);
+  if (csectors[blocknum] > sb.bsize / DISK_BLOCKSIZE) return DFS_FAIL;
+  for (int i = 0; i < csectors[blocknum]; i++) {
+    if (DiskIO(blocknum*(sb.bsize/DISK_BLOCKSIZE) + i, packed + i*DISK_BLOCKSIZE, false) != DFS_SUCCESS) return DFS_FAIL;
+  }
+  clen = GetBE32(packed);
+  if (clen < 0 || clen > csectors[blocknum]*DISK_BLOCKSIZE - 4) return DFS_FAIL;
+  if (LzDecompress(packed + 4, clen, data, sb.bsize) != sb.bsize) return DFS_FAIL;
+  return DFS_SUCCESS;
+}
+
+// Reads or writes len bytes of a metadata region spanning DFS blocks
+// start..end-1, zero filling whatever is left over in the last block.
+int DfsImage::Region(int start, int end, char *bytes, int len, bool write) {
+  char block[DFS_MAX_BLOCKSIZE];
+  int off = 0, n;
+
+  for (int b = start; b < end; b++, off += sb.bsize) {
+    n = len - off;
+    if (n > sb.bsize) n = sb.bsize;
+    if (n < 0) n = 0;
+    if (write) {
+      memset(block, 0, sb.bsize);
+      memcpy(block, bytes + off, n);
+      if (WriteBlock(b, block) != DFS_SUCCESS) return DFS_FAIL;
+    } else {
+      if (ReadBlock(b, block) != DFS_SUCCESS) return DFS_FAIL;
+      memcpy(bytes + off, block, n);
+    }
+  }
+  return DFS_SUCCESS;
+}
+
+//----------------------------------------------------------------------------
+// Format lays the file system out exactly like fdisk does, on freshly
+// truncated (so sparse, all zero) image files. The share count and
+// compressed size regions are already zero and are not written at all.
+//----------------------------------------------------------------------------
+
+int DfsImage::Format(int bsize, int members, int stripe_blocks) {
+  int fd, nwords;
+
+  if (bsize != 1024 && bsize != 2048 && bsize != 4096) {
+    fprintf(stderr, "dfstool: block size must be 1024, 2048 or 4096, not %d\n", bsize);
+    return DFS_FAIL;
+  }
+  if (members < 1 || members > DISK_MAX_MEMBERS || members > (int)filenames.size() || stripe_blocks < 1) {
+    fprintf(stderr, "dfstool: can't stripe over %d disks\n", members);
+    return DFS_FAIL;
+  }
+  ndisks = members;
+  stripe = stripe_blocks * (bsize / DISK_BLOCKSIZE);
+  for (int m = 0; m < ndisks; m++) {
+    if ((fd = open(filenames[m].c_str(), O_RDWR | O_CREAT | O_TRUNC, 0644)) < 0 ||
+        ftruncate(fd, (off_t)DISK_NUMBLOCKS * DISK_BLOCKSIZE) < 0) {
+      fprintf(stderr, "dfstool: %s: %s\n", filenames[m].c_str(), strerror(errno));
+      if (fd >= 0) close(fd);
+      return DFS_FAIL;
+    }
+    fds.push_back(fd);
+  }
+
+  memset(&sb, 0, sizeof(sb));
+  sb.bsize = bsize;
+  sb.ndisks = ndisks;
+  sb.stripe = stripe;
+  sb.nblocks = (int)(((long long)DiskNumBlocks() * DISK_BLOCKSIZE) / bsize);
+  if (sb.nblocks > DFS_MAX_NUM_BLOCKS) sb.nblocks = DFS_MAX_NUM_BLOCKS;
+  sb.ninodes = DFSTOOL_NUM_INODES;
+  sb.inodeBstart = 1;
+  sb.fbvBstart = sb.inodeBstart + DFSTOOL_NUM_INODES * DFSTOOL_INODE_BYTES / bsize;
+  nwords = (sb.nblocks + 31) / 32;
+  sb.refBstart = sb.fbvBstart + (nwords*4 + bsize - 1) / bsize;
+  sb.compBstart = sb.refBstart + (sb.nblocks + bsize - 1) / bsize;
+  sb.dataBstart = sb.compBstart + (sb.nblocks + bsize - 1) / bsize;
+
+  inodes.assign(sb.ninodes, DfsToolInode());
+  for (int i = 0; i < sb.ninodes; i++) {
+    inodes[i].inuse = 0;
+    inodes[i].fsize = 0;
+    inodes[i].type = DFS_INODE_TYPE_FILE;
+    inodes[i].flags = 0;
+    inodes[i].parent = DFS_ROOT_INODE;
+    inodes[i].ClearBlocks();
+  }
+  inodes[DFS_ROOT_INODE].inuse = 1;
+  inodes[DFS_ROOT_INODE].type = DFS_INODE_TYPE_DIR;
+
+  fbv.assign(nwords * 4, 0);
+  for (int b = 0; b < sb.dataBstart; b++) SetBlockUsed(b, true);
+  for (int b = sb.nblocks; b < nwords * 32; b++) SetBlockUsed(b, true);
+  refcounts.assign(sb.nblocks, 0);
+  csectors.assign(sb.nblocks, 0);
+  return DFS_SUCCESS;
+}
+
+//----------------------------------------------------------------------------
+// Open reads the superblock from disk block 1 (always on the first image,
+// the stripe unit is at least 2 blocks), then the striping parameters tell
+// it which other images to open before it loads the rest of the metadata.
+//----------------------------------------------------------------------------
+
+int DfsImage::Open() {
+  char block[DISK_BLOCKSIZE];
+  int fd, *field[] = { &sb.valid, &sb.bsize, &sb.nblocks, &sb.ninodes, &sb.inodeBstart,
+                       &sb.fbvBstart, &sb.refBstart, &sb.compBstart, &sb.dataBstart,
+                       &sb.ndisks, &sb.stripe };
+  std::vector<char> raw;
+
+  if ((fd = open(filenames[0].c_str(), O_RDWR)) < 0) {
+    fprintf(stderr, "dfstool: %s: %s\n", filenames[0].c_str(), strerror(errno));
+    return DFS_FAIL;
+  }
+  fds.push_back(fd);
+  if (DiskIO(1, block, false) != DFS_SUCCESS) return DFS_FAIL;
+  for (int i = 0; i < 11; i++) *field[i] = GetBE32(block + 4*i);
+  if (sb.valid != 1 || (sb.bsize != 1024 && sb.bsize != 2048 && sb.bsize != 4096) ||
+      sb.nblocks <= 0 || sb.nblocks > DFS_MAX_NUM_BLOCKS || sb.ninodes != DFSTOOL_NUM_INODES ||
+      sb.ndisks < 1 || sb.ndisks > DISK_MAX_MEMBERS || sb.stripe < DISK_MIN_STRIPE) {
+    fprintf(stderr, "dfstool: %s doesn't hold a valid DFS file system\n", filenames[0].c_str());
+    return DFS_FAIL;
+  }
+  if (sb.ndisks > (int)filenames.size()) {
+    fprintf(stderr, "dfstool: file system is striped over %d images, only %d given\n",
+            sb.ndisks, (int)filenames.size());
+    return DFS_FAIL;
+  }
+  for (int m = 1; m < sb.ndisks; m++) {
+    if ((fd = open(filenames[m].c_str(), O_RDWR)) < 0) {
+      fprintf(stderr, "dfstool: %s: %s\n", filenames[m].c_str(), strerror(errno));
+      return DFS_FAIL;
+    }
+    fds.push_back(fd);
+  }
+  ndisks = sb.ndisks;
+  stripe = sb.stripe;
+
+  raw.assign(sb.ninodes * DFSTOOL_INODE_BYTES, 0);
+  if (Region(sb.inodeBstart, sb.fbvBstart, &raw[0], raw.size(), false) != DFS_SUCCESS) return DFS_FAIL;
+  inodes.assign(sb.ninodes, DfsToolInode());
+  for (int i = 0; i < sb.ninodes; i++) {
+    char *p = &raw[i * DFSTOOL_INODE_BYTES];
+    inodes[i].inuse = GetBE32(p);
+    inodes[i].fsize = GetBE32(p + 4);
+    inodes[i].type = GetBE16(p + 8);
+    inodes[i].flags = GetBE16(p + 10);
+    inodes[i].parent = GetBE32(p + 12);
+    memcpy(inodes[i].tail, p + DFSTOOL_INODE_TAIL, DFS_INODE_INLINE_MAX);
+  }
+  fbv.assign((sb.nblocks + 31) / 32 * 4, 0);
+  refcounts.assign(sb.nblocks, 0);
+  csectors.assign(sb.nblocks, 0);
+  if (Region(sb.fbvBstart, sb.refBstart, (char *)&fbv[0], fbv.size(), false) != DFS_SUCCESS ||
+      Region(sb.refBstart, sb.compBstart, (char *)&refcounts[0], sb.nblocks, false) != DFS_SUCCESS ||
+      Region(sb.compBstart, sb.dataBstart, (char *)&csectors[0], sb.nblocks, false) != DFS_SUCCESS) {
+    return DFS_FAIL;
+  }
+  return DFS_SUCCESS;
+}
+
+// Flush writes all the metadata back, superblock last (and valid).
+int DfsImage::Flush() {
+  char block[DISK_BLOCKSIZE];
+  int *field[] = { &sb.valid, &sb.bsize, &sb.nblocks, &sb.ninodes, &sb.inodeBstart,
+                   &sb.fbvBstart, &sb.refBstart, &sb.compBstart, &sb.dataBstart,
+                   &sb.ndisks, &sb.stripe };
+  std::vector<char> raw(sb.ninodes * DFSTOOL_INODE_BYTES, 0);
+
+  for (int i = 0; i < sb.ninodes; i++) {
+    char *p = &raw[i * DFSTOOL_INODE_BYTES];
+    PutBE32(p, inodes[i].inuse);
+    PutBE32(p + 4, inodes[i].fsize);
+    PutBE16(p + 8, inodes[i].type);
+    PutBE16(p + 10, inodes[i].flags);
+    PutBE32(p + 12, inodes[i].parent);
+    memcpy(p + DFSTOOL_INODE_TAIL, inodes[i].tail, DFS_INODE_INLINE_MAX);
+  }
+  if (Region(sb.inodeBstart, sb.fbvBstart, &raw[0], raw.size(), true) != DFS_SUCCESS ||
+      Region(sb.fbvBstart, sb.refBstart, (char *)&fbv[0], fbv.size(), true) != DFS_SUCCESS) {
+    return DFS_FAIL;
+  }
+  // A fresh image already has zeros here, leave it sparse
+  for (int b = 0; b < sb.nblocks; b++) {
+    if (refcounts[b] == 0 && csectors[b] == 0) continue;
+    if (Region(sb.refBstart, sb.compBstart, (char *)&refcounts[0], sb.nblocks, true) != DFS_SUCCESS ||
+        Region(sb.compBstart, sb.dataBstart, (char *)&csectors[0], sb.nblocks, true) != DFS_SUCCESS) {
+      return DFS_FAIL;
+    }
+    break;
+  }
+  sb.valid = 1;
+  memset(block, 0, sizeof(block));
+  for (int i = 0; i < 11; i++) PutBE32(block + 4*i, *field[i]);
+  return DiskIO(1, block, true);
+}
+
+// AllocateRun finds the first run of n free data blocks, marks it used
+// and returns its first block, or DFS_FAIL if there is no such run.
+int DfsImage::AllocateRun(int n) {
+  int start = sb.dataBstart, len = 0;
+
+  for (int b = sb.dataBstart; b < sb.nblocks; b++) {
+    if (BlockUsed(b)) {  len = 0; start = b + 1; continue;  }
+    if (++len < n) continue;
+    for (int i = start; i < start + n; i++) SetBlockUsed(i, true);
+    return start;
+  }
+  return DFS_FAIL;
+}
+
+// Returns the DFS block holding virtual block vblock of the inode, -1 for
+// a hole, or DFS_FAIL.
+int DfsImage::VirtualBlock(int handle, int vblock) {
+  char block[DFS_MAX_BLOCKSIZE];
+
+  if (vblock < DFS_INODE_BTABLE_SIZE) return inodes[handle].Block(vblock);
+  if (vblock >= MaxVBlocks() || inodes[handle].Indirect() == -1) return -1;
+  if (ReadBlock(inodes[handle].Indirect(), block) != DFS_SUCCESS) return DFS_FAIL;
+  return GetBE32(block + 4 * (vblock - DFS_INODE_BTABLE_SIZE));
+}
+
+//----------------------------------------------------------------------------
+// Directories: the probing here must stay in step with DfsDirLookup and
+// DfsDirAddEntry in os/dfs.c.
+//----------------------------------------------------------------------------
+
+int DfsImage::DirLookup(int dir, const char *name) {
+  char block[DFS_MAX_BLOCKSIZE];
+  int bucket = DfsToolNameHash(name) % DFS_DIR_NUM_BUCKETS, more, ino;
+
+  if (inodes[dir].inuse != 1 || inodes[dir].type != DFS_INODE_TYPE_DIR) return DFS_FAIL;
+  for (int k = 0; k < DFS_DIR_NUM_BUCKETS; k++) {
+    if (inodes[dir].Block(bucket) == -1) return DFS_FAIL;
+    if (ReadBlock(inodes[dir].Block(bucket), block) != DFS_SUCCESS) return DFS_FAIL;
+    more = 1;
+    for (int i = 0; i < DirentsPerBlock(); i++) {
+      dfs_dirent *e = (dfs_dirent *)(block + i * sizeof(dfs_dirent));
+      ino = GetBE32((char *)&e->inode);
+      if (ino == DFS_DIRENT_FREE) {  more = 0; continue;  }
+      if (ino == DFS_DIRENT_DELETED) continue;
+      if (strncmp(e->name, name, DFS_DIRENT_NAME_LENGTH) == 0) return ino;
+    }
+    if (!more) return DFS_FAIL;
+    bucket = (bucket + 1) % DFS_DIR_NUM_BUCKETS;
+  }
+  return DFS_FAIL;
+}
+
+int DfsImage::DirAddEntry(int dir, const char *name, int inode) {
+  char block[DFS_MAX_BLOCKSIZE];
+  int bucket = DfsToolNameHash(name) % DFS_DIR_NUM_BUCKETS, blocknum, ino;
+
+  if (strlen(name) >= DFS_DIRENT_NAME_LENGTH) return DFS_FAIL;
+  for (int k = 0; k < DFS_DIR_NUM_BUCKETS; k++) {
+    if ((blocknum = inodes[dir].Block(bucket)) == -1) {
+      if ((blocknum = AllocateRun(1)) == DFS_FAIL) return DFS_FAIL;
+      inodes[dir].SetBlock(bucket, blocknum);
+      memset(block, 0, sb.bsize);
+      for (int i = 0; i < DirentsPerBlock(); i++) PutBE32(block + i * sizeof(dfs_dirent), DFS_DIRENT_FREE);
+    } else if (ReadBlock(blocknum, block) != DFS_SUCCESS) {
+      return DFS_FAIL;
+    }
+    for (int i = 0; i < DirentsPerBlock(); i++) {
+      dfs_dirent *e = (dfs_dirent *)(block + i * sizeof(dfs_dirent));
+      ino = GetBE32((char *)&e->inode);
+      if (ino != DFS_DIRENT_FREE && ino != DFS_DIRENT_DELETED) continue;
+      PutBE32((char *)&e->inode, inode);
+      memset(e->name, 0, DFS_DIRENT_NAME_LENGTH);
+      strcpy(e->name, name);
+      if (WriteBlock(blocknum, block) != DFS_SUCCESS) return DFS_FAIL;
+      inodes[dir].fsize += 1;
+      return DFS_SUCCESS;
+    }
+    bucket = (bucket + 1) % DFS_DIR_NUM_BUCKETS;
+  }
+  return DFS_FAIL;
+}
+
+// Same rules as DfsInodeWalkPath: returns the directory that holds the
+// last component, which is left in name (empty for the root).
+int DfsImage::WalkPath(const char *path, std::string &name) {
+  int dir = DFS_ROOT_INODE, next;
+  const char *end;
+
+  name.clear();
+  while (1) {
+    while (*path == '/') path++;
+    if (*path == '\0') return dir;
+    for (end = path; *end != '/' && *end != '\0'; end++);
+    if (end - path >= DFS_DIRENT_NAME_LENGTH) return DFS_FAIL;
+    name.assign(path, end - path);
+    path = end;
+    while (*path == '/') path++;
+    if (*path == '\0') {
+      if (name == ".") {  name.clear(); return dir;  }
+      if (name == "..") {  name.clear(); return inodes[dir].parent;  }
+      return dir;
+    }
+    if (name == ".") continue;
+    if (name == "..") {  dir = inodes[dir].parent; continue;  }
+    if ((next = DirLookup(dir, name.c_str())) == DFS_FAIL) return DFS_FAIL;
+    if (inodes[next].type != DFS_INODE_TYPE_DIR) return DFS_FAIL;
+    dir = next;
+  }
+}
+
+int DfsImage::Lookup(const char *path) {
+  std::string name;
+  int dir = WalkPath(path, name);
+
+  if (dir == DFS_FAIL) return DFS_FAIL;
+  if (name.empty()) return dir;
+  return DirLookup(dir, name.c_str());
+}
+
+// Like DfsInodeAllocate, files start out empty and inline.
+int DfsImage::AllocateInode(int dir, const char *name, int type) {
+  int i;
+
+  for (i = 0; i < sb.ninodes; i++) if (inodes[i].inuse != 1) break;
+  if (i == sb.ninodes) return DFS_FAIL;
+  inodes[i].inuse = 1;
+  inodes[i].fsize = 0;
+  inodes[i].type = type;
+  inodes[i].parent = dir;
+  inodes[i].ClearBlocks();
+  inodes[i].flags = 0;
+  if (type == DFS_INODE_TYPE_FILE) {
+    inodes[i].flags = DFS_INODE_FLAG_INLINE;
+    memset(inodes[i].tail, 0, DFS_INODE_INLINE_MAX);
+  }
+  if (DirAddEntry(dir, name, i) != DFS_SUCCESS) {  inodes[i].inuse = 0; return DFS_FAIL;  }
+  return i;
+}
+
+//----------------------------------------------------------------------------
+// import: copies a host file or directory tree into the file system. Each
+// file's data blocks are allocated as one contiguous run.
+//----------------------------------------------------------------------------
+
+static int ImportFile(DfsImage &fs, const char *host, int dir, const char *name) {
+  std::vector<char> data;
+  char buf[65536], block[DFS_MAX_BLOCKSIZE];
+  int fd, handle, nblocks, run, ind = -1;
+  ssize_t n;
+
+  if ((fd = open(host, O_RDONLY)) < 0) {
+    fprintf(stderr, "dfstool: %s: %s\n", host, strerror(errno));
+    return DFS_FAIL;
+  }
+  while ((n = read(fd, buf, sizeof(buf))) > 0) data.insert(data.end(), buf, buf + n);
+  close(fd);
+  nblocks = (data.size() + fs.sb.bsize - 1) / fs.sb.bsize;
+  if (nblocks > fs.MaxVBlocks()) {
+    fprintf(stderr, "dfstool: %s is too big for a DFS file (%d blocks max)\n", host, fs.MaxVBlocks());
+    return DFS_FAIL;
+  }
+  if (fs.DirLookup(dir, name) != DFS_FAIL) {
+    fprintf(stderr, "dfstool: %s already exists in the image\n", name);
+    return DFS_FAIL;
+  }
+  if ((handle = fs.AllocateInode(dir, name, DFS_INODE_TYPE_FILE)) == DFS_FAIL) {
+    fprintf(stderr, "dfstool: no free inode or directory slot for %s\n", name);
+    return DFS_FAIL;
+  }
+  fs.inodes[handle].fsize = data.size();
+  if (data.size() <= DFS_INODE_INLINE_MAX) {
+    if (data.size() > 0) memcpy(fs.inodes[handle].tail, &data[0], data.size());
+    return DFS_SUCCESS;
+  }
+
+  // Too big to be inline, give it one run of blocks (and an indirect table)
+  fs.inodes[handle].flags = 0;
+  fs.inodes[handle].ClearBlocks();
+  if ((run = fs.AllocateRun(nblocks)) == DFS_FAIL ||
+      (nblocks > DFS_INODE_BTABLE_SIZE && (ind = fs.AllocateRun(1)) == DFS_FAIL)) {
+    fprintf(stderr, "dfstool: no room for %d contiguous blocks for %s\n", nblocks, host);
+    return DFS_FAIL;
+  }
+  for (int v = 0; v < nblocks; v++) {
+    memset(block, 0, fs.sb.bsize);
+    memcpy(block, &data[v * fs.sb.bsize], std::min((size_t)fs.sb.bsize, data.size() - v * fs.sb.bsize));
+    if (fs.WriteBlock(run + v, block) != DFS_SUCCESS) return DFS_FAIL;
+    if (v < DFS_INODE_BTABLE_SIZE) fs.inodes[handle].SetBlock(v, run + v);
+  }
+  if (ind != -1) {
+    fs.inodes[handle].SetIndirect(ind);
+    for (int i = 0; i < fs.sb.bsize / 4; i++) {
+      int v = DFS_INODE_BTABLE_SIZE + i;
+      PutBE32(block + 4*i, (v < nblocks) ? run + v : -1);
+    }
+    if (fs.WriteBlock(ind, block) != DFS_SUCCESS) return DFS_FAIL;
+  }
+  return DFS_SUCCESS;
+}
+
+static int ImportPath(DfsImage &fs, const std::string &host, int dir, const char *name) {
+  struct stat st;
+  DIR *d;
+  struct dirent *ent;
+  int sub, result = DFS_SUCCESS;
+
+  if (stat(host.c_str(), &st) < 0) {
+    fprintf(stderr, "dfstool: %s: %s\n", host.c_str(), strerror(errno));
+    return DFS_FAIL;
+  }
+  if (S_ISREG(st.st_mode)) return ImportFile(fs, host.c_str(), dir, name);
+  if (!S_ISDIR(st.st_mode)) {
+    fprintf(stderr, "dfstool: skipping %s, not a file or directory\n", host.c_str());
+    return DFS_SUCCESS;
+  }
+
+  // Merge into a directory that's already there
+  if (name[0] == '\0') sub = dir;
+  else if ((sub = fs.DirLookup(dir, name)) == DFS_FAIL) {
+    if ((sub = fs.AllocateInode(dir, name, DFS_INODE_TYPE_DIR)) == DFS_FAIL) {
+      fprintf(stderr, "dfstool: can't create directory %s\n", name);
+      return DFS_FAIL;
+    }
+  } else if (fs.inodes[sub].type != DFS_INODE_TYPE_DIR) {
+    fprintf(stderr, "dfstool: %s exists and isn't a directory\n", name);
+    return DFS_FAIL;
+  }
+  if ((d = opendir(host.c_str())) == NULL) {
+    fprintf(stderr, "dfstool: %s: %s\n", host.c_str(), strerror(errno));
+    return DFS_FAIL;
+  }
+  while ((ent = readdir(d)) != NULL) {
+    if (strcmp(ent->d_name, ".") == 0 || strcmp(ent->d_name, "..") == 0) continue;
+    if (ImportPath(fs, host + "/" + ent->d_name, sub, ent->d_name) != DFS_SUCCESS) {
+      result = DFS_FAIL;
+      break;
+    }
+  }
+  closedir(d);
+  return result;
+}
+
+//----------------------------------------------------------------------------
+// export: copies a file or directory tree out of the file system
+//----------------------------------------------------------------------------
+
+static int ExportPath(DfsImage &fs, int handle, const std::string &host);
+
+static int ForEachEntry(DfsImage &fs, int dir, int (*fn)(DfsImage &, int, int, const char *, void *), void *arg) {
+  char block[DFS_MAX_BLOCKSIZE];
+  int ino;
+
+  for (int bucket = 0; bucket < DFS_DIR_NUM_BUCKETS; bucket++) {
+    if (fs.inodes[dir].Block(bucket) == -1) continue;
+    if (fs.ReadBlock(fs.inodes[dir].Block(bucket), block) != DFS_SUCCESS) return DFS_FAIL;
+    for (int i = 0; i < fs.DirentsPerBlock(); i++) {
+      dfs_dirent *e = (dfs_dirent *)(block + i * sizeof(dfs_dirent));
+      char name[DFS_DIRENT_NAME_LENGTH];
+      ino = GetBE32((char *)&e->inode);
+      if (ino == DFS_DIRENT_FREE || ino == DFS_DIRENT_DELETED) continue;
+      memcpy(name, e->name, DFS_DIRENT_NAME_LENGTH);
+      name[DFS_DIRENT_NAME_LENGTH-1] = '\0';
+      if (fn(fs, dir, ino, name, arg) != DFS_SUCCESS) return DFS_FAIL;
+    }
+  }
+  return DFS_SUCCESS;
+}
+
+static int ExportEntry(DfsImage &fs, int dir, int ino, const char *name, void *arg) {
+  const std::string &host = *(const std::string *)arg;
+  return ExportPath(fs, ino, host + "/" + name);
+}
+
+static int ExportPath(DfsImage &fs, int handle, const std::string &host) {
+  DfsToolInode &ip = fs.inodes[handle];
+  char block[DFS_MAX_BLOCKSIZE];
+  int fd, b, n, result = DFS_SUCCESS;
+
+  if (ip.type == DFS_INODE_TYPE_DIR) {
+    if (mkdir(host.c_str(), 0755) < 0 && errno != EEXIST) {
+      fprintf(stderr, "dfstool: %s: %s\n", host.c_str(), strerror(errno));
+      return DFS_FAIL;
+    }
+    return ForEachEntry(fs, handle, ExportEntry, (void *)&host);
+  }
+
+  if ((fd = open(host.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644)) < 0) {
+    fprintf(stderr, "dfstool: %s: %s\n", host.c_str(), strerror(errno));
+    return DFS_FAIL;
+  }
+  if (ip.flags & DFS_INODE_FLAG_INLINE) {
+    if (write(fd, ip.tail, ip.fsize) != ip.fsize) result = DFS_FAIL;
+  } else {
+    for (int v = 0; v * fs.sb.bsize < ip.fsize; v++) {
+      n = std::min(fs.sb.bsize, ip.fsize - v * fs.sb.bsize);
+      if ((b = fs.VirtualBlock(handle, v)) == -1) memset(block, 0, n);  // a hole
+      else if (b == DFS_FAIL || fs.ReadDataBlock(b, block) != DFS_SUCCESS) {  result = DFS_FAIL; break;  }
+      if (write(fd, block, n) != n) {  result = DFS_FAIL; break;  }
+    }
+  }
+  close(fd);
+  if (result != DFS_SUCCESS) fprintf(stderr, "dfstool: error exporting to %s\n", host.c_str());
+  return result;
+}
+
+//----------------------------------------------------------------------------
+// ls and dump print the metadata, fsck cross-checks it
+//----------------------------------------------------------------------------
+
+static int ListEntry(DfsImage &fs, int dir, int ino, const char *name, void *arg) {
+  if (ino < 0 || ino >= fs.sb.ninodes) {
+    printf("  ???  %5d %10s  %s\n", ino, "", name);
+    return DFS_SUCCESS;
+  }
+  printf("  %s  %5d %10d  %s%s\n", (fs.inodes[ino].type == DFS_INODE_TYPE_DIR) ? "dir " : "file",
+         ino, fs.inodes[ino].fsize, name, (fs.inodes[ino].type == DFS_INODE_TYPE_DIR) ? "/" : "");
+  return DFS_SUCCESS;
+}
+
+static void Dump(DfsImage &fs) {
+  int used = 0, shared = 0, compressed = 0;
+
+  printf("superblock: valid %d, bsize %d, nblocks %d, ninodes %d\n",
+         fs.sb.valid, fs.sb.bsize, fs.sb.nblocks, fs.sb.ninodes);
+  printf("  inodes %d, fbv %d, share counts %d, compressed sizes %d, data %d\n",
+         fs.sb.inodeBstart, fs.sb.fbvBstart, fs.sb.refBstart, fs.sb.compBstart, fs.sb.dataBstart);
+  printf("  striped over %d image(s), %d disk blocks per stripe unit\n", fs.sb.ndisks, fs.sb.stripe);
+  for (int b = 0; b < fs.sb.nblocks; b++) {
+    if (fs.BlockUsed(b)) used++;
+    if (fs.refcounts[b]) shared++;
+    if (fs.csectors[b]) compressed++;
+  }
+  printf("blocks: %d used, %d free, %d shared, %d compressed\n",
+         used, fs.sb.nblocks - used, shared, compressed);
+  printf("inodes:\n");
+  for (int i = 0; i < fs.sb.ninodes; i++) {
+    DfsToolInode &ip = fs.inodes[i];
+    if (ip.inuse != 1) continue;
+    printf("  %3d %s size %d parent %d%s%s", i, (ip.type == DFS_INODE_TYPE_DIR) ? "dir " : "file",
+           ip.fsize, ip.parent, (ip.flags & DFS_INODE_FLAG_INLINE) ? " inline" : "",
+           (ip.flags & DFS_INODE_FLAG_COMPRESS) ? " compressed" : "");
+    if (!(ip.flags & DFS_INODE_FLAG_INLINE)) {
+      printf(" blocks");
+      for (int v = 0; v < DFS_INODE_BTABLE_SIZE; v++) printf(" %d", ip.Block(v));
+      if (ip.Indirect() != -1) printf(" indirect %d", ip.Indirect());
+    }
+    printf("\n");
+  }
+}
+
+struct FsckState {
+  std::vector<int> refs;      // inodes pointing at each block
+  std::vector<int> seen;      // times each inode was reached
+  int errors;
+};
+
+static void FsckError(FsckState &st, const char *fmt, ...) {
+  va_list args;
+
+  va_start(args, fmt);
+  printf("fsck: ");
+  vprintf(fmt, args);
+  printf("\n");
+  va_end(args);
+  st.errors++;
+}
+
+static void FsckBlock(DfsImage &fs, FsckState &st, int ino, int b) {
+  if (b == -1) return;
+  if (b < fs.sb.dataBstart || b >= fs.sb.nblocks) {  FsckError(st, "inode %d points at block %d outside the data area", ino, b); return;  }
+  if (!fs.BlockUsed(b)) FsckError(st, "inode %d uses block %d, which is free in the fbv", ino, b);
+  st.refs[b]++;
+}
+
+static int FsckEntry(DfsImage &fs, int dir, int ino, const char *name, void *arg);
+
+static void FsckInode(DfsImage &fs, FsckState &st, int ino, int parent) {
+  DfsToolInode &ip = fs.inodes[ino];
+  char block[DFS_MAX_BLOCKSIZE];
+  int nblocks = 0, entries = 0;
+
+  if (ip.inuse != 1) {  FsckError(st, "directory %d names free inode %d", parent, ino); return;  }
+  if (++st.seen[ino] > 1) {  FsckError(st, "inode %d is linked %d times", ino, st.seen[ino]); return;  }
+  if (ip.parent != parent) FsckError(st, "inode %d has parent %d, not %d", ino, ip.parent, parent);
+  if (ip.type == DFS_INODE_TYPE_DIR) {
+    for (int v = 0; v < DFS_INODE_BTABLE_SIZE; v++) FsckBlock(fs, st, ino, ip.Block(v));
+    for (int v = 0; v < DFS_INODE_BTABLE_SIZE; v++) {
+      if (ip.Block(v) == -1 || fs.ReadBlock(ip.Block(v), block) != DFS_SUCCESS) continue;
+      for (int i = 0; i < fs.DirentsPerBlock(); i++) {
+        int e = GetBE32(block + i * sizeof(dfs_dirent));
+        if (e != DFS_DIRENT_FREE && e != DFS_DIRENT_DELETED) entries++;
+      }
+    }
+    if (entries != ip.fsize) FsckError(st, "directory %d has %d entries", ino, entries);
+    ForEachEntry(fs, ino, FsckEntry, &st);
+    return;
+  }
+  if (ip.flags & DFS_INODE_FLAG_INLINE) {
+    if (ip.fsize > DFS_INODE_INLINE_MAX) FsckError(st, "inline inode %d has size %d", ino, ip.fsize);
+    return;
+  }
+  for (int v = 0; v < DFS_INODE_BTABLE_SIZE; v++) FsckBlock(fs, st, ino, ip.Block(v));
+  if (ip.Indirect() != -1) {
+    FsckBlock(fs, st, ino, ip.Indirect());
+    if (fs.ReadBlock(ip.Indirect(), block) == DFS_SUCCESS) {
+      for (int i = 0; i < fs.sb.bsize / 4; i++) FsckBlock(fs, st, ino, GetBE32(block + 4*i));
+    }
+  }
+  nblocks = (ip.fsize + fs.sb.bsize - 1) / fs.sb.bsize;
+  if (nblocks > fs.MaxVBlocks()) FsckError(st, "inode %d is %d bytes, too big", ino, ip.fsize);
+}
+
+static int FsckEntry(DfsImage &fs, int dir, int ino, const char *name, void *arg) {
+  FsckState &st = *(FsckState *)arg;
+
+  if (ino < 0 || ino >= fs.sb.ninodes) {  FsckError(st, "directory %d names bad inode %d", dir, ino); return DFS_SUCCESS;  }
+  if (fs.DirLookup(dir, name) != ino) FsckError(st, "%s in directory %d can't be found by name", name, dir);
+  FsckInode(fs, st, ino, dir);
+  return DFS_SUCCESS;
+}
+
+static int Fsck(DfsImage &fs) {
+  FsckState st;
+
+  st.refs.assign(fs.sb.nblocks, 0);
+  st.seen.assign(fs.sb.ninodes, 0);
+  st.errors = 0;
+  if (fs.inodes[DFS_ROOT_INODE].type != DFS_INODE_TYPE_DIR) FsckError(st, "root inode %d isn't a directory", DFS_ROOT_INODE);
+  FsckInode(fs, st, DFS_ROOT_INODE, DFS_ROOT_INODE);
+
+  for (int i = 0; i < fs.sb.ninodes; i++) {
+    if (fs.inodes[i].inuse == 1 && st.seen[i] == 0) FsckError(st, "inode %d is in use but not in any directory", i);
+  }
+  for (int b = 0; b < fs.sb.dataBstart; b++) {
+    if (!fs.BlockUsed(b)) FsckError(st, "metadata block %d is free in the fbv", b);
+  }
+  for (int b = fs.sb.dataBstart; b < fs.sb.nblocks; b++) {
+    if (fs.BlockUsed(b) && st.refs[b] == 0) FsckError(st, "block %d is allocated but unused", b);
+    if (st.refs[b] > 0 && fs.refcounts[b] != st.refs[b] - 1) FsckError(st, "block %d share count should be %d", b, st.refs[b] - 1);
+    if (st.refs[b] == 0 && fs.refcounts[b] != 0) FsckError(st, "unused block %d has share count %d", b, fs.refcounts[b]);
+    if (fs.csectors[b] > fs.sb.bsize / DISK_BLOCKSIZE) FsckError(st, "block %d compressed into %d disk blocks", b, fs.csectors[b]);
+    if (!fs.BlockUsed(b) && fs.csectors[b] != 0) FsckError(st, "free block %d is marked compressed", b);
+  }
+  printf("fsck: %d error(s)\n", st.errors);
+  return (st.errors == 0) ? DFS_SUCCESS : DFS_FAIL;
+}
+
+//----------------------------------------------------------------------------
+// Command line
+//----------------------------------------------------------------------------
+
+static void Usage() {
+  fprintf(stderr,
+    "Usage: dfstool [-d image]... command [args]\n"
+    "  mkfs [blocksize [ndisks [stripe_blocks]]]   format, same arguments as fdisk\n"
+    "  import <host path> [dfs path]               copy a file or directory tree in\n"
+    "  export <dfs path> <host path>               copy a file or directory tree out\n"
+    "  ls [dfs path]                               list a directory\n"
+    "  dump                                        print the superblock and inodes\n"
+    "  fsck                                        check the metadata\n"
+    "Each -d names the next image of a striped disk, the default is the\n"
+    "images the simulator uses (include/os/disk.h).\n");
+  exit(1);
+}
+
+int main(int argc, char *argv[]) {
+  const char *defaults[] = DISK_MEMBER_FILENAMES;
+  std::vector<std::string> images;
+  std::string cmd, name;
+  int argi = 1, handle, dir;
+
+  while (argi + 1 < argc && strcmp(argv[argi], "-d") == 0) {
+    images.push_back(argv[argi + 1]);
+    argi += 2;
+  }
+  if (images.empty()) images.assign(defaults, defaults + DISK_MAX_MEMBERS);
+  if (argi >= argc) Usage();
+  cmd = argv[argi++];
+  DfsImage fs(images);
+
+  if (cmd == "mkfs") {
+    int bsize = DFS_BLOCKSIZE, ndisks = 1, stripe_blocks = DFSTOOL_STRIPE_BLOCKS;
+    if (argc - argi > 3) Usage();
+    if (argi < argc) bsize = atoi(argv[argi]);
+    if (argi + 1 < argc) ndisks = atoi(argv[argi + 1]);
+    if (argi + 2 < argc) stripe_blocks = atoi(argv[argi + 2]);
+    if (fs.Format(bsize, ndisks, stripe_blocks) != DFS_SUCCESS || fs.Flush() != DFS_SUCCESS) return 1;
+    printf("formatted %d block(s) of %d bytes over %d image(s), data starts at block %d\n",
+           fs.sb.nblocks, fs.sb.bsize, fs.sb.ndisks, fs.sb.dataBstart);
+    return 0;
+  }
+  if (fs.Open() != DFS_SUCCESS) return 1;
+
+  if (cmd == "import") {
+    // Onto an existing directory the source goes inside it under its own
+    // name, otherwise the destination path is the new name
+    std::string base = argv[argi];
+    if (argc - argi < 1 || argc - argi > 2) Usage();
+    while (base.size() > 1 && base[base.size() - 1] == '/') base.erase(base.size() - 1);
+    if (base.rfind('/') != std::string::npos) base = base.substr(base.rfind('/') + 1);
+    if (base == "." || base == "..") base = "";
+    handle = fs.Lookup((argi + 1 < argc) ? argv[argi + 1] : "/");
+    if (handle != DFS_FAIL && fs.inodes[handle].type == DFS_INODE_TYPE_DIR) {
+      dir = handle;
+      name = base;
+    } else if ((dir = fs.WalkPath(argv[argi + 1], name)) == DFS_FAIL || name.empty()) {
+      fprintf(stderr, "dfstool: %s: no such directory in the image\n", argv[argi + 1]);
+      return 1;
+    }
+    if (ImportPath(fs, argv[argi], dir, name.c_str()) != DFS_SUCCESS) {
+      fs.Flush();
+      return 1;
+    }
+    return (fs.Flush() == DFS_SUCCESS) ? 0 : 1;
+  }
+  if (cmd == "export") {
+    if (argc - argi != 2) Usage();
+    if ((handle = fs.Lookup(argv[argi])) == DFS_FAIL) {
+      fprintf(stderr, "dfstool: %s: no such file in the image\n", argv[argi]);
+      return 1;
+    }
+    return (ExportPath(fs, handle, argv[argi + 1]) == DFS_SUCCESS) ? 0 : 1;
+  }
+  if (cmd == "ls") {
+    if (argc - argi > 1) Usage();
+    handle = fs.Lookup((argi < argc) ? argv[argi] : "/");
+    if (handle == DFS_FAIL || fs.inodes[handle].type != DFS_INODE_TYPE_DIR) {
+      fprintf(stderr, "dfstool: no such directory in the image\n");
+      return 1;
+    }
+    return (ForEachEntry(fs, handle, ListEntry, NULL) == DFS_SUCCESS) ? 0 : 1;
+  }
+  if (cmd == "dump") {
+    Dump(fs);
+    return 0;
+  }
+  if (cmd == "fsck") return (Fsck(fs) == DFS_SUCCESS) ? 0 : 1;
+  Usage();
+  return 1;
+}
@@ -53,6 +53,25 @@ then
     echo Running dfsAPItest.c
     make run
 fi
+if [ "$1" == "Q7" ]
+then
+    echo Q7. Write a disk buffer cache in your DFS file system driver
+    read -p "Press enter to continue"
+    echo Building the OS
+    cd flat/os/
+    make clean
+    make
+    echo Building fdisk and the benchmark program dfsbench.c
+    cd ../apps/fdisk
+    make clean
+    make
+    cd ../dfsbench
+    make clean
+    make
+    clear
+    echo Running dfsbench.c on 1KB and 4KB block file systems
+    make run
+fi
 if [ "$1" == "clean" ]
 then
     echo CLEANING ALL LAB4 DIRECTORIES FOR COMPILER GENERATED FILES
@@ -65,6 +84,8 @@ then
     make clean
     cd ../fdisk
     make clean
+    cd ../dfsbench
+    make clean
     clear
 fi
 